@@ -1,8 +1,17 @@
-// WebSocket connection to /wsdev
-var socket = new WebSocket("ws://ddev-esp32.local/wsden");
+// Live temperatures pushed by the ESP32 over Server-Sent Events on /events.
+// The browser reconnects on its own and sends the id of the last event it got,
+// the ESP32 then replays what was missed from its recent events.
+var events = new EventSource("/events");
 
+// Every reading, about every 5 seconds
+events.addEventListener("sample", function (event) {
+  const sample = JSON.parse(event.data);
+  document.getElementById("liveData").innerText =
+    (Math.round(sample.temperature * 100) / 100) + " °C";
+});
 
-// WebSocket message event handler
-socket.onmessage = function (event) {
-  document.getElementById("liveData").innerText = event.data; // Update display with received data
-};
\ No newline at end of file
+// Logged averages reach the chart over /samples, see temperatur.js
+
+events.onerror = function () {
+  document.getElementById("liveData").innerText = "Reconnecting...";
+};
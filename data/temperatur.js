@@ -18,98 +18,199 @@ deleteDataLogBtn.addEventListener("click", function () {
 
 
 
-function getData() {
-  fetch("/getData") // Replace with your endpoint
-    .then((response) => response.json())
-    .then((data) => {
-      console.log("Fetched data:", data); // Log the parsed data
+// Logged averages arrive over a WebSocket as packed binary blocks, see src/sample_socket.h:
+// uint8 type, uint16 count, uint32 base epoch, then per record a zigzag varint of seconds
+// since the previous record and an int16 temperature in hundredths of a degree
+const SAMPLE_HISTORY = 1;
+const SAMPLE_HISTORY_END = 2;
+const SAMPLE_LIVE = 3;
+const SAMPLE_RECONNECT_MS = 5000;
 
-      const temperatures = [];
-      const dates = [];
+let sampleTimes = new Float64Array(1024); // ms since 1970, what Highcharts expects
+let sampleTemps = new Float32Array(1024);
+let sampleCount = 0;
+let historyDone = false;
+
+function growSamples() {
+  const times = new Float64Array(sampleTimes.length * 2);
+  const temps = new Float32Array(sampleTemps.length * 2);
+  times.set(sampleTimes);
+  temps.set(sampleTemps);
+  sampleTimes = times;
+  sampleTemps = temps;
+}
 
-      // Loop through each data object
-      for (const item of data.data) {
-        const roundedTemperature = Math.round(item.temperature * 100) / 100;
-        temperatures.push(roundedTemperature);
-        //temperatures.push(item.temperature);
-        dates.push(item.date);
+// Decode every block of a frame into the sample arrays, returns the type of the last block
+function decodeSamples(buffer) {
+  const view = new DataView(buffer);
+  let offset = 0;
+  let type = 0;
+  while (offset + 7 <= view.byteLength) {
+    type = view.getUint8(offset);
+    const count = view.getUint16(offset + 1, true);
+    let time = view.getUint32(offset + 3, true);
+    offset += 7;
+    for (let i = 0; i < count; i++) {
+      let zigzag = 0;
+      let shift = 0;
+      let byte;
+      do {
+        byte = view.getUint8(offset++);
+        zigzag += (byte & 0x7f) * 2 ** shift;
+        shift += 7;
+      } while (byte & 0x80);
+      time += zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2;
+      const temperature = view.getInt16(offset, true) / 100;
+      offset += 2;
+
+      if (sampleCount == sampleTimes.length) {
+        growSamples();
       }
+      sampleTimes[sampleCount] = time * 1000;
+      sampleTemps[sampleCount] = temperature;
+      sampleCount++;
+    }
+  }
+  return type;
+}
 
-      console.log("Temperatures:", temperatures);
-      console.log("Dates:", dates);
+// Live averages can arrive while the history is still coming, sort them in and drop doubles
+function sortSamples() {
+  const order = Array.from(sampleTimes.subarray(0, sampleCount).keys());
+  order.sort((a, b) => sampleTimes[a] - sampleTimes[b]);
+  const times = new Float64Array(sampleTimes.length);
+  const temps = new Float32Array(sampleTemps.length);
+  let count = 0;
+  for (const i of order) {
+    if (count && times[count - 1] == sampleTimes[i]) {
+      continue;
+    }
+    times[count] = sampleTimes[i];
+    temps[count] = sampleTemps[i];
+    count++;
+  }
+  sampleTimes = times;
+  sampleTemps = temps;
+  sampleCount = count;
+}
 
-      // Use these arrays in Highcharts
-      Highcharts.chart("chart-temperature", {
-        chart: {
-          backgroundColor: "#212529",
-          type: "spline",
-        },
-        title: {
-          text: "Average Temperature",
-          style: {
-            color: "white",
-          },
-        },
-        xAxis: {
-          categories: dates,
-          accessibility: {
-            description: "Months of the year",
-          },
-          labels: {
-            style: {
-              color: "white",
-            },
-          },
-        },
-        yAxis: {
-          gridLineColor: "yellow",
-          gridLineWidth: 0.1,
-          title: {
-            text: "Temperature",
-            style: {
-              color: "white",
-            },
-          },
-          labels: {
-            format: "{value}°",
-            style: {
-              color: "white",
-            },
-          },
+function chartPoints(from) {
+  const points = new Array(sampleCount - from);
+  for (let i = from; i < sampleCount; i++) {
+    points[i - from] = [sampleTimes[i], sampleTemps[i]];
+  }
+  return points;
+}
+
+function getData() {
+  Highcharts.setOptions({ time: { useUTC: false } });
+  // Kept so new averages can be added as they arrive
+  window.temperatureChart = createChart();
+  openSamples();
+}
+
+// A new connection gets the whole history again, so the chart starts over with it
+function openSamples() {
+  sampleCount = 0;
+  historyDone = false;
+
+  const socket = new WebSocket("ws://" + location.host + "/samples");
+  socket.binaryType = "arraybuffer";
+  socket.onmessage = function (event) {
+    const before = sampleCount;
+    const type = decodeSamples(event.data);
+    if (!historyDone) {
+      if (type == SAMPLE_HISTORY_END) {
+        historyDone = true;
+        sortSamples();
+        window.temperatureChart.series[0].setData(chartPoints(0));
+      }
+      return;
+    }
+    if (type != SAMPLE_LIVE) {
+      return;
+    }
+    // Later averages only, an older one is already on the chart
+    for (let i = before; i < sampleCount; i++) {
+      if (i == 0 || sampleTimes[i] > sampleTimes[i - 1]) {
+        window.temperatureChart.series[0].addPoint([sampleTimes[i], sampleTemps[i]], false);
+      }
+    }
+    window.temperatureChart.redraw();
+  };
+  socket.onerror = function (error) {
+    console.error("Error receiving samples:", error);
+  };
+  // The ESP32 restarted, or dropped a dashboard that stopped answering pings
+  socket.onclose = function () {
+    setTimeout(openSamples, SAMPLE_RECONNECT_MS);
+  };
+}
+
+function createChart() {
+  return Highcharts.chart("chart-temperature", {
+    chart: {
+      backgroundColor: "#212529",
+      type: "spline",
+    },
+    title: {
+      text: "Average Temperature",
+      style: {
+        color: "white",
+      },
+    },
+    xAxis: {
+      type: "datetime",
+      labels: {
+        style: {
+          color: "white",
         },
-        tooltip: {
-          crosshairs: true,
-          shared: true,
+      },
+    },
+    yAxis: {
+      gridLineColor: "yellow",
+      gridLineWidth: 0.1,
+      title: {
+        text: "Temperature",
+        style: {
+          color: "white",
         },
-        plotOptions: {
-          spline: {
-            marker: {
-              radius: 4,
-              lineWidth: 1,
-              lineColor: "white",
-              fillColor: "white",
-              symbol: "circle",
-            },
-          },
+      },
+      labels: {
+        format: "{value}°",
+        style: {
+          color: "white",
         },
-        series: [
-          {
-            name: "Temperature (°C)",
-            data: temperatures,
-            color: "white",
-          },
-        ],
-        legend: {
-          itemStyle: {
-            color: "white",
-          },
+      },
+    },
+    tooltip: {
+      crosshairs: true,
+      shared: true,
+    },
+    plotOptions: {
+      spline: {
+        marker: {
+          radius: 4,
+          lineWidth: 1,
+          lineColor: "white",
+          fillColor: "white",
+          symbol: "circle",
         },
-      });
-    })
-    .catch((error) => {
-      console.error("Error processing data:", error);
-      // Handle errors here (e.g., display error message)
-    });
+      },
+    },
+    series: [
+      {
+        name: "Temperature (°C)",
+        data: [],
+        color: "white",
+      },
+    ],
+    legend: {
+      itemStyle: {
+        color: "white",
+      },
+    },
+  });
 }
 
 function deleteNetworkSetting() {
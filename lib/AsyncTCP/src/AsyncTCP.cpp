@@ -36,12 +36,15 @@ extern "C"{
  * */
 
 typedef enum {
-    LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS
+    LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS, LWIP_TCP_CALL
 } lwip_event_t;
 
 typedef struct {
         lwip_event_t event;
         void *arg;
+        //the client's event slot and its generation when the event was queued, -1 when not a client's
+        int16_t slot;
+        uint32_t generation;
         union {
                 struct {
                         void * pcb;
@@ -73,6 +76,9 @@ typedef struct {
                         const char * name;
                         ip_addr_t addr;
                 } dns;
+                struct {
+                        AcCallFunction fn;
+                } call;
         };
 } lwip_event_packet_t;
 
@@ -92,6 +98,96 @@ static uint32_t _closed_index = []() {
     return 1;
 }();
 
+/*
+ * Event Slots
+ * Every client with a connection holds a slot. Closing the client moves the slot's generation on, so
+ * its events still in the queue are skipped when they come up instead of being searched for.
+ * A slot is held from when the client gets its pcb until the async_tcp task is done with it, which
+ * can outlast the pcb. Clients that find no free slot have their events removed from the queue
+ * */
+
+const int _number_of_event_slots = CONFIG_LWIP_MAX_ACTIVE_TCP * 2;
+static uint32_t _event_generations[_number_of_event_slots];
+static int16_t _free_event_slots[_number_of_event_slots];
+static int _free_event_slot_count = []() {
+    for (int i = 0; i < _number_of_event_slots; ++ i) {
+        _free_event_slots[i] = _number_of_event_slots - 1 - i;
+    }
+    return _number_of_event_slots;
+}();
+
+
+/*
+ * Event Packet Pool
+ * A lock-free stack of the preallocated packets, taken from the lwIP task and any task calling
+ * asyncTcpCall(), returned by the async_tcp task. The head holds the first free packet's index + 1
+ * in the low half and a count of updates in the high half, so a pop that raced with a pop and push
+ * of the same packet fails its compare-and-swap instead of linking in a packet that is in use
+ * */
+
+static lwip_event_packet_t _event_pool[CONFIG_ASYNC_TCP_EVENT_POOL_SIZE];
+static uint16_t _event_pool_next[CONFIG_ASYNC_TCP_EVENT_POOL_SIZE];
+static uint32_t _event_pool_exhausted = 0;
+static uint32_t _event_pool_head = []() {
+    //every packet links to the one before it, the last one is on top
+    for (int i = 0; i < CONFIG_ASYNC_TCP_EVENT_POOL_SIZE; ++ i) {
+        _event_pool_next[i] = i;
+    }
+    return (uint32_t)CONFIG_ASYNC_TCP_EVENT_POOL_SIZE;
+}();
+
+static lwip_event_packet_t * _alloc_event(){
+    uint32_t head = __atomic_load_n(&_event_pool_head, __ATOMIC_ACQUIRE);
+    while(head & 0xFFFF){
+        uint16_t index = (head & 0xFFFF) - 1;
+        uint32_t next = ((head + 0x10000) & 0xFFFF0000) | __atomic_load_n(&_event_pool_next[index], __ATOMIC_RELAXED);
+        if(__atomic_compare_exchange_n(&_event_pool_head, &head, next, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+            return &_event_pool[index];
+        }
+    }
+    __atomic_fetch_add(&_event_pool_exhausted, 1, __ATOMIC_RELAXED);
+    return (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+}
+
+static void _free_event(lwip_event_packet_t * e){
+    if(e < _event_pool || e >= _event_pool + CONFIG_ASYNC_TCP_EVENT_POOL_SIZE){
+        free((void*)(e));
+        return;
+    }
+    uint16_t index = e - _event_pool;
+    uint32_t head = __atomic_load_n(&_event_pool_head, __ATOMIC_RELAXED);
+    uint32_t next;
+    do {
+        __atomic_store_n(&_event_pool_next[index], (uint16_t)(head & 0xFFFF), __ATOMIC_RELAXED);
+        next = ((head + 0x10000) & 0xFFFF0000) | (index + 1);
+    } while(!__atomic_compare_exchange_n(&_event_pool_head, &head, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+uint32_t asyncTcpPoolExhausted(){
+    return __atomic_load_n(&_event_pool_exhausted, __ATOMIC_RELAXED);
+}
+
+static void _tag_event(lwip_event_packet_t * e, void * arg){
+    e->arg = arg;
+    if(arg){
+        reinterpret_cast<AsyncClient*>(arg)->_event_tag(&e->slot, &e->generation);
+    } else {
+        e->slot = -1;
+        e->generation = 0;
+    }
+}
+
+static inline bool _is_stale_event(lwip_event_packet_t * e){
+    return e->slot >= 0 && __atomic_load_n(&_event_generations[e->slot], __ATOMIC_ACQUIRE) != e->generation;
+}
+
+//frees an event that is not handled, with the data it holds
+static void _discard_event(lwip_event_packet_t * e){
+    if(e->event == LWIP_TCP_RECV && e->recv.pb){
+        pbuf_free(e->recv.pb);
+    }
+    _free_event(e);
+}
 
 static inline bool _init_async_event_queue(){
     if(!_async_queue){
@@ -129,7 +225,7 @@ static bool _remove_events_with_arg(void * arg){
         }
         //discard packet if matching
         if((int)first_packet->arg == (int)arg){
-            free(first_packet);
+            _discard_event(first_packet);
             first_packet = NULL;
         //return first packet to the back of the queue
         } else if(xQueueSend(_async_queue, &first_packet, portMAX_DELAY) != pdPASS){
@@ -142,7 +238,7 @@ static bool _remove_events_with_arg(void * arg){
             return false;
         }
         if((int)packet->arg == (int)arg){
-            free(packet);
+            _discard_event(packet);
             packet = NULL;
         } else if(xQueueSend(_async_queue, &packet, portMAX_DELAY) != pdPASS){
             return false;
@@ -152,7 +248,14 @@ static bool _remove_events_with_arg(void * arg){
 }
 
 static void _handle_async_event(lwip_event_packet_t * e){
-    if(e->arg == NULL){
+    if(_is_stale_event(e)){
+        //queued for a client that was closed since
+        _discard_event(e);
+        return;
+    }
+    if(e->event == LWIP_TCP_CALL){
+        e->call.fn(e->arg);
+    } else if(e->arg == NULL){
         // do nothing when arg is NULL
         //ets_printf("event arg == NULL: 0x%08x\n", e->recv.pcb);
     } else if(e->event == LWIP_TCP_CLEAR){
@@ -182,25 +285,84 @@ static void _handle_async_event(lwip_event_packet_t * e){
         //ets_printf("D: 0x%08x %s = %s\n", e->arg, e->dns.name, ipaddr_ntoa(&e->dns.addr));
         AsyncClient::_s_dns_found(e->dns.name, &e->dns.addr, e->arg);
     }
-    free((void*)(e));
+    _free_event(e);
+}
+
+/*
+ * Task Load
+ * Only written by the async_tcp task, once per batch
+ * */
+
+static portMUX_TYPE _stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static AsyncTcpStats _stats = {};
+static uint32_t _window_start = 0;
+static uint32_t _window_events = 0;
+static uint32_t _window_us = 0;
+
+static void _count_batch(uint32_t events, uint32_t us){
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_stats_lock);
+    _stats.events += events;
+    _stats.batches++;
+    _stats.busyUs += us;
+    _window_events += events;
+    _window_us += us;
+    if(now - _window_start >= 1000){
+        _stats.eventsPerSecond = (uint64_t)_window_events * 1000 / (now - _window_start);
+        _stats.usPerEvent = _window_us / _window_events;
+        _window_start = now;
+        _window_events = 0;
+        _window_us = 0;
+    }
+    portEXIT_CRITICAL(&_stats_lock);
+}
+
+AsyncTcpStats asyncTcpStats(){
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_stats_lock);
+    AsyncTcpStats stats = _stats;
+    //the rates are only updated by a batch, a quiet task is caught up here
+    if(now - _window_start >= 2000){
+        stats.eventsPerSecond = (uint64_t)_window_events * 1000 / (now - _window_start);
+        stats.usPerEvent = _window_events ? _window_us / _window_events : 0;
+    }
+    portEXIT_CRITICAL(&_stats_lock);
+    stats.queued = _async_queue ? uxQueueMessagesWaiting(_async_queue) : 0;
+    stats.poolExhausted = asyncTcpPoolExhausted();
+    return stats;
 }
 
 static void _async_service_task(void *pvParameters){
     lwip_event_packet_t * packet = NULL;
     for (;;) {
-        if(_get_async_event(&packet)){
+        if(!_get_async_event(&packet)){
+            continue;
+        }
 #if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_add(NULL) != ESP_OK){
-                log_e("Failed to add async task to WDT");
-            }
+        if(esp_task_wdt_add(NULL) != ESP_OK){
+            log_e("Failed to add async task to WDT");
+        }
+        uint32_t fed = millis();
 #endif
+        uint32_t start = micros();
+        uint32_t handled = 0;
+        //the rest of the batch is taken without waiting
+        do {
             _handle_async_event(packet);
+            handled++;
 #if CONFIG_ASYNC_TCP_USE_WDT
-            if(esp_task_wdt_delete(NULL) != ESP_OK){
-                log_e("Failed to remove loop task from WDT");
+            if(millis() - fed >= CONFIG_ASYNC_TCP_WDT_FEED_MS){
+                esp_task_wdt_reset();
+                fed = millis();
             }
 #endif
+        } while(handled < CONFIG_ASYNC_TCP_MAX_BATCH && xQueueReceive(_async_queue, &packet, 0) == pdPASS);
+#if CONFIG_ASYNC_TCP_USE_WDT
+        if(esp_task_wdt_delete(NULL) != ESP_OK){
+            log_e("Failed to remove loop task from WDT");
         }
+#endif
+        _count_batch(handled, micros() - start);
     }
     vTaskDelete(NULL);
     _async_service_task_handle = NULL;
@@ -226,48 +388,83 @@ static bool _start_async_task(){
     return true;
 }
 
+bool asyncTcpCall(AcCallFunction fn, void* arg, uint32_t waitMs){
+    if(!_async_queue || !fn){
+        return false;
+    }
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return false;
+    }
+    e->event = LWIP_TCP_CALL;
+    e->arg = arg;
+    e->slot = -1;
+    e->call.fn = fn;
+    if(xQueueSend(_async_queue, &e, pdMS_TO_TICKS(waitMs)) != pdPASS){
+        _free_event(e);
+        return false;
+    }
+    return true;
+}
+
 /*
  * LwIP Callbacks
  * */
 
 static int8_t _tcp_clear_events(void * arg) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        //only called on the async_tcp task, the queue can be cleared right away
+        _remove_events_with_arg(arg);
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_CLEAR;
     e->arg = arg;
+    e->slot = -1;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err) {
     //ets_printf("+C: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_CONNECTED;
-    e->arg = arg;
+    _tag_event(e, arg);
     e->connected.pcb = pcb;
     e->connected.err = err;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_poll(void * arg, struct tcp_pcb * pcb) {
     //ets_printf("+P: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_POLL;
-    e->arg = arg;
+    _tag_event(e, arg);
     e->poll.pcb = pcb;
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
-    e->arg = arg;
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        //lwIP offers the data again later
+        return ERR_MEM;
+    }
+    _tag_event(e, arg);
     if(pb){
         //ets_printf("+R: 0x%08x\n", pcb);
         e->event = LWIP_TCP_RECV;
@@ -283,40 +480,49 @@ static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_
         AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
     }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
     //ets_printf("+S: 0x%08x\n", pcb);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_SENT;
-    e->arg = arg;
+    _tag_event(e, arg);
     e->sent.pcb = pcb;
     e->sent.len = len;
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
 
 static void _tcp_error(void * arg, int8_t err) {
     //ets_printf("+E: 0x%08x\n", arg);
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return;
+    }
     e->event = LWIP_TCP_ERROR;
-    e->arg = arg;
+    _tag_event(e, arg);
     e->error.err = err;
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
 }
 
 static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * arg) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return;
+    }
     //ets_printf("+DNS: name=%s ipaddr=0x%08x arg=%x\n", name, ipaddr, arg);
     e->event = LWIP_TCP_DNS;
-    e->arg = arg;
+    _tag_event(e, arg);
     e->dns.name = name;
     if (ipaddr) {
         memcpy(&e->dns.addr, ipaddr, sizeof(struct ip_addr));
@@ -324,18 +530,22 @@ static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * ar
         memset(&e->dns.addr, 0, sizeof(e->dns.addr));
     }
     if (!_send_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
 }
 
 //Used to switch out from LwIP thread
 static int8_t _tcp_accept(void * arg, AsyncClient * client) {
-    lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+    lwip_event_packet_t * e = _alloc_event();
+    if(!e){
+        return ERR_OK;
+    }
     e->event = LWIP_TCP_ACCEPT;
     e->arg = arg;
+    e->slot = -1;
     e->accept.client = client;
     if (!_prepend_async_event(&e)) {
-        free((void*)(e));
+        _free_event(e);
     }
     return ERR_OK;
 }
@@ -567,8 +777,12 @@ AsyncClient::AsyncClient(tcp_pcb* pcb)
 {
     _pcb = pcb;
     _closed_slot = -1;
+    _event_slot = -1;
+    _event_generation = 0;
+    _event_slot_held = false;
     if(_pcb){
         _allocate_closed_slot();
+        _allocate_event_slot();
         _rx_last_packet = millis();
         tcp_arg(_pcb, this);
         tcp_recv(_pcb, &_tcp_recv);
@@ -583,6 +797,7 @@ AsyncClient::~AsyncClient(){
         _close();
     }
     _free_closed_slot();
+    _free_event_slot();
 }
 
 /*
@@ -597,6 +812,7 @@ AsyncClient& AsyncClient::operator=(const AsyncClient& other){
     _pcb = other._pcb;
     _closed_slot = other._closed_slot;
     if (_pcb) {
+        _allocate_event_slot();
         _rx_last_packet = millis();
         tcp_arg(_pcb, this);
         tcp_recv(_pcb, &_tcp_recv);
@@ -694,6 +910,7 @@ bool AsyncClient::connect(IPAddress ip, uint16_t port){
         return false;
     }
 
+    _allocate_event_slot();
     tcp_arg(pcb, this);
     tcp_err(pcb, &_tcp_error);
     tcp_recv(pcb, &_tcp_recv);
@@ -712,6 +929,7 @@ bool AsyncClient::connect(const char* host, uint16_t port){
       return false;
     }
     
+    _allocate_event_slot();
     err_t err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_found, this);
     if(err == ERR_OK) {
         return connect(IPAddress(addr.u_addr.ip4.addr), port);
@@ -805,7 +1023,7 @@ int8_t AsyncClient::_close(){
         tcp_recv(_pcb, NULL);
         tcp_err(_pcb, NULL);
         tcp_poll(_pcb, NULL, 0);
-        _tcp_clear_events(this);
+        _clear_events();
         err = _tcp_close(_pcb, _closed_slot);
         if(err != ERR_OK) {
             err = abort();
@@ -841,6 +1059,43 @@ void AsyncClient::_free_closed_slot(){
     }
 }
 
+void AsyncClient::_allocate_event_slot(){
+    if (_event_slot_held) {
+        return;
+    }
+    xSemaphoreTake(_slots_lock, portMAX_DELAY);
+    if (_free_event_slot_count) {
+        _event_slot = _free_event_slots[-- _free_event_slot_count];
+        _event_generation = _event_generations[_event_slot];
+        _event_slot_held = true;
+    } else {
+        _event_slot = -1;
+    }
+    xSemaphoreGive(_slots_lock);
+    if (!_event_slot_held) {
+        log_w("no free event slot");
+    }
+}
+
+void AsyncClient::_free_event_slot(){
+    if (_event_slot_held) {
+        xSemaphoreTake(_slots_lock, portMAX_DELAY);
+        __atomic_store_n(&_event_generations[_event_slot], _event_generation + 1, __ATOMIC_RELEASE);
+        _free_event_slots[_free_event_slot_count ++] = _event_slot;
+        _event_slot_held = false;
+        xSemaphoreGive(_slots_lock);
+    }
+}
+
+//drops the events still queued for this client
+void AsyncClient::_clear_events(){
+    if (_event_slot_held) {
+        _free_event_slot();
+    } else if (_event_slot == -1) {
+        _tcp_clear_events(this);
+    }
+}
+
 /*
  * Private Callbacks
  * */
@@ -871,6 +1126,8 @@ void AsyncClient::_error(int8_t err) {
         }
         _pcb = NULL;
     }
+    //lwIP has freed the pcb, nothing queued after the error is for this connection
+    _free_event_slot();
     if(_error_cb) {
         _error_cb(_error_cb_arg, this, err);
     }
@@ -902,7 +1159,7 @@ int8_t AsyncClient::_lwip_fin(tcp_pcb* pcb, int8_t err) {
 
 //In Async Thread
 int8_t AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
-    _tcp_clear_events(this);
+    _clear_events();
     if(_discard_cb) {
         _discard_cb(_discard_cb_arg, this);
     }
@@ -36,6 +36,24 @@ extern "C" {
 #define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, adds between 33us and 200us per event
 #endif
 
+//event packets allocated up front for the lwIP callbacks, the heap is only used when all are in use.
+//The event queue holds 32, the rest covers the one being handled and callers waiting for room
+#ifndef CONFIG_ASYNC_TCP_EVENT_POOL_SIZE
+#define CONFIG_ASYNC_TCP_EVENT_POOL_SIZE 40
+#endif
+
+//events the async_tcp task handles in one go before it waits on the queue again. The task is added
+//to the watchdog once per batch instead of once per event
+#ifndef CONFIG_ASYNC_TCP_MAX_BATCH
+#define CONFIG_ASYNC_TCP_MAX_BATCH 16
+#endif
+
+//during a batch the watchdog is fed between events at most this often (milliseconds),
+//keep it well below the watchdog timeout
+#ifndef CONFIG_ASYNC_TCP_WDT_FEED_MS
+#define CONFIG_ASYNC_TCP_WDT_FEED_MS 1000
+#endif
+
 class AsyncClient;
 
 #define ASYNC_MAX_ACK_TIME 5000
@@ -48,6 +66,27 @@ typedef std::function<void(void*, AsyncClient*, int8_t error)> AcErrorHandler;
 typedef std::function<void(void*, AsyncClient*, void *data, size_t len)> AcDataHandler;
 typedef std::function<void(void*, AsyncClient*, struct pbuf *pb)> AcPacketHandler;
 typedef std::function<void(void*, AsyncClient*, uint32_t time)> AcTimeoutHandler;
+typedef void (*AcCallFunction)(void* arg);
+
+//runs fn(arg) on the async_tcp task, callable from any other task. False if the task is not
+//running or its queue stays full for waitMs, the call is then not made
+bool asyncTcpCall(AcCallFunction fn, void* arg, uint32_t waitMs = 0);
+
+//event packets that had to come from the heap because the pool was empty, since boot
+uint32_t asyncTcpPoolExhausted();
+
+typedef struct {
+    uint32_t queued;          //events waiting now
+    uint32_t events;          //events handled since boot
+    uint32_t batches;         //times the task woke up to handle them
+    uint64_t busyUs;          //time spent handling them
+    uint32_t eventsPerSecond; //over the last second or so
+    uint32_t usPerEvent;      //average handling time over the same time
+    uint32_t poolExhausted;   //see asyncTcpPoolExhausted()
+} AsyncTcpStats;
+
+//load of the async_tcp task, callable from any task
+AsyncTcpStats asyncTcpStats();
 
 struct tcp_pcb;
 struct ip_addr;
@@ -138,10 +177,15 @@ class AsyncClient {
 
     int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err);
     tcp_pcb * pcb(){ return _pcb; }
+    void _event_tag(int16_t * slot, uint32_t * generation){ *slot = _event_slot; *generation = _event_generation; }
 
   protected:
     tcp_pcb* _pcb;
     int8_t  _closed_slot;
+    //the slot is kept after it was freed, so that late events are tagged as stale
+    int16_t _event_slot;
+    uint32_t _event_generation;
+    bool _event_slot_held;
 
     AcConnectHandler _connect_cb;
     void* _connect_cb_arg;
@@ -172,6 +216,9 @@ class AsyncClient {
     int8_t _close();
     void _free_closed_slot();
     void _allocate_closed_slot();
+    void _allocate_event_slot();
+    void _free_event_slot();
+    void _clear_events();
     int8_t _connected(void* pcb, int8_t err);
     void _error(int8_t err);
     int8_t _poll(tcp_pcb* pcb);
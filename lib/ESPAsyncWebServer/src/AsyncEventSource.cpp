@@ -19,6 +19,7 @@
 */
 #include "Arduino.h"
 #include "AsyncEventSource.h"
+#include <new>
 
 static String generateEventMessage(const char *message, const char *event, uint32_t id, uint32_t reconnect){
   String ev = "";
@@ -104,55 +105,70 @@ static String generateEventMessage(const char *message, const char *event, uint3
   return ev;
 }
 
-// Message
+// Buffer
 
-AsyncEventSourceMessage::AsyncEventSourceMessage(const char * data, size_t len)
-: _data(nullptr), _len(len), _sent(0), _acked(0)
+AsyncEventSourceBuffer::AsyncEventSourceBuffer(size_t len, uint32_t key)
+  : _len(len)
+  , _key(key)
+  , _refs(1)
 {
-  _data = (uint8_t*)malloc(_len+1);
-  if(_data == nullptr){
-    _len = 0;
-  } else {
-    memcpy(_data, data, len);
-    _data[_len] = 0;
-  }
+#ifdef ESP32
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
 }
 
-AsyncEventSourceMessage::~AsyncEventSourceMessage() {
-     if(_data != NULL)
-        free(_data);
+AsyncEventSourceBuffer* AsyncEventSourceBuffer::create(const char *data, size_t len, uint32_t key){
+  //header and event in one allocation
+  void *mem = malloc(sizeof(AsyncEventSourceBuffer) + len);
+  if(mem == NULL)
+    return NULL;
+  AsyncEventSourceBuffer *buffer = new (mem) AsyncEventSourceBuffer(len, key);
+  memcpy((uint8_t *)mem + sizeof(AsyncEventSourceBuffer), data, len);
+  return buffer;
 }
 
-size_t AsyncEventSourceMessage::ack(size_t len, uint32_t time) {
-  (void)time;
-  // If the whole message is now acked...
-  if(_acked + len > _len){
-     // Return the number of extra bytes acked (they will be carried on to the next message)
-     const size_t extra = _acked + len - _len;
-     _acked = _len;
-     return extra;
-  }
-  // Return that no extra bytes left.
-  _acked += len;
-  return 0;
+//only compared with other keys, 0 is left for none
+uint32_t AsyncEventSourceBuffer::keyOf(const char *event){
+  if(event == NULL)
+    return 0;
+  uint32_t hash = AsyncWebFieldTable::hash(event, strlen(event), false);
+  return hash ? hash : 1;
 }
 
-size_t AsyncEventSourceMessage::send(AsyncClient *client) {
-  const size_t len = _len - _sent;
-  if(client->space() < len){
-    return 0;
+AsyncEventSourceBuffer* AsyncEventSourceBuffer::retain(){
+#ifdef ESP32
+  portENTER_CRITICAL(&_mux);
+#endif
+  _refs++;
+#ifdef ESP32
+  portEXIT_CRITICAL(&_mux);
+#endif
+  return this;
+}
+
+void AsyncEventSourceBuffer::release(){
+#ifdef ESP32
+  portENTER_CRITICAL(&_mux);
+#endif
+  uint16_t refs = --_refs;
+#ifdef ESP32
+  portEXIT_CRITICAL(&_mux);
+#endif
+  if(refs == 0){
+    this->~AsyncEventSourceBuffer();
+    free(this);
   }
-  size_t sent = client->add((const char *)_data, len);
-  if(client->canSend())
-    client->send();
-  _sent += sent;
-  return sent; 
 }
 
 // Client
 
 AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, AsyncEventSource *server)
-: _messageQueue(LinkedList<AsyncEventSourceMessage *>([](AsyncEventSourceMessage *m){ delete  m; }))
+  : _policy(server->policy())
+  , _head(0)
+  , _length(0)
+  , _sending(0)
+  , _sent(0)
+  , _acked(0)
 {
   _client = request->client();
   _server = server;
@@ -173,39 +189,73 @@ AsyncEventSourceClient::AsyncEventSourceClient(AsyncWebServerRequest *request, A
 }
 
 AsyncEventSourceClient::~AsyncEventSourceClient(){
-   _messageQueue.free();
+  while(_length)
+    _removeAt(_length - 1);
   close();
 }
 
-void AsyncEventSourceClient::_queueMessage(AsyncEventSourceMessage *dataMessage){
-  if(dataMessage == NULL)
+//drops the buffer at index, the ones after it move up
+void AsyncEventSourceClient::_removeAt(uint8_t index){
+  _at(index)->release();
+  if(index == 0){
+    _head = (_head + 1) % SSE_MAX_QUEUED_MESSAGES;
+  } else {
+    for(uint8_t i = index; i + 1 < _length; i++)
+      _at(i) = _at(i + 1);
+  }
+  _length--;
+}
+
+void AsyncEventSourceClient::_queueBuffer(AsyncEventSourceBuffer *buffer){
+  if(buffer == NULL)
     return;
-  if(!connected()){
-    delete dataMessage;
+  if(!connected())
     return;
+  //only buffers nothing was sent of yet can be replaced or dropped
+  uint8_t unsent = _sending + (_sent ? 1 : 0);
+  if(_policy == SSE_LATEST_PER_EVENT && buffer->key()){
+    for(uint8_t i = unsent; i < _length; i++){
+      if(_at(i)->key() == buffer->key()){
+        //removed rather than overwritten, so ids keep rising in the order they are sent
+        _removeAt(i);
+        break;
+      }
+    }
   }
-  if(_messageQueue.length() >= SSE_MAX_QUEUED_MESSAGES){
+  if(_length >= SSE_MAX_QUEUED_MESSAGES){
+    if(_policy == SSE_LATEST_PER_EVENT && unsent < _length){
+      _removeAt(unsent);
+    } else {
       ets_printf("ERROR: Too many messages queued\n");
-      delete dataMessage;
-  } else {
-      _messageQueue.add(dataMessage);
+      return;
+    }
   }
+  _at(_length++) = buffer->retain();
   if(_client->canSend())
     _runQueue();
 }
 
 void AsyncEventSourceClient::_onAck(size_t len, uint32_t time){
-  while(len && !_messageQueue.isEmpty()){
-    len = _messageQueue.front()->ack(len, time);
-    if(_messageQueue.front()->finished())
-      _messageQueue.remove(_messageQueue.front());
+  (void)time;
+  while(len && _length){
+    size_t waiting = _at(0)->length() - _acked;
+    if(len < waiting){
+      _acked += len;
+      break;
+    }
+    //acknowledged in full, so it was sent in full
+    len -= waiting;
+    _acked = 0;
+    _removeAt(0);
+    if(_sending)
+      _sending--;
   }
 
   _runQueue();
 }
 
 void AsyncEventSourceClient::_onPoll(){
-  if(!_messageQueue.isEmpty()){
+  if(_length){
     _runQueue();
   }
 }
@@ -226,24 +276,44 @@ void AsyncEventSourceClient::close(){
 }
 
 void AsyncEventSourceClient::write(const char * message, size_t len){
-  _queueMessage(new AsyncEventSourceMessage(message, len));
+  AsyncEventSourceBuffer *buffer = AsyncEventSourceBuffer::create(message, len, 0);
+  if(buffer == NULL)
+    return;
+  _queueBuffer(buffer);
+  buffer->release();
 }
 
 void AsyncEventSourceClient::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
   String ev = generateEventMessage(message, event, id, reconnect);
-  _queueMessage(new AsyncEventSourceMessage(ev.c_str(), ev.length()));
+  AsyncEventSourceBuffer *buffer = AsyncEventSourceBuffer::create(ev.c_str(), ev.length(), AsyncEventSourceBuffer::keyOf(event));
+  if(buffer == NULL)
+    return;
+  _queueBuffer(buffer);
+  buffer->release();
 }
 
 void AsyncEventSourceClient::_runQueue(){
-  while(!_messageQueue.isEmpty() && _messageQueue.front()->finished()){
-    _messageQueue.remove(_messageQueue.front());
-  }
-
-  for(auto i = _messageQueue.begin(); i != _messageQueue.end(); ++i)
-  {
-    if(!(*i)->sent())
-      (*i)->send(_client);
+  if(_client == NULL)
+    return;
+  size_t added = 0;
+  while(_sending < _length){
+    AsyncEventSourceBuffer *buffer = _at(_sending);
+    size_t len = buffer->length() - _sent;
+    size_t space = _client->space();
+    if(space == 0)
+      break;
+    size_t sent = _client->add(buffer->data() + _sent, (len < space) ? len : space);
+    if(sent == 0)
+      break;
+    added += sent;
+    _sent += sent;
+    if(_sent == buffer->length()){
+      _sending++;
+      _sent = 0;
+    }
   }
+  if(added && _client->canSend())
+    _client->send();
 }
 
 
@@ -253,6 +323,7 @@ AsyncEventSource::AsyncEventSource(const String& url)
   : _url(url)
   , _clients(LinkedList<AsyncEventSourceClient *>([](AsyncEventSourceClient *c){ delete c; }))
   , _connectcb(NULL)
+  , _policy(SSE_QUEUE_ALL)
 {}
 
 AsyncEventSource::~AsyncEventSource(){
@@ -314,12 +385,17 @@ size_t AsyncEventSource::avgPacketsWaiting() const {
 void AsyncEventSource::send(const char *message, const char *event, uint32_t id, uint32_t reconnect){
 
 
+  //formatted and stored once, every client queues a reference
   String ev = generateEventMessage(message, event, id, reconnect);
+  AsyncEventSourceBuffer *buffer = AsyncEventSourceBuffer::create(ev.c_str(), ev.length(), AsyncEventSourceBuffer::keyOf(event));
+  if(buffer == NULL)
+    return;
   for(const auto &c: _clients){
     if(c->connected()) {
-      c->write(ev.c_str(), ev.length());
+      c->_queueBuffer(buffer);
     }
   }
+  buffer->release();
 }
 
 size_t AsyncEventSource::count() const {
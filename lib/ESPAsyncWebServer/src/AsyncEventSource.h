@@ -50,29 +50,55 @@ class AsyncEventSourceResponse;
 class AsyncEventSourceClient;
 typedef std::function<void(AsyncEventSourceClient *client)> ArEventHandlerFunction;
 
-class AsyncEventSourceMessage {
+/*
+ * EVENT BUFFER :: One formatted event, allocated once and shared by the queues of all clients
+ * it is sent to. The last client to get it acknowledged frees it.
+ * */
+
+class AsyncEventSourceBuffer {
   private:
-    uint8_t * _data; 
     size_t _len;
-    size_t _sent;
-    //size_t _ack;
-    size_t _acked; 
+    uint32_t _key;      // event name hash, 0 for unnamed events and raw writes
+    uint16_t _refs;
+#ifdef ESP32
+    portMUX_TYPE _mux;
+#endif
+
+    AsyncEventSourceBuffer(size_t len, uint32_t key);
+
   public:
-    AsyncEventSourceMessage(const char * data, size_t len);
-    ~AsyncEventSourceMessage();
-    size_t ack(size_t len, uint32_t time __attribute__((unused)));
-    size_t send(AsyncClient *client);
-    bool finished(){ return _acked == _len; }
-    bool sent() { return _sent == _len; }
+    //one reference for the caller, NULL when out of memory
+    static AsyncEventSourceBuffer* create(const char *data, size_t len, uint32_t key);
+    static uint32_t keyOf(const char *event);
+    AsyncEventSourceBuffer* retain();
+    void release();
+    const char* data() const { return (const char *)(this + 1); }
+    size_t length() const { return _len; }
+    uint32_t key() const { return _key; }
 };
 
+//what a client does with an event when one of the same name still waits to be sent
+typedef enum {
+  SSE_QUEUE_ALL,        // send every event, newest ones are dropped when the queue is full
+  SSE_LATEST_PER_EVENT  // the waiting one is replaced, a lagging client only gets the newest value
+} AsyncEventSourcePolicy;
+
 class AsyncEventSourceClient {
   private:
     AsyncClient *_client;
     AsyncEventSource *_server;
     uint32_t _lastId;
-    LinkedList<AsyncEventSourceMessage *> _messageQueue;
-    void _queueMessage(AsyncEventSourceMessage *dataMessage);
+    AsyncEventSourcePolicy _policy;
+    //ring of shared buffers: [0, _sending) sent and waiting for their ack, the rest not (fully) sent
+    AsyncEventSourceBuffer *_queue[SSE_MAX_QUEUED_MESSAGES];
+    uint8_t _head;
+    uint8_t _length;
+    uint8_t _sending;
+    size_t _sent;       // bytes of _queue[_sending] already sent
+    size_t _acked;      // bytes of the first buffer acknowledged
+    AsyncEventSourceBuffer*& _at(uint8_t index){ return _queue[(_head + index) % SSE_MAX_QUEUED_MESSAGES]; }
+    void _removeAt(uint8_t index);
+    void _queueBuffer(AsyncEventSourceBuffer *buffer);
     void _runQueue();
 
   public:
@@ -86,13 +112,17 @@ class AsyncEventSourceClient {
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     bool connected() const { return (_client != NULL) && _client->connected(); }
     uint32_t lastId() const { return _lastId; }
-    size_t  packetsWaiting() const { return _messageQueue.length(); }
+    size_t  packetsWaiting() const { return _length; }
+    void setPolicy(AsyncEventSourcePolicy policy){ _policy = policy; }
+    AsyncEventSourcePolicy policy() const { return _policy; }
 
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
     void _onPoll(); 
     void _onTimeout(uint32_t time);
     void _onDisconnect();
+
+    friend AsyncEventSource;
 };
 
 class AsyncEventSource: public AsyncWebHandler {
@@ -100,6 +130,7 @@ class AsyncEventSource: public AsyncWebHandler {
     String _url;
     LinkedList<AsyncEventSourceClient *> _clients;
     ArEventHandlerFunction _connectcb;
+    AsyncEventSourcePolicy _policy;
   public:
     AsyncEventSource(const String& url);
     ~AsyncEventSource();
@@ -107,6 +138,9 @@ class AsyncEventSource: public AsyncWebHandler {
     const char * url() const { return _url.c_str(); }
     void close();
     void onConnect(ArEventHandlerFunction cb);
+    //policy of clients that connect from now on, onConnect can still change it per client
+    void setPolicy(AsyncEventSourcePolicy policy){ _policy = policy; }
+    AsyncEventSourcePolicy policy() const { return _policy; }
     void send(const char *message, const char *event=NULL, uint32_t id=0, uint32_t reconnect=0);
     size_t count() const; //number clinets connected
     size_t  avgPacketsWaiting() const;
@@ -116,6 +150,9 @@ class AsyncEventSource: public AsyncWebHandler {
     void _handleDisconnect(AsyncEventSourceClient * client);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
+    virtual WebRouteKind routeKind() const override final { return ROUTE_EXACT; }
+    virtual String routeUri() const override final { return _url; }
+    virtual WebRequestMethodComposite routeMethods() const override final { return HTTP_GET; }
 };
 
 class AsyncEventSourceResponse: public AsyncWebServerResponse {
@@ -191,10 +191,14 @@ public:
   : _uri(uri), _method(HTTP_POST|HTTP_PUT|HTTP_PATCH), _onRequest(onRequest), maxJsonBufferSize(maxJsonBufferSize), _maxContentLength(16384) {}
 #endif
   
-  void setMethod(WebRequestMethodComposite method){ _method = method; }
+  void setMethod(WebRequestMethodComposite method){ _method = method; invalidateRoutes(); }
   void setMaxContentLength(int maxContentLength){ _maxContentLength = maxContentLength; }
   void onRequest(ArJsonRequestHandlerFunction fn){ _onRequest = fn; }
 
+  virtual WebRouteKind routeKind() const override final { return ROUTE_PATH; }
+  virtual String routeUri() const override final { return _uri; }
+  virtual WebRequestMethodComposite routeMethods() const override final { return _method; }
+
   virtual bool canHandle(AsyncWebServerRequest *request) override final{
     if(!_onRequest)
       return false;
@@ -31,6 +31,13 @@
 
 #define MAX_PRINTF_LEN 64
 
+//largest frame header: 2 bytes, a 16 bit length and the mask. Frames never get a 64 bit
+//length, they are cut to what fits the TCP window
+#define WS_FRAME_HEADROOM 8
+
+//set on the first frame of a permessage-deflate compressed message
+#define WS_FRAME_RSV1 0x40
+
 size_t webSocketSendFrameWindow(AsyncClient *client){
   if(!client->canSend())
     return 0;
@@ -40,6 +47,59 @@ size_t webSocketSendFrameWindow(AsyncClient *client){
   return space - 8;
 }
 
+//XOR len bytes with the 4 byte mask, offset is the position of data[0] in the masked payload.
+//Once data is aligned whole words are done at a time, a word is a multiple of 4 bytes so the
+//same rotated mask fits every one of them
+typedef size_t __attribute__((__may_alias__)) webSocketMaskWord;
+
+void webSocketMask(uint8_t *data, size_t len, const uint8_t *mask, size_t offset){
+  //short payloads are not worth the setup
+  if(len >= 4 * sizeof(webSocketMaskWord)){
+    while((uintptr_t)data & (sizeof(webSocketMaskWord) - 1)){
+      *data++ ^= mask[offset++ & 3];
+      len--;
+    }
+    uint8_t bytes[sizeof(webSocketMaskWord)];
+    for(size_t i = 0; i < sizeof(bytes); i++)
+      bytes[i] = mask[(offset + i) & 3];
+    webSocketMaskWord word;
+    memcpy(&word, bytes, sizeof(word));
+    webSocketMaskWord *words = (webSocketMaskWord *)data;
+    size_t count = len / sizeof(word);
+    for(size_t i = 0; i < count; i++)
+      words[i] ^= word;
+    data += count * sizeof(word);
+    len -= count * sizeof(word);
+  }
+  while(len--)
+    *data++ ^= mask[offset++ & 3];
+}
+
+//payloads keep WS_FRAME_HEADROOM bytes in front of them for webSocketSendFrame, and a 0 after
+static uint8_t * webSocketAllocPayload(size_t len){
+  uint8_t *buf = (uint8_t*)malloc(WS_FRAME_HEADROOM + len + 1);
+  if(buf == NULL)
+    return NULL;
+  buf[WS_FRAME_HEADROOM + len] = 0;
+  return buf + WS_FRAME_HEADROOM;
+}
+
+static uint8_t * webSocketReallocPayload(uint8_t *data, size_t len){
+  uint8_t *buf = (uint8_t*)realloc(data ? data - WS_FRAME_HEADROOM : NULL, WS_FRAME_HEADROOM + len + 1);
+  if(buf == NULL)
+    return NULL;
+  buf[WS_FRAME_HEADROOM + len] = 0;
+  return buf + WS_FRAME_HEADROOM;
+}
+
+static void webSocketFreePayload(uint8_t *data){
+  if(data != NULL)
+    free(data - WS_FRAME_HEADROOM);
+}
+
+//data must have WS_FRAME_HEADROOM bytes in front of it. The header is written there so header
+//and payload go out with one add(), the bytes it covers are put back afterwards. Those are
+//the headroom or payload of an earlier frame, either way lwIP has its own copy by then
 size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len){
   if(!client->canSend())
     return 0;
@@ -47,14 +107,15 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   if(space < 2)
     return 0;
   uint8_t mbuf[4] = {0,0,0,0};
-  uint8_t headLen = 2;
+  uint8_t maskLen = 0;
   if(len && mask){
-    headLen += 4;
+    maskLen = 4;
     mbuf[0] = rand() % 0xFF;
     mbuf[1] = rand() % 0xFF;
     mbuf[2] = rand() % 0xFF;
     mbuf[3] = rand() % 0xFF;
   }
+  uint8_t headLen = 2 + maskLen;
   if(len > 125)
     headLen += 2;
   if(space < headLen)
@@ -62,14 +123,15 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
   space -= headLen;
 
   if(len > space) len = space;
+  //cut below 126, the length has to use the short form again
+  if(len < 126 && headLen - maskLen > 2)
+    headLen -= 2;
 
-  uint8_t *buf = (uint8_t*)malloc(headLen);
-  if(buf == NULL){
-    //os_printf("could not malloc %u bytes for frame header\n", headLen);
-    return 0;
-  }
+  uint8_t *buf = data - headLen;
+  uint8_t saved[WS_FRAME_HEADROOM];
+  memcpy(saved, buf, headLen);
 
-  buf[0] = opcode & 0x0F;
+  buf[0] = opcode & (WS_FRAME_RSV1 | 0x0F);
   if(final)
     buf[0] |= 0x80;
   if(len < 126)
@@ -79,27 +141,22 @@ size_t webSocketSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool
     buf[2] = (uint8_t)((len >> 8) & 0xFF);
     buf[3] = (uint8_t)(len & 0xFF);
   }
-  if(len && mask){
+  if(maskLen){
     buf[1] |= 0x80;
     memcpy(buf + (headLen - 4), mbuf, 4);
+    webSocketMask(data, len, mbuf, 0);
   }
-  if(client->add((const char *)buf, headLen) != headLen){
-    //os_printf("error adding %lu header bytes\n", headLen);
-    free(buf);
-    return 0;
-  }
-  free(buf);
 
-  if(len){
-    if(len && mask){
-      size_t i;
-      for(i=0;i<len;i++)
-        data[i] = data[i] ^ mbuf[i%4];
-    }
-    if(client->add((const char *)data, len) != len){
-      //os_printf("error adding %lu data bytes\n", len);
-      return 0;
-    }
+  size_t added = client->add((const char *)buf, headLen + len);
+
+  //the message may be shared with other clients or sent again after a failed add
+  if(maskLen)
+    webSocketMask(data, len, mbuf, 0);
+  memcpy(buf, saved, headLen);
+
+  if(added != headLen + len){
+    //os_printf("error adding %lu frame bytes\n", headLen + len);
+    return 0;
   }
   if(!client->send()){
     //os_printf("error sending frame: %lu\n", headLen+len);
@@ -135,7 +192,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(uint8_t * data, size_t
     return; 
   }
 
-  _data = new uint8_t[_len + 1];
+  _data = webSocketAllocPayload(_len);
 
   if (_data) {
     memcpy(_data, data, _len);
@@ -150,7 +207,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(size_t size)
   ,_lock(false)
   ,_count(0)
 {
-  _data = new uint8_t[_len + 1]; 
+  _data = webSocketAllocPayload(_len); 
 
   if (_data) {
     _data[_len] = 0; 
@@ -169,7 +226,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const AsyncWebSocketMes
   _count = 0;
 
   if (_len) {
-    _data = new uint8_t[_len + 1]; 
+    _data = webSocketAllocPayload(_len); 
     _data[_len] = 0; 
   } 
 
@@ -200,7 +257,7 @@ AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(AsyncWebSocketMessageBu
 AsyncWebSocketMessageBuffer::~AsyncWebSocketMessageBuffer()
 {
     if (_data) {
-      delete[] _data; 
+      webSocketFreePayload(_data); 
     }
 }
 
@@ -209,11 +266,11 @@ bool AsyncWebSocketMessageBuffer::reserve(size_t size)
   _len = size; 
 
   if (_data) {
-    delete[] _data;
+    webSocketFreePayload(_data);
     _data = nullptr; 
   }
 
-  _data = new uint8_t[_len + 1];
+  _data = webSocketAllocPayload(_len);
 
   if (_data) {
     _data[_len] = 0;
@@ -233,10 +290,11 @@ bool AsyncWebSocketMessageBuffer::reserve(size_t size)
 class AsyncWebSocketControl {
   private:
     uint8_t _opcode;
-    uint8_t *_data;
     size_t _len;
     bool _mask;
     bool _finished;
+    //control payloads are at most 125 bytes, kept inline with room for the header
+    uint8_t _frame[WS_FRAME_HEADROOM + 125];
   public:
     AsyncWebSocketControl(uint8_t opcode, uint8_t *data=NULL, size_t len=0, bool mask=false)
       :_opcode(opcode)
@@ -246,25 +304,18 @@ class AsyncWebSocketControl {
   {
       if(data == NULL)
         _len = 0;
-      if(_len){
-        if(_len > 125)
-          _len = 125;
-        _data = (uint8_t*)malloc(_len);
-        if(_data == NULL)
-          _len = 0;
-        else memcpy(_data, data, len);
-      } else _data = NULL;
-    }
-    virtual ~AsyncWebSocketControl(){
-      if(_data != NULL)
-        free(_data);
+      if(_len > 125)
+        _len = 125;
+      if(_len)
+        memcpy(_frame + WS_FRAME_HEADROOM, data, _len);
     }
+    virtual ~AsyncWebSocketControl(){}
     virtual bool finished() const { return _finished; }
     uint8_t opcode(){ return _opcode; }
     uint8_t len(){ return _len + 2; }
     size_t send(AsyncClient *client){
       _finished = true;
-      return webSocketSendFrame(client, true, _opcode & 0x0F, _mask, _data, _len);
+      return webSocketSendFrame(client, true, _opcode & 0x0F, _mask, _frame + WS_FRAME_HEADROOM, _len);
     }
 };
 
@@ -281,14 +332,13 @@ AsyncWebSocketBasicMessage::AsyncWebSocketBasicMessage(const char * data, size_t
 {
   _opcode = opcode & 0x07;
   _mask = mask;
-  _data = (uint8_t*)malloc(_len+1);
+  _data = webSocketAllocPayload(_len);
   if(_data == NULL){
     _len = 0;
     _status = WS_MSG_ERROR;
   } else {
     _status = WS_MSG_SENDING;
     memcpy(_data, data, _len);
-    _data[_len] = 0;
   }
 }
 AsyncWebSocketBasicMessage::AsyncWebSocketBasicMessage(uint8_t opcode, bool mask)
@@ -305,8 +355,30 @@ AsyncWebSocketBasicMessage::AsyncWebSocketBasicMessage(uint8_t opcode, bool mask
 
 
 AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
-  if(_data != NULL)
-    free(_data);
+  webSocketFreePayload(_data);
+}
+
+bool AsyncWebSocketBasicMessage::append(const uint8_t *data, size_t len) {
+  if(!pending())
+    return false;
+  bool newline = (_opcode == WS_TEXT) && _len;
+  uint8_t *grown = webSocketReallocPayload(_data, _len + newline + len);
+  if(grown == NULL)
+    return false;
+  _data = grown;
+  if(newline)
+    _data[_len++] = '\n';
+  memcpy(_data + _len, data, len);
+  _len += len;
+  return true;
+}
+
+bool AsyncWebSocketBasicMessage::setCompressedPayload(uint8_t *data, size_t len) {
+  webSocketFreePayload(_data);
+  _data = data;
+  _len = len;
+  _compressed = true;
+  return true;
 }
 
  void AsyncWebSocketBasicMessage::ack(size_t len, uint32_t time)  {
@@ -344,7 +416,7 @@ AsyncWebSocketBasicMessage::~AsyncWebSocketBasicMessage() {
 
   bool final = (_sent == _len);
   uint8_t* dPtr = (uint8_t*)(_data + (_sent - toSend));
-  uint8_t opCode = (toSend && _sent == toSend)?_opcode:(uint8_t)WS_CONTINUATION;
+  uint8_t opCode = (toSend && _sent == toSend)?(uint8_t)(_opcode | (_compressed ? WS_FRAME_RSV1 : 0)):(uint8_t)WS_CONTINUATION;
 
   size_t sent = webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend);
   _status = WS_MSG_SENDING;
@@ -380,6 +452,7 @@ AsyncWebSocketMultiMessage::AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuff
   ,_ack(0)
   ,_acked(0)
   ,_WSbuffer(nullptr)
+  ,_compressedData(nullptr)
 {
 
   _opcode = opcode & 0x07;
@@ -403,6 +476,21 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
   if (_WSbuffer) {
     (*_WSbuffer)--; // decreases the counter. 
   }
+  webSocketFreePayload(_compressedData);
+}
+
+bool AsyncWebSocketMultiMessage::setCompressedPayload(uint8_t *data, size_t len) {
+  //compressed for this client alone, the shared buffer is no longer needed
+  if (_WSbuffer) {
+    (*_WSbuffer)--;
+    _WSbuffer = nullptr;
+  }
+  webSocketFreePayload(_compressedData);
+  _compressedData = data;
+  _data = data;
+  _len = len;
+  _compressed = true;
+  return true;
 }
 
  void AsyncWebSocketMultiMessage::ack(size_t len, uint32_t time)  {
@@ -443,7 +531,7 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
 
   bool final = (_sent == _len);
   uint8_t* dPtr = (uint8_t*)(_data + (_sent - toSend));
-  uint8_t opCode = (toSend && _sent == toSend)?_opcode:(uint8_t)WS_CONTINUATION;
+  uint8_t opCode = (toSend && _sent == toSend)?(uint8_t)(_opcode | (_compressed ? WS_FRAME_RSV1 : 0)):(uint8_t)WS_CONTINUATION;
 
   size_t sent = webSocketSendFrame(client, final, opCode, _mask, dPtr, toSend);
   _status = WS_MSG_SENDING;
@@ -463,7 +551,7 @@ AsyncWebSocketMultiMessage::~AsyncWebSocketMultiMessage() {
  const char * AWSC_PING_PAYLOAD = "ESPAsyncWebServer-PING";
  const size_t AWSC_PING_PAYLOAD_LEN = 22;
 
-AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server)
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, AsyncWebSocketDeflater *deflater)
   : _controlQueue(LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *c){ delete  c; }))
   , _messageQueue(LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m){ delete  m; }))
   , _tempObject(NULL)
@@ -474,7 +562,21 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _status = WS_CONNECTED;
   _pstate = 0;
   _lastMessageTime = millis();
-  _keepAlivePeriod = 0;
+  _lastReceiveTime = _lastMessageTime;
+  _keepAlivePeriod = _server->keepAlivePeriod() * 1000;
+  _idleTimeout = _server->idleTimeout() * 1000;
+  _closing = false;
+  _closeStart = 0;
+  _tableNext = NULL;
+  _timerNext = NULL;
+  _timerPrev = NULL;
+  _timerSlot = 0xFF;
+  _timerDue = 0;
+  _queuePolicy = _server->queuePolicy();
+  _dropped = 0;
+  _deflater = deflater;
+  _inflater = NULL;
+  _inflating = false;
   _client->setRxTimeout(0);
   _client->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; ((AsyncWebSocketClient*)(r))->_onError(error); }, this);
   _client->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; ((AsyncWebSocketClient*)(r))->_onAck(len, time); }, this);
@@ -483,6 +585,7 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
   _client->onData([](void *r, AsyncClient* c, void *buf, size_t len){ (void)c; ((AsyncWebSocketClient*)(r))->_onData(buf, len); }, this);
   _client->onPoll([](void *r, AsyncClient* c){ (void)c; ((AsyncWebSocketClient*)(r))->_onPoll(); }, this);
   _server->_addClient(this);
+  _scheduleTimer();
   _server->_handleEvent(this, WS_EVT_CONNECT, request, NULL, 0);
   delete request;
 }
@@ -490,9 +593,17 @@ AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebServerRequest *request, Async
 AsyncWebSocketClient::~AsyncWebSocketClient(){
   _messageQueue.free();
   _controlQueue.free();
+  delete _deflater;
+  delete _inflater;
+  _server->_removeClient(this);
   _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
 }
 
+void AsyncWebSocketClient::_setStatus(AwsClientStatus status){
+  _server->_handleStatus(_status, status);
+  _status = status;
+}
+
 void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
   _lastMessageTime = millis();
   if(!_controlQueue.isEmpty()){
@@ -501,7 +612,7 @@ void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
       len -= head->len();
       if(_status == WS_DISCONNECTING && head->opcode() == WS_DISCONNECT){
         _controlQueue.remove(head);
-        _status = WS_DISCONNECTED;
+        _setStatus(WS_DISCONNECTED);
         _client->close(true);
         return;
       }
@@ -518,9 +629,46 @@ void AsyncWebSocketClient::_onAck(size_t len, uint32_t time){
 void AsyncWebSocketClient::_onPoll(){
   if(_client->canSend() && (!_controlQueue.isEmpty() || !_messageQueue.isEmpty())){
     _runQueue();
-  } else if(_keepAlivePeriod > 0 && _controlQueue.isEmpty() && _messageQueue.isEmpty() && (millis() - _lastMessageTime) >= _keepAlivePeriod){
+  }
+  //may close any client, this one included, so nothing of it is used afterwards
+  _server->_runTimers();
+}
+
+//the next time _onTimer has to look at this client. Timers are not moved on every message,
+//_onTimer checks again and schedules the next one
+void AsyncWebSocketClient::_scheduleTimer(){
+  uint32_t due;
+  if(_closing){
+    due = _closeStart + WS_CLOSE_TIMEOUT_MS;
+  } else if(_keepAlivePeriod || _idleTimeout){
+    uint32_t now = millis();
+    due = now + (_keepAlivePeriod ? _keepAlivePeriod : _idleTimeout);
+    if(_keepAlivePeriod && (int32_t)(_lastMessageTime + _keepAlivePeriod - now) > 0){
+      due = _lastMessageTime + _keepAlivePeriod;
+    }
+    if(_idleTimeout && (int32_t)(_lastReceiveTime + _idleTimeout - due) < 0){
+      due = _lastReceiveTime + _idleTimeout;
+    }
+  } else {
+    _server->_cancelTimer(this);
+    return;
+  }
+  _server->_scheduleTimer(this, due);
+}
+
+void AsyncWebSocketClient::_onTimer(uint32_t now){
+  if(_closing){
+    if((now - _closeStart) >= WS_CLOSE_TIMEOUT_MS){
+      _client->close(true);
+      return;
+    }
+  } else if(_idleTimeout && (now - _lastReceiveTime) >= _idleTimeout){
+    _client->close(true);
+    return;
+  } else if(_keepAlivePeriod && _controlQueue.isEmpty() && _messageQueue.isEmpty() && (now - _lastMessageTime) >= _keepAlivePeriod){
     ping((uint8_t *)AWSC_PING_PAYLOAD, AWSC_PING_PAYLOAD_LEN);
   }
+  _scheduleTimer();
 }
 
 void AsyncWebSocketClient::_runQueue(){
@@ -531,15 +679,114 @@ void AsyncWebSocketClient::_runQueue(){
   if(!_controlQueue.isEmpty() && (_messageQueue.isEmpty() || _messageQueue.front()->betweenFrames()) && webSocketSendFrameWindow(_client) > (size_t)(_controlQueue.front()->len() - 1)){
     _controlQueue.front()->send(_client);
   } else if(!_messageQueue.isEmpty() && _messageQueue.front()->betweenFrames() && webSocketSendFrameWindow(_client)){
+    if(_deflater != NULL && !_messageQueue.front()->deflated())
+      _deflateMessage(_messageQueue.front());
     _messageQueue.front()->send(_client);
   }
 }
 
+//compressed only now, so the queue policies still see the plain payload and context takeover
+//sees messages in the order they go out
+void AsyncWebSocketClient::_deflateMessage(AsyncWebSocketMessage *dataMessage){
+  dataMessage->setDeflated();
+  size_t len = dataMessage->payloadLength();
+  //an empty message has nothing to shrink, and len - 1 below would wrap
+  if(len == 0 || len < _server->deflateMinSize() || dataMessage->payload() == NULL)
+    return;
+  uint32_t start = micros();
+  //only worth it when smaller
+  uint8_t *out = webSocketAllocPayload(len - 1);
+  size_t outLen = 0;
+  if(out != NULL)
+    outLen = _deflater->deflate(dataMessage->payload(), len, out, len - 1);
+  _server->_handleDeflate(len, outLen, micros() - start);
+  if(outLen){
+    uint8_t *shrunk = webSocketReallocPayload(out, outLen);
+    if(shrunk != NULL)
+      out = shrunk;
+    _deflater->sent(dataMessage->payload(), len);
+    if(dataMessage->setCompressedPayload(out, outLen))
+      return;
+  }
+  webSocketFreePayload(out);
+}
+
 bool AsyncWebSocketClient::queueIsFull(){
-  if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (_status != WS_CONNECTED) ) return true;
+  if((_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES) || (queuedBytes() >= WS_MAX_QUEUED_BYTES) || (_status != WS_CONNECTED) ) return true;
   return false;
 }
 
+size_t AsyncWebSocketClient::queuedBytes() const {
+  size_t bytes = 0;
+  for(const auto& m: _messageQueue)
+    bytes += m->payloadLength();
+  return bytes;
+}
+
+void AsyncWebSocketClient::_dropMessage(AsyncWebSocketMessage *dataMessage){
+  _dropped++;
+  _server->_handleDrop();
+  if(_messageQueue.remove(dataMessage))
+    return;
+  delete dataMessage;
+}
+
+//WS_QUEUE_LATEST and WS_QUEUE_BATCH: true when the newest waiting message of the topic took the new one in
+bool AsyncWebSocketClient::_mergeMessage(AsyncWebSocketMessage *dataMessage){
+  AsyncWebSocketMessage *waiting = NULL;
+  for(const auto& m: _messageQueue){
+    if(m->pending() && m->topic() == dataMessage->topic() && m->opcode() == dataMessage->opcode())
+      waiting = m;
+  }
+  if(waiting == NULL)
+    return false;
+
+  if(_queuePolicy == WS_QUEUE_LATEST){
+    //the new one goes to the end, so topics keep the order their values were published in
+    _dropMessage(waiting);
+    return false;
+  }
+
+  if(waiting->payloadLength() + 1 + dataMessage->payloadLength() > WS_BATCH_MAX_SIZE)
+    return false;
+  if(waiting->append(dataMessage->payload(), dataMessage->payloadLength())){
+    delete dataMessage;
+    return true;
+  }
+  //a shared buffer is not changed, the batch gets a copy of its own
+  AsyncWebSocketMessage *batch = new AsyncWebSocketBasicMessage((const char *)waiting->payload(), waiting->payloadLength(), waiting->opcode());
+  if(batch == NULL)
+    return false;
+  if(!batch->append(dataMessage->payload(), dataMessage->payloadLength())){
+    delete batch;
+    return false;
+  }
+  batch->setTopic(waiting->topic());
+  _messageQueue.remove(waiting);
+  _messageQueue.add(batch);
+  delete dataMessage;
+  return true;
+}
+
+//drops waiting messages until len more bytes fit, unless the policy keeps what is queued
+bool AsyncWebSocketClient::_makeRoom(size_t len){
+  while(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES || (!_messageQueue.isEmpty() && queuedBytes() + len > WS_MAX_QUEUED_BYTES)){
+    if(_queuePolicy == WS_QUEUE_DROP_NEWEST)
+      return false;
+    AsyncWebSocketMessage *oldest = NULL;
+    for(const auto& m: _messageQueue){
+      if(m->pending()){
+        oldest = m;
+        break;
+      }
+    }
+    if(oldest == NULL)
+      return false;
+    _dropMessage(oldest);
+  }
+  return true;
+}
+
 void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
   if(dataMessage == NULL)
     return;
@@ -547,9 +794,11 @@ void AsyncWebSocketClient::_queueMessage(AsyncWebSocketMessage *dataMessage){
     delete dataMessage;
     return;
   }
-  if(_messageQueue.length() >= WS_MAX_QUEUED_MESSAGES){
+  if(dataMessage->topic() && (_queuePolicy == WS_QUEUE_LATEST || _queuePolicy == WS_QUEUE_BATCH) && _mergeMessage(dataMessage)){
+    //merged into a message that was already queued
+  } else if(!_makeRoom(dataMessage->payloadLength())){
       ets_printf("ERROR: Too many messages queued\n");
-      delete dataMessage;
+      _dropMessage(dataMessage);
   } else {
       _messageQueue.add(dataMessage);
   }
@@ -566,8 +815,11 @@ void AsyncWebSocketClient::_queueControl(AsyncWebSocketControl *controlMessage){
 }
 
 void AsyncWebSocketClient::close(uint16_t code, const char * message){
-  if(_status != WS_CONNECTED)
+  if(_status != WS_CONNECTED || _closing)
     return;
+  _closing = true;
+  _closeStart = millis();
+  _scheduleTimer();
   if(code){
     uint8_t packetLen = 2;
     if(message != NULL){
@@ -607,8 +859,43 @@ void AsyncWebSocketClient::_onDisconnect(){
   _server->_handleDisconnect(this);
 }
 
+//a compressed message is handed on whole, as a single unfragmented frame once its last frame is in.
+//False after it was found corrupt or too big and the connection is closed
+bool AsyncWebSocketClient::_inflateData(uint8_t *data, size_t len, bool last){
+  if(_pinfo.opcode != WS_CONTINUATION)
+    _pinfo.message_opcode = _pinfo.opcode;
+  bool ok = _inflater != NULL && _inflater->write(data, len);
+  if(ok && last)
+    ok = _inflater->finish();
+  if(!ok){
+    //1009: too big, 1007: not valid
+    uint16_t code = (_inflater != NULL && _inflater->length() >= WS_INFLATE_MAX_SIZE) ? 1009 : 1007;
+    delete _inflater;
+    _inflater = NULL;
+    _inflating = false;
+    close(code);
+    return false;
+  }
+  if(!last)
+    return true;
+
+  AwsFrameInfo info = _pinfo;
+  info.opcode = info.message_opcode;
+  info.num = 0;
+  info.final = 1;
+  info.index = 0;
+  info.len = _inflater->length();
+  _server->_handleInflate();
+  _server->_handleEvent(this, WS_EVT_DATA, (void *)&info, _inflater->data(), _inflater->length());
+  delete _inflater;
+  _inflater = NULL;
+  _inflating = false;
+  return true;
+}
+
 void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
   _lastMessageTime = millis();
+  _lastReceiveTime = _lastMessageTime;
   uint8_t *data = (uint8_t*)pbuf;
   while(plen > 0){
     if(!_pstate){
@@ -617,6 +904,7 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
       _pinfo.final = (fdata[0] & 0x80) != 0;
       _pinfo.opcode = fdata[0] & 0x0F;
       _pinfo.masked = (fdata[1] & 0x80) != 0;
+      bool rsv1 = (fdata[0] & WS_FRAME_RSV1) != 0;
       _pinfo.len = fdata[1] & 0x7F;
       data += 2;
       plen -= 2;
@@ -635,14 +923,23 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
         data += 4;
         plen -= 4;
       }
+
+      //RSV1 marks the first frame of a compressed message, only when permessage-deflate was agreed on
+      if(rsv1 && (_deflater == NULL || _pinfo.opcode == WS_CONTINUATION || _pinfo.opcode >= 8 || _inflating)){
+        close(1002);
+        return;
+      }
+      if(rsv1){
+        _inflater = new AsyncWebSocketInflater();
+        _inflating = true;
+      }
     }
 
     const size_t datalen = std::min((size_t)(_pinfo.len - _pinfo.index), plen);
     const auto datalast = data[datalen];
 
     if(_pinfo.masked){
-      for(size_t i=0;i<datalen;i++)
-        data[i] ^= _pinfo.mask[(_pinfo.index+i)%4];
+      webSocketMask(data, datalen, _pinfo.mask, (size_t)(_pinfo.index & 3));
     }
 
     if((datalen + _pinfo.index) < _pinfo.len){
@@ -654,7 +951,11 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
           _pinfo.num = 0;
         } else _pinfo.num += 1;
       }
-      _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, (uint8_t*)data, datalen);
+      if(_inflating && _pinfo.opcode < 8){
+        if(!_inflateData(data, datalen, false))
+          return;
+      } else
+        _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, (uint8_t*)data, datalen);
 
       _pinfo.index += datalen;
     } else if((datalen + _pinfo.index) == _pinfo.len){
@@ -668,10 +969,15 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
           }
         }
         if(_status == WS_DISCONNECTING){
-          _status = WS_DISCONNECTED;
+          _setStatus(WS_DISCONNECTED);
           _client->close(true);
         } else {
-          _status = WS_DISCONNECTING;
+          _setStatus(WS_DISCONNECTING);
+          if(!_closing){
+            _closing = true;
+            _closeStart = millis();
+            _scheduleTimer();
+          }
           _client->ackLater();
           _queueControl(new AsyncWebSocketControl(WS_DISCONNECT, data, datalen));
         }
@@ -680,6 +986,9 @@ void AsyncWebSocketClient::_onData(void *pbuf, size_t plen){
       } else if(_pinfo.opcode == WS_PONG){
         if(datalen != AWSC_PING_PAYLOAD_LEN || memcmp(AWSC_PING_PAYLOAD, data, AWSC_PING_PAYLOAD_LEN) != 0)
           _server->_handleEvent(this, WS_EVT_PONG, NULL, data, datalen);
+      } else if(_pinfo.opcode < 8 && _inflating){
+        if(!_inflateData(data, datalen, _pinfo.final))
+          return;
       } else if(_pinfo.opcode < 8){//continuation or text/binary frame
         _server->_handleEvent(this, WS_EVT_DATA, (void *)&_pinfo, data, datalen);
       }
@@ -852,13 +1161,45 @@ AsyncWebSocket::AsyncWebSocket(const String& url)
   ,_clients(LinkedList<AsyncWebSocketClient *>([](AsyncWebSocketClient *c){ delete c; }))
   ,_cNextId(1)
   ,_enabled(true)
+  ,_queuePolicy(WS_QUEUE_DROP_NEWEST)
+  ,_dropped(0)
+  ,_keepAlivePeriod(0)
+  ,_idleTimeout(0)
+  ,_connected(0)
+  ,_timerPos(0)
+  ,_deflate(false)
+  ,_deflateWindowBits(WS_DEFLATE_WINDOW_BITS)
+  ,_deflateContextTakeover(false)
+  ,_deflateMinSize(WS_DEFLATE_MIN_SIZE)
   ,_buffers(LinkedList<AsyncWebSocketMessageBuffer *>([](AsyncWebSocketMessageBuffer *b){ delete b; }))
 {
   _eventHandler = NULL;
+  memset(&_deflateStats, 0, sizeof(_deflateStats));
+  memset(_clientTable, 0, sizeof(_clientTable));
+  memset(_timerWheel, 0, sizeof(_timerWheel));
+  _timerTime = millis();
 }
 
 AsyncWebSocket::~AsyncWebSocket(){}
 
+void AsyncWebSocket::setDeflate(bool enable, uint8_t windowBits, bool contextTakeover, size_t minSize){
+  _deflate = enable;
+  _deflateWindowBits = constrain(windowBits, 8, 15);
+  _deflateContextTakeover = contextTakeover;
+  _deflateMinSize = minSize;
+}
+
+void AsyncWebSocket::_handleDeflate(size_t in, size_t out, uint32_t us){
+  if(out){
+    _deflateStats.messages++;
+    _deflateStats.bytesIn += in;
+    _deflateStats.bytesOut += out;
+  } else {
+    _deflateStats.skipped++;
+  }
+  _deflateStats.micros += us;
+}
+
 void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len){
   if(_eventHandler != NULL){
     _eventHandler(this, client, type, arg, data, len);
@@ -867,6 +1208,104 @@ void AsyncWebSocket::_handleEvent(AsyncWebSocketClient * client, AwsEventType ty
 
 void AsyncWebSocket::_addClient(AsyncWebSocketClient * client){
   _clients.add(client);
+  AsyncWebSocketClient **bucket = &_clientTable[client->id() & (WS_CLIENT_TABLE_SIZE - 1)];
+  client->_tableNext = *bucket;
+  *bucket = client;
+  _connected++;
+}
+
+//called by the client destructor
+void AsyncWebSocket::_removeClient(AsyncWebSocketClient * client){
+  AsyncWebSocketClient **link = &_clientTable[client->id() & (WS_CLIENT_TABLE_SIZE - 1)];
+  while(*link != NULL && *link != client){
+    link = &(*link)->_tableNext;
+  }
+  if(*link != NULL){
+    *link = client->_tableNext;
+  }
+  _cancelTimer(client);
+  if(client->status() == WS_CONNECTED){
+    _connected--;
+  }
+}
+
+void AsyncWebSocket::_handleStatus(AwsClientStatus from, AwsClientStatus to){
+  if(from == WS_CONNECTED && to != WS_CONNECTED){
+    _connected--;
+  }
+}
+
+/*
+ * Timer wheel
+ * Slot _timerPos was run at _timerTime, a client due n ticks later sits n slots further on.
+ * Deadlines beyond one turn are put in the farthest slot and moved on when it comes up
+ * */
+
+void AsyncWebSocket::_scheduleTimer(AsyncWebSocketClient * client, uint32_t due){
+  _cancelTimer(client);
+  int32_t delay = (int32_t)(due - _timerTime);
+  uint32_t ticks = 1;
+  if(delay > WS_TIMER_TICK_MS){
+    ticks = ((uint32_t)delay + WS_TIMER_TICK_MS - 1) / WS_TIMER_TICK_MS;
+    if(ticks > WS_TIMER_SLOTS){
+      ticks = WS_TIMER_SLOTS;
+    }
+  }
+  uint8_t slot = (_timerPos + ticks) & (WS_TIMER_SLOTS - 1);
+  client->_timerDue = due;
+  client->_timerSlot = slot;
+  client->_timerPrev = NULL;
+  client->_timerNext = _timerWheel[slot];
+  if(client->_timerNext != NULL){
+    client->_timerNext->_timerPrev = client;
+  }
+  _timerWheel[slot] = client;
+}
+
+void AsyncWebSocket::_cancelTimer(AsyncWebSocketClient * client){
+  if(client->_timerSlot == 0xFF){
+    return;
+  }
+  if(client->_timerPrev != NULL){
+    client->_timerPrev->_timerNext = client->_timerNext;
+  } else {
+    _timerWheel[client->_timerSlot] = client->_timerNext;
+  }
+  if(client->_timerNext != NULL){
+    client->_timerNext->_timerPrev = client->_timerPrev;
+  }
+  client->_timerNext = NULL;
+  client->_timerPrev = NULL;
+  client->_timerSlot = 0xFF;
+}
+
+//run from every client's poll, does nothing until the next tick is due
+void AsyncWebSocket::_runTimers(){
+  uint32_t now = millis();
+  if((now - _timerTime) > (uint32_t)WS_TIMER_SLOTS * WS_TIMER_TICK_MS){
+    //after a stall every slot is run once, the deadlines still decide who is due
+    _timerTime = now - (uint32_t)WS_TIMER_SLOTS * WS_TIMER_TICK_MS;
+  }
+  while((now - _timerTime) >= WS_TIMER_TICK_MS){
+    _timerTime += WS_TIMER_TICK_MS;
+    _timerPos = (_timerPos + 1) & (WS_TIMER_SLOTS - 1);
+
+    //moved aside first, _onTimer may put the client back into this slot or close any client
+    AsyncWebSocketClient *c = _timerWheel[_timerPos];
+    _timerWheel[_timerPos] = NULL;
+    _timerWheel[WS_TIMER_SLOTS] = c;
+    for(; c != NULL; c = c->_timerNext){
+      c->_timerSlot = WS_TIMER_SLOTS;
+    }
+    while((c = _timerWheel[WS_TIMER_SLOTS]) != NULL){
+      _cancelTimer(c);
+      if((int32_t)(c->_timerDue - _timerTime) > 0){
+        _scheduleTimer(c, c->_timerDue);
+      } else {
+        c->_onTimer(now);
+      }
+    }
+  }
 }
 
 void AsyncWebSocket::_handleDisconnect(AsyncWebSocketClient * client){
@@ -884,23 +1323,24 @@ bool AsyncWebSocket::availableForWriteAll(){
 }
 
 bool AsyncWebSocket::availableForWrite(uint32_t id){
-  for(const auto& c: _clients){
-    if(c->queueIsFull() && (c->id() == id )) return false;
+  AsyncWebSocketClient * c = _clientTable[id & (WS_CLIENT_TABLE_SIZE - 1)];
+  while(c != NULL && c->id() != id){
+    c = c->_tableNext;
   }
-  return true;
+  return c == NULL || !c->queueIsFull();
 }
 
 size_t AsyncWebSocket::count() const {
-  return _clients.count_if([](AsyncWebSocketClient * c){
-    return c->status() == WS_CONNECTED;
-  });
+  return _connected;
 }
 
 AsyncWebSocketClient * AsyncWebSocket::client(uint32_t id){
-  for(const auto &c: _clients){
-    if(c->id() == id && c->status() == WS_CONNECTED){
-      return c;
-    }
+  AsyncWebSocketClient * c = _clientTable[id & (WS_CLIENT_TABLE_SIZE - 1)];
+  while(c != NULL && c->id() != id){
+    c = c->_tableNext;
+  }
+  if(c != NULL && c->status() == WS_CONNECTED){
+    return c;
   }
   return nullptr;
 }
@@ -992,6 +1432,39 @@ void AsyncWebSocket::message(uint32_t id, AsyncWebSocketMessage *message){
     c->message(message);
 }
 
+//only compared with other topics, 0 is left for none
+uint32_t AsyncWebSocket::topicOf(const char *topic){
+  if(topic == NULL)
+    return 0;
+  uint32_t hash = AsyncWebFieldTable::hash(topic, strlen(topic), false);
+  return hash ? hash : 1;
+}
+
+void AsyncWebSocket::publish(const char *topic, AsyncWebSocketMessageBuffer *buffer, AwsFrameType type){
+  if (!buffer) return;
+  uint32_t key = topicOf(topic);
+  buffer->lock();
+  for(const auto& c: _clients){
+    if(c->status() == WS_CONNECTED){
+      AsyncWebSocketMessage *message = new AsyncWebSocketMultiMessage(buffer, type);
+      if(message == NULL)
+        continue;
+      message->setTopic(key);
+      c->message(message);
+    }
+  }
+  buffer->unlock();
+  _cleanBuffers();
+}
+
+void AsyncWebSocket::publish(const char *topic, const uint8_t *data, size_t len, AwsFrameType type){
+  publish(topic, makeBuffer((uint8_t *)data, len), type);
+}
+
+void AsyncWebSocket::publish(const char *topic, const String &message, AwsFrameType type){
+  publish(topic, (const uint8_t *)message.c_str(), message.length(), type);
+}
+
 void AsyncWebSocket::messageAll(AsyncWebSocketMultiMessage *message){
   for(const auto& c: _clients){
     if(c->status() == WS_CONNECTED)
@@ -1152,6 +1625,7 @@ const char * WS_STR_VERSION = "Sec-WebSocket-Version";
 const char * WS_STR_KEY = "Sec-WebSocket-Key";
 const char * WS_STR_PROTOCOL = "Sec-WebSocket-Protocol";
 const char * WS_STR_ACCEPT = "Sec-WebSocket-Accept";
+const char * WS_STR_EXTENSIONS = "Sec-WebSocket-Extensions";
 const char * WS_STR_UUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
 bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
@@ -1167,6 +1641,7 @@ bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request){
   request->addInterestingHeader(WS_STR_VERSION);
   request->addInterestingHeader(WS_STR_KEY);
   request->addInterestingHeader(WS_STR_PROTOCOL);
+  request->addInterestingHeader(WS_STR_EXTENSIONS);
   return true;
 }
 
@@ -1186,12 +1661,18 @@ void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request){
     return;
   }
   AsyncWebHeader* key = request->getHeader(WS_STR_KEY);
-  AsyncWebServerResponse *response = new AsyncWebSocketResponse(key->value(), this);
+  AsyncWebSocketResponse *response = new AsyncWebSocketResponse(key->value(), this);
   if(request->hasHeader(WS_STR_PROTOCOL)){
     AsyncWebHeader* protocol = request->getHeader(WS_STR_PROTOCOL);
     //ToDo: check protocol
     response->addHeader(WS_STR_PROTOCOL, protocol->value());
   }
+  if(_deflate && request->hasHeader(WS_STR_EXTENSIONS)){
+    String extension;
+    AsyncWebSocketDeflater *deflater = AsyncWebSocketDeflater::negotiate(request->getHeader(WS_STR_EXTENSIONS)->value(), _deflateWindowBits, _deflateContextTakeover, extension);
+    if(deflater != NULL)
+      response->setDeflate(deflater, extension);
+  }
   request->send(response);
 }
 
@@ -1221,11 +1702,8 @@ void AsyncWebSocket::_cleanBuffers()
 {
   AsyncWebLockGuard l(_lock);
 
-  for(AsyncWebSocketMessageBuffer * c: _buffers){
-    if(c && c->canDelete()){
-        _buffers.remove(c);
-    }
-  }
+  //removing while iterating would step on from the deleted node
+  while(_buffers.remove_first([](AsyncWebSocketMessageBuffer * c){ return c && c->canDelete(); }));
 }
 
 AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() const {
@@ -1239,6 +1717,7 @@ AsyncWebSocket::AsyncWebSocketClientLinkedList AsyncWebSocket::getClients() cons
 
 AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket *server){
   _server = server;
+  _deflater = NULL;
   _code = 101;
   _sendContentLength = false;
 
@@ -1275,6 +1754,16 @@ AsyncWebSocketResponse::AsyncWebSocketResponse(const String& key, AsyncWebSocket
   free(hash);
 }
 
+AsyncWebSocketResponse::~AsyncWebSocketResponse(){
+  delete _deflater;
+}
+
+void AsyncWebSocketResponse::setDeflate(AsyncWebSocketDeflater *deflater, const String &extension){
+  delete _deflater;
+  _deflater = deflater;
+  addHeader(WS_STR_EXTENSIONS, extension);
+}
+
 void AsyncWebSocketResponse::_respond(AsyncWebServerRequest *request){
   if(_state == RESPONSE_FAILED){
     request->client()->close(true);
@@ -1288,7 +1777,8 @@ void AsyncWebSocketResponse::_respond(AsyncWebServerRequest *request){
 size_t AsyncWebSocketResponse::_ack(AsyncWebServerRequest *request, size_t len, uint32_t time){
   (void)time;
   if(len){
-    new AsyncWebSocketClient(request, _server);
+    new AsyncWebSocketClient(request, _server, _deflater);
+    _deflater = NULL;
   }
   return 0;
 }
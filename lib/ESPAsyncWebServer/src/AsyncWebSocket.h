@@ -32,6 +32,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "AsyncWebSynchronization.h"
+#include "AsyncWebSocketDeflate.h"
 
 #ifdef ESP8266
 #include <Hash.h>
@@ -40,11 +41,43 @@
 #endif
 #endif
 
+#ifndef DEFAULT_MAX_WS_CLIENTS
 #ifdef ESP32
 #define DEFAULT_MAX_WS_CLIENTS 8
 #else
 #define DEFAULT_MAX_WS_CLIENTS 4
 #endif
+#endif
+
+//buckets of the id-indexed client table (power of two); ids are sequential, so up to this many
+//clients each find theirs in one step
+#ifndef WS_CLIENT_TABLE_SIZE
+#define WS_CLIENT_TABLE_SIZE 32
+#endif
+
+//timer wheel for pings, idle timeouts and close handshakes: WS_TIMER_SLOTS (power of two, at most 128) slots
+//of WS_TIMER_TICK_MS each. Later deadlines wait for another turn of the wheel
+#ifndef WS_TIMER_SLOTS
+#define WS_TIMER_SLOTS 64
+#endif
+#ifndef WS_TIMER_TICK_MS
+#define WS_TIMER_TICK_MS 250
+#endif
+
+//a client that does not answer our close frame within this is dropped
+#ifndef WS_CLOSE_TIMEOUT_MS
+#define WS_CLOSE_TIMEOUT_MS 5000
+#endif
+
+//payload bytes one client may hold in its queue, shared buffers are counted for every client holding them
+#ifndef WS_MAX_QUEUED_BYTES
+#define WS_MAX_QUEUED_BYTES 16384
+#endif
+
+//largest frame WS_QUEUE_BATCH builds from waiting messages of one topic
+#ifndef WS_BATCH_MAX_SIZE
+#define WS_BATCH_MAX_SIZE 1024
+#endif
 
 class AsyncWebSocket;
 class AsyncWebSocketResponse;
@@ -80,6 +113,14 @@ typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PIN
 typedef enum { WS_MSG_SENDING, WS_MSG_SENT, WS_MSG_ERROR } AwsMessageStatus;
 typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
 
+//what a client does with new messages while it falls behind; only messages nothing was sent of are dropped or merged
+typedef enum {
+  WS_QUEUE_DROP_NEWEST, // a full queue refuses new messages
+  WS_QUEUE_DROP_OLDEST, // a full queue drops its oldest waiting message
+  WS_QUEUE_LATEST,      // a message replaces the waiting one of its topic, otherwise like WS_QUEUE_DROP_OLDEST
+  WS_QUEUE_BATCH        // a message is appended to the waiting one of its topic, text joined by newlines
+} AwsQueuePolicy;
+
 class AsyncWebSocketMessageBuffer {
   private:
     uint8_t * _data;
@@ -113,13 +154,32 @@ class AsyncWebSocketMessage {
     uint8_t _opcode;
     bool _mask;
     AwsMessageStatus _status;
+    uint32_t _topic;
+    bool _deflated;
+    bool _compressed;
   public:
-    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR){}
+    AsyncWebSocketMessage():_opcode(WS_TEXT),_mask(false),_status(WS_MSG_ERROR),_topic(0),_deflated(false),_compressed(false){}
     virtual ~AsyncWebSocketMessage(){}
     virtual void ack(size_t len __attribute__((unused)), uint32_t time __attribute__((unused))){}
     virtual size_t send(AsyncClient *client __attribute__((unused))){ return 0; }
     virtual bool finished(){ return _status != WS_MSG_SENDING; }
     virtual bool betweenFrames() const { return false; }
+
+    //queue policies match messages on topic, 0 takes no part in WS_QUEUE_LATEST and WS_QUEUE_BATCH
+    uint32_t topic() const { return _topic; }
+    void setTopic(uint32_t topic){ _topic = topic; }
+    uint8_t opcode() const { return _opcode; }
+    //nothing of it was sent yet, so it can still be dropped or merged
+    virtual bool pending() const { return false; }
+    virtual const uint8_t * payload() const { return NULL; }
+    virtual size_t payloadLength() const { return 0; }
+    //adds to a pending message that owns its payload
+    virtual bool append(const uint8_t *data __attribute__((unused)), size_t len __attribute__((unused))){ return false; }
+    //permessage-deflate is decided once, right before the first frame; a compressed message is no longer pending
+    bool deflated() const { return _deflated; }
+    void setDeflated(){ _deflated = true; }
+    //takes over a compressed payload with frame headroom, the first frame gets RSV1
+    virtual bool setCompressedPayload(uint8_t *data __attribute__((unused)), size_t len __attribute__((unused))){ return false; }
 };
 
 class AsyncWebSocketBasicMessage: public AsyncWebSocketMessage {
@@ -136,6 +196,11 @@ public:
     virtual bool betweenFrames() const override { return _acked == _ack; }
     virtual void ack(size_t len, uint32_t time) override ;
     virtual size_t send(AsyncClient *client) override ;
+    virtual bool pending() const override { return _status == WS_MSG_SENDING && _sent == 0 && !_deflated; }
+    virtual const uint8_t * payload() const override { return _data; }
+    virtual size_t payloadLength() const override { return _len; }
+    virtual bool append(const uint8_t *data, size_t len) override;
+    virtual bool setCompressedPayload(uint8_t *data, size_t len) override;
 };
 
 class AsyncWebSocketMultiMessage: public AsyncWebSocketMessage {
@@ -146,12 +211,17 @@ class AsyncWebSocketMultiMessage: public AsyncWebSocketMessage {
     size_t _ack;
     size_t _acked;
     AsyncWebSocketMessageBuffer * _WSbuffer; 
+    uint8_t * _compressedData;
 public:
     AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer * buffer, uint8_t opcode=WS_TEXT, bool mask=false); 
     virtual ~AsyncWebSocketMultiMessage() override;
     virtual bool betweenFrames() const override { return _acked == _ack; }
     virtual void ack(size_t len, uint32_t time) override ;
     virtual size_t send(AsyncClient *client) override ;
+    virtual bool pending() const override { return _status == WS_MSG_SENDING && _sent == 0 && !_deflated; }
+    virtual const uint8_t * payload() const override { return _data; }
+    virtual size_t payloadLength() const override { return _len; }
+    virtual bool setCompressedPayload(uint8_t *data, size_t len) override;
 };
 
 class AsyncWebSocketClient {
@@ -169,15 +239,44 @@ class AsyncWebSocketClient {
 
     uint32_t _lastMessageTime;
     uint32_t _keepAlivePeriod;
+    uint32_t _lastReceiveTime;
+    uint32_t _idleTimeout;
+    bool _closing;
+    uint32_t _closeStart;
+
+    //links of the server's client table and timer wheel
+    AsyncWebSocketClient *_tableNext;
+    AsyncWebSocketClient *_timerNext;
+    AsyncWebSocketClient *_timerPrev;
+    uint8_t _timerSlot;
+    uint32_t _timerDue;
+
+    AwsQueuePolicy _queuePolicy;
+    uint32_t _dropped;
+
+    AsyncWebSocketDeflater *_deflater;
+    AsyncWebSocketInflater *_inflater;
+    bool _inflating;
 
     void _queueMessage(AsyncWebSocketMessage *dataMessage);
+    bool _mergeMessage(AsyncWebSocketMessage *dataMessage);
+    bool _makeRoom(size_t len);
+    void _dropMessage(AsyncWebSocketMessage *dataMessage);
     void _queueControl(AsyncWebSocketControl *controlMessage);
     void _runQueue();
+    void _deflateMessage(AsyncWebSocketMessage *dataMessage);
+    bool _inflateData(uint8_t *data, size_t len, bool last);
+    void _setStatus(AwsClientStatus status);
+    void _scheduleTimer();
+    void _onTimer(uint32_t now);
+
+    friend AsyncWebSocket;
 
   public:
     void *_tempObject;
 
-    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server);
+    //takes over deflater, the permessage-deflate the handshake agreed on
+    AsyncWebSocketClient(AsyncWebServerRequest *request, AsyncWebSocket *server, AsyncWebSocketDeflater *deflater=NULL);
     ~AsyncWebSocketClient();
 
     //client id increments for the given server
@@ -197,10 +296,20 @@ class AsyncWebSocketClient {
     //set auto-ping period in seconds. disabled if zero (default)
     void keepAlivePeriod(uint16_t seconds){
       _keepAlivePeriod = seconds * 1000;
+      _scheduleTimer();
     }
     uint16_t keepAlivePeriod(){
       return (uint16_t)(_keepAlivePeriod / 1000);
     }
+    //drop the connection after this many seconds without anything received, pongs included.
+    //set it above keepAlivePeriod() so that the pings get an answer in time. disabled if zero (default)
+    void idleTimeout(uint16_t seconds){
+      _idleTimeout = seconds * 1000;
+      _scheduleTimer();
+    }
+    uint16_t idleTimeout(){
+      return (uint16_t)(_idleTimeout / 1000);
+    }
 
     //data packets
     void message(AsyncWebSocketMessage *message){ _queueMessage(message); }
@@ -228,6 +337,16 @@ class AsyncWebSocketClient {
 
     bool canSend() { return _messageQueue.length() < WS_MAX_QUEUED_MESSAGES; }
 
+    //what happens to new messages while this client falls behind
+    void setQueuePolicy(AwsQueuePolicy policy){ _queuePolicy = policy; }
+    AwsQueuePolicy queuePolicy() const { return _queuePolicy; }
+    size_t queueLength() const { return _messageQueue.length(); }
+    size_t queuedBytes() const;
+    //messages refused, dropped or replaced before anything of them was sent
+    uint32_t dropped() const { return _dropped; }
+    //permessage-deflate was agreed on
+    bool compressed() const { return _deflater != NULL; }
+
     //system callbacks (do not call)
     void _onAck(size_t len, uint32_t time);
     void _onError(int8_t);
@@ -250,6 +369,21 @@ class AsyncWebSocket: public AsyncWebHandler {
     AwsEventHandler _eventHandler;
     bool _enabled;
     AsyncWebLock _lock;
+    AwsQueuePolicy _queuePolicy;
+    uint32_t _dropped;
+    uint16_t _keepAlivePeriod;
+    uint16_t _idleTimeout;
+    size_t _connected;
+    AsyncWebSocketClient *_clientTable[WS_CLIENT_TABLE_SIZE];
+    //the extra slot holds the clients whose slot is being run
+    AsyncWebSocketClient *_timerWheel[WS_TIMER_SLOTS + 1];
+    uint8_t _timerPos;
+    uint32_t _timerTime;
+    bool _deflate;
+    uint8_t _deflateWindowBits;
+    bool _deflateContextTakeover;
+    size_t _deflateMinSize;
+    AsyncWebSocketDeflateStats _deflateStats;
 
   public:
     AsyncWebSocket(const String& url);
@@ -304,6 +438,31 @@ class AsyncWebSocket: public AsyncWebHandler {
     void message(uint32_t id, AsyncWebSocketMessage *message);
     void messageAll(AsyncWebSocketMultiMessage *message);
 
+    //a shared buffer to every client, tagged with a topic for WS_QUEUE_LATEST and WS_QUEUE_BATCH
+    void publish(const char *topic, AsyncWebSocketMessageBuffer *buffer, AwsFrameType type=WS_TEXT);
+    void publish(const char *topic, const uint8_t *data, size_t len, AwsFrameType type=WS_TEXT);
+    void publish(const char *topic, const String &message, AwsFrameType type=WS_TEXT);
+    static uint32_t topicOf(const char *topic);
+
+    //policy of clients that connect from now on, WS_EVT_CONNECT can still change it per client
+    void setQueuePolicy(AwsQueuePolicy policy){ _queuePolicy = policy; }
+    AwsQueuePolicy queuePolicy() const { return _queuePolicy; }
+    //messages dropped by all clients, including those that are gone
+    uint32_t dropped() const { return _dropped; }
+
+    //keepAlivePeriod() and idleTimeout() of clients that connect from now on, in seconds
+    void setKeepAlivePeriod(uint16_t seconds){ _keepAlivePeriod = seconds; }
+    uint16_t keepAlivePeriod() const { return _keepAlivePeriod; }
+    void setIdleTimeout(uint16_t seconds){ _idleTimeout = seconds; }
+    uint16_t idleTimeout() const { return _idleTimeout; }
+
+    //RFC 7692 permessage-deflate with clients that offer it, from the next handshake on. Messages
+    //below minSize go out as they are. A client keeps 2^windowBits bytes between messages with
+    //contextTakeover, none without
+    void setDeflate(bool enable, uint8_t windowBits=WS_DEFLATE_WINDOW_BITS, bool contextTakeover=false, size_t minSize=WS_DEFLATE_MIN_SIZE);
+    size_t deflateMinSize() const { return _deflateMinSize; }
+    const AsyncWebSocketDeflateStats &deflateStats() const { return _deflateStats; }
+
     size_t printf(uint32_t id, const char *format, ...)  __attribute__ ((format (printf, 3, 4)));
     size_t printfAll(const char *format, ...)  __attribute__ ((format (printf, 2, 3)));
 #ifndef ESP32
@@ -319,10 +478,21 @@ class AsyncWebSocket: public AsyncWebHandler {
     //system callbacks (do not call)
     uint32_t _getNextId(){ return _cNextId++; }
     void _addClient(AsyncWebSocketClient * client);
+    void _removeClient(AsyncWebSocketClient * client);
     void _handleDisconnect(AsyncWebSocketClient * client);
+    void _handleStatus(AwsClientStatus from, AwsClientStatus to);
+    void _scheduleTimer(AsyncWebSocketClient * client, uint32_t due);
+    void _cancelTimer(AsyncWebSocketClient * client);
+    void _runTimers();
+    void _handleDrop(){ _dropped++; }
+    void _handleDeflate(size_t in, size_t out, uint32_t us);
+    void _handleInflate(){ _deflateStats.inflated++; }
     void _handleEvent(AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
     virtual void handleRequest(AsyncWebServerRequest *request) override final;
+    virtual WebRouteKind routeKind() const override final { return ROUTE_EXACT; }
+    virtual String routeUri() const override final { return _url; }
+    virtual WebRequestMethodComposite routeMethods() const override final { return HTTP_GET; }
 
 
     //  messagebuffer functions/objects. 
@@ -339,8 +509,12 @@ class AsyncWebSocketResponse: public AsyncWebServerResponse {
   private:
     String _content;
     AsyncWebSocket *_server;
+    AsyncWebSocketDeflater *_deflater;
   public:
     AsyncWebSocketResponse(const String& key, AsyncWebSocket *server);
+    ~AsyncWebSocketResponse();
+    //answers the Sec-WebSocket-Extensions offer, the client created on the ack takes it over
+    void setDeflate(AsyncWebSocketDeflater *deflater, const String &extension);
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return true; }
@@ -0,0 +1,422 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "AsyncWebSocketDeflate.h"
+
+#ifdef ESP32
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32S2
+#include "esp32s2/rom/miniz.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+#include "esp32c3/rom/miniz.h"
+#else
+#include "esp32/rom/miniz.h"
+#endif
+#endif
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+static const uint16_t lengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t distanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+  4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+//compressed output, written LSB first. Writing past size only counts, the caller checks pos
+typedef struct {
+  uint8_t *out;
+  size_t size;
+  size_t pos;
+  uint32_t bits;
+  uint8_t count;
+} DeflateOutput;
+
+static void putBits(DeflateOutput &o, uint32_t value, uint8_t len){
+  o.bits |= value << o.count;
+  o.count += len;
+  while(o.count >= 8){
+    if(o.pos < o.size)
+      o.out[o.pos] = o.bits & 0xFF;
+    o.pos++;
+    o.bits >>= 8;
+    o.count -= 8;
+  }
+}
+
+//Huffman codes are sent MSB first
+static void putCode(DeflateOutput &o, uint16_t code, uint8_t len){
+  uint16_t reversed = 0;
+  for(uint8_t i = 0; i < len; i++){
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  putBits(o, reversed, len);
+}
+
+//literal/length symbol in the fixed code of RFC 1951 3.2.6
+static void putSymbol(DeflateOutput &o, uint16_t symbol){
+  if(symbol < 144)
+    putCode(o, 0x30 + symbol, 8);
+  else if(symbol < 256)
+    putCode(o, 0x190 + symbol - 144, 9);
+  else if(symbol < 280)
+    putCode(o, symbol - 256, 7);
+  else
+    putCode(o, 0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(DeflateOutput &o, size_t len, size_t distance){
+  uint8_t i = 28;
+  while(len < lengthBase[i])
+    i--;
+  putSymbol(o, 257 + i);
+  putBits(o, len - lengthBase[i], lengthExtra[i]);
+  i = 29;
+  while(distance < distanceBase[i])
+    i--;
+  putCode(o, i, 5);
+  putBits(o, distance - distanceBase[i], distanceExtra[i]);
+}
+
+static inline uint32_t hashOf(const uint8_t *p){
+  return (((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u) >> (32 - WS_DEFLATE_HASH_BITS);
+}
+
+AsyncWebSocketDeflater::AsyncWebSocketDeflater(uint8_t windowBits, bool contextTakeover)
+  : _windowBits(constrain(windowBits, 8, 15))
+  , _contextTakeover(contextTakeover)
+  , _window(NULL)
+  , _windowLength(0)
+{
+  if(_contextTakeover){
+    _window = (uint8_t*)malloc((size_t)1 << _windowBits);
+    //without RAM for the window every message is compressed on its own, which the client accepts as well
+    if(_window == NULL)
+      _contextTakeover = false;
+  }
+}
+
+AsyncWebSocketDeflater::~AsyncWebSocketDeflater(){
+  if(_window != NULL)
+    free(_window);
+}
+
+size_t AsyncWebSocketDeflater::deflate(const uint8_t *data, size_t len, uint8_t *out, size_t outSize){
+  const size_t window = (size_t)1 << _windowBits;
+  size_t history = _contextTakeover ? _windowLength : 0;
+  size_t end = history + len;
+
+  //matches may reach back into the earlier messages the client still has in its window
+  const uint8_t *in = data;
+  uint8_t *joined = NULL;
+  if(history){
+    joined = (uint8_t*)malloc(end);
+    if(joined == NULL)
+      return 0;
+    memcpy(joined, _window, history);
+    memcpy(joined + history, data, len);
+    in = joined;
+  }
+  //positions + 1 modulo 2^16, 0 is empty. Every candidate is compared byte by byte and kept
+  //within the window, so a stale or wrapped entry only costs a comparison
+  uint16_t *head = (uint16_t*)calloc((size_t)1 << WS_DEFLATE_HASH_BITS, sizeof(uint16_t));
+  uint16_t *prev = (uint16_t*)malloc(window * sizeof(uint16_t));
+  if(head == NULL || prev == NULL){
+    free(head);
+    free(prev);
+    free(joined);
+    return 0;
+  }
+
+  DeflateOutput o = { out, outSize, 0, 0, 0 };
+  putBits(o, 2, 3); //BFINAL 0, BTYPE 01: fixed codes
+
+  size_t pos = 0;
+  while(pos < end && o.pos <= outSize){
+    size_t bestLen = 0;
+    size_t bestDistance = 0;
+    if(pos + DEFLATE_MIN_MATCH <= end){
+      uint32_t h = hashOf(in + pos);
+      if(pos >= history){
+        size_t maxLen = end - pos;
+        if(maxLen > DEFLATE_MAX_MATCH)
+          maxLen = DEFLATE_MAX_MATCH;
+        uint16_t candidate = head[h];
+        for(uint8_t chain = 0; candidate && chain < WS_DEFLATE_CHAIN; chain++){
+          size_t distance = (uint16_t)(pos + 1 - candidate);
+          if(distance == 0 || distance > window || distance > pos)
+            break;
+          const uint8_t *a = in + pos;
+          const uint8_t *b = a - distance;
+          if(a[bestLen] == b[bestLen]){
+            size_t n = 0;
+            while(n < maxLen && a[n] == b[n])
+              n++;
+            if(n > bestLen){
+              bestLen = n;
+              bestDistance = distance;
+              if(n == maxLen)
+                break;
+            }
+          }
+          candidate = prev[(pos - distance) & (window - 1)];
+        }
+      }
+      prev[pos & (window - 1)] = head[h];
+      head[h] = pos + 1;
+    }
+
+    if(pos < history){
+      pos++;
+    } else if(bestLen >= DEFLATE_MIN_MATCH){
+      putMatch(o, bestLen, bestDistance);
+      for(size_t i = 1; i < bestLen; i++){
+        if(pos + i + DEFLATE_MIN_MATCH <= end){
+          uint32_t h = hashOf(in + pos + i);
+          prev[(pos + i) & (window - 1)] = head[h];
+          head[h] = pos + i + 1;
+        }
+      }
+      pos += bestLen;
+    } else {
+      putSymbol(o, in[pos]);
+      pos++;
+    }
+  }
+
+  putSymbol(o, 256);
+  //the empty stored block that ends every message, RFC 7692 drops its LEN and NLEN (00 00 FF FF)
+  putBits(o, 0, 3);
+  if(o.count)
+    putBits(o, 0, 8 - o.count);
+
+  free(head);
+  free(prev);
+
+  free(joined);
+  return o.pos <= outSize ? o.pos : 0;
+}
+
+void AsyncWebSocketDeflater::sent(const uint8_t *data, size_t len){
+  if(!_contextTakeover)
+    return;
+  const size_t window = (size_t)1 << _windowBits;
+  if(len >= window){
+    memcpy(_window, data + len - window, window);
+    _windowLength = window;
+    return;
+  }
+  if(_windowLength + len > window){
+    size_t drop = _windowLength + len - window;
+    memmove(_window, _window + drop, _windowLength - drop);
+    _windowLength -= drop;
+  }
+  memcpy(_window + _windowLength, data, len);
+  _windowLength += len;
+}
+
+//value of a parameter, quotes removed, "" when it has none
+static String paramValue(const String &param, int eq){
+  if(eq < 0)
+    return String();
+  String value = param.substring(eq + 1);
+  value.trim();
+  if(value.length() >= 2 && value.startsWith("\"") && value.endsWith("\""))
+    value = value.substring(1, value.length() - 1);
+  return value;
+}
+
+static bool parseWindowBits(const String &value, uint8_t &bits){
+  if(value.length() == 0 || value.length() > 2)
+    return false;
+  for(size_t i = 0; i < value.length(); i++){
+    if(!isdigit(value[i]))
+      return false;
+  }
+  long n = value.toInt();
+  if(n < 8 || n > 15)
+    return false;
+  bits = n;
+  return true;
+}
+
+AsyncWebSocketDeflater *AsyncWebSocketDeflater::negotiate(const String &offers, uint8_t windowBits, bool contextTakeover, String &response){
+#ifdef ESP32
+  windowBits = constrain(windowBits, 8, 15);
+  int start = 0;
+  while(start < (int)offers.length()){
+    int comma = offers.indexOf(',', start);
+    if(comma < 0)
+      comma = offers.length();
+    String offer = offers.substring(start, comma);
+    start = comma + 1;
+
+    uint8_t bits = windowBits;
+    bool takeover = contextTakeover;
+    bool valid = true;
+    uint8_t seen = 0;
+    int from = 0;
+    for(uint8_t index = 0; valid && from <= (int)offer.length(); index++){
+      int semicolon = offer.indexOf(';', from);
+      if(semicolon < 0)
+        semicolon = offer.length();
+      String param = offer.substring(from, semicolon);
+      from = semicolon + 1;
+      int eq = param.indexOf('=');
+      String name = eq < 0 ? param : param.substring(0, eq);
+      name.trim();
+      String value = paramValue(param, eq);
+
+      uint8_t flag = 0;
+      if(index == 0){
+        valid = name.equalsIgnoreCase("permessage-deflate") && eq < 0;
+      } else if(name.equalsIgnoreCase("server_no_context_takeover")){
+        flag = 1;
+        valid = eq < 0;
+        takeover = false;
+      } else if(name.equalsIgnoreCase("client_no_context_takeover")){
+        flag = 2;
+        valid = eq < 0;
+      } else if(name.equalsIgnoreCase("server_max_window_bits")){
+        flag = 4;
+        uint8_t offered;
+        valid = parseWindowBits(value, offered);
+        if(valid && offered < bits)
+          bits = offered;
+      } else if(name.equalsIgnoreCase("client_max_window_bits")){
+        //any window is fine, messages are inflated whole without one
+        flag = 8;
+        uint8_t offered;
+        valid = eq < 0 || parseWindowBits(value, offered);
+      } else {
+        valid = false;
+      }
+      if(seen & flag)
+        valid = false;
+      seen |= flag;
+    }
+    if(!valid)
+      continue;
+
+    AsyncWebSocketDeflater *deflater = new AsyncWebSocketDeflater(bits, takeover);
+    if(deflater == NULL)
+      return NULL;
+    response = "permessage-deflate; client_no_context_takeover";
+    if(!deflater->contextTakeover())
+      response += "; server_no_context_takeover";
+    if(deflater->windowBits() < 15){
+      response += "; server_max_window_bits=";
+      response += deflater->windowBits();
+    }
+    return deflater;
+  }
+#else
+  (void)offers;
+  (void)windowBits;
+  (void)contextTakeover;
+  (void)response;
+#endif
+  return NULL;
+}
+
+AsyncWebSocketInflater::AsyncWebSocketInflater()
+  : _state(NULL)
+  , _data(NULL)
+  , _size(0)
+  , _len(0)
+  , _done(false)
+{
+#ifdef ESP32
+  _state = malloc(sizeof(tinfl_decompressor));
+  if(_state != NULL)
+    tinfl_init((tinfl_decompressor*)_state);
+#endif
+}
+
+AsyncWebSocketInflater::~AsyncWebSocketInflater(){
+  free(_state);
+  free(_data);
+}
+
+bool AsyncWebSocketInflater::write(const uint8_t *data, size_t len){
+#ifdef ESP32
+  if(_state == NULL)
+    return false;
+  while(len && !_done){
+    if(_len == _size){
+      if(_size == WS_INFLATE_MAX_SIZE)
+        return false;
+      size_t size = _size ? _size * 2 : 256;
+      if(size > WS_INFLATE_MAX_SIZE)
+        size = WS_INFLATE_MAX_SIZE;
+      //one more for the 0 handlers may put after the data
+      uint8_t *grown = (uint8_t*)realloc(_data, size + 1);
+      if(grown == NULL)
+        return false;
+      _data = grown;
+      _size = size;
+    }
+    //the output is the window: the client does not take over its context, so no match reaches
+    //before the message, and tinfl keeps no pointers between calls, so _data may move
+    size_t inSize = len;
+    size_t outSize = _size - _len;
+    tinfl_status status = tinfl_decompress((tinfl_decompressor*)_state, data, &inSize, _data, _data + _len, &outSize,
+      TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+    data += inSize;
+    len -= inSize;
+    _len += outSize;
+    if(status < TINFL_STATUS_DONE)
+      return false;
+    if(status == TINFL_STATUS_DONE)
+      _done = true;
+    else if(status == TINFL_STATUS_NEEDS_MORE_INPUT && len)
+      return false;
+  }
+  return true;
+#else
+  (void)data;
+  (void)len;
+  return false;
+#endif
+}
+
+bool AsyncWebSocketInflater::finish(){
+  static const uint8_t trailer[4] = { 0x00, 0x00, 0xFF, 0xFF };
+  if(!write(trailer, sizeof(trailer)))
+    return false;
+  //an empty message still gets a buffer, handlers may write the 0 after the data
+  if(_data == NULL){
+    _data = (uint8_t*)malloc(1);
+    if(_data == NULL)
+      return false;
+  }
+  _data[_len] = 0;
+  return true;
+}
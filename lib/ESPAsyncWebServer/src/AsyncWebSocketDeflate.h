@@ -0,0 +1,112 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBSOCKETDEFLATE_H_
+#define ASYNCWEBSOCKETDEFLATE_H_
+
+#include "Arduino.h"
+
+//sliding window of the compressor (8..15), the bytes a client keeps between messages with context takeover
+#ifndef WS_DEFLATE_WINDOW_BITS
+#define WS_DEFLATE_WINDOW_BITS 11
+#endif
+
+//hash table used while a message is compressed, 2^bits entries of two bytes
+#ifndef WS_DEFLATE_HASH_BITS
+#define WS_DEFLATE_HASH_BITS 10
+#endif
+
+//earlier positions tried per match, more compresses better at more CPU
+#ifndef WS_DEFLATE_CHAIN
+#define WS_DEFLATE_CHAIN 8
+#endif
+
+//smaller messages are sent as they are
+#ifndef WS_DEFLATE_MIN_SIZE
+#define WS_DEFLATE_MIN_SIZE 128
+#endif
+
+//largest message a client may send compressed, it is inflated in one piece
+#ifndef WS_INFLATE_MAX_SIZE
+#define WS_INFLATE_MAX_SIZE 4096
+#endif
+
+/*
+ * DEFLATE :: RFC 7692 permessage-deflate for one client. Messages are compressed with LZ77 and the
+ * fixed Huffman codes: no tables to build or send, which suits the short messages of a socket.
+ * The window only outlives a message with context takeover, so that is the RAM a client keeps.
+ * Clients are always told client_no_context_takeover, their messages are inflated by the tinfl
+ * of the ROM into the message buffer itself and need no window of their own.
+ * */
+
+//totals of a socket over all its clients
+typedef struct {
+  uint32_t messages;  //sent compressed
+  uint32_t skipped;   //tried, but did not get smaller
+  uint64_t bytesIn;   //payload of the compressed messages before
+  uint64_t bytesOut;  //and after compression, the ratio is bytesIn / bytesOut
+  uint64_t micros;    //spent compressing, skipped messages included
+  uint32_t inflated;  //compressed messages received
+} AsyncWebSocketDeflateStats;
+
+class AsyncWebSocketDeflater {
+  private:
+    uint8_t _windowBits;
+    bool _contextTakeover;
+    uint8_t *_window;
+    size_t _windowLength;
+
+  public:
+    AsyncWebSocketDeflater(uint8_t windowBits, bool contextTakeover);
+    ~AsyncWebSocketDeflater();
+    uint8_t windowBits() const { return _windowBits; }
+    bool contextTakeover() const { return _contextTakeover; }
+
+    //compress len bytes into out, 0 when the result does not fit outSize
+    size_t deflate(const uint8_t *data, size_t len, uint8_t *out, size_t outSize);
+    //the compressed message goes out, the client's window moves on by it. Messages sent as they
+    //are never reach the client's window
+    void sent(const uint8_t *data, size_t len);
+
+    //picks the first offer of a Sec-WebSocket-Extensions header that can be served, NULL for none.
+    //response is set to the header value that accepts it
+    static AsyncWebSocketDeflater *negotiate(const String &offers, uint8_t windowBits, bool contextTakeover, String &response);
+};
+
+class AsyncWebSocketInflater {
+  private:
+    void *_state;
+    uint8_t *_data;
+    size_t _size;
+    size_t _len;
+    bool _done;
+
+  public:
+    AsyncWebSocketInflater();
+    ~AsyncWebSocketInflater();
+    //false when the data is corrupt, the message grows over WS_INFLATE_MAX_SIZE or RAM runs out
+    bool write(const uint8_t *data, size_t len);
+    //the message is complete, adds the trailer the sender removed
+    bool finish();
+    uint8_t *data(){ return _data; }
+    size_t length() const { return _len; }
+};
+
+#endif /* ASYNCWEBSOCKETDEFLATE_H_ */
@@ -27,6 +27,12 @@
 #include "FS.h"
 
 #include "StringArray.h"
+#include "WebRouteTable.h"
+#include "WebFieldTable.h"
+#include "WebAssetCache.h"
+#include "WebObjectPool.h"
+#include "WebDeferred.h"
+#include "WebMetrics.h"
 
 #ifdef ESP32
 #include <WiFi.h>
@@ -46,6 +52,50 @@
 
 #define DEBUGF(...) //Serial.printf(__VA_ARGS__)
 
+//request line and headers of a request are kept in one buffer of at most WEBSERVER_MAX_HEAD_SIZE bytes,
+//larger heads or more headers are answered with 431
+#ifndef WEBSERVER_MAX_HEAD_SIZE
+#define WEBSERVER_MAX_HEAD_SIZE 2048
+#endif
+
+#ifndef WEBSERVER_MAX_HEADERS
+#define WEBSERVER_MAX_HEADERS 32
+#endif
+
+//persistent connections: idle time before the server closes (seconds), requests served per connection
+#ifndef WEBSERVER_KEEPALIVE_TIMEOUT
+#define WEBSERVER_KEEPALIVE_TIMEOUT 5
+#endif
+
+#ifndef WEBSERVER_KEEPALIVE_MAX_REQUESTS
+#define WEBSERVER_KEEPALIVE_MAX_REQUESTS 100
+#endif
+
+//pipelined bytes buffered while the previous response is still being sent
+#ifndef WEBSERVER_MAX_PIPELINE_SIZE
+#define WEBSERVER_MAX_PIPELINE_SIZE 2048
+#endif
+
+//connections served at the same time, requests live in a static pool. When it is full the longest idle
+//persistent connection is closed for a new one, only when none is idle does a connection get a 503
+#ifndef WEBSERVER_MAX_REQUESTS
+#define WEBSERVER_MAX_REQUESTS 8
+#endif
+
+//responses up to WEBSERVER_RESPONSE_SLOT_SIZE bytes come from a static pool, larger ones (or more) from the heap
+#ifndef WEBSERVER_MAX_RESPONSES
+#define WEBSERVER_MAX_RESPONSES 8
+#endif
+
+#ifndef WEBSERVER_RESPONSE_SLOT_SIZE
+#define WEBSERVER_RESPONSE_SLOT_SIZE 192
+#endif
+
+//header and parameter objects of a request are placed in its arena, this much of it is part of the request
+#ifndef WEBSERVER_REQUEST_ARENA_SIZE
+#define WEBSERVER_REQUEST_ARENA_SIZE 256
+#endif
+
 class AsyncWebServer;
 class AsyncWebServerRequest;
 class AsyncWebServerResponse;
@@ -76,6 +126,21 @@ typedef enum {
 typedef uint8_t WebRequestMethodComposite;
 typedef std::function<void(void)> ArDisconnectHandler;
 
+/*
+ * POOL STATS :: Use of the request and response pools since boot
+ * */
+
+typedef struct {
+  uint16_t requests;          // in use now
+  uint16_t requestsPeak;
+  uint16_t requestsMax;
+  uint32_t requestsRefused;   // connections answered with 503
+  uint16_t responses;
+  uint16_t responsesPeak;
+  uint16_t responsesMax;
+  uint32_t responsesOnHeap;   // larger than a slot or no slot free
+} AsyncWebPoolStats;
+
 /*
  * PARAMETER :: Chainable object to hold GET/POST and FILE parameters
  * */
@@ -136,17 +201,28 @@ class AsyncWebServerRequest {
   using FS = fs::FS;
   friend class AsyncWebServer;
   friend class AsyncCallbackWebHandler;
+  friend class AsyncWebServerResponse;
+  friend class AsyncWebDeferred;
   private:
     AsyncClient* _client;
     AsyncWebServer* _server;
     AsyncWebHandler* _handler;
     AsyncWebServerResponse* _response;
-    StringArray _interestingHeaders;
+    AsyncWebDeferred* _deferred;    // answer promised by defer(), not given yet
+    bool *_destroyed;               // set by the destructor while a callback that may close runs
+    bool _metricsPending;           // a request started and is not counted yet
+    uint32_t _metricsStart;         // micros() at its first byte
+    size_t _metricsIn;
     ArDisconnectHandler _onDisconnectfn;
 
     String _temp;
     uint8_t _parseState;
 
+    uint8_t _headState;
+    size_t _tokenStart;
+    size_t _nameStart;
+    size_t _nameLength;
+
     uint8_t _version;
     WebRequestMethodComposite _method;
     String _url;
@@ -155,16 +231,28 @@ class AsyncWebServerRequest {
     String _boundary;
     String _authorization;
     RequestedConnectionType _reqconntype;
-    void _removeNotInterestingHeaders();
     bool _isDigest;
     bool _isMultipart;
     bool _isPlainPost;
     bool _expectingContinue;
+    bool _unframedBody;           // Transfer-Encoding body, its end is not known to the parser
     size_t _contentLength;
     size_t _parsedLength;
 
-    LinkedList<AsyncWebHeader *> _headers;
-    LinkedList<AsyncWebParameter *> _params;
+    bool _keepAlive;              // connection is reused once the response is sent
+    uint16_t _requestCount;
+    uint32_t _idleSince;
+    AsyncWebServerRequest *_nextRequest;  // all live requests, to find an idle one when the pool is full
+    uint8_t *_pipeline;           // bytes of the next requests, received before this one finished
+    size_t _pipelineLength;
+
+    AsyncWebFieldTable _headers;    // holds the request line tokens until the headers start
+    AsyncWebFieldTable _params;
+    mutable AsyncWebArena<WEBSERVER_REQUEST_ARENA_SIZE> _arena;
+    mutable AsyncWebHeader **_headerObjects;    // created in the arena by getHeader()/getParam() on first use
+    mutable size_t _headerObjectSlots;
+    mutable AsyncWebParameter **_paramObjects;
+    mutable size_t _paramObjectSlots;
     LinkedList<String *> _pathParams;
 
     uint8_t _multiParseState;
@@ -186,15 +274,34 @@ class AsyncWebServerRequest {
     void _onDisconnect();
     void _onData(void *buf, size_t len);
 
-    void _addParam(AsyncWebParameter*);
+    void _ackResponse(size_t len, uint32_t time);
+    bool _responseDone();
+    void _recordMetrics();
+    void _deferredDone(AsyncWebServerResponse *response);
+    void _reset();
+    void _releaseObjects();
+    static void _refuse(AsyncClient *c);
+    bool _idle() const;
+    static bool _closeIdle();
+    void _pipelineAppend(const uint8_t *data, size_t len);
+
+    void _addParam(const String& name, const String& value, bool form=false, bool file=false, size_t size=0);
     void _addPathParam(const char *param);
-
-    bool _parseReqHead();
-    bool _parseReqHeader();
-    void _parseLine();
+    void _addPathParam(const char *param, size_t len);
+
+    size_t _parseHead(const uint8_t *data, size_t len);
+    bool _headAppend(const char *data, size_t len);
+    void _headToken(char delimiter);
+    void _headFail(int code);
+    void _parseReqHead();
+    void _parseReqHeader(const char *name, const char *value, size_t valueLength);
+    void _endOfHead();
+    void _parseBody(uint8_t *data, size_t len);
     void _parsePlainPostChar(uint8_t data);
     void _parseMultipartPostByte(uint8_t data, bool last);
     void _addGetParams(const String& params);
+    void _addGetParams(const char *params, size_t len);
+    String _urlDecode(const char *text, size_t len) const;
 
     void _handleUploadStart();
     void _handleUploadByte(uint8_t data, bool last);
@@ -205,6 +312,10 @@ class AsyncWebServerRequest {
     void *_tempObject;
 
     AsyncWebServerRequest(AsyncWebServer*, AsyncClient*);
+    //from the request pool, NULL when all WEBSERVER_MAX_REQUESTS are in use
+    static void *operator new(size_t size) noexcept;
+    static void operator delete(void *p);
+    static void _poolStats(AsyncWebPoolStats& stats);
     ~AsyncWebServerRequest();
 
     AsyncClient* client(){ return _client; }
@@ -229,10 +340,15 @@ class AsyncWebServerRequest {
     void requestAuthentication(const char * realm = NULL, bool isDigest = true);
 
     void setHandler(AsyncWebHandler *handler){ _handler = handler; }
-    void addInterestingHeader(const String& name);
+    //every header of the request is available, only kept for compatibility
+    void addInterestingHeader(const String& name){ (void)name; }
 
     void redirect(const String& url);
 
+    //answer later: the handler returns and the handle is completed from another task or event.
+    //NULL if the request is already answered or deferred, or there is no memory for the handle
+    AsyncWebDeferred* defer();
+
     void send(AsyncWebServerResponse *response);
     void send(int code, const String& contentType=String(), const String& content=String());
     void send(FS &fs, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
@@ -277,7 +393,7 @@ class AsyncWebServerRequest {
     bool hasArg(const char* name) const;         // check if argument exists
     bool hasArg(const __FlashStringHelper * data) const;         // check if F(argument) exists
 
-    const String& ASYNCWEBSERVER_REGEX_ATTRIBUTE pathArg(size_t i) const;
+    const String& pathArg(size_t i) const;     // get {name} or regex path argument by number
 
     const String& header(const char* name) const;// get request header value by name
     const String& header(const __FlashStringHelper * data) const;// get request header value by F(name)    
@@ -301,13 +417,16 @@ bool ON_AP_FILTER(AsyncWebServerRequest *request);
  * */
 
 class AsyncWebRewrite {
+  friend class AsyncWebServer;
+  private:
+    bool _exact; // created by AsyncWebServer::rewrite(), match() is known to be a plain compare
   protected:
     String _from;
     String _toUrl;
     String _params;
     ArRequestFilterFunction _filter;
   public:
-    AsyncWebRewrite(const char* from, const char* to): _from(from), _toUrl(to), _params(String()), _filter(NULL){
+    AsyncWebRewrite(const char* from, const char* to): _exact(false), _from(from), _toUrl(to), _params(String()), _filter(NULL){
       int index = _toUrl.indexOf('?');
       if (index > 0) {
         _params = _toUrl.substring(index +1);
@@ -332,6 +451,8 @@ class AsyncWebHandler {
     ArRequestFilterFunction _filter;
     String _username;
     String _password;
+    static uint32_t _routeGeneration;
+    AsyncWebMetrics _metrics;
   public:
     AsyncWebHandler():_username(""), _password(""){}
     AsyncWebHandler& setFilter(ArRequestFilterFunction fn) { _filter = fn; return *this; }
@@ -345,6 +466,17 @@ class AsyncWebHandler {
     virtual void handleUpload(AsyncWebServerRequest *request  __attribute__((unused)), const String& filename __attribute__((unused)), size_t index __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), bool final  __attribute__((unused))){}
     virtual void handleBody(AsyncWebServerRequest *request __attribute__((unused)), uint8_t *data __attribute__((unused)), size_t len __attribute__((unused)), size_t index __attribute__((unused)), size_t total __attribute__((unused))){}
     virtual bool isRequestHandlerTrivial(){return true;}
+
+    //route table hooks: describe the urls canHandle() accepts so the server only asks matching handlers
+    virtual WebRouteKind routeKind() const { return ROUTE_OPAQUE; }
+    virtual String routeUri() const { return String(); }
+    virtual WebRequestMethodComposite routeMethods() const { return HTTP_ANY; }
+    //called instead of canHandle() once the route table has matched url and method
+    virtual bool canHandleRoute(AsyncWebServerRequest *request){ return canHandle(request); }
+    //call when a handler changes its uri or methods after it was added to the server
+    static void invalidateRoutes(){ _routeGeneration++; }
+    static uint32_t routeGeneration(){ return _routeGeneration; }
+    AsyncWebMetrics& metrics(){ return _metrics; }
 };
 
 /*
@@ -369,10 +501,17 @@ class AsyncWebServerResponse {
     size_t _writtenLength;
     WebResponseState _state;
     const char* _responseCodeToString(int code);
+    void _addConnectionHeader(AsyncWebServerRequest *request);
+    //value of a header added to the response, NULL if there is none
+    const String* _header(const char* name) const;
 
   public:
     AsyncWebServerResponse();
     virtual ~AsyncWebServerResponse();
+    //from the response pool when there is a free slot large enough, otherwise from the heap
+    static void *operator new(size_t size) noexcept;
+    static void operator delete(void *p);
+    static void _poolStats(AsyncWebPoolStats& stats);
     virtual void setCode(int code);
     virtual void setContentLength(size_t len);
     virtual void setContentType(const String& type);
@@ -382,6 +521,7 @@ class AsyncWebServerResponse {
     virtual bool _finished() const;
     virtual bool _failed() const;
     virtual bool _sourceValid() const;
+    size_t _written() const { return _writtenLength; }
     virtual void _respond(AsyncWebServerRequest *request);
     virtual size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
 };
@@ -401,6 +541,16 @@ class AsyncWebServer {
     LinkedList<AsyncWebHandler*> _handlers;
     AsyncCallbackWebHandler* _catchAllHandler;
 
+    AsyncWebRouteTable _rewriteRoutes;
+    AsyncWebRouteTable _handlerRoutes;
+    std::vector<AsyncWebRewrite*> _rewriteList;
+    std::vector<AsyncWebHandler*> _handlerList;
+    uint32_t _routeGeneration;
+    void _buildRoutes();
+    bool _keepAlive;
+    AsyncWebMetrics _badRequests;   // requests that never reached a handler
+    uint32_t _connections;
+
   public:
     AsyncWebServer(uint16_t port);
     ~AsyncWebServer();
@@ -432,6 +582,13 @@ class AsyncWebServer {
     void onRequestBody(ArBodyHandlerFunction fn); //handle posts with plain body content (JSON often transmitted this way as a request)
 
     void reset(); //remove all writers and handlers, with onNotFound/onFileUpload/onRequestBody 
+
+    void setKeepAlive(bool enable){ _keepAlive = enable; } //persistent connections, on by default
+    bool keepAlive() const { return _keepAlive; }
+    static AsyncWebPoolStats poolStats();
+    //Prometheus text format: per handler requests, bytes and latency, connections and heap
+    void printMetrics(Print& out);
+    AsyncWebMetrics& _badRequestMetrics(){ return _badRequests; }
   
     void _handleDisconnect(AsyncWebServerRequest *request);
     void _attachHandler(AsyncWebServerRequest *request);
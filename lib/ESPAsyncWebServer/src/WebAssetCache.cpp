@@ -0,0 +1,309 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "ESPAsyncWebServer.h"
+#include "WebResponseImpl.h"
+
+AsyncWebAssetCache::AsyncWebAssetCache(size_t budget)
+  : _budget(budget)
+  , _size(0)
+  , _tick(0)
+{}
+
+AsyncWebAssetCache::~AsyncWebAssetCache(){
+  clear();
+}
+
+bool AsyncWebAssetCache::cacheable(const String& path){
+  //plain text is what the application tends to rewrite at runtime (settings, logs)
+  return strcmp(AsyncFileResponse::contentTypeFor(path), "text/plain") != 0;
+}
+
+void AsyncWebAssetCache::release(AsyncWebAsset *asset){
+  if(--asset->refs)
+    return;
+  free(asset->plain.data);
+  free(asset->gzip.data);
+  delete asset;
+}
+
+void AsyncWebAssetCache::setBudget(size_t budget){
+  _budget = budget;
+  _evict(0);
+}
+
+bool AsyncWebAssetCache::_loadBody(FS& fs, const String& path, AsyncWebAssetBody& body){
+  File file = fs.open(path, "r");
+  if(!file)
+    return false;
+  size_t length = file.size();
+  if(file.isDirectory() || length == 0 || length > WEBSERVER_ASSET_MAX_FILE_SIZE || length > _budget){
+    file.close();
+    return false;
+  }
+
+  uint8_t *data = NULL;
+#ifdef ESP32
+  if(psramFound())
+    data = (uint8_t*)ps_malloc(length);
+#endif
+  if(data == NULL)
+    data = (uint8_t*)malloc(length);
+  if(data == NULL){
+    file.close();
+    return false;
+  }
+
+  size_t done = 0;
+  while(done < length){
+    size_t r = file.read(data + done, length - done);
+    if(r == 0)
+      break;
+    done += r;
+  }
+  file.close();
+  if(done != length){
+    free(data);
+    return false;
+  }
+
+  char etag[11];
+  snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned int)AsyncWebFieldTable::hash((const char*)data, length, false));
+  body.data = data;
+  body.length = length;
+  body.etag = etag;
+  return true;
+}
+
+AsyncWebAsset* AsyncWebAssetCache::load(FS& fs, const String& path){
+  if(_budget == 0)
+    return NULL;
+  remove(path);
+
+  AsyncWebAsset *asset = new AsyncWebAsset();
+  asset->path = path;
+  asset->hash = AsyncWebFieldTable::hash(path.c_str(), path.length(), false);
+  asset->contentType = AsyncFileResponse::contentTypeFor(path);
+  asset->plain.data = NULL;
+  asset->plain.length = 0;
+  asset->gzip.data = NULL;
+  asset->gzip.length = 0;
+  asset->lastUsed = ++_tick;
+  asset->refs = 1;
+
+  _loadBody(fs, path, asset->plain);
+  _loadBody(fs, path + ".gz", asset->gzip);
+  size_t size = asset->plain.length + asset->gzip.length;
+  if(size == 0 || size > _budget){
+    release(asset);
+    return NULL;
+  }
+
+  _evict(size);
+  _assets.push_back(asset);
+  _size += size;
+  return asset;
+}
+
+void AsyncWebAssetCache::preload(FS& fs, const String& dir){
+  if(_budget == 0)
+    return;
+  File root = fs.open(dir.length() ? dir : String("/"), "r");
+  if(!root)
+    return;
+  if(!root.isDirectory()){
+    root.close();
+    if(cacheable(dir))
+      load(fs, dir);
+    return;
+  }
+
+  File file = root.openNextFile();
+  while(file){
+#ifdef ESP32
+    String path = file.path();
+#else
+    String path = file.fullName();
+#endif
+    bool isDir = file.isDirectory();
+    file.close();
+
+    if(isDir){
+      preload(fs, path);
+    } else {
+      //path and path.gz end up in the same asset
+      if(path.endsWith(".gz"))
+        path = path.substring(0, path.length() - 3);
+      bool known = false;
+      for(const auto& a: _assets)
+        if(a->path == path)
+          known = true;
+      if(!known && cacheable(path))
+        load(fs, path);
+    }
+    file = root.openNextFile();
+  }
+  root.close();
+}
+
+AsyncWebAsset* AsyncWebAssetCache::find(const String& path){
+  uint32_t hash = AsyncWebFieldTable::hash(path.c_str(), path.length(), false);
+  for(const auto& a: _assets){
+    if(a->hash == hash && a->path == path){
+      a->lastUsed = ++_tick;
+      return a;
+    }
+  }
+  return NULL;
+}
+
+void AsyncWebAssetCache::_remove(size_t index){
+  AsyncWebAsset *asset = _assets[index];
+  _size -= asset->plain.length + asset->gzip.length;
+  _assets.erase(_assets.begin() + index);
+  //a response still streaming the asset frees it when done
+  release(asset);
+}
+
+void AsyncWebAssetCache::_evict(size_t needed){
+  while(_assets.size() && _size + needed > _budget){
+    size_t oldest = 0;
+    for(size_t i = 1; i < _assets.size(); i++)
+      if((int32_t)(_assets[i]->lastUsed - _assets[oldest]->lastUsed) < 0)
+        oldest = i;
+    _remove(oldest);
+  }
+}
+
+void AsyncWebAssetCache::remove(const String& path){
+  for(size_t i = 0; i < _assets.size(); i++){
+    if(_assets[i]->path == path){
+      _remove(i);
+      return;
+    }
+  }
+}
+
+void AsyncWebAssetCache::clear(){
+  while(_assets.size())
+    _remove(_assets.size() - 1);
+}
+
+void AsyncWebAssetCache::resetHeads(){
+  for(const auto& a: _assets){
+    a->plain.head = String();
+    a->gzip.head = String();
+  }
+}
+
+int AsyncWebETagTable::_indexOf(const String& path) const {
+  uint32_t hash = AsyncWebFieldTable::hash(path.c_str(), path.length(), false);
+  for(size_t i = 0; i < _tags.size(); i++)
+    if(_tags[i].hash == hash && _tags[i].path == path)
+      return i;
+  return -1;
+}
+
+const String* AsyncWebETagTable::find(const String& path) const {
+  int i = _indexOf(path);
+  if(i < 0)
+    return NULL;
+  return &_tags[i].etag;
+}
+
+const String& AsyncWebETagTable::update(const String& path, File& file){
+  size_t size = file.size();
+  time_t lastWrite = file.getLastWrite();
+  int i = _indexOf(path);
+
+  if(i >= 0){
+    AsyncWebFileTag& tag = _tags[i];
+    //the content is only read again when the file changed, without modification times (SPIFFS built
+    //without them) a rewrite that keeps the size needs invalidate()
+    if(tag.size == size && tag.lastWrite == lastWrite){
+      tag.checked = millis();
+      return tag.etag;
+    }
+  } else {
+    //make room by dropping the tag that was checked longest ago
+    if(_tags.size() >= WEBSERVER_ETAG_ENTRIES){
+      size_t oldest = 0;
+      for(size_t j = 1; j < _tags.size(); j++)
+        if((int32_t)(_tags[j].checked - _tags[oldest].checked) < 0)
+          oldest = j;
+      _tags.erase(_tags.begin() + oldest);
+    }
+    AsyncWebFileTag tag;
+    tag.path = path;
+    tag.hash = AsyncWebFieldTable::hash(path.c_str(), path.length(), false);
+    _tags.push_back(tag);
+    i = _tags.size() - 1;
+  }
+
+  char etag[24];
+  if(size > WEBSERVER_ETAG_HASH_LIMIT){
+    snprintf(etag, sizeof(etag), "W/\"%x-%lx\"", (unsigned int)size, (unsigned long)lastWrite);
+  } else {
+    uint32_t h = 2166136261UL;
+    uint8_t buf[256];
+    size_t r;
+    while((r = file.read(buf, sizeof(buf))) > 0)
+      h = AsyncWebFieldTable::hash((const char*)buf, r, false, h);
+    file.seek(0);
+    snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned int)h);
+  }
+
+  AsyncWebFileTag& tag = _tags[i];
+  tag.size = size;
+  tag.lastWrite = lastWrite;
+  tag.checked = millis();
+  tag.etag = etag;
+  return tag.etag;
+}
+
+void AsyncWebETagTable::remove(const String& path){
+  int i = _indexOf(path);
+  if(i >= 0)
+    _tags.erase(_tags.begin() + i);
+}
+
+bool AsyncWebETagTable::matches(const String& ifNoneMatch, const String& etag){
+  const char *e = etag.c_str();
+  if(strncmp(e, "W/", 2) == 0)
+    e += 2;
+  size_t elen = strlen(e);
+
+  const char *p = ifNoneMatch.c_str();
+  while(*p){
+    while(*p == ' ' || *p == ',')
+      p++;
+    if(*p == '*')
+      return true;
+    if(strncmp(p, "W/", 2) == 0)
+      p += 2;
+    const char *end = p;
+    while(*end && *end != ',' && *end != ' ')
+      end++;
+    if((size_t)(end - p) == elen && memcmp(p, e, elen) == 0)
+      return true;
+    p = end;
+  }
+  return false;
+}
@@ -0,0 +1,148 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBASSETCACHE_H_
+#define ASYNCWEBASSETCACHE_H_
+
+#include "Arduino.h"
+#include "FS.h"
+#include <vector>
+
+//bytes of file content a static handler keeps in RAM (PSRAM when available), 0 disables the cache
+#ifndef WEBSERVER_ASSET_CACHE_SIZE
+#define WEBSERVER_ASSET_CACHE_SIZE 32768
+#endif
+
+//larger files are always streamed from the filesystem
+#ifndef WEBSERVER_ASSET_MAX_FILE_SIZE
+#define WEBSERVER_ASSET_MAX_FILE_SIZE 8192
+#endif
+
+//files a static handler remembers the ETag of
+#ifndef WEBSERVER_ETAG_ENTRIES
+#define WEBSERVER_ETAG_ENTRIES 32
+#endif
+
+//larger files get a weak ETag from their size and modification time instead of a content hash
+#ifndef WEBSERVER_ETAG_HASH_LIMIT
+#define WEBSERVER_ETAG_HASH_LIMIT 65536
+#endif
+
+/*
+ * ASSET :: One static file held in RAM, with its plain and/or precompressed ".gz" body.
+ * Assets are reference counted, the cache holds one reference and every response
+ * streaming from the asset another, so eviction never frees a body in flight.
+ * */
+
+struct AsyncWebAssetBody {
+  uint8_t *data;
+  size_t length;
+  String etag;          // quoted content hash
+  String head;          // response headers built on first use, cleared when the handler settings change
+};
+
+struct AsyncWebAsset {
+  String path;          // filesystem path without ".gz"
+  uint32_t hash;
+  const char *contentType;
+  AsyncWebAssetBody plain;
+  AsyncWebAssetBody gzip;
+  uint32_t lastUsed;
+  uint16_t refs;
+};
+
+/*
+ * ASSET CACHE :: Static files of a handler kept in RAM under a byte budget,
+ * the least recently used asset is evicted when a new one does not fit.
+ * */
+
+class AsyncWebAssetCache {
+  using File = fs::File;
+  using FS = fs::FS;
+  private:
+    std::vector<AsyncWebAsset*> _assets;
+    size_t _budget;
+    size_t _size;
+    uint32_t _tick;
+
+    bool _loadBody(FS& fs, const String& path, AsyncWebAssetBody& body);
+    void _remove(size_t index);
+    void _evict(size_t needed);
+
+  public:
+    AsyncWebAssetCache(size_t budget=WEBSERVER_ASSET_CACHE_SIZE);
+    ~AsyncWebAssetCache();
+
+    void setBudget(size_t budget);
+    size_t budget() const { return _budget; }
+    size_t size() const { return _size; }
+    size_t count() const { return _assets.size(); }
+
+    //reads path and path.gz into RAM, returns NULL if neither exists or fits
+    AsyncWebAsset* load(FS& fs, const String& path);
+    //loads every cacheable file below dir
+    void preload(FS& fs, const String& dir);
+    //marks the asset as most recently used
+    AsyncWebAsset* find(const String& path);
+    void remove(const String& path);
+    void clear();
+    //forgets the prebuilt response headers of all assets
+    void resetHeads();
+
+    static bool cacheable(const String& path);
+    static void retain(AsyncWebAsset *asset){ asset->refs++; }
+    static void release(AsyncWebAsset *asset);
+};
+
+/*
+ * ETAG TABLE :: Content hash ETags of the files a static handler streams from the filesystem.
+ * A tag is recomputed when the size or modification time of the file changes, or after invalidate().
+ * A remembered tag answers a matching conditional request without opening the file, until invalidate()
+ * */
+
+struct AsyncWebFileTag {
+  String path;
+  uint32_t hash;
+  size_t size;
+  time_t lastWrite;
+  uint32_t checked;     // millis() of the last comparison with the file, the oldest is dropped first
+  String etag;
+};
+
+class AsyncWebETagTable {
+  using File = fs::File;
+  private:
+    std::vector<AsyncWebFileTag> _tags;
+
+    int _indexOf(const String& path) const;
+
+  public:
+    //the remembered ETag of path, NULL if there is none
+    const String* find(const String& path) const;
+    //the ETag of the open file, reads the content only when it changed, the file is rewound
+    const String& update(const String& path, File& file);
+    void remove(const String& path);
+    void clear(){ _tags.clear(); }
+
+    //If-None-Match value lists etag (weak comparison, as allowed for GET)
+    static bool matches(const String& ifNoneMatch, const String& etag);
+};
+
+#endif /* ASYNCWEBASSETCACHE_H_ */
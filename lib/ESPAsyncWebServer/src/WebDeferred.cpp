@@ -0,0 +1,112 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "ESPAsyncWebServer.h"
+#include "WebResponseImpl.h"
+
+AsyncWebDeferred::AsyncWebDeferred(AsyncWebServerRequest *request)
+  : _request(request)
+  , _response(NULL)
+  , _started(millis())
+  , _refs(2)
+  , _answered(false)
+{
+#ifdef ESP32
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+}
+
+AsyncWebDeferred::~AsyncWebDeferred(){
+  delete _response;
+}
+
+void AsyncWebDeferred::_release(){
+  _lock();
+  bool last = --_refs == 0;
+  _unlock();
+  if(last)
+    delete this;
+}
+
+bool AsyncWebDeferred::abandoned(){
+  _lock();
+  bool gone = _request == NULL;
+  _unlock();
+  return gone;
+}
+
+void AsyncWebDeferred::send(AsyncWebServerResponse *response){
+  _lock();
+  bool gone = _request == NULL;
+  if(!gone){
+    _response = response;
+    _answered = true;
+  }
+  _unlock();
+  if(gone){
+    delete response;
+    _release();
+    return;
+  }
+#ifdef ESP32
+  //the queued call takes over the reference, if it can not be queued the next poll of the connection delivers
+  if(asyncTcpCall(_s_deliver, this))
+    return;
+#else
+  _deliver();
+#endif
+  _release();
+}
+
+void AsyncWebDeferred::send(int code, const String& contentType, const String& content){
+  send(new AsyncBasicResponse(code, contentType, content));
+}
+
+void AsyncWebDeferred::_s_deliver(void *arg){
+  AsyncWebDeferred *deferred = (AsyncWebDeferred*)arg;
+  deferred->_deliver();
+  deferred->_release();
+}
+
+bool AsyncWebDeferred::_deliver(){
+  _lock();
+  AsyncWebServerRequest *request = _answered ? _request : NULL;
+  AsyncWebServerResponse *response = _response;
+  if(request != NULL){
+    _request = NULL;
+    _response = NULL;
+  }
+  _unlock();
+  if(request == NULL)
+    return false;
+  //drops the reference of the request, a NULL response is answered with 503
+  request->_deferredDone(response);
+  return true;
+}
+
+void AsyncWebDeferred::_detach(){
+  _lock();
+  _request = NULL;
+  AsyncWebServerResponse *response = _response;
+  _response = NULL;
+  _unlock();
+  delete response;
+  _release();
+}
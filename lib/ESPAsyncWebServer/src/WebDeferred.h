@@ -0,0 +1,80 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBDEFERRED_H_
+#define ASYNCWEBDEFERRED_H_
+
+#include "Arduino.h"
+
+//time a deferred request waits for its answer before it is answered with 503 (milliseconds)
+#ifndef WEBSERVER_DEFERRED_TIMEOUT
+#define WEBSERVER_DEFERRED_TIMEOUT 30000
+#endif
+
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+/*
+ * DEFERRED :: Answer to a request that is given later, by another task or a later event.
+ * The request and the code answering it each hold a reference, so either may go first:
+ * an answer for a client that is gone is dropped, and the response is always sent from the TCP task.
+ * */
+
+class AsyncWebDeferred {
+  friend class AsyncWebServerRequest;
+  private:
+    AsyncWebServerRequest *_request;
+    AsyncWebServerResponse *_response;
+    uint32_t _started;
+    uint8_t _refs;
+    bool _answered;
+#ifdef ESP32
+    portMUX_TYPE _mux;
+#endif
+
+    inline void _lock(){
+#ifdef ESP32
+      portENTER_CRITICAL(&_mux);
+#endif
+    }
+    inline void _unlock(){
+#ifdef ESP32
+      portEXIT_CRITICAL(&_mux);
+#endif
+    }
+
+    AsyncWebDeferred(AsyncWebServerRequest *request);
+    ~AsyncWebDeferred();
+    void _release();
+    //called by the request when it goes away
+    void _detach();
+    //on the TCP task, hands a given answer to the request. The request may be gone when this returns true
+    bool _deliver();
+    static void _s_deliver(void *arg);
+
+  public:
+    //true once the client is gone, the work for the answer can be skipped
+    bool abandoned();
+    //answers the request from any task, the handle must not be used afterwards
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String& contentType=String(), const String& content=String());
+};
+
+#endif /* ASYNCWEBDEFERRED_H_ */
@@ -0,0 +1,126 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "WebFieldTable.h"
+
+AsyncWebFieldTable::AsyncWebFieldTable(bool ignoreCase, size_t maxLength, size_t maxFields)
+  : _data(NULL)
+  , _length(0)
+  , _capacity(0)
+  , _maxLength(maxLength)
+  , _fields(NULL)
+  , _count(0)
+  , _fieldCapacity(0)
+  , _maxFields(maxFields)
+  , _ignoreCase(ignoreCase)
+{}
+
+AsyncWebFieldTable::~AsyncWebFieldTable(){
+  free(_data);
+  free(_fields);
+}
+
+void AsyncWebFieldTable::clear(){
+  _length = 0;
+  _count = 0;
+}
+
+//FNV-1a, folded to lower case for header names
+uint32_t AsyncWebFieldTable::hash(const char *s, size_t len, bool ignoreCase, uint32_t h){
+  for(size_t i = 0; i < len; i++){
+    uint8_t c = s[i];
+    if(ignoreCase && c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h = (h ^ c) * 16777619UL;
+  }
+  return h;
+}
+
+bool AsyncWebFieldTable::append(const char *data, size_t len){
+  size_t needed = _length + len;
+  if(needed < _length || needed > _maxLength)
+    return false;
+  if(needed > _capacity){
+    size_t capacity = _capacity ? _capacity : FIELD_TABLE_DATA_CHUNK;
+    while(capacity < needed)
+      capacity *= 2;
+    if(capacity > _maxLength)
+      capacity = _maxLength;
+    char *buffer = (char*)realloc(_data, capacity);
+    if(buffer == NULL)
+      return false;
+    _data = buffer;
+    _capacity = capacity;
+  }
+  memcpy(_data + _length, data, len);
+  _length = needed;
+  return true;
+}
+
+bool AsyncWebFieldTable::addField(size_t name, size_t nameLength, size_t value, size_t valueLength, uint8_t flags, size_t size){
+  if(_count == _maxFields)
+    return false;
+  if(_count == _fieldCapacity){
+    size_t capacity = _fieldCapacity ? _fieldCapacity * 2 : FIELD_TABLE_FIELD_CHUNK;
+    if(capacity > _maxFields)
+      capacity = _maxFields;
+    Field *fields = (Field*)realloc(_fields, capacity * sizeof(Field));
+    if(fields == NULL)
+      return false;
+    _fields = fields;
+    _fieldCapacity = capacity;
+  }
+  Field& f = _fields[_count++];
+  f.hash = hash(_data + name, nameLength, _ignoreCase);
+  f.name = name;
+  f.nameLength = nameLength;
+  f.value = value;
+  f.valueLength = valueLength;
+  f.size = size;
+  f.flags = flags;
+  return true;
+}
+
+bool AsyncWebFieldTable::add(const char *name, size_t nameLength, const char *value, size_t valueLength, uint8_t flags, size_t size){
+  size_t start = _length;
+  if(!append(name, nameLength) || !append('\0') || !append(value, valueLength) || !append('\0')){
+    _length = start;
+    return false;
+  }
+  if(!addField(start, nameLength, start + nameLength + 1, valueLength, flags, size)){
+    _length = start;
+    return false;
+  }
+  return true;
+}
+
+int AsyncWebFieldTable::find(const char *name, uint8_t mask, uint8_t match) const {
+  size_t len = strlen(name);
+  uint32_t h = hash(name, len, _ignoreCase);
+  for(size_t i = 0; i < _count; i++){
+    const Field& f = _fields[i];
+    if(f.hash != h || f.nameLength != len || (f.flags & mask) != match)
+      continue;
+    const char *n = _data + f.name;
+    if(_ignoreCase ? strncasecmp(n, name, len) == 0 : memcmp(n, name, len) == 0)
+      return i;
+  }
+  return -1;
+}
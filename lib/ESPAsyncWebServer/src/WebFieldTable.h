@@ -0,0 +1,95 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBFIELDTABLE_H_
+#define ASYNCWEBFIELDTABLE_H_
+
+#include "Arduino.h"
+
+//first allocation of the data buffer and of the field array
+#ifndef FIELD_TABLE_DATA_CHUNK
+#define FIELD_TABLE_DATA_CHUNK 256
+#endif
+
+#ifndef FIELD_TABLE_FIELD_CHUNK
+#define FIELD_TABLE_FIELD_CHUNK 8
+#endif
+
+/*
+ * FIELD TABLE :: Name/value pairs (headers or parameters) of a request.
+ * All names and values live zero terminated in one buffer, the fields are a contiguous
+ * array of offsets with a precomputed hash of the name, so a lookup compares hashes
+ * and touches the strings only on a hit.
+ * */
+
+class AsyncWebFieldTable {
+  public:
+    struct Field {
+      uint32_t hash;
+      size_t name;          // offsets into the data buffer
+      size_t nameLength;
+      size_t value;
+      size_t valueLength;
+      size_t size;
+      uint8_t flags;
+    };
+
+  private:
+    char *_data;
+    size_t _length;
+    size_t _capacity;
+    size_t _maxLength;
+    Field *_fields;
+    size_t _count;
+    size_t _fieldCapacity;
+    size_t _maxFields;
+    bool _ignoreCase;
+
+  public:
+    AsyncWebFieldTable(bool ignoreCase, size_t maxLength = (size_t)-1, size_t maxFields = (size_t)-1);
+    ~AsyncWebFieldTable();
+    void clear();
+
+    //raw bytes at the end of the buffer, e.g. a field assembled in place by a parser
+    bool append(const char *data, size_t len);
+    bool append(char c){ return append(&c, 1); }
+    void truncate(size_t len){ if(len < _length) _length = len; }
+    size_t length() const { return _length; }
+    char *data() const { return _data; }
+
+    //name and value already in the buffer, both followed by a zero
+    bool addField(size_t name, size_t nameLength, size_t value, size_t valueLength, uint8_t flags = 0, size_t size = 0);
+    //copies name and value into the buffer
+    bool add(const char *name, size_t nameLength, const char *value, size_t valueLength, uint8_t flags = 0, size_t size = 0);
+
+    size_t count() const { return _count; }
+    const Field& field(size_t i) const { return _fields[i]; }
+    const char *name(size_t i) const { return _data + _fields[i].name; }
+    const char *value(size_t i) const { return _data + _fields[i].value; }
+
+    //index of the first field called name with (flags & mask) == match, -1 if there is none
+    int find(const char *name, uint8_t mask = 0, uint8_t match = 0) const;
+
+    //FNV-1a, pass the previous result as h to continue over several chunks. Also the hash of event keys,
+    //WebSocket topics and file ETags
+    static uint32_t hash(const char *s, size_t len, bool ignoreCase, uint32_t h=2166136261UL);
+};
+
+#endif /* ASYNCWEBFIELDTABLE_H_ */
@@ -35,7 +35,12 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
   private:
     bool _getFile(AsyncWebServerRequest *request);
     bool _fileExists(AsyncWebServerRequest *request, const String& path);
+    bool _openFile(AsyncWebServerRequest *request, const String& path);
     uint8_t _countBits(const uint8_t value) const;
+    bool _isNotModified(AsyncWebServerRequest *request, const String& path) const;
+    void _sendNotModified(AsyncWebServerRequest *request, const String& etag);
+    void _sendAsset(AsyncWebServerRequest *request, AsyncWebAsset *asset);
+    String _assetHead(const AsyncWebAsset *asset, bool gzip) const;
   protected:
     FS _fs;
     String _uri;
@@ -47,6 +52,9 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     bool _isDir;
     bool _gzipFirst;
     uint8_t _gzipStats;
+    AsyncWebAssetCache _cache;
+    bool _preloaded;      // the cache was filled from _path, done on the first request
+    AsyncWebETagTable _etags;
   public:
     AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control);
     virtual bool canHandle(AsyncWebServerRequest *request) override final;
@@ -61,6 +69,12 @@ class AsyncStaticWebHandler: public AsyncWebHandler {
     AsyncStaticWebHandler& setLastModified(); //sets to current time. Make sure sntp is runing and time is updated
   #endif
     AsyncStaticWebHandler& setTemplateProcessor(AwsTemplateProcessor newCallback) {_callback = newCallback; return *this;}
+    AsyncStaticWebHandler& setCacheSize(size_t bytes); //RAM for small files, 0 always reads the filesystem
+    AsyncStaticWebHandler& invalidate(const char* path=nullptr); //forget a changed file (or all), in RAM and its ETag
+
+    virtual WebRouteKind routeKind() const override final { return ROUTE_PREFIX; }
+    virtual String routeUri() const override final { return _uri; }
+    virtual WebRequestMethodComposite routeMethods() const override final { return HTTP_GET; }
 };
 
 class AsyncCallbackWebHandler: public AsyncWebHandler {
@@ -72,13 +86,17 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
     ArUploadHandlerFunction _onUpload;
     ArBodyHandlerFunction _onBody;
     bool _isRegex;
+    bool _hasPathParams;
+    bool _matchPath(AsyncWebServerRequest *request) const;
   public:
-    AsyncCallbackWebHandler() : _uri(), _method(HTTP_ANY), _onRequest(NULL), _onUpload(NULL), _onBody(NULL), _isRegex(false) {}
+    AsyncCallbackWebHandler() : _uri(), _method(HTTP_ANY), _onRequest(NULL), _onUpload(NULL), _onBody(NULL), _isRegex(false), _hasPathParams(false) {}
     void setUri(const String& uri){ 
       _uri = uri; 
       _isRegex = uri.startsWith("^") && uri.endsWith("$");
+      _hasPathParams = uri.indexOf("/{") >= 0;
+      invalidateRoutes();
     }
-    void setMethod(WebRequestMethodComposite method){ _method = method; }
+    void setMethod(WebRequestMethodComposite method){ _method = method; invalidateRoutes(); }
     void onRequest(ArRequestHandlerFunction fn){ _onRequest = fn; }
     void onUpload(ArUploadHandlerFunction fn){ _onUpload = fn; }
     void onBody(ArBodyHandlerFunction fn){ _onBody = fn; }
@@ -118,12 +136,38 @@ class AsyncCallbackWebHandler: public AsyncWebHandler {
         if (!request->url().startsWith(uriTemplate))
           return false;
       }
-      else if(_uri.length() && (_uri != request->url() && !request->url().startsWith(_uri+"/")))
+      else if(_uri.length() && !_matchPath(request))
         return false;
 
       request->addInterestingHeader("ANY");
       return true;
     }
+
+    virtual WebRouteKind routeKind() const override final {
+      if(_isRegex)
+        return ROUTE_OPAQUE;
+      if(_uri.startsWith("/*."))
+        return ROUTE_EXTENSION;
+      if(_uri.endsWith("*"))
+        return ROUTE_PREFIX;
+      return ROUTE_PATH;
+    }
+    virtual String routeUri() const override final {
+      if(_uri.startsWith("/*."))
+        return _uri.substring(_uri.lastIndexOf("."));
+      if(_uri.endsWith("*"))
+        return _uri.substring(0, _uri.length() - 1);
+      return _uri;
+    }
+    virtual WebRequestMethodComposite routeMethods() const override final { return _method; }
+
+    //url, method and path arguments were already matched by the route table
+    virtual bool canHandleRoute(AsyncWebServerRequest *request) override final{
+      if(!_onRequest)
+        return false;
+      request->addInterestingHeader("ANY");
+      return true;
+    }
   
     virtual void handleRequest(AsyncWebServerRequest *request) override final {
       if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
@@ -21,6 +21,49 @@
 #include "ESPAsyncWebServer.h"
 #include "WebHandlerImpl.h"
 
+bool AsyncCallbackWebHandler::_matchPath(AsyncWebServerRequest *request) const {
+  const String& url = request->url();
+  if(!_hasPathParams){
+    // The uri itself or anything below it
+    return url.startsWith(_uri) && (url.length() == _uri.length() || url[_uri.length()] == '/');
+  }
+
+  // Same rules as the route table: a whole "{name}" segment captures one url segment
+  const char* t = _uri.c_str();
+  const char* u = url.c_str();
+  const char* start[ROUTE_MAX_PARAMS];
+  size_t length[ROUTE_MAX_PARAMS];
+  uint8_t params = 0;
+  while(*t){
+    if(*t == '{' && t != _uri.c_str() && t[-1] == '/' && params < ROUTE_MAX_PARAMS){
+      const char* close = t;
+      while(*close && *close != '/') close++;
+      if(AsyncWebRouteTable::isParamSegment(t, close - t)){
+        const char* end = u;
+        while(*end && *end != '/') end++;
+        if(end == u)
+          return false;
+        start[params] = u;
+        length[params] = end - u;
+        params++;
+        t = close;
+        u = end;
+        continue;
+      }
+    }
+    if(*t != *u)
+      return false;
+    t++;
+    u++;
+  }
+  if(*u && *u != '/')
+    return false;
+
+  for(uint8_t i = 0; i < params; i++)
+    request->_addPathParam(start[i], length[i]);
+  return true;
+}
+
 AsyncStaticWebHandler::AsyncStaticWebHandler(const char* uri, FS& fs, const char* path, const char* cache_control)
   : _fs(fs), _uri(uri), _path(path), _default_file("index.htm"), _cache_control(cache_control), _last_modified(""), _callback(nullptr)
 {
@@ -40,6 +83,9 @@ AsyncStaticWebHandler::AsyncStaticWebHandler(const char* uri, FS& fs, const char
   // Reset stats
   _gzipFirst = false;
   _gzipStats = 0xF8;
+
+  // Small files are read into RAM on the first request, after the setters have run, so a budget of 0 reads nothing
+  _preloaded = false;
 }
 
 AsyncStaticWebHandler& AsyncStaticWebHandler::setIsDir(bool isDir){
@@ -54,11 +100,13 @@ AsyncStaticWebHandler& AsyncStaticWebHandler::setDefaultFile(const char* filenam
 
 AsyncStaticWebHandler& AsyncStaticWebHandler::setCacheControl(const char* cache_control){
   _cache_control = String(cache_control);
+  _cache.resetHeads();
   return *this;
 }
 
 AsyncStaticWebHandler& AsyncStaticWebHandler::setLastModified(const char* last_modified){
   _last_modified = String(last_modified);
+  _cache.resetHeads();
   return *this;
 }
 
@@ -80,6 +128,26 @@ AsyncStaticWebHandler& AsyncStaticWebHandler::setLastModified(){
   return setLastModified(last_modified);
 }
 #endif
+
+AsyncStaticWebHandler& AsyncStaticWebHandler::setCacheSize(size_t bytes){
+  bool grow = bytes > _cache.budget();
+  _cache.setBudget(bytes);
+  if (grow && _preloaded)
+    _cache.preload(_fs, _path);
+  return *this;
+}
+
+AsyncStaticWebHandler& AsyncStaticWebHandler::invalidate(const char* path){
+  if (path) {
+    _cache.remove(String(path));
+    _etags.remove(String(path));
+  } else {
+    _cache.clear();
+    _etags.clear();
+  }
+  return *this;
+}
+
 bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request){
   if(request->method() != HTTP_GET 
     || !request->url().startsWith(_uri) 
@@ -87,14 +155,11 @@ bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request){
   ){
     return false;
   }
+  if (!_preloaded) {
+    _preloaded = true;
+    _cache.preload(_fs, _path);
+  }
   if (_getFile(request)) {
-    // We interested in "If-Modified-Since" header to check if file was modified
-    if (_last_modified.length())
-      request->addInterestingHeader("If-Modified-Since");
-
-    if(_cache_control.length())
-      request->addInterestingHeader("If-None-Match");
-
     DEBUGF("[AsyncStaticWebHandler::canHandle] TRUE\n");
     return true;
   }
@@ -135,6 +200,25 @@ bool AsyncStaticWebHandler::_getFile(AsyncWebServerRequest *request)
 #endif
 
 bool AsyncStaticWebHandler::_fileExists(AsyncWebServerRequest *request, const String& path)
+{
+  // A cached file is served from RAM and a known ETag answers a conditional request,
+  // templates are processed from the file every time
+  bool found = !_callback && (_cache.find(path) || _isNotModified(request, path));
+  if (!found)
+    found = _openFile(request, path);
+
+  if (found) {
+    // Extract the file name from the path and keep it in _tempObject
+    size_t pathLen = path.length();
+    char * _tempPath = (char*)malloc(pathLen+1);
+    snprintf(_tempPath, pathLen+1, "%s", path.c_str());
+    request->_tempObject = (void*)_tempPath;
+  }
+
+  return found;
+}
+
+bool AsyncStaticWebHandler::_openFile(AsyncWebServerRequest *request, const String& path)
 {
   bool fileFound = false;
   bool gzipFound = false;
@@ -160,12 +244,6 @@ bool AsyncStaticWebHandler::_fileExists(AsyncWebServerRequest *request, const St
   bool found = fileFound || gzipFound;
 
   if (found) {
-    // Extract the file name from the path and keep it in _tempObject
-    size_t pathLen = path.length();
-    char * _tempPath = (char*)malloc(pathLen+1);
-    snprintf(_tempPath, pathLen+1, "%s", path.c_str());
-    request->_tempObject = (void*)_tempPath;
-
     // Calculate gzip statistic
     _gzipStats = (_gzipStats << 1) + (gzipFound ? 1 : 0);
     if (_gzipStats == 0x00) _gzipFirst = false; // All files are not gzip
@@ -176,6 +254,14 @@ bool AsyncStaticWebHandler::_fileExists(AsyncWebServerRequest *request, const St
   return found;
 }
 
+bool AsyncStaticWebHandler::_isNotModified(AsyncWebServerRequest *request, const String& path) const
+{
+  if (!request->hasHeader("If-None-Match"))
+    return false;
+  const String* etag = _etags.find(path);
+  return etag && AsyncWebETagTable::matches(request->header("If-None-Match"), *etag);
+}
+
 uint8_t AsyncStaticWebHandler::_countBits(const uint8_t value) const
 {
   uint8_t w = value;
@@ -184,6 +270,50 @@ uint8_t AsyncStaticWebHandler::_countBits(const uint8_t value) const
   return n;
 }
 
+String AsyncStaticWebHandler::_assetHead(const AsyncWebAsset *asset, bool gzip) const
+{
+  const AsyncWebAssetBody& body = gzip ? asset->gzip : asset->plain;
+  String head;
+  if (gzip)
+    head += "Content-Encoding: gzip\r\n";
+  if (asset->plain.data && asset->gzip.data)
+    head += "Vary: Accept-Encoding\r\n";
+  head += "Content-Disposition: inline; filename=\"";
+  head += asset->path.substring(asset->path.lastIndexOf('/') + 1);
+  head += "\"\r\n";
+  if (_last_modified.length())
+    head += "Last-Modified: " + _last_modified + "\r\n";
+  if (_cache_control.length())
+    head += "Cache-Control: " + _cache_control + "\r\n";
+  head += "ETag: " + body.etag + "\r\n";
+  return head;
+}
+
+void AsyncStaticWebHandler::_sendAsset(AsyncWebServerRequest *request, AsyncWebAsset *asset)
+{
+  bool gzip = asset->gzip.data && (!asset->plain.data || request->header("Accept-Encoding").indexOf("gzip") >= 0);
+  AsyncWebAssetBody& body = gzip ? asset->gzip : asset->plain;
+  if (!body.head.length())
+    body.head = _assetHead(asset, gzip);
+
+  if (_last_modified.length() && _last_modified == request->header("If-Modified-Since")) {
+    request->send(304); // Not modified
+  } else if (AsyncWebETagTable::matches(request->header("If-None-Match"), body.etag)) {
+    _sendNotModified(request, body.etag);
+  } else {
+    request->send(new AsyncAssetResponse(asset, gzip));
+  }
+}
+
+void AsyncStaticWebHandler::_sendNotModified(AsyncWebServerRequest *request, const String& etag)
+{
+  AsyncWebServerResponse * response = new AsyncBasicResponse(304); // Not modified
+  if (_cache_control.length())
+    response->addHeader("Cache-Control", _cache_control);
+  response->addHeader("ETag", etag);
+  request->send(response);
+}
+
 void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
 {
   // Get the filename from request->_tempObject and free it
@@ -193,25 +323,46 @@ void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request)
   if((_username != "" && _password != "") && !request->authenticate(_username.c_str(), _password.c_str()))
       return request->requestAuthentication();
 
+  if (!_callback) {
+    // canHandle opened no file, the asset is in RAM or the client has the current version
+    if (request->_tempFile == false) {
+      AsyncWebAsset * asset = _cache.find(filename);
+      if (asset)
+        return _sendAsset(request, asset);
+      if (_isNotModified(request, filename)) {
+        _sendNotModified(request, *_etags.find(filename));
+        return;
+      }
+      // Evicted or invalidated meanwhile
+      _openFile(request, filename);
+    }
+    if (request->_tempFile == true && _cache.budget() && request->_tempFile.size() <= WEBSERVER_ASSET_MAX_FILE_SIZE && AsyncWebAssetCache::cacheable(filename)) {
+      AsyncWebAsset * asset = _cache.load(_fs, filename);
+      if (asset) {
+        request->_tempFile.close();
+        return _sendAsset(request, asset);
+      }
+    }
+  }
+
   if (request->_tempFile == true) {
-    String etag = String(request->_tempFile.size());
+    // Content hash of the file, only read again when its size or modification time changed.
+    // Template output differs from the file, so it gets no ETag
+    String etag = _callback ? String() : _etags.update(filename, request->_tempFile);
     if (_last_modified.length() && _last_modified == request->header("If-Modified-Since")) {
       request->_tempFile.close();
       request->send(304); // Not modified
-    } else if (_cache_control.length() && request->hasHeader("If-None-Match") && request->header("If-None-Match").equals(etag)) {
+    } else if (etag.length() && AsyncWebETagTable::matches(request->header("If-None-Match"), etag)) {
       request->_tempFile.close();
-      AsyncWebServerResponse * response = new AsyncBasicResponse(304); // Not modified
-      response->addHeader("Cache-Control", _cache_control);
-      response->addHeader("ETag", etag);
-      request->send(response);
+      _sendNotModified(request, etag);
     } else {
       AsyncWebServerResponse * response = new AsyncFileResponse(request->_tempFile, filename, String(), false, _callback);
       if (_last_modified.length())
         response->addHeader("Last-Modified", _last_modified);
-      if (_cache_control.length()){
+      if (_cache_control.length())
         response->addHeader("Cache-Control", _cache_control);
+      if (etag.length())
         response->addHeader("ETag", etag);
-      }
       request->send(response);
     }
   } else {
@@ -0,0 +1,49 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "WebMetrics.h"
+
+const uint32_t AsyncWebMetrics::bucketUs[WEBSERVER_METRICS_BUCKETS] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000
+};
+
+const char* const AsyncWebMetrics::bucketLabel[WEBSERVER_METRICS_BUCKETS] = {
+  "0.001", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "5"
+};
+
+AsyncWebMetrics::AsyncWebMetrics()
+  : requests(0)
+  , bytesIn(0)
+  , bytesOut(0)
+  , latencySumUs(0)
+{
+  memset(latency, 0, sizeof(latency));
+}
+
+void AsyncWebMetrics::record(uint32_t us, size_t in, size_t out){
+  requests++;
+  bytesIn += in;
+  bytesOut += out;
+  latencySumUs += us;
+  uint8_t bucket = 0;
+  while(bucket < WEBSERVER_METRICS_BUCKETS && us > bucketUs[bucket])
+    bucket++;
+  latency[bucket]++;
+}
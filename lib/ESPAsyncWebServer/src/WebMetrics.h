@@ -0,0 +1,56 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBMETRICS_H_
+#define ASYNCWEBMETRICS_H_
+
+#include "Arduino.h"
+
+//per handler request counts, bytes and latency histograms, printed by AsyncWebServer::printMetrics()
+#ifndef WEBSERVER_METRICS
+#define WEBSERVER_METRICS 1
+#endif
+
+#define WEBSERVER_METRICS_BUCKETS 10
+
+/*
+ * METRICS :: Counters of one handler. Requests are only handled on the TCP task, which is the
+ * only writer, so counting takes no lock: a few additions and a short bucket search per request.
+ * Counters wrap around like any Prometheus counter after a restart.
+ * */
+
+class AsyncWebMetrics {
+  public:
+    //upper bounds of the latency buckets in microseconds, the last bucket is +Inf
+    static const uint32_t bucketUs[WEBSERVER_METRICS_BUCKETS];
+    static const char* const bucketLabel[WEBSERVER_METRICS_BUCKETS];
+
+    uint32_t requests;
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+    uint32_t latency[WEBSERVER_METRICS_BUCKETS + 1];  // not cumulative, summed up when printed
+    uint64_t latencySumUs;
+
+    AsyncWebMetrics();
+    //latency from the first byte of the request to the last acknowledged byte of the response
+    void record(uint32_t us, size_t in, size_t out);
+};
+
+#endif /* ASYNCWEBMETRICS_H_ */
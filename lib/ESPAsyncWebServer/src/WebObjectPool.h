@@ -0,0 +1,171 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBOBJECTPOOL_H_
+#define ASYNCWEBOBJECTPOOL_H_
+
+#include "Arduino.h"
+
+/*
+ * OBJECT POOL :: Fixed number of equally sized slots in static memory.
+ * Requests and responses come from here instead of the heap, so weeks of connections
+ * do not fragment it, and running out is a counted, checked condition.
+ * */
+
+template<size_t SIZE, size_t COUNT>
+class AsyncWebObjectPool {
+  private:
+    union Slot {
+      Slot *next;
+      uint8_t data[SIZE];
+      uint64_t align;
+    };
+    Slot _slots[COUNT];
+    Slot *_free;
+    uint16_t _used;
+    uint16_t _peak;
+    uint32_t _failed;
+#ifdef ESP32
+    portMUX_TYPE _mux;
+#endif
+
+    inline void _lock(){
+#ifdef ESP32
+      portENTER_CRITICAL(&_mux);
+#endif
+    }
+    inline void _unlock(){
+#ifdef ESP32
+      portEXIT_CRITICAL(&_mux);
+#endif
+    }
+
+  public:
+    AsyncWebObjectPool()
+      : _free(NULL)
+      , _used(0)
+      , _peak(0)
+      , _failed(0)
+    {
+#ifdef ESP32
+      _mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+      for(size_t i = COUNT; i > 0; i--){
+        _slots[i - 1].next = _free;
+        _free = &_slots[i - 1];
+      }
+    }
+
+    //NULL when all slots are taken or the object is larger than a slot
+    void *alloc(size_t size){
+      void *p = NULL;
+      _lock();
+      if(size <= SIZE && _free){
+        p = _free;
+        _free = _free->next;
+        if(++_used > _peak)
+          _peak = _used;
+      } else {
+        _failed++;
+      }
+      _unlock();
+      return p;
+    }
+
+    bool owns(const void *p) const {
+      return p >= (const void*)_slots && p < (const void*)(_slots + COUNT);
+    }
+
+    void release(void *p){
+      _lock();
+      Slot *s = (Slot*)p;
+      s->next = _free;
+      _free = s;
+      _used--;
+      _unlock();
+    }
+
+    size_t used() const { return _used; }
+    size_t peak() const { return _peak; }
+    size_t capacity() const { return COUNT; }
+    uint32_t failed() const { return _failed; }
+};
+
+/*
+ * ARENA :: Bump allocator for the objects of one request, its first block is part of the request.
+ * Nothing is freed on its own, reset() drops everything at once when the request completes.
+ * */
+
+template<size_t SIZE>
+class AsyncWebArena {
+  private:
+    struct Block {
+      Block *next;
+      size_t size;
+    };
+    uint64_t _inline[(SIZE + 7) / 8];
+    size_t _used;
+    Block *_blocks;       // overflow blocks, newest first
+    size_t _blockUsed;
+
+    static size_t _align(size_t size){ return (size + 7) & ~(size_t)7; }
+
+  public:
+    AsyncWebArena()
+      : _used(0)
+      , _blocks(NULL)
+      , _blockUsed(0)
+    {}
+    ~AsyncWebArena(){ reset(); }
+
+    void *alloc(size_t size){
+      size = _align(size);
+      if(_used + size <= sizeof(_inline)){
+        void *p = (uint8_t*)_inline + _used;
+        _used += size;
+        return p;
+      }
+      if(_blocks == NULL || _blockUsed + size > _blocks->size){
+        size_t blockSize = size > SIZE ? size : SIZE;
+        Block *b = (Block*)malloc(_align(sizeof(Block)) + blockSize);
+        if(b == NULL)
+          return NULL;
+        b->next = _blocks;
+        b->size = blockSize;
+        _blocks = b;
+        _blockUsed = 0;
+      }
+      void *p = (uint8_t*)_blocks + _align(sizeof(Block)) + _blockUsed;
+      _blockUsed += size;
+      return p;
+    }
+
+    void reset(){
+      while(_blocks){
+        Block *b = _blocks;
+        _blocks = b->next;
+        free(b);
+      }
+      _used = 0;
+      _blockUsed = 0;
+    }
+};
+
+#endif /* ASYNCWEBOBJECTPOOL_H_ */
@@ -21,6 +21,7 @@
 #include "ESPAsyncWebServer.h"
 #include "WebResponseImpl.h"
 #include "WebAuthentication.h"
+#include <new>
 
 #ifndef ESP8266
 #define os_strlen strlen
@@ -32,13 +33,77 @@ static const String SharedEmptyString = String();
 
 enum { PARSE_REQ_START, PARSE_REQ_HEADERS, PARSE_REQ_BODY, PARSE_REQ_END, PARSE_REQ_FAIL };
 
+enum { PARAM_POST = 1, PARAM_FILE = 2 };
+
+enum { HEAD_METHOD, HEAD_URL, HEAD_VERSION, HEAD_LINE_START, HEAD_NAME, HEAD_VALUE_START, HEAD_VALUE, HEAD_SKIP_LINE };
+
+static AsyncWebObjectPool<sizeof(AsyncWebServerRequest), WEBSERVER_MAX_REQUESTS> requestPool;
+//created and deleted on the async_tcp task only
+static AsyncWebServerRequest *requestList = NULL;
+
+//sent when there is no memory for a request or its response
+static const char serviceUnavailable[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+void *AsyncWebServerRequest::operator new(size_t size) noexcept {
+  return requestPool.alloc(size);
+}
+
+void AsyncWebServerRequest::operator delete(void *p){
+  if(p)
+    requestPool.release(p);
+}
+
+void AsyncWebServerRequest::_poolStats(AsyncWebPoolStats& stats){
+  stats.requests = requestPool.used();
+  stats.requestsPeak = requestPool.peak();
+  stats.requestsMax = requestPool.capacity();
+  stats.requestsRefused = requestPool.failed();
+}
+
+//a persistent connection waiting for its next request
+bool AsyncWebServerRequest::_idle() const {
+  return _requestCount && _response == NULL && _parseState < PARSE_REQ_BODY;
+}
+
+//frees a slot of a full pool by closing the connection that has been idle longest, false if none is idle
+bool AsyncWebServerRequest::_closeIdle(){
+  if(requestPool.used() < requestPool.capacity())
+    return true;
+  AsyncWebServerRequest *oldest = NULL;
+  for(AsyncWebServerRequest *r = requestList; r != NULL; r = r->_nextRequest){
+    if(r->_idle() && (oldest == NULL || (int32_t)(r->_idleSince - oldest->_idleSince) < 0))
+      oldest = r;
+  }
+  if(oldest == NULL)
+    return false;
+  //closing deletes the request
+  oldest->_client->close(true);
+  return requestPool.used() < requestPool.capacity();
+}
+
+//answers a connection that got no request object, the client is deleted once closed
+void AsyncWebServerRequest::_refuse(AsyncClient *c){
+  c->onDisconnect([](void *r, AsyncClient* c){ (void)r; delete c; }, NULL);
+  c->write(serviceUnavailable, sizeof(serviceUnavailable) - 1);
+  c->close();
+}
+
 AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   : _client(c)
   , _server(s)
   , _handler(NULL)
   , _response(NULL)
+  , _deferred(NULL)
+  , _destroyed(NULL)
+  , _metricsPending(false)
+  , _metricsStart(0)
+  , _metricsIn(0)
   , _temp()
   , _parseState(0)
+  , _headState(0)
+  , _tokenStart(0)
+  , _nameStart(0)
+  , _nameLength(0)
   , _version(0)
   , _method(HTTP_ANY)
   , _url()
@@ -51,10 +116,21 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _isMultipart(false)
   , _isPlainPost(false)
   , _expectingContinue(false)
+  , _unframedBody(false)
   , _contentLength(0)
   , _parsedLength(0)
-  , _headers(LinkedList<AsyncWebHeader *>([](AsyncWebHeader *h){ delete h; }))
-  , _params(LinkedList<AsyncWebParameter *>([](AsyncWebParameter *p){ delete p; }))
+  , _keepAlive(false)
+  , _requestCount(0)
+  , _idleSince(0)
+  , _nextRequest(requestList)
+  , _pipeline(NULL)
+  , _pipelineLength(0)
+  , _headers(true, WEBSERVER_MAX_HEAD_SIZE, WEBSERVER_MAX_HEADERS)
+  , _params(false)
+  , _headerObjects(NULL)
+  , _headerObjectSlots(0)
+  , _paramObjects(NULL)
+  , _paramObjectSlots(0)
   , _pathParams(LinkedList<String *>([](String *p){ delete p; }))
   , _multiParseState(0)
   , _boundaryPosition(0)
@@ -69,6 +145,7 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
   , _itemIsFile(false)
   , _tempObject(NULL)
 {
+  requestList = this;
   c->onError([](void *r, AsyncClient* c, int8_t error){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onError(error); }, this);
   c->onAck([](void *r, AsyncClient* c, size_t len, uint32_t time){ (void)c; AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onAck(len, time); }, this);
   c->onDisconnect([](void *r, AsyncClient* c){ AsyncWebServerRequest *req = (AsyncWebServerRequest*)r; req->_onDisconnect(); delete c; }, this);
@@ -78,12 +155,24 @@ AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* s, AsyncClient* c)
 }
 
 AsyncWebServerRequest::~AsyncWebServerRequest(){
-  _headers.free();
+  if(_destroyed != NULL)
+    *_destroyed = true;
+  for(AsyncWebServerRequest **r = &requestList; *r != NULL; r = &(*r)->_nextRequest){
+    if(*r == this){
+      *r = _nextRequest;
+      break;
+    }
+  }
+  //an answer still to come is dropped when it arrives
+  if(_deferred != NULL)
+    _deferred->_detach();
+  //a response that closes the connection deletes the request right when it ends
+  _recordMetrics();
 
-  _params.free();
+  _releaseObjects();
   _pathParams.free();
 
-  _interestingHeaders.free();
+  free(_pipeline);
 
   if(_response != NULL){
     delete _response;
@@ -99,111 +188,468 @@ AsyncWebServerRequest::~AsyncWebServerRequest(){
 }
 
 void AsyncWebServerRequest::_onData(void *buf, size_t len){
-  size_t i = 0;
-  while (true) {
-
+  uint8_t *data = (uint8_t*)buf;
+  if(_parseState == PARSE_REQ_END && _response != NULL && _response->_finished() && !_responseDone())
+    return;
+#if WEBSERVER_METRICS
+  if(!_metricsPending && _parseState == PARSE_REQ_START && len){
+    _metricsPending = true;
+    _metricsStart = micros();
+    _metricsIn = 0;
+  }
+#endif
   if(_parseState < PARSE_REQ_BODY){
-    // Find new line in buf
-    char *str = (char*)buf;
-    for (i = 0; i < len; i++) {
-      if (str[i] == '\n') {
-        break;
-      }
+    size_t used = _parseHead(data, len);
+    data += used;
+    len -= used;
+    _metricsIn += used;
+  }
+  if(_parseState == PARSE_REQ_BODY && len){
+    //bytes after Content-Length are not part of this body
+    size_t remaining = _contentLength - _parsedLength;
+    size_t used = len < remaining ? len : remaining;
+    _parseBody(data, used);
+    data += used;
+    len -= used;
+    _metricsIn += used;
+  }
+  //the next requests of a persistent connection wait until this response is sent
+  if(_parseState == PARSE_REQ_END && _keepAlive && len)
+    _pipelineAppend(data, len);
+}
+
+void AsyncWebServerRequest::_pipelineAppend(const uint8_t *data, size_t len){
+  uint8_t *pipeline = NULL;
+  if(_pipelineLength + len <= WEBSERVER_MAX_PIPELINE_SIZE)
+    pipeline = (uint8_t*)realloc(_pipeline, _pipelineLength + len);
+  if(pipeline == NULL){
+    //the connection closes after this response, the client repeats what was not answered
+    _keepAlive = false;
+    return;
+  }
+  memcpy(pipeline + _pipelineLength, data, len);
+  _pipeline = pipeline;
+  _pipelineLength += len;
+}
+
+void AsyncWebServerRequest::_recordMetrics(){
+  if(!_metricsPending)
+    return;
+  _metricsPending = false;
+  //requests without a handler failed to parse or were closed before they were complete
+  AsyncWebMetrics& metrics = (_handler != NULL) ? _handler->metrics() : _server->_badRequestMetrics();
+  metrics.record(micros() - _metricsStart, _metricsIn, (_response != NULL) ? _response->_written() : 0);
+}
+
+//false when the connection closed, which deletes this request
+bool AsyncWebServerRequest::_responseDone(){
+  AsyncWebServerResponse* r = _response;
+  _response = NULL;
+  bool reuse = _keepAlive && !r->_failed();
+  delete r;
+  if(!reuse){
+    //the response may have said keep-alive before the pipeline overflowed, the client would wait
+    _client->close();
+    return false;
+  }
+
+  _reset();
+  if(_pipelineLength){
+    uint8_t *data = _pipeline;
+    size_t len = _pipelineLength;
+    _pipeline = NULL;
+    _pipelineLength = 0;
+    //answering the next request may close the connection as well
+    bool destroyed = false;
+    bool *outer = _destroyed;
+    _destroyed = &destroyed;
+    _onData(data, len);
+    free(data);
+    if(destroyed){
+      if(outer != NULL)
+        *outer = true;
+      return false;
     }
-    if (i == len) { // No new line, just add the buffer in _temp
-      char ch = str[len-1];
-      str[len-1] = 0;
-      _temp.reserve(_temp.length()+len);
-      _temp.concat(str);
-      _temp.concat(ch);
-    } else { // Found new line - extract it and parse
-      str[i] = 0; // Terminate the string at the end of the line.
-      _temp.concat(str);
-      _temp.trim();
-      _parseLine();
-      if (++i < len) {
-        // Still have more buffer to process
-        buf = str+i;
-        len-= i;
-        continue;
+    _destroyed = outer;
+  }
+  return true;
+}
+
+void AsyncWebServerRequest::_reset(){
+  _onDisconnectfn = nullptr;
+  _handler = NULL;
+  _temp = String();
+  _parseState = PARSE_REQ_START;
+  _headState = HEAD_METHOD;
+  _tokenStart = 0;
+  _nameStart = 0;
+  _nameLength = 0;
+  _version = 0;
+  _method = HTTP_ANY;
+  _url = String();
+  _host = String();
+  _contentType = String();
+  _boundary = String();
+  _authorization = String();
+  _reqconntype = RCT_HTTP;
+  _isDigest = false;
+  _isMultipart = false;
+  _isPlainPost = false;
+  _expectingContinue = false;
+  _unframedBody = false;
+  _contentLength = 0;
+  _parsedLength = 0;
+  _keepAlive = false;
+  _requestCount++;
+  _idleSince = millis();
+
+  _releaseObjects();
+  _headers.clear();
+  _params.clear();
+  _pathParams.free();
+
+  _multiParseState = 0;
+  _boundaryPosition = 0;
+  _itemStartIndex = 0;
+  _itemSize = 0;
+  _itemName = String();
+  _itemFilename = String();
+  _itemType = String();
+  _itemValue = String();
+  if(_itemBuffer){
+    free(_itemBuffer);
+    _itemBuffer = NULL;
+  }
+  _itemBufferIndex = 0;
+  _itemIsFile = false;
+
+  if(_tempFile){
+    _tempFile.close();
+  }
+  if(_tempObject != NULL){
+    free(_tempObject);
+    _tempObject = NULL;
+  }
+}
+
+//the objects only need their destructors, the arena memory goes in one step
+void AsyncWebServerRequest::_releaseObjects(){
+  for(size_t i = 0; i < _headerObjectSlots; i++)
+    if(_headerObjects[i])
+      _headerObjects[i]->~AsyncWebHeader();
+  for(size_t i = 0; i < _paramObjectSlots; i++)
+    if(_paramObjects[i])
+      _paramObjects[i]->~AsyncWebParameter();
+  _headerObjects = NULL;
+  _headerObjectSlots = 0;
+  _paramObjects = NULL;
+  _paramObjectSlots = 0;
+  _arena.reset();
+}
+
+void AsyncWebServerRequest::_parseBody(uint8_t *buf, size_t len){
+  // A handler should be already attached at this point in _endOfHead function.
+  // If handler does nothing (_onRequest is NULL), we don't need to really parse the body.
+  const bool needParse = _handler && !_handler->isRequestHandlerTrivial();
+  if(_isMultipart){
+    if(needParse){
+      size_t i;
+      for(i=0; i<len; i++){
+        _parseMultipartPostByte(buf[i], i == len - 1);
+        _parsedLength++;
       }
-    }
-  } else if(_parseState == PARSE_REQ_BODY){
-    // A handler should be already attached at this point in _parseLine function.
-    // If handler does nothing (_onRequest is NULL), we don't need to really parse the body.
-    const bool needParse = _handler && !_handler->isRequestHandlerTrivial();
-    if(_isMultipart){
-      if(needParse){
-        size_t i;
-        for(i=0; i<len; i++){
-          _parseMultipartPostByte(((uint8_t*)buf)[i], i == len - 1);
-          _parsedLength++;
-        }
-      } else
-          _parsedLength += len;
-    } else {
-      if(_parsedLength == 0){
-        if(_contentType.startsWith("application/x-www-form-urlencoded")){
+    } else
+        _parsedLength += len;
+  } else {
+    if(_parsedLength == 0){
+      if(_contentType.startsWith("application/x-www-form-urlencoded")){
+        _isPlainPost = true;
+      } else if(_contentType == "text/plain" && __is_param_char(((char*)buf)[0])){
+        size_t i = 0;
+        while (i<len && __is_param_char(((char*)buf)[i++]));
+        if(i < len && ((char*)buf)[i-1] == '='){
           _isPlainPost = true;
-        } else if(_contentType == "text/plain" && __is_param_char(((char*)buf)[0])){
-          size_t i = 0;
-          while (i<len && __is_param_char(((char*)buf)[i++]));
-          if(i < len && ((char*)buf)[i-1] == '='){
-            _isPlainPost = true;
-          }
         }
       }
-      if(!_isPlainPost) {
-        //check if authenticated before calling the body
-        if(_handler) _handler->handleBody(this, (uint8_t*)buf, len, _parsedLength, _contentLength);
-        _parsedLength += len;
-      } else if(needParse) {
-        size_t i;
-        for(i=0; i<len; i++){
-          _parsedLength++;
-          _parsePlainPostChar(((uint8_t*)buf)[i]);
-        }
-      } else {
-        _parsedLength += len;
+    }
+    if(!_isPlainPost) {
+      //check if authenticated before calling the body
+      if(_handler) _handler->handleBody(this, buf, len, _parsedLength, _contentLength);
+      _parsedLength += len;
+    } else if(needParse) {
+      size_t i;
+      for(i=0; i<len; i++){
+        _parsedLength++;
+        _parsePlainPostChar(buf[i]);
+      }
+    } else {
+      _parsedLength += len;
+    }
+  }
+  if(_parsedLength == _contentLength){
+    _parseState = PARSE_REQ_END;
+    //check if authenticated before calling handleRequest and request auth instead
+    if(_handler) _handler->handleRequest(this);
+    else send(501);
+  }
+}
+
+/*
+ * HEAD PARSER :: Byte level state machine over the request line and headers.
+ * It resumes wherever the previous packet ended, tokens are copied once (zero terminated)
+ * into the header table, which keeps the headers as offsets into its buffer.
+ * */
+
+static inline bool isHeadDelimiter(uint8_t state, char c){
+  if(c == '\r' || c == '\n') return true;
+  if(c == ' ') return state == HEAD_METHOD || state == HEAD_URL;
+  if(c == ':') return state == HEAD_NAME;
+  return false;
+}
+
+static String spanToString(const char *data, size_t len){
+  String s;
+  s.reserve(len);
+  for(size_t i = 0; i < len; i++)
+    s += data[i];
+  return s;
+}
+
+//decodes the character at text[i] and moves i past it
+static char urlDecodeChar(const char *text, size_t len, size_t& i){
+  char encodedChar = text[i++];
+  if ((encodedChar == '%') && (i + 1 < len)){
+    char temp[] = "0x00";
+    temp[2] = text[i++];
+    temp[3] = text[i++];
+    return strtol(temp, NULL, 16);
+  }
+  if (encodedChar == '+')
+    return ' ';
+  return encodedChar;  // normal ascii char
+}
+
+//decodes text onto the end of the table buffer, returns the decoded length
+static size_t appendUrlDecoded(AsyncWebFieldTable& table, const char *text, size_t len){
+  size_t start = table.length();
+  size_t i = 0;
+  while (i < len){
+    if(!table.append(urlDecodeChar(text, len, i)))
+      break;
+  }
+  return table.length() - start;
+}
+
+static bool containsIgnoreCase(const char *src, const char *find){
+  size_t flen = strlen(find);
+  for(; *src; src++){
+    if(strncasecmp(src, find, flen) == 0)
+      return true;
+  }
+  return false;
+}
+
+size_t AsyncWebServerRequest::_parseHead(const uint8_t *data, size_t len){
+  size_t i = 0;
+  while(i < len && _parseState < PARSE_REQ_BODY){
+    char c = (char)data[i];
+
+    if(_headState == HEAD_LINE_START){
+      if(c == '\n'){
+        _endOfHead();
+        return i + 1;
       }
+      if(c == '\r'){
+        i++;
+        continue;
+      }
+      if(_headers.count() == WEBSERVER_MAX_HEADERS){
+        _headFail(431);
+        return len;
+      }
+      _tokenStart = _headers.length();
+      _headState = HEAD_NAME;
     }
-    if(_parsedLength == _contentLength){
-      _parseState = PARSE_REQ_END;
-      //check if authenticated before calling handleRequest and request auth instead
-      if(_handler) _handler->handleRequest(this);
-      else send(501);
+
+    if(_headState == HEAD_VALUE_START){
+      if(c == ' ' || c == '\t'){
+        i++;
+        continue;
+      }
+      _tokenStart = _headers.length();
+      _headState = HEAD_VALUE;
+    }
+
+    if(_headState == HEAD_SKIP_LINE){
+      const uint8_t *eol = (const uint8_t*)memchr(data + i, '\n', len - i);
+      if(eol == NULL)
+        return len;
+      i = eol - data + 1;
+      _headState = HEAD_LINE_START;
+      continue;
+    }
+
+    //copy the run up to the next delimiter at once
+    size_t end = i;
+    while(end < len && !isHeadDelimiter(_headState, (char)data[end]))
+      end++;
+    if(end > i && !_headAppend((const char*)data + i, end - i))
+      return len;
+    i = end;
+    if(i < len){
+      c = (char)data[i++];
+      if(c != '\r')
+        _headToken(c);
     }
   }
-  break;
+  return i;
+}
+
+bool AsyncWebServerRequest::_headAppend(const char *data, size_t len){
+  if(!_headers.append(data, len)){
+    _headFail(431);
+    return false;
   }
+  return true;
 }
 
-void AsyncWebServerRequest::_removeNotInterestingHeaders(){
-  if (_interestingHeaders.containsIgnoreCase("ANY")) return; // nothing to do
-  for(const auto& header: _headers){
-      if(!_interestingHeaders.containsIgnoreCase(header->name().c_str())){
-        _headers.remove(header);
+void AsyncWebServerRequest::_headToken(char delimiter){
+  const char zero = 0;
+  size_t length = _headers.length();
+  switch(_headState){
+    case HEAD_METHOD:
+      if(length == 0) //empty lines before the request line are ignored
+        return;
+      if(delimiter != ' '){
+        _headFail(400);
+        return;
       }
+      if(!_headAppend(&zero, 1)) return;
+      _tokenStart = _headers.length();
+      _headState = HEAD_URL;
+      break;
+
+    case HEAD_URL:
+      if(delimiter == ' ' && length == _tokenStart) //extra spaces before the url
+        return;
+      if(!_headAppend(&zero, 1)) return;
+      if(delimiter == ' '){
+        _tokenStart = _headers.length();
+        _headState = HEAD_VERSION;
+        break;
+      }
+      //request line without version
+      if(!_headAppend(&zero, 1)) return;
+      _parseReqHead();
+      break;
+
+    case HEAD_VERSION:
+      if(!_headAppend(&zero, 1)) return;
+      _parseReqHead();
+      break;
+
+    case HEAD_NAME:
+      if(delimiter == ':' && length > _tokenStart){
+        _nameStart = _tokenStart;
+        _nameLength = length - _tokenStart;
+        if(!_headAppend(&zero, 1)) return;
+        _headState = HEAD_VALUE_START;
+        break;
+      }
+      //not a header, drop the line
+      _headers.truncate(_tokenStart);
+      _headState = delimiter == '\n' ? HEAD_LINE_START : HEAD_SKIP_LINE;
+      break;
+
+    case HEAD_VALUE: {
+      const char *data = _headers.data();
+      while(length > _tokenStart && (data[length - 1] == ' ' || data[length - 1] == '\t'))
+        length--;
+      _headers.truncate(length);
+      if(!_headAppend(&zero, 1)) return;
+      if(!_headers.addField(_nameStart, _nameLength, _tokenStart, length - _tokenStart)){
+        _headFail(431);
+        return;
+      }
+      _headState = HEAD_LINE_START;
+      _parseReqHeader(_headers.data() + _nameStart, _headers.data() + _tokenStart, length - _tokenStart);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+void AsyncWebServerRequest::_headFail(int code){
+  _parseState = PARSE_REQ_FAIL;
+  //the rest of a bad head is not a request, the connection closes after the error
+  _keepAlive = false;
+  send(code);
+}
+
+void AsyncWebServerRequest::_endOfHead(){
+  //_keepAlive holds what the client asked for, the response may still close
+  _keepAlive = _keepAlive && _server->keepAlive() && _reqconntype == RCT_HTTP && _method != HTTP_HEAD && !_unframedBody
+               && _requestCount + 1 < WEBSERVER_KEEPALIVE_MAX_REQUESTS;
+  _server->_rewriteRequest(this);
+  _server->_attachHandler(this);
+  if(_expectingContinue){
+    const char * response = "HTTP/1.1 100 Continue\r\n\r\n";
+    _client->write(response, os_strlen(response));
+  }
+  //check handler for authentication
+  if(_contentLength){
+    _parseState = PARSE_REQ_BODY;
+  } else {
+    _parseState = PARSE_REQ_END;
+    if(_handler) _handler->handleRequest(this);
+    else send(501);
   }
 }
 
 void AsyncWebServerRequest::_onPoll(){
   //os_printf("p\n");
-  if(_response != NULL && _client != NULL && _client->canSend() && !_response->_finished()){
-    _response->_ack(this, 0, 0);
+  if(_deferred != NULL){
+    //an answer whose call could not be queued, or none in time
+    if(_deferred->_deliver())
+      return; // sending may have closed the connection and deleted this request
+    if(millis() - _deferred->_started >= WEBSERVER_DEFERRED_TIMEOUT){
+      AsyncWebDeferred *deferred = _deferred;
+      _deferred = NULL;
+      deferred->_detach();
+      send(503);
+    }
+  } else if(_response != NULL && _client != NULL && _client->canSend() && !_response->_finished()){
+    _ackResponse(0, 0);
+  } else if(_response != NULL && _response->_finished()){
+    _responseDone();
+  } else if(_idle() && millis() - _idleSince >= WEBSERVER_KEEPALIVE_TIMEOUT * 1000){
+    //idle persistent connection
+    _client->close();
   }
 }
 
 void AsyncWebServerRequest::_onAck(size_t len, uint32_t time){
   //os_printf("a:%u:%u\n", len, time);
-  if(_response != NULL){
-    if(!_response->_finished()){
-      _response->_ack(this, len, time);
-    } else {
-      AsyncWebServerResponse* r = _response;
-      _response = NULL;
-      delete r;
-    }
+  if(_response != NULL && !_response->_finished())
+    _ackResponse(len, time);
+  else if(_response != NULL)
+    _responseDone();
+}
+
+void AsyncWebServerRequest::_ackResponse(size_t len, uint32_t time){
+  //the response may close the connection, or hand it over, and so delete this request
+  bool destroyed = false;
+  _destroyed = &destroyed;
+  _response->_ack(this, len, time);
+  if(destroyed)
+    return;
+  _destroyed = NULL;
+  //the ack that completes a response ends its latency sample and starts the next request right away
+  if(_response != NULL && _response->_finished()){
+    _recordMetrics();
+    _responseDone();
   }
 }
 
@@ -229,126 +675,124 @@ void AsyncWebServerRequest::_onDisconnect(){
   _server->_handleDisconnect(this);
 }
 
-void AsyncWebServerRequest::_addParam(AsyncWebParameter *p){
-  _params.add(p);
+void AsyncWebServerRequest::_addParam(const String& name, const String& value, bool form, bool file, size_t size){
+  uint8_t flags = (form ? PARAM_POST : 0) | (file ? PARAM_FILE : 0);
+  _params.add(name.c_str(), name.length(), value.c_str(), value.length(), flags, size);
 }
 
 void AsyncWebServerRequest::_addPathParam(const char *p){
   _pathParams.add(new String(p));
 }
 
+void AsyncWebServerRequest::_addPathParam(const char *p, size_t len){
+  _pathParams.add(new String(spanToString(p, len)));
+}
+
 void AsyncWebServerRequest::_addGetParams(const String& params){
+  _addGetParams(params.c_str(), params.length());
+}
+
+void AsyncWebServerRequest::_addGetParams(const char *params, size_t len){
+  //name and value are decoded straight into the parameter table
   size_t start = 0;
-  while (start < params.length()){
-    int end = params.indexOf('&', start);
-    if (end < 0) end = params.length();
-    int equal = params.indexOf('=', start);
-    if (equal < 0 || equal > end) equal = end;
-    String name = params.substring(start, equal);
-    String value = equal + 1 < end ? params.substring(equal + 1, end) : String();
-    _addParam(new AsyncWebParameter(urlDecode(name), urlDecode(value)));
+  while (start < len){
+    const char *amp = (const char*)memchr(params + start, '&', len - start);
+    size_t end = amp ? amp - params : len;
+    const char *eq = (const char*)memchr(params + start, '=', end - start);
+    size_t equal = eq ? eq - params : end;
+    size_t mark = _params.length();
+    size_t nameLength = appendUrlDecoded(_params, params + start, equal - start);
+    size_t value = _params.length() + 1;
+    size_t valueLength = 0;
+    bool added = _params.append('\0');
+    if(added && equal + 1 < end)
+      valueLength = appendUrlDecoded(_params, params + equal + 1, end - equal - 1);
+    added = added && _params.length() == value + valueLength && _params.append('\0');
+    if(!added || !_params.addField(mark, nameLength, value, valueLength))
+      _params.truncate(mark);
     start = end + 1;
   }
 }
 
-bool AsyncWebServerRequest::_parseReqHead(){
-  // Split the head into method, url and version
-  int index = _temp.indexOf(' ');
-  String m = _temp.substring(0, index);
-  index = _temp.indexOf(' ', index+1);
-  String u = _temp.substring(m.length()+1, index);
-  _temp = _temp.substring(index+1);
+void AsyncWebServerRequest::_parseReqHead(){
+  // Method, url and version are the first three tokens in the header buffer
+  const char *m = _headers.data();
+  const char *u = m + strlen(m) + 1;
+  const char *v = u + strlen(u) + 1;
 
-  if(m == "GET"){
+  if(strcmp(m, "GET") == 0){
     _method = HTTP_GET;
-  } else if(m == "POST"){
+  } else if(strcmp(m, "POST") == 0){
     _method = HTTP_POST;
-  } else if(m == "DELETE"){
+  } else if(strcmp(m, "DELETE") == 0){
     _method = HTTP_DELETE;
-  } else if(m == "PUT"){
+  } else if(strcmp(m, "PUT") == 0){
     _method = HTTP_PUT;
-  } else if(m == "PATCH"){
+  } else if(strcmp(m, "PATCH") == 0){
     _method = HTTP_PATCH;
-  } else if(m == "HEAD"){
+  } else if(strcmp(m, "HEAD") == 0){
     _method = HTTP_HEAD;
-  } else if(m == "OPTIONS"){
+  } else if(strcmp(m, "OPTIONS") == 0){
     _method = HTTP_OPTIONS;
   }
 
-  String g = String();
-  index = u.indexOf('?');
-  if(index > 0){
-    g = u.substring(index +1);
-    u = u.substring(0, index);
-  }
-  _url = urlDecode(u);
-  _addGetParams(g);
+  size_t urlLength = strlen(u);
+  const char *query = strchr(u, '?');
+  size_t pathLength = (query && query != u) ? query - u : urlLength;
+  _url = _urlDecode(u, pathLength);
+  if(pathLength < urlLength)
+    _addGetParams(u + pathLength + 1, urlLength - pathLength - 1);
 
-  if(!_temp.startsWith("HTTP/1.0"))
+  if(strncmp(v, "HTTP/1.0", 8) != 0)
     _version = 1;
-
-  _temp = String();
-  return true;
-}
-
-bool strContains(String src, String find, bool mindcase = true) {
-  int pos=0, i=0;
-  const int slen = src.length();
-  const int flen = find.length();
-
-  if (slen < flen) return false;
-  while (pos <= (slen - flen)) {
-    for (i=0; i < flen; i++) {
-      if (mindcase) {
-        if (src[pos+i] != find[i]) i = flen + 1; // no match
-      } else if (tolower(src[pos+i]) != tolower(find[i])) i = flen + 1; // no match
+  //HTTP/1.1 connections are persistent unless the client says otherwise
+  _keepAlive = _version == 1;
+
+  //the request line is not needed anymore, headers start at the beginning of the buffer
+  _headers.truncate(0);
+  _tokenStart = 0;
+  _parseState = PARSE_REQ_HEADERS;
+  _headState = HEAD_LINE_START;
+}
+
+void AsyncWebServerRequest::_parseReqHeader(const char *name, const char *value, size_t valueLength){
+  if(strcasecmp(name, "Host") == 0){
+    _host = value;
+  } else if(strcasecmp(name, "Content-Type") == 0){
+    const char *semicolon = strchr(value, ';');
+    _contentType = spanToString(value, semicolon ? semicolon - value : valueLength);
+    if (strncmp(value, "multipart/", 10) == 0){
+      const char *equal = strchr(value, '=');
+      _boundary = equal ? equal + 1 : value;
+      _boundary.replace("\"","");
+      _isMultipart = true;
     }
-    if (i == flen) return true;
-    pos++;
-  }
-  return false;
-}
-
-bool AsyncWebServerRequest::_parseReqHeader(){
-  int index = _temp.indexOf(':');
-  if(index){
-    String name = _temp.substring(0, index);
-    String value = _temp.substring(index + 2);
-    if(name.equalsIgnoreCase("Host")){
-      _host = value;
-    } else if(name.equalsIgnoreCase("Content-Type")){
-	  _contentType = value.substring(0, value.indexOf(';'));
-      if (value.startsWith("multipart/")){
-        _boundary = value.substring(value.indexOf('=')+1);
-        _boundary.replace("\"","");
-        _isMultipart = true;
-      }
-    } else if(name.equalsIgnoreCase("Content-Length")){
-      _contentLength = atoi(value.c_str());
-    } else if(name.equalsIgnoreCase("Expect") && value == "100-continue"){
-      _expectingContinue = true;
-    } else if(name.equalsIgnoreCase("Authorization")){
-      if(value.length() > 5 && value.substring(0,5).equalsIgnoreCase("Basic")){
-        _authorization = value.substring(6);
-      } else if(value.length() > 6 && value.substring(0,6).equalsIgnoreCase("Digest")){
-        _isDigest = true;
-        _authorization = value.substring(7);
-      }
-    } else {
-      if(name.equalsIgnoreCase("Upgrade") && value.equalsIgnoreCase("websocket")){
-        // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
-        _reqconntype = RCT_WS;
-      } else {
-        if(name.equalsIgnoreCase("Accept") && strContains(value, "text/event-stream", false)){
-          // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
-          _reqconntype = RCT_EVENT;
-        }
-      }
+  } else if(strcasecmp(name, "Content-Length") == 0){
+    _contentLength = atoi(value);
+  } else if(strcasecmp(name, "Transfer-Encoding") == 0){
+    //the body is not read, its bytes must not be taken for the next request
+    _unframedBody = true;
+  } else if(strcasecmp(name, "Expect") == 0 && strcmp(value, "100-continue") == 0){
+    _expectingContinue = true;
+  } else if(strcasecmp(name, "Authorization") == 0){
+    if(valueLength > 5 && strncasecmp(value, "Basic", 5) == 0){
+      _authorization = value + 6;
+    } else if(valueLength > 6 && strncasecmp(value, "Digest", 6) == 0){
+      _isDigest = true;
+      _authorization = value + 7;
     }
-    _headers.add(new AsyncWebHeader(name, value));
+  } else if(strcasecmp(name, "Connection") == 0){
+    if(containsIgnoreCase(value, "close"))
+      _keepAlive = false;
+    else if(containsIgnoreCase(value, "keep-alive"))
+      _keepAlive = true;
+  } else if(strcasecmp(name, "Upgrade") == 0 && strcasecmp(value, "websocket") == 0){
+    // WebSocket request can be uniquely identified by header: [Upgrade: websocket]
+    _reqconntype = RCT_WS;
+  } else if(strcasecmp(name, "Accept") == 0 && containsIgnoreCase(value, "text/event-stream")){
+    // WebEvent request can be uniquely identified by header:  [Accept: text/event-stream]
+    _reqconntype = RCT_EVENT;
   }
-  _temp = String();
-  return true;
 }
 
 void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
@@ -361,7 +805,7 @@ void AsyncWebServerRequest::_parsePlainPostChar(uint8_t data){
       name = _temp.substring(0, _temp.indexOf('='));
       value = _temp.substring(_temp.indexOf('=') + 1);
     }
-    _addParam(new AsyncWebParameter(urlDecode(name), urlDecode(value), true));
+    _addParam(urlDecode(name), urlDecode(value), true);
     _temp = String();
   }
 }
@@ -508,13 +952,13 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
     } else if(_boundaryPosition == _boundary.length() - 1){
       _multiParseState = DASH3_OR_RETURN2;
       if(!_itemIsFile){
-        _addParam(new AsyncWebParameter(_itemName, _itemValue, true));
+        _addParam(_itemName, _itemValue, true);
       } else {
         if(_itemSize){
           //check if authenticated before calling the upload
           if(_handler) _handler->handleUpload(this, _itemFilename, _itemSize - _itemBufferIndex, _itemBuffer, _itemBufferIndex, true);
           _itemBufferIndex = 0;
-          _addParam(new AsyncWebParameter(_itemName, _itemFilename, true, true, _itemSize));
+          _addParam(_itemName, _itemFilename, true, true, _itemSize);
         }
         free(_itemBuffer);
         _itemBuffer = NULL;
@@ -551,51 +995,28 @@ void AsyncWebServerRequest::_parseMultipartPostByte(uint8_t data, bool last){
   }
 }
 
-void AsyncWebServerRequest::_parseLine(){
-  if(_parseState == PARSE_REQ_START){
-    if(!_temp.length()){
-      _parseState = PARSE_REQ_FAIL;
-      _client->close();
-    } else {
-      _parseReqHead();
-      _parseState = PARSE_REQ_HEADERS;
-    }
-    return;
-  }
-
-  if(_parseState == PARSE_REQ_HEADERS){
-    if(!_temp.length()){
-      //end of headers
-      _server->_rewriteRequest(this);
-      _server->_attachHandler(this);
-      _removeNotInterestingHeaders();
-      if(_expectingContinue){
-        const char * response = "HTTP/1.1 100 Continue\r\n\r\n";
-        _client->write(response, os_strlen(response));
-      }
-      //check handler for authentication
-      if(_contentLength){
-        _parseState = PARSE_REQ_BODY;
-      } else {
-        _parseState = PARSE_REQ_END;
-        if(_handler) _handler->handleRequest(this);
-        else send(501);
-      }
-    } else _parseReqHeader();
-  }
+//grows the lazily filled object array to count zeroed slots, the old array stays in the arena until reset
+template<typename T, typename A>
+static bool reserveObjects(A& arena, T**& objects, size_t& slots, size_t count){
+  if(count <= slots)
+    return true;
+  T** grown = (T**)arena.alloc(count * sizeof(T*));
+  if(grown == NULL)
+    return false;
+  if(slots)
+    memcpy(grown, objects, slots * sizeof(T*));
+  memset(grown + slots, 0, (count - slots) * sizeof(T*));
+  objects = grown;
+  slots = count;
+  return true;
 }
 
 size_t AsyncWebServerRequest::headers() const{
-  return _headers.length();
+  return _headers.count();
 }
 
 bool AsyncWebServerRequest::hasHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return true;
-    }
-  }
-  return false;
+  return _headers.find(name.c_str()) >= 0;
 }
 
 bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
@@ -619,12 +1040,8 @@ bool AsyncWebServerRequest::hasHeader(const __FlashStringHelper * data) const {
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
-  for(const auto& h: _headers){
-    if(h->name().equalsIgnoreCase(name)){
-      return h;
-    }
-  }
-  return nullptr;
+  int index = _headers.find(name.c_str());
+  return index < 0 ? nullptr : getHeader((size_t)index);
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * data) const {
@@ -642,21 +1059,25 @@ AsyncWebHeader* AsyncWebServerRequest::getHeader(const __FlashStringHelper * dat
 }
 
 AsyncWebHeader* AsyncWebServerRequest::getHeader(size_t num) const {
-  auto header = _headers.nth(num);
-  return header ? *header : nullptr;
+  if(num >= _headers.count() || !reserveObjects(_arena, _headerObjects, _headerObjectSlots, _headers.count()))
+    return nullptr;
+  if(_headerObjects[num] == NULL){
+    const AsyncWebFieldTable::Field& f = _headers.field(num);
+    void *p = _arena.alloc(sizeof(AsyncWebHeader));
+    if(p == NULL)
+      return nullptr;
+    _headerObjects[num] = new (p) AsyncWebHeader(spanToString(_headers.name(num), f.nameLength), spanToString(_headers.value(num), f.valueLength));
+  }
+  return _headerObjects[num];
 }
 
 size_t AsyncWebServerRequest::params() const {
-  return _params.length();
+  return _params.count();
 }
 
 bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
-  for(const auto& p: _params){
-    if(p->name() == name && p->isPost() == post && p->isFile() == file){
-      return true;
-    }
-  }
-  return false;
+  uint8_t flags = (post ? PARAM_POST : 0) | (file ? PARAM_FILE : 0);
+  return _params.find(name.c_str(), PARAM_POST | PARAM_FILE, flags) >= 0;
 }
 
 bool AsyncWebServerRequest::hasParam(const __FlashStringHelper * data, bool post, bool file) const {
@@ -676,12 +1097,9 @@ bool AsyncWebServerRequest::hasParam(const __FlashStringHelper * data, bool post
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
-  for(const auto& p: _params){
-    if(p->name() == name && p->isPost() == post && p->isFile() == file){
-      return p;
-    }
-  }
-  return nullptr;
+  uint8_t flags = (post ? PARAM_POST : 0) | (file ? PARAM_FILE : 0);
+  int index = _params.find(name.c_str(), PARAM_POST | PARAM_FILE, flags);
+  return index < 0 ? nullptr : getParam((size_t)index);
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(const __FlashStringHelper * data, bool post, bool file) const {
@@ -699,20 +1117,41 @@ AsyncWebParameter* AsyncWebServerRequest::getParam(const __FlashStringHelper * d
 }
 
 AsyncWebParameter* AsyncWebServerRequest::getParam(size_t num) const {
-  auto param = _params.nth(num);
-  return param ? *param : nullptr;
+  if(num >= _params.count() || !reserveObjects(_arena, _paramObjects, _paramObjectSlots, _params.count()))
+    return nullptr;
+  if(_paramObjects[num] == NULL){
+    const AsyncWebFieldTable::Field& f = _params.field(num);
+    void *p = _arena.alloc(sizeof(AsyncWebParameter));
+    if(p == NULL)
+      return nullptr;
+    _paramObjects[num] = new (p) AsyncWebParameter(spanToString(_params.name(num), f.nameLength), spanToString(_params.value(num), f.valueLength),
+                                               f.flags & PARAM_POST, f.flags & PARAM_FILE, f.size);
+  }
+  return _paramObjects[num];
+}
+
+AsyncWebDeferred* AsyncWebServerRequest::defer(){
+  if(_deferred != NULL || _response != NULL)
+    return NULL;
+  _deferred = new AsyncWebDeferred(this);
+  if(_deferred != NULL)
+    _client->setRxTimeout(0); // WEBSERVER_DEFERRED_TIMEOUT applies instead
+  return _deferred;
 }
 
-void AsyncWebServerRequest::addInterestingHeader(const String& name){
-  if(!_interestingHeaders.containsIgnoreCase(name))
-    _interestingHeaders.add(name);
+void AsyncWebServerRequest::_deferredDone(AsyncWebServerResponse *response){
+  AsyncWebDeferred *deferred = _deferred;
+  _deferred = NULL;
+  deferred->_release();
+  send(response);
 }
 
 void AsyncWebServerRequest::send(AsyncWebServerResponse *response){
   _response = response;
   if(_response == NULL){
-    _client->close(true);
-    _onDisconnect();
+    //closing runs onDisconnect, which deletes this request
+    _client->write(serviceUnavailable, sizeof(serviceUnavailable) - 1);
+    _client->close();
     return;
   }
   if(!_response->_sourceValid()){
@@ -862,12 +1301,7 @@ void AsyncWebServerRequest::requestAuthentication(const char * realm, bool isDig
 }
 
 bool AsyncWebServerRequest::hasArg(const char* name) const {
-  for(const auto& arg: _params){
-    if(arg->name() == name){
-      return true;
-    }
-  }
-  return false;
+  return _params.find(name) >= 0;
 }
 
 bool AsyncWebServerRequest::hasArg(const __FlashStringHelper * data) const {
@@ -886,12 +1320,9 @@ bool AsyncWebServerRequest::hasArg(const __FlashStringHelper * data) const {
 
 
 const String& AsyncWebServerRequest::arg(const String& name) const {
-  for(const auto& arg: _params){
-    if(arg->name() == name){
-      return arg->value();
-    }
-  }
-  return SharedEmptyString;
+  int index = _params.find(name.c_str());
+  AsyncWebParameter* p = index < 0 ? nullptr : getParam((size_t)index);
+  return p ? p->value() : SharedEmptyString;
 }
 
 const String& AsyncWebServerRequest::arg(const __FlashStringHelper * data) const {
@@ -910,11 +1341,13 @@ const String& AsyncWebServerRequest::arg(const __FlashStringHelper * data) const
 }
 
 const String& AsyncWebServerRequest::arg(size_t i) const {
-  return getParam(i)->value();
+  AsyncWebParameter* p = getParam(i);
+  return p ? p->value() : SharedEmptyString;
 }
 
 const String& AsyncWebServerRequest::argName(size_t i) const {
-  return getParam(i)->name();
+  AsyncWebParameter* p = getParam(i);
+  return p ? p->name() : SharedEmptyString;
 }
 
 const String& AsyncWebServerRequest::pathArg(size_t i) const {
@@ -923,7 +1356,8 @@ const String& AsyncWebServerRequest::pathArg(size_t i) const {
 }
 
 const String& AsyncWebServerRequest::header(const char* name) const {
-  AsyncWebHeader* h = getHeader(String(name));
+  int index = _headers.find(name);
+  AsyncWebHeader* h = index < 0 ? nullptr : getHeader((size_t)index);
   return h ? h->value() : SharedEmptyString;
 }
 
@@ -953,25 +1387,15 @@ const String& AsyncWebServerRequest::headerName(size_t i) const {
 }
 
 String AsyncWebServerRequest::urlDecode(const String& text) const {
-  char temp[] = "0x00";
-  unsigned int len = text.length();
-  unsigned int i = 0;
+  return _urlDecode(text.c_str(), text.length());
+}
+
+String AsyncWebServerRequest::_urlDecode(const char *text, size_t len) const {
+  size_t i = 0;
   String decoded = String();
   decoded.reserve(len); // Allocate the string internal buffer - never longer from source text
-  while (i < len){
-    char decodedChar;
-    char encodedChar = text.charAt(i++);
-    if ((encodedChar == '%') && (i + 1 < len)){
-      temp[2] = text.charAt(i++);
-      temp[3] = text.charAt(i++);
-      decodedChar = strtol(temp, NULL, 16);
-    } else if (encodedChar == '+') {
-      decodedChar = ' ';
-    } else {
-      decodedChar = encodedChar;  // normal ascii char
-    }
-    decoded.concat(decodedChar);
-  }
+  while (i < len)
+    decoded.concat(urlDecodeChar(text, len, i));
   return decoded;
 }
 
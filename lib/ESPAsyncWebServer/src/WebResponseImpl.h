@@ -39,44 +39,123 @@ class AsyncBasicResponse: public AsyncWebServerResponse {
     bool _sourceValid() const { return true; }
 };
 
+#ifndef TEMPLATE_PLACEHOLDER
+#define TEMPLATE_PLACEHOLDER '%'
+#endif
+
+#define TEMPLATE_PARAM_NAME_LENGTH 32
+
+//content bytes the template scanner reads ahead of its output
+#ifndef TEMPLATE_BUFFER_SIZE
+#define TEMPLATE_BUFFER_SIZE 256
+#endif
+
+class AsyncAbstractResponse;
+
+/*
+ * TEMPLATE SCANNER :: Replaces %NAME% placeholders while the content streams through it.
+ * Content is read into a fixed buffer and scanned once, a placeholder name is collected on the side
+ * (at most TEMPLATE_PARAM_NAME_LENGTH bytes of lookahead) and a value that does not fit into the
+ * output is kept for the next call, so nothing is ever shifted or inserted.
+ * */
+
+class AsyncTemplateScanner {
+  private:
+    uint8_t _buffer[TEMPLATE_BUFFER_SIZE];
+    size_t _start;
+    size_t _length;
+    bool _end;
+    bool _inName;
+    char _name[TEMPLATE_PARAM_NAME_LENGTH + 2];   // room for the leading placeholder when it is sent as text
+    size_t _nameLength;
+    String _value;
+    const char *_pending;
+    size_t _pendingLength;
+
+    void _nameAsText();
+
+  public:
+    AsyncTemplateScanner();
+    //fills up to len bytes of output, RESPONSE_TRY_AGAIN if the content had nothing yet
+    size_t fill(AsyncAbstractResponse *response, const AwsTemplateProcessor& callback, uint8_t *data, size_t len);
+};
+
 class AsyncAbstractResponse: public AsyncWebServerResponse {
   private:
     String _head;
-    // Data is inserted into cache at begin(). 
-    // This is inefficient with vector, but if we use some other container, 
-    // we won't be able to access it as contiguous array of bytes when reading from it,
-    // so by gaining performance in one place, we'll lose it in another.
-    std::vector<uint8_t> _cache;
-    size_t _readDataFromCacheOrContent(uint8_t* data, const size_t len);
+    AsyncTemplateScanner *_template;
     size_t _fillBufferAndProcessTemplates(uint8_t* buf, size_t maxLen);
   protected:
     AwsTemplateProcessor _callback;
   public:
     AsyncAbstractResponse(AwsTemplateProcessor callback=nullptr);
+    virtual ~AsyncAbstractResponse();
     void _respond(AsyncWebServerRequest *request);
     size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time);
     bool _sourceValid() const { return false; }
     virtual size_t _fillBuffer(uint8_t *buf __attribute__((unused)), size_t maxLen __attribute__((unused))) { return 0; }
 };
 
-#ifndef TEMPLATE_PLACEHOLDER
-#define TEMPLATE_PLACEHOLDER '%'
+//max ranges accepted in one Range header, a longer list is answered with the whole file
+#ifndef WEBSERVER_MAX_RANGES
+#define WEBSERVER_MAX_RANGES 8
 #endif
 
-#define TEMPLATE_PARAM_NAME_LENGTH 32
+/*
+ * BYTE RANGES :: Parts of a file asked for with "Range: bytes=...". Overlapping and adjacent
+ * ranges are merged, more than one range left is sent as multipart/byteranges.
+ * The file is seeked to each part, nothing before or between them is read.
+ * */
+
+class AsyncByteRanges {
+  using File = fs::File;
+  private:
+    size_t _start[WEBSERVER_MAX_RANGES];
+    size_t _end[WEBSERVER_MAX_RANGES];    // last byte, inclusive
+    uint8_t _count;
+    uint8_t _next;                        // next range to seek to
+    size_t _left;                         // file bytes left of the current range
+    size_t _size;
+    String _type;
+    String _boundary;                     // empty for a single range
+    String _part;                         // head of the current part or the closing boundary
+    size_t _partSent;
+    bool _closed;
+
+    String _partHead(uint8_t index) const;
+    static size_t _number(const char*& p);
+
+  public:
+    AsyncByteRanges();
+    //returns the number of ranges for a file of size bytes, 0 if none can be satisfied
+    //and -1 if the header is malformed or too long and has to be ignored
+    int parse(const String& value, size_t size);
+    uint8_t count() const { return _count; }
+    size_t start(uint8_t index) const { return _start[index]; }
+    size_t end(uint8_t index) const { return _end[index]; }
+    //sends the ranges as parts of a multipart/byteranges body, returns its length
+    size_t multipart(const String& type, const String& boundary);
+    size_t fill(File& file, uint8_t *data, size_t len);
+};
+
 class AsyncFileResponse: public AsyncAbstractResponse {
   using File = fs::File;
   using FS = fs::FS;
   private:
     File _content;
     String _path;
+    AsyncByteRanges *_ranges;
     void _setContentType(const String& path);
+    bool _ifRangeMatches(AsyncWebServerRequest *request) const;
+    void _applyRange(const String& value);
   public:
     AsyncFileResponse(FS &fs, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
     AsyncFileResponse(File content, const String& path, const String& contentType=String(), bool download=false, AwsTemplateProcessor callback=nullptr);
     ~AsyncFileResponse();
+    void _respond(AsyncWebServerRequest *request) override;
     bool _sourceValid() const { return !!(_content); }
     virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+    static const char* contentTypeFor(const String& path);
 };
 
 class AsyncStreamResponse: public AsyncAbstractResponse {
@@ -118,6 +197,19 @@ class AsyncProgmemResponse: public AsyncAbstractResponse {
     virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
 };
 
+class AsyncAssetResponse: public AsyncAbstractResponse {
+  private:
+    AsyncWebAsset *_asset;
+    const AsyncWebAssetBody *_body;
+    size_t _readLength;
+  public:
+    AsyncAssetResponse(AsyncWebAsset *asset, bool gzip);
+    ~AsyncAssetResponse();
+    bool _sourceValid() const { return true; }
+    virtual String _assembleHead(uint8_t version) override;
+    virtual size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+};
+
 class cbuf;
 
 class AsyncResponseStream: public AsyncAbstractResponse, public Print {
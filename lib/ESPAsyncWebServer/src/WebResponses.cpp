@@ -72,6 +72,7 @@ const char* AsyncWebServerResponse::_responseCodeToString(int code) {
     case 415: return "Unsupported Media Type";
     case 416: return "Requested range not satisfiable";
     case 417: return "Expectation Failed";
+    case 431: return "Request Header Fields Too Large";
     case 500: return "Internal Server Error";
     case 501: return "Not Implemented";
     case 502: return "Bad Gateway";
@@ -82,6 +83,27 @@ const char* AsyncWebServerResponse::_responseCodeToString(int code) {
   }
 }
 
+static AsyncWebObjectPool<WEBSERVER_RESPONSE_SLOT_SIZE, WEBSERVER_MAX_RESPONSES> responsePool;
+
+void *AsyncWebServerResponse::operator new(size_t size) noexcept {
+  void *p = responsePool.alloc(size);
+  return p ? p : malloc(size);
+}
+
+void AsyncWebServerResponse::operator delete(void *p){
+  if(responsePool.owns(p))
+    responsePool.release(p);
+  else
+    free(p);
+}
+
+void AsyncWebServerResponse::_poolStats(AsyncWebPoolStats& stats){
+  stats.responses = responsePool.used();
+  stats.responsesPeak = responsePool.peak();
+  stats.responsesMax = responsePool.capacity();
+  stats.responsesOnHeap = responsePool.failed();
+}
+
 AsyncWebServerResponse::AsyncWebServerResponse()
   : _code(0)
   , _headers(LinkedList<AsyncWebHeader *>([](AsyncWebHeader *h){ delete h; }))
@@ -123,9 +145,24 @@ void AsyncWebServerResponse::addHeader(const String& name, const String& value){
   _headers.add(new AsyncWebHeader(name, value));
 }
 
+//the connection is reused only if the client can tell where this response ends
+void AsyncWebServerResponse::_addConnectionHeader(AsyncWebServerRequest *request){
+  if(!_sendContentLength && !(_chunked && request->version()))
+    request->_keepAlive = false;
+  if(!request->_keepAlive){
+    addHeader("Connection","close");
+    return;
+  }
+  char buf[40];
+  snprintf(buf, sizeof(buf), "timeout=%u, max=%u", WEBSERVER_KEEPALIVE_TIMEOUT, WEBSERVER_KEEPALIVE_MAX_REQUESTS - request->_requestCount - 1);
+  addHeader("Connection","keep-alive");
+  addHeader("Keep-Alive", buf);
+}
+
 String AsyncWebServerResponse::_assembleHead(uint8_t version){
   if(version){
-    addHeader("Accept-Ranges","none");
+    if(!_header("Accept-Ranges"))
+      addHeader("Accept-Ranges","none");
     if(_chunked)
       addHeader("Transfer-Encoding","chunked");
   }
@@ -156,6 +193,13 @@ String AsyncWebServerResponse::_assembleHead(uint8_t version){
   return out;
 }
 
+const String* AsyncWebServerResponse::_header(const char* name) const {
+  for(const auto& header: _headers)
+    if(header->name().equalsIgnoreCase(name))
+      return &header->value();
+  return NULL;
+}
+
 bool AsyncWebServerResponse::_started() const { return _state > RESPONSE_SETUP; }
 bool AsyncWebServerResponse::_finished() const { return _state > RESPONSE_WAIT_ACK; }
 bool AsyncWebServerResponse::_failed() const { return _state == RESPONSE_FAILED; }
@@ -175,10 +219,10 @@ AsyncBasicResponse::AsyncBasicResponse(int code, const String& contentType, cons
     if(!_contentType.length())
       _contentType = "text/plain";
   }
-  addHeader("Connection","close");
 }
 
 void AsyncBasicResponse::_respond(AsyncWebServerRequest *request){
+  _addConnectionHeader(request);
   _state = RESPONSE_HEADERS;
   String out = _assembleHead(request->version());
   size_t outLen = out.length();
@@ -244,7 +288,7 @@ size_t AsyncBasicResponse::_ack(AsyncWebServerRequest *request, size_t len, uint
  * Abstract Response
  * */
 
-AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _callback(callback)
+AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _template(NULL), _callback(callback)
 {
   // In case of template processing, we're unable to determine real response size
   if(callback) {
@@ -255,7 +299,7 @@ AsyncAbstractResponse::AsyncAbstractResponse(AwsTemplateProcessor callback): _ca
 }
 
 void AsyncAbstractResponse::_respond(AsyncWebServerRequest *request){
-  addHeader("Connection","close");
+  _addConnectionHeader(request);
   _head = _assembleHead(request->version());
   _state = RESPONSE_HEADERS;
   _ack(request, 0, 0);
@@ -364,18 +408,8 @@ size_t AsyncAbstractResponse::_ack(AsyncWebServerRequest *request, size_t len, u
   return 0;
 }
 
-size_t AsyncAbstractResponse::_readDataFromCacheOrContent(uint8_t* data, const size_t len)
-{
-    // If we have something in cache, copy it to buffer
-    const size_t readFromCache = std::min(len, _cache.size());
-    if(readFromCache) {
-      memcpy(data, _cache.data(), readFromCache);
-      _cache.erase(_cache.begin(), _cache.begin() + readFromCache);
-    }
-    // If we need to read more...
-    const size_t needFromFile = len - readFromCache;
-    const size_t readFromContent = _fillBuffer(data + readFromCache, needFromFile);
-    return readFromCache + readFromContent;
+AsyncAbstractResponse::~AsyncAbstractResponse(){
+  delete _template;
 }
 
 size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size_t len)
@@ -383,93 +417,116 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
   if(!_callback)
     return _fillBuffer(data, len);
 
-  const size_t originalLen = len;
-  len = _readDataFromCacheOrContent(data, len);
-  // Now we've read 'len' bytes, either from cache or from file
-  // Search for template placeholders
-  uint8_t* pTemplateStart = data;
-  while((pTemplateStart < &data[len]) && (pTemplateStart = (uint8_t*)memchr(pTemplateStart, TEMPLATE_PLACEHOLDER, &data[len - 1] - pTemplateStart + 1))) { // data[0] ... data[len - 1]
-    uint8_t* pTemplateEnd = (pTemplateStart < &data[len - 1]) ? (uint8_t*)memchr(pTemplateStart + 1, TEMPLATE_PLACEHOLDER, &data[len - 1] - pTemplateStart) : nullptr;
-    // temporary buffer to hold parameter name
-    uint8_t buf[TEMPLATE_PARAM_NAME_LENGTH + 1];
-    String paramName;
-    // If closing placeholder is found:
-    if(pTemplateEnd) {
-      // prepare argument to callback
-      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
-      if(paramNameLength) {
-        memcpy(buf, pTemplateStart + 1, paramNameLength);
-        buf[paramNameLength] = 0;
-        paramName = String(reinterpret_cast<char*>(buf));
-      } else { // double percent sign encountered, this is single percent sign escaped.
-        // remove the 2nd percent sign
-        memmove(pTemplateEnd, pTemplateEnd + 1, &data[len] - pTemplateEnd - 1);
-        len += _readDataFromCacheOrContent(&data[len - 1], 1) - 1;
-        ++pTemplateStart;
+  if(_template == NULL){
+    _template = new AsyncTemplateScanner();
+    if(_template == NULL)
+      return 0;
+  }
+  return _template->fill(this, _callback, data, len);
+}
+
+/*
+ * Template Scanner
+ * */
+
+AsyncTemplateScanner::AsyncTemplateScanner()
+  : _start(0)
+  , _length(0)
+  , _end(false)
+  , _inName(false)
+  , _nameLength(0)
+  , _value()
+  , _pending(NULL)
+  , _pendingLength(0)
+{}
+
+//not a placeholder after all, the collected bytes go out as they came in
+void AsyncTemplateScanner::_nameAsText(){
+  memmove(_name + 1, _name, _nameLength);
+  _name[0] = TEMPLATE_PLACEHOLDER;
+  _pending = _name;
+  _pendingLength = _nameLength + 1;
+  _inName = false;
+}
+
+size_t AsyncTemplateScanner::fill(AsyncAbstractResponse *response, const AwsTemplateProcessor& callback, uint8_t *data, size_t len){
+  size_t out = 0;
+  while(out < len){
+    //the rest of a value (or of text that was no placeholder) comes first
+    if(_pendingLength){
+      size_t n = _pendingLength < len - out ? _pendingLength : len - out;
+      memcpy(data + out, _pending, n);
+      out += n;
+      _pending += n;
+      _pendingLength -= n;
+      continue;
+    }
+
+    if(_length == 0){
+      if(_end){
+        if(!_inName)
+          break;
+        _nameAsText(); // content ended inside a placeholder
+        continue;
       }
-    } else if(&data[len - 1] - pTemplateStart + 1 < TEMPLATE_PARAM_NAME_LENGTH + 2) { // closing placeholder not found, check if it's in the remaining file data
-      memcpy(buf, pTemplateStart + 1, &data[len - 1] - pTemplateStart);
-      const size_t readFromCacheOrContent = _readDataFromCacheOrContent(buf + (&data[len - 1] - pTemplateStart), TEMPLATE_PARAM_NAME_LENGTH + 2 - (&data[len - 1] - pTemplateStart + 1));
-      if(readFromCacheOrContent) {
-        pTemplateEnd = (uint8_t*)memchr(buf + (&data[len - 1] - pTemplateStart), TEMPLATE_PLACEHOLDER, readFromCacheOrContent);
-        if(pTemplateEnd) {
-          // prepare argument to callback
-          *pTemplateEnd = 0;
-          paramName = String(reinterpret_cast<char*>(buf));
-          // Copy remaining read-ahead data into cache
-          _cache.insert(_cache.begin(), pTemplateEnd + 1, buf + (&data[len - 1] - pTemplateStart) + readFromCacheOrContent);
-          pTemplateEnd = &data[len - 1];
-        }
-        else // closing placeholder not found in file data, store found percent symbol as is and advance to the next position
-        {
-          // but first, store read file data in cache
-          _cache.insert(_cache.begin(), buf + (&data[len - 1] - pTemplateStart), buf + (&data[len - 1] - pTemplateStart) + readFromCacheOrContent);
-          ++pTemplateStart;
-        }
+      size_t n = response->_fillBuffer(_buffer, TEMPLATE_BUFFER_SIZE);
+      if(n == RESPONSE_TRY_AGAIN)
+        return out ? out : RESPONSE_TRY_AGAIN;
+      if(n == 0)
+        _end = true;
+      _start = 0;
+      _length = n;
+      continue;
+    }
+
+    const uint8_t *in = _buffer + _start;
+    if(!_inName){
+      //copy text up to the next placeholder in one go
+      const uint8_t *mark = (const uint8_t*)memchr(in, TEMPLATE_PLACEHOLDER, _length);
+      size_t n = mark ? (size_t)(mark - in) : _length;
+      if(n > len - out)
+        n = len - out;
+      memcpy(data + out, in, n);
+      out += n;
+      _start += n;
+      _length -= n;
+      if(mark && mark == in + n){
+        _start++;
+        _length--;
+        _inName = true;
+        _nameLength = 0;
       }
-      else // closing placeholder not found in content data, store found percent symbol as is and advance to the next position
-        ++pTemplateStart;
+      continue;
     }
-    else // closing placeholder not found in content data, store found percent symbol as is and advance to the next position
-      ++pTemplateStart;
-    if(paramName.length()) {
-      // call callback and replace with result.
-      // Everything in range [pTemplateStart, pTemplateEnd] can be safely replaced with parameter value.
-      // Data after pTemplateEnd may need to be moved.
-      // The first byte of data after placeholder is located at pTemplateEnd + 1.
-      // It should be located at pTemplateStart + numBytesCopied (to begin right after inserted parameter value).
-      const String paramValue(_callback(paramName));
-      const char* pvstr = paramValue.c_str();
-      const unsigned int pvlen = paramValue.length();
-      const size_t numBytesCopied = std::min(pvlen, static_cast<unsigned int>(&data[originalLen - 1] - pTemplateStart + 1));
-      // make room for param value
-      // 1. move extra data to cache if parameter value is longer than placeholder AND if there is no room to store
-      if((pTemplateEnd + 1 < pTemplateStart + numBytesCopied) && (originalLen - (pTemplateStart + numBytesCopied - pTemplateEnd - 1) < len)) {
-        _cache.insert(_cache.begin(), &data[originalLen - (pTemplateStart + numBytesCopied - pTemplateEnd - 1)], &data[len]);
-        //2. parameter value is longer than placeholder text, push the data after placeholder which not saved into cache further to the end
-        memmove(pTemplateStart + numBytesCopied, pTemplateEnd + 1, &data[originalLen] - pTemplateStart - numBytesCopied);
-        len = originalLen; // fix issue with truncated data, not sure if it has any side effects
-      } else if(pTemplateEnd + 1 != pTemplateStart + numBytesCopied)
-        //2. Either parameter value is shorter than placeholder text OR there is enough free space in buffer to fit.
-        //   Move the entire data after the placeholder
-        memmove(pTemplateStart + numBytesCopied, pTemplateEnd + 1, &data[len] - pTemplateEnd - 1);
-      // 3. replace placeholder with actual value
-      memcpy(pTemplateStart, pvstr, numBytesCopied);
-      // If result is longer than buffer, copy the remainder into cache (this could happen only if placeholder text itself did not fit entirely in buffer)
-      if(numBytesCopied < pvlen) {
-        _cache.insert(_cache.begin(), pvstr + numBytesCopied, pvstr + pvlen);
-      } else if(pTemplateStart + numBytesCopied < pTemplateEnd + 1) { // result is copied fully; if result is shorter than placeholder text...
-        // there is some free room, fill it from cache
-        const size_t roomFreed = pTemplateEnd + 1 - pTemplateStart - numBytesCopied;
-        const size_t totalFreeRoom = originalLen - len + roomFreed;
-        len += _readDataFromCacheOrContent(&data[len - roomFreed], totalFreeRoom) - roomFreed;
-      } else { // result is copied fully; it is longer than placeholder text
-        const size_t roomTaken = pTemplateStart + numBytesCopied - pTemplateEnd - 1;
-        len = std::min(len + roomTaken, originalLen);
+
+    //collect the name up to the closing placeholder, one byte more than a name can hold is enough to tell
+    size_t room = TEMPLATE_PARAM_NAME_LENGTH - _nameLength;
+    size_t scan = _length <= room ? _length : room + 1;
+    const uint8_t *mark = (const uint8_t*)memchr(in, TEMPLATE_PLACEHOLDER, scan);
+    size_t n = mark ? (size_t)(mark - in) : (scan <= room ? scan : room);
+    memcpy(_name + _nameLength, in, n);
+    _nameLength += n;
+    _start += n;
+    _length -= n;
+
+    if(mark){
+      _start++;
+      _length--;
+      _inName = false;
+      if(_nameLength == 0){
+        data[out++] = TEMPLATE_PLACEHOLDER; // "%%" is an escaped '%'
+      } else {
+        _name[_nameLength] = 0;
+        _value = callback(String(_name));
+        _pending = _value.c_str();
+        _pendingLength = _value.length();
       }
+    } else if(scan > room){
+      //too long for a name, the byte after it is scanned again as text
+      _nameAsText();
     }
-  } // while(pTemplateStart)
-  return len;
+  }
+  return out;
 }
 
 
@@ -478,33 +535,38 @@ size_t AsyncAbstractResponse::_fillBufferAndProcessTemplates(uint8_t* data, size
  * */
 
 AsyncFileResponse::~AsyncFileResponse(){
+  delete _ranges;
   if(_content)
     _content.close();
 }
 
+const char* AsyncFileResponse::contentTypeFor(const String& path){
+  if (path.endsWith(".html")) return "text/html";
+  else if (path.endsWith(".htm")) return "text/html";
+  else if (path.endsWith(".css")) return "text/css";
+  else if (path.endsWith(".json")) return "application/json";
+  else if (path.endsWith(".js")) return "application/javascript";
+  else if (path.endsWith(".png")) return "image/png";
+  else if (path.endsWith(".gif")) return "image/gif";
+  else if (path.endsWith(".jpg")) return "image/jpeg";
+  else if (path.endsWith(".ico")) return "image/x-icon";
+  else if (path.endsWith(".svg")) return "image/svg+xml";
+  else if (path.endsWith(".eot")) return "font/eot";
+  else if (path.endsWith(".woff")) return "font/woff";
+  else if (path.endsWith(".woff2")) return "font/woff2";
+  else if (path.endsWith(".ttf")) return "font/ttf";
+  else if (path.endsWith(".xml")) return "text/xml";
+  else if (path.endsWith(".pdf")) return "application/pdf";
+  else if (path.endsWith(".zip")) return "application/zip";
+  else if(path.endsWith(".gz")) return "application/x-gzip";
+  return "text/plain";
+}
+
 void AsyncFileResponse::_setContentType(const String& path){
-  if (path.endsWith(".html")) _contentType = "text/html";
-  else if (path.endsWith(".htm")) _contentType = "text/html";
-  else if (path.endsWith(".css")) _contentType = "text/css";
-  else if (path.endsWith(".json")) _contentType = "application/json";
-  else if (path.endsWith(".js")) _contentType = "application/javascript";
-  else if (path.endsWith(".png")) _contentType = "image/png";
-  else if (path.endsWith(".gif")) _contentType = "image/gif";
-  else if (path.endsWith(".jpg")) _contentType = "image/jpeg";
-  else if (path.endsWith(".ico")) _contentType = "image/x-icon";
-  else if (path.endsWith(".svg")) _contentType = "image/svg+xml";
-  else if (path.endsWith(".eot")) _contentType = "font/eot";
-  else if (path.endsWith(".woff")) _contentType = "font/woff";
-  else if (path.endsWith(".woff2")) _contentType = "font/woff2";
-  else if (path.endsWith(".ttf")) _contentType = "font/ttf";
-  else if (path.endsWith(".xml")) _contentType = "text/xml";
-  else if (path.endsWith(".pdf")) _contentType = "application/pdf";
-  else if (path.endsWith(".zip")) _contentType = "application/zip";
-  else if(path.endsWith(".gz")) _contentType = "application/x-gzip";
-  else _contentType = "text/plain";
-}
-
-AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback){
+  _contentType = contentTypeFor(path);
+}
+
+AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback), _ranges(NULL){
   _code = 200;
   _path = path;
 
@@ -538,7 +600,7 @@ AsyncFileResponse::AsyncFileResponse(FS &fs, const String& path, const String& c
   addHeader("Content-Disposition", buf);
 }
 
-AsyncFileResponse::AsyncFileResponse(File content, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback){
+AsyncFileResponse::AsyncFileResponse(File content, const String& path, const String& contentType, bool download, AwsTemplateProcessor callback): AsyncAbstractResponse(callback), _ranges(NULL){
   _code = 200;
   _path = path;
 
@@ -569,10 +631,239 @@ AsyncFileResponse::AsyncFileResponse(File content, const String& path, const Str
   addHeader("Content-Disposition", buf);
 }
 
+void AsyncFileResponse::_respond(AsyncWebServerRequest *request){
+  // Ranges are of the file as stored (a .gz one included), template output has no known length
+  if(_code == 200 && !_callback && _content){
+    addHeader("Accept-Ranges", "bytes");
+    if((request->method() & (HTTP_GET | HTTP_HEAD)) && request->hasHeader("Range") && _ifRangeMatches(request))
+      _applyRange(request->header("Range"));
+  }
+  AsyncAbstractResponse::_respond(request);
+}
+
+// If-Range asks for the ranges only while the file is the version the client has
+bool AsyncFileResponse::_ifRangeMatches(AsyncWebServerRequest *request) const {
+  if(!request->hasHeader("If-Range"))
+    return true;
+  String condition = request->header("If-Range");
+  if(condition.startsWith("W/"))
+    return false; // weak tags never match
+  const String* validator = _header(condition.startsWith("\"") ? "ETag" : "Last-Modified");
+  return validator && *validator == condition;
+}
+
+void AsyncFileResponse::_applyRange(const String& value){
+  size_t size = _contentLength;
+  AsyncByteRanges *ranges = new AsyncByteRanges();
+  if(ranges == NULL)
+    return;
+  int count = ranges->parse(value, size);
+  if(count < 0){
+    delete ranges;
+    return;
+  }
+
+  char buf[64];
+  if(count == 0){
+    delete ranges;
+    _code = 416;
+    snprintf(buf, sizeof(buf), "bytes */%u", (unsigned)size);
+    addHeader("Content-Range", buf);
+    _contentLength = 0; // the file stays open but is not read
+    return;
+  }
+
+  _code = 206;
+  _ranges = ranges;
+  if(count == 1){
+    snprintf(buf, sizeof(buf), "bytes %u-%u/%u", (unsigned)ranges->start(0), (unsigned)ranges->end(0), (unsigned)size);
+    addHeader("Content-Range", buf);
+    _contentLength = ranges->end(0) - ranges->start(0) + 1;
+  } else {
+    snprintf(buf, sizeof(buf), "byteranges_%08x%08x", (unsigned)random(0x7FFFFFFF), (unsigned)size);
+    _contentLength = ranges->multipart(_contentType, buf);
+    _contentType = "multipart/byteranges; boundary=" + String(buf);
+  }
+}
+
 size_t AsyncFileResponse::_fillBuffer(uint8_t *data, size_t len){
+  if(_ranges)
+    return _ranges->fill(_content, data, len);
   return _content.read(data, len);
 }
 
+/*
+ * Byte Ranges
+ * */
+
+AsyncByteRanges::AsyncByteRanges()
+  : _count(0)
+  , _next(0)
+  , _left(0)
+  , _size(0)
+  , _type()
+  , _boundary()
+  , _part()
+  , _partSent(0)
+  , _closed(false)
+{}
+
+//digits at p, saturating instead of wrapping around
+size_t AsyncByteRanges::_number(const char*& p){
+  size_t n = 0;
+  while(*p >= '0' && *p <= '9'){
+    size_t digit = *p++ - '0';
+    n = (n > (SIZE_MAX - digit) / 10) ? SIZE_MAX : n * 10 + digit;
+  }
+  return n;
+}
+
+int AsyncByteRanges::parse(const String& value, size_t size){
+  _count = 0;
+  _size = size;
+
+  const char *p = value.c_str();
+  while(*p == ' ') p++;
+  if(strncasecmp(p, "bytes=", 6) != 0)
+    return -1; // no other unit is known
+  p += 6;
+
+  bool any = false;
+  while(true){
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p == ',' ){
+      p++;
+      continue;
+    }
+    if(*p == 0)
+      break;
+
+    size_t first, last;
+    bool satisfiable;
+    if(*p == '-'){
+      // "-n" is the last n bytes
+      p++;
+      if(*p < '0' || *p > '9')
+        return -1;
+      size_t n = _number(p);
+      satisfiable = n > 0 && size > 0;
+      first = n < size ? size - n : 0;
+      last = size - 1;
+    } else {
+      if(*p < '0' || *p > '9')
+        return -1;
+      first = _number(p);
+      if(*p++ != '-')
+        return -1;
+      last = (*p >= '0' && *p <= '9') ? _number(p) : SIZE_MAX;
+      if(last < first)
+        return -1;
+      satisfiable = first < size;
+      if(last >= size)
+        last = size - 1;
+    }
+    any = true;
+
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p != ',' && *p != 0)
+      return -1;
+
+    if(satisfiable){
+      if(_count == WEBSERVER_MAX_RANGES)
+        return -1;
+      // insert sorted by start
+      uint8_t i = _count++;
+      while(i > 0 && _start[i - 1] > first){
+        _start[i] = _start[i - 1];
+        _end[i] = _end[i - 1];
+        i--;
+      }
+      _start[i] = first;
+      _end[i] = last;
+    }
+  }
+  if(!any)
+    return -1;
+
+  // merge what overlaps or touches
+  uint8_t merged = 0;
+  for(uint8_t i = 1; i < _count; i++){
+    if(_start[i] <= _end[merged] + 1){
+      if(_end[i] > _end[merged])
+        _end[merged] = _end[i];
+    } else {
+      merged++;
+      _start[merged] = _start[i];
+      _end[merged] = _end[i];
+    }
+  }
+  if(_count)
+    _count = merged + 1;
+  return _count;
+}
+
+String AsyncByteRanges::_partHead(uint8_t index) const {
+  char range[48];
+  snprintf(range, sizeof(range), "%u-%u/%u", (unsigned)_start[index], (unsigned)_end[index], (unsigned)_size);
+  String head;
+  head.reserve(_boundary.length() + _type.length() + 64);
+  if(index)
+    head += "\r\n";
+  head += "--";
+  head += _boundary;
+  head += "\r\nContent-Type: ";
+  head += _type;
+  head += "\r\nContent-Range: bytes ";
+  head += range;
+  head += "\r\n\r\n";
+  return head;
+}
+
+size_t AsyncByteRanges::multipart(const String& type, const String& boundary){
+  _type = type;
+  _boundary = boundary;
+  size_t length = 2 + 2 + _boundary.length() + 4; // "\r\n--boundary--\r\n"
+  for(uint8_t i = 0; i < _count; i++)
+    length += _partHead(i).length() + _end[i] - _start[i] + 1;
+  return length;
+}
+
+size_t AsyncByteRanges::fill(File& file, uint8_t *data, size_t len){
+  size_t out = 0;
+  while(out < len){
+    if(_partSent < _part.length()){
+      size_t n = _part.length() - _partSent;
+      if(n > len - out)
+        n = len - out;
+      memcpy(data + out, _part.c_str() + _partSent, n);
+      _partSent += n;
+      out += n;
+    } else if(_left){
+      size_t n = file.read(data + out, _left < len - out ? _left : len - out);
+      if(n == 0)
+        break;
+      _left -= n;
+      out += n;
+    } else if(_next < _count){
+      if(_boundary.length()){
+        _part = _partHead(_next);
+        _partSent = 0;
+      }
+      if(!file.seek(_start[_next]))
+        break;
+      _left = _end[_next] - _start[_next] + 1;
+      _next++;
+    } else if(_boundary.length() && !_closed){
+      _part = "\r\n--" + _boundary + "--\r\n";
+      _partSent = 0;
+      _closed = true;
+    } else {
+      break;
+    }
+  }
+  return out;
+}
+
 /*
  * Stream Response
  * */
@@ -662,6 +953,45 @@ size_t AsyncProgmemResponse::_fillBuffer(uint8_t *data, size_t len){
 }
 
 
+/*
+ * Asset Response (file content kept in RAM by AsyncWebAssetCache)
+ * */
+
+AsyncAssetResponse::AsyncAssetResponse(AsyncWebAsset *asset, bool gzip){
+  _code = 200;
+  _asset = asset;
+  _body = gzip ? &asset->gzip : &asset->plain;
+  _contentType = asset->contentType;
+  _contentLength = _body->length;
+  _readLength = 0;
+  AsyncWebAssetCache::retain(_asset);
+}
+
+AsyncAssetResponse::~AsyncAssetResponse(){
+  AsyncWebAssetCache::release(_asset);
+}
+
+String AsyncAssetResponse::_assembleHead(uint8_t version){
+  String out = AsyncAbstractResponse::_assembleHead(version);
+  //the prebuilt asset headers go in front of the empty line closing the head
+  String head;
+  head.reserve(out.length() + _body->head.length());
+  head.concat(out.substring(0, out.length() - 2));
+  head.concat(_body->head);
+  head.concat("\r\n");
+  _headLength = head.length();
+  return head;
+}
+
+size_t AsyncAssetResponse::_fillBuffer(uint8_t *data, size_t len){
+  size_t left = _contentLength - _readLength;
+  if(left > len)
+    left = len;
+  memcpy(data, _body->data + _readLength, left);
+  _readLength += left;
+  return left;
+}
+
 /*
  * Response Stream (You can print/write/printf to it, up to the contentLen bytes)
  * */
@@ -0,0 +1,228 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "WebRouteTable.h"
+
+AsyncWebRouteTable::Node::Node(const char* l, size_t len)
+  : label()
+  , paramChild(ROUTE_NO_NODE)
+{
+  label.reserve(len);
+  for(size_t i = 0; i < len; i++)
+    label += l[i];
+}
+
+AsyncWebRouteTable::AsyncWebRouteTable(){
+  clear();
+}
+
+void AsyncWebRouteTable::clear(){
+  _nodes.clear();
+  _extensions.clear();
+  _opaque.clear();
+  _nodes.push_back(Node("", 0));
+}
+
+bool AsyncWebRouteTable::isParamSegment(const char* segment, size_t len){
+  return len > 2 && segment[0] == '{' && segment[len - 1] == '}';
+}
+
+uint16_t AsyncWebRouteTable::_child(uint16_t node, const char* label, size_t len, bool param){
+  if(param){
+    if(_nodes[node].paramChild != ROUTE_NO_NODE)
+      return _nodes[node].paramChild;
+  } else {
+    for(uint16_t c : _nodes[node].children){
+      const String& l = _nodes[c].label;
+      if(l.length() == len && memcmp(l.c_str(), label, len) == 0)
+        return c;
+    }
+  }
+  if(_nodes.size() >= ROUTE_NO_NODE)
+    return ROUTE_NO_NODE;
+
+  uint16_t c = _nodes.size();
+  _nodes.push_back(Node(label, len));
+  if(param)
+    _nodes[node].paramChild = c;
+  else
+    _nodes[node].children.push_back(c);
+  return c;
+}
+
+void AsyncWebRouteTable::add(uint16_t index, WebRouteKind kind, const String& uri, uint8_t methods){
+  Entry entry;
+  entry.index = index;
+  entry.kind = kind;
+  entry.methods = methods;
+
+  const char* u = uri.c_str();
+  size_t len = uri.length();
+
+  if(kind == ROUTE_EXTENSION && len){
+    entry.rest = uri;
+    _extensions.push_back(entry);
+    return;
+  }
+
+  if(kind != ROUTE_OPAQUE && (len == 0 || u[0] == '/')){
+    //walk the full segments, a prefix keeps the tail after its last '/' for a string compare
+    size_t end = len;
+    if(kind == ROUTE_PREFIX){
+      end = 0;
+      for(size_t i = 0; i < len; i++)
+        if(u[i] == '/') end = i;
+      entry.rest = uri.substring(end);
+    }
+
+    uint16_t node = 0;
+    uint8_t params = 0;
+    size_t pos = 0;
+    while(node != ROUTE_NO_NODE && pos < end){
+      size_t start = pos + 1;
+      size_t stop = start;
+      while(stop < end && u[stop] != '/') stop++;
+
+      bool param = kind == ROUTE_PATH && isParamSegment(u + start, stop - start);
+      if(param && ++params > ROUTE_MAX_PARAMS)
+        break;
+      node = _child(node, u + start, stop - start, param);
+      pos = stop;
+    }
+
+    if(node != ROUTE_NO_NODE && pos >= end){
+      _nodes[node].entries.push_back(entry);
+      return;
+    }
+  }
+
+  //can not be expressed in the trie, canHandle() decides
+  entry.kind = ROUTE_OPAQUE;
+  entry.methods = 0xFF;
+  entry.rest = String();
+  _opaque.push_back(entry);
+}
+
+void AsyncWebRouteTable::_collect(const Entry& entry, Walk& walk){
+  if(!(entry.methods & walk.method))
+    return;
+  if(walk.count == walk.maxMatches){
+    walk.overflow = true;
+    return;
+  }
+  Match& m = walk.matches[walk.count++];
+  m.index = entry.index;
+  m.kind = entry.kind;
+  m.params = walk.params;
+  for(uint8_t i = 0; i < walk.params; i++){
+    m.paramStart[i] = walk.paramStart[i];
+    m.paramLength[i] = walk.paramLength[i];
+  }
+}
+
+void AsyncWebRouteTable::_walk(uint16_t node, size_t pos, Walk& walk) const {
+  const Node& n = _nodes[node];
+  const char* rest = walk.url + pos;
+  size_t restLength = walk.length - pos;
+
+  for(const Entry& e : n.entries){
+    switch(e.kind){
+      case ROUTE_EXACT:
+        if(restLength == 0)
+          _collect(e, walk);
+        break;
+      case ROUTE_PATH:
+        _collect(e, walk);
+        break;
+      case ROUTE_PREFIX:
+        if(restLength >= e.rest.length() && memcmp(rest, e.rest.c_str(), e.rest.length()) == 0)
+          _collect(e, walk);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if(restLength == 0 || walk.overflow)
+    return;
+
+  //next segment, rest starts with '/'
+  size_t start = pos + 1;
+  size_t stop = start;
+  while(stop < walk.length && walk.url[stop] != '/') stop++;
+  size_t len = stop - start;
+
+  for(uint16_t c : n.children){
+    const String& l = _nodes[c].label;
+    if(l.length() == len && memcmp(l.c_str(), walk.url + start, len) == 0){
+      _walk(c, stop, walk);
+      break;
+    }
+  }
+
+  if(n.paramChild != ROUTE_NO_NODE && len && walk.params < ROUTE_MAX_PARAMS){
+    walk.paramStart[walk.params] = start;
+    walk.paramLength[walk.params] = len;
+    walk.params++;
+    _walk(n.paramChild, stop, walk);
+    walk.params--;
+  }
+}
+
+int AsyncWebRouteTable::match(const char* url, size_t length, uint8_t method, Match* matches, size_t maxMatches) const {
+  if(length > 0xFFFF || (length && url[0] != '/'))
+    return -1;
+
+  Walk walk;
+  walk.url = url;
+  walk.length = length;
+  walk.method = method;
+  walk.matches = matches;
+  walk.maxMatches = maxMatches;
+  walk.count = 0;
+  walk.overflow = false;
+  walk.params = 0;
+
+  for(const Entry& e : _opaque)
+    _collect(e, walk);
+
+  for(const Entry& e : _extensions){
+    size_t len = e.rest.length();
+    if(length >= len && memcmp(url + length - len, e.rest.c_str(), len) == 0)
+      _collect(e, walk);
+  }
+
+  _walk(0, 0, walk);
+
+  if(walk.overflow)
+    return -1;
+
+  //candidates are tried in registration order
+  for(size_t i = 1; i < walk.count; i++){
+    Match m = matches[i];
+    size_t j = i;
+    while(j > 0 && matches[j - 1].index > m.index){
+      matches[j] = matches[j - 1];
+      j--;
+    }
+    matches[j] = m;
+  }
+  return walk.count;
+}
@@ -0,0 +1,111 @@
+/*
+  Asynchronous WebServer library for Espressif MCUs
+
+  Copyright (c) 2016 Hristo Gochkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#ifndef ASYNCWEBROUTETABLE_H_
+#define ASYNCWEBROUTETABLE_H_
+
+#include "Arduino.h"
+#include <vector>
+
+//max handlers (or rewrites) matched by a single url before dispatch falls back to the linear scan
+#ifndef ROUTE_MAX_CANDIDATES
+#define ROUTE_MAX_CANDIDATES 16
+#endif
+
+//max {name} segments captured per route
+#ifndef ROUTE_MAX_PARAMS
+#define ROUTE_MAX_PARAMS 4
+#endif
+
+#define ROUTE_NO_NODE 0xFFFF
+
+/*
+ * ROUTE KIND :: How a handler or rewrite matches the request url
+ * */
+
+typedef enum {
+  ROUTE_OPAQUE,     // only canHandle() knows, always a candidate
+  ROUTE_EXACT,      // url equals the uri
+  ROUTE_PATH,       // url equals the uri or continues below it, {name} segments are captured
+  ROUTE_PREFIX,     // url starts with the uri
+  ROUTE_EXTENSION   // url ends with the uri, e.g. ".css"
+} WebRouteKind;
+
+/*
+ * ROUTE TABLE :: Trie keyed on url segments, rebuilt by the server when handlers change.
+ * Matching walks the url once and does not allocate.
+ * */
+
+class AsyncWebRouteTable {
+  public:
+    struct Match {
+      uint16_t index;   // registration order of the handler or rewrite
+      uint8_t kind;
+      uint8_t params;
+      uint16_t paramStart[ROUTE_MAX_PARAMS];
+      uint16_t paramLength[ROUTE_MAX_PARAMS];
+    };
+
+  private:
+    struct Entry {
+      uint16_t index;
+      uint8_t kind;
+      uint8_t methods;
+      String rest;      // part of a prefix after the last full segment, or the extension
+    };
+    struct Node {
+      String label;
+      uint16_t paramChild;
+      std::vector<uint16_t> children;
+      std::vector<Entry> entries;
+      Node(const char* l, size_t len);
+    };
+    struct Walk {
+      const char* url;
+      size_t length;
+      uint8_t method;
+      Match* matches;
+      size_t maxMatches;
+      size_t count;
+      bool overflow;
+      uint8_t params;
+      uint16_t paramStart[ROUTE_MAX_PARAMS];
+      uint16_t paramLength[ROUTE_MAX_PARAMS];
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<Entry> _extensions;
+    std::vector<Entry> _opaque;
+
+    uint16_t _child(uint16_t node, const char* label, size_t len, bool param);
+    void _walk(uint16_t node, size_t pos, Walk& walk) const;
+    static void _collect(const Entry& entry, Walk& walk);
+
+  public:
+    AsyncWebRouteTable();
+    void clear();
+    void add(uint16_t index, WebRouteKind kind, const String& uri, uint8_t methods);
+    //fills matches sorted by index, returns -1 if the url can not be resolved by the table
+    int match(const char* url, size_t length, uint8_t method, Match* matches, size_t maxMatches) const;
+    //true for a "{name}" path segment
+    static bool isParamSegment(const char* segment, size_t len);
+};
+
+#endif /* ASYNCWEBROUTETABLE_H_ */
@@ -29,11 +29,17 @@ bool ON_AP_FILTER(AsyncWebServerRequest *request) {
   return WiFi.localIP() != request->client()->localIP();
 }
 
+uint32_t AsyncWebHandler::_routeGeneration = 1;
+
 
 AsyncWebServer::AsyncWebServer(uint16_t port)
   : _server(port)
   , _rewrites(LinkedList<AsyncWebRewrite*>([](AsyncWebRewrite* r){ delete r; }))
   , _handlers(LinkedList<AsyncWebHandler*>([](AsyncWebHandler* h){ delete h; }))
+  , _routeGeneration(0)
+  , _keepAlive(true)
+  , _badRequests()
+  , _connections(0)
 {
   _catchAllHandler = new AsyncCallbackWebHandler();
   if(_catchAllHandler == NULL)
@@ -42,12 +48,12 @@ AsyncWebServer::AsyncWebServer(uint16_t port)
     if(c == NULL)
       return;
     c->setRxTimeout(3);
+    ((AsyncWebServer*)s)->_connections++;
+    //a full pool makes room by closing an idle persistent connection
+    AsyncWebServerRequest::_closeIdle();
     AsyncWebServerRequest *r = new AsyncWebServerRequest((AsyncWebServer*)s, c);
-    if(r == NULL){
-      c->close(true);
-      c->free();
-      delete c;
-    }
+    if(r == NULL)
+      AsyncWebServerRequest::_refuse(c);
   }, this);
 }
 
@@ -59,27 +65,55 @@ AsyncWebServer::~AsyncWebServer(){
 
 AsyncWebRewrite& AsyncWebServer::addRewrite(AsyncWebRewrite* rewrite){
   _rewrites.add(rewrite);
+  AsyncWebHandler::invalidateRoutes();
   return *rewrite;
 }
 
 bool AsyncWebServer::removeRewrite(AsyncWebRewrite *rewrite){
-  return _rewrites.remove(rewrite);
+  //a table built before the remove would still point at the deleted rewrite
+  bool removed = _rewrites.remove(rewrite);
+  AsyncWebHandler::invalidateRoutes();
+  return removed;
 }
 
 AsyncWebRewrite& AsyncWebServer::rewrite(const char* from, const char* to){
-  return addRewrite(new AsyncWebRewrite(from, to));
+  AsyncWebRewrite* rewrite = new AsyncWebRewrite(from, to);
+  rewrite->_exact = true;
+  return addRewrite(rewrite);
 }
 
 AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler){
   _handlers.add(handler);
+  AsyncWebHandler::invalidateRoutes();
   return *handler;
 }
 
 bool AsyncWebServer::removeHandler(AsyncWebHandler *handler){
-  return _handlers.remove(handler);
+  bool removed = _handlers.remove(handler);
+  AsyncWebHandler::invalidateRoutes();
+  return removed;
+}
+
+void AsyncWebServer::_buildRoutes(){
+  _routeGeneration = AsyncWebHandler::routeGeneration();
+
+  _rewriteRoutes.clear();
+  _rewriteList.clear();
+  for(const auto& r: _rewrites){
+    _rewriteRoutes.add(_rewriteList.size(), r->_exact ? ROUTE_EXACT : ROUTE_OPAQUE, r->from(), HTTP_ANY);
+    _rewriteList.push_back(r);
+  }
+
+  _handlerRoutes.clear();
+  _handlerList.clear();
+  for(const auto& h: _handlers){
+    _handlerRoutes.add(_handlerList.size(), h->routeKind(), h->routeUri(), h->routeMethods());
+    _handlerList.push_back(h);
+  }
 }
 
 void AsyncWebServer::begin(){
+  _buildRoutes();
   _server.setNoDelay(true);
   _server.begin();
 }
@@ -98,27 +132,196 @@ void AsyncWebServer::beginSecure(const char *cert, const char *key, const char *
 }
 #endif
 
+AsyncWebPoolStats AsyncWebServer::poolStats(){
+  AsyncWebPoolStats stats;
+  AsyncWebServerRequest::_poolStats(stats);
+  AsyncWebServerResponse::_poolStats(stats);
+  return stats;
+}
+
+/*
+ * Metrics
+ * */
+
+typedef struct {
+  String handler;
+  String id;
+  const AsyncWebMetrics* metrics;
+} WebMetricsSeries;
+
+//name{handler="...",id="..." ; the caller adds any further labels and the value
+static void printSeries(Print& out, const char* name, const WebMetricsSeries& series){
+  out.print(name);
+  out.print("{handler=\"");
+  for(size_t i = 0; i < series.handler.length(); i++){
+    char c = series.handler[i];
+    if(c == '"' || c == '\\')
+      out.print('\\');
+    out.print(c);
+  }
+  out.printf("\",id=\"%s\"", series.id.c_str());
+}
+
+static void printFamily(Print& out, const char* name, const char* type, const char* help){
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+//Prometheus wants all series of one metric together, so each family walks the handlers once
+void AsyncWebServer::printMetrics(Print& out){
+  std::vector<WebMetricsSeries> series;
+  uint16_t index = 0;
+  for(const auto& h: _handlers){
+    //the position keeps handlers with the same (or no) uri apart
+    series.push_back({h->routeUri(), String(index++), &h->metrics()});
+  }
+  if(_catchAllHandler != NULL)
+    series.push_back({String(), String("notfound"), &_catchAllHandler->metrics()});
+  series.push_back({String(), String("badrequest"), &_badRequests});
+
+  printFamily(out, "http_requests_total", "counter", "Requests answered");
+  for(const auto& s: series){
+    printSeries(out, "http_requests_total", s);
+    out.printf("} %u\n", s.metrics->requests);
+  }
+  printFamily(out, "http_received_bytes_total", "counter", "Request bytes received");
+  for(const auto& s: series){
+    printSeries(out, "http_received_bytes_total", s);
+    out.printf("} %u\n", s.metrics->bytesIn);
+  }
+  printFamily(out, "http_sent_bytes_total", "counter", "Response bytes sent");
+  for(const auto& s: series){
+    printSeries(out, "http_sent_bytes_total", s);
+    out.printf("} %u\n", s.metrics->bytesOut);
+  }
+  printFamily(out, "http_request_duration_seconds", "histogram", "First request byte to last response byte");
+  for(const auto& s: series){
+    const AsyncWebMetrics& m = *s.metrics;
+    uint32_t count = 0;
+    for(uint8_t b = 0; b <= WEBSERVER_METRICS_BUCKETS; b++){
+      count += m.latency[b];
+      printSeries(out, "http_request_duration_seconds_bucket", s);
+      out.printf(",le=\"%s\"} %u\n", (b < WEBSERVER_METRICS_BUCKETS)?AsyncWebMetrics::bucketLabel[b]:"+Inf", count);
+    }
+    printSeries(out, "http_request_duration_seconds_sum", s);
+    out.printf("} %lu.%06lu\n", (unsigned long)(m.latencySumUs / 1000000), (unsigned long)(m.latencySumUs % 1000000));
+    printSeries(out, "http_request_duration_seconds_count", s);
+    out.printf("} %u\n", count);
+  }
+
+  AsyncWebPoolStats pool = poolStats();
+  printFamily(out, "http_connections_total", "counter", "Connections accepted");
+  out.printf("http_connections_total %u\n", _connections);
+  printFamily(out, "http_connections_refused_total", "counter", "Connections answered with 503, all requests in use");
+  out.printf("http_connections_refused_total %u\n", pool.requestsRefused);
+  printFamily(out, "http_connections_open", "gauge", "Connections open now");
+  out.printf("http_connections_open %u\n", pool.requests);
+  printFamily(out, "http_connections_open_peak", "gauge", "Most connections open at once");
+  out.printf("http_connections_open_peak %u\n", pool.requestsPeak);
+  printFamily(out, "http_responses_on_heap_total", "counter", "Responses that did not fit the response pool");
+  out.printf("http_responses_on_heap_total %u\n", pool.responsesOnHeap);
+
+#ifdef ESP32
+  AsyncTcpStats tcp = asyncTcpStats();
+  printFamily(out, "async_tcp_queue_depth", "gauge", "Events waiting for the async_tcp task");
+  out.printf("async_tcp_queue_depth %u\n", tcp.queued);
+  printFamily(out, "async_tcp_events_total", "counter", "Events handled by the async_tcp task");
+  out.printf("async_tcp_events_total %u\n", tcp.events);
+  printFamily(out, "async_tcp_batches_total", "counter", "Times the async_tcp task woke up for events");
+  out.printf("async_tcp_batches_total %u\n", tcp.batches);
+  printFamily(out, "async_tcp_busy_seconds_total", "counter", "Time the async_tcp task spent handling events");
+  out.printf("async_tcp_busy_seconds_total %lu.%06lu\n", (unsigned long)(tcp.busyUs / 1000000), (unsigned long)(tcp.busyUs % 1000000));
+  printFamily(out, "async_tcp_events_per_second", "gauge", "Events handled over the last second");
+  out.printf("async_tcp_events_per_second %u\n", tcp.eventsPerSecond);
+  printFamily(out, "async_tcp_event_seconds", "gauge", "Average time per event over the last second");
+  out.printf("async_tcp_event_seconds %u.%06u\n", tcp.usPerEvent / 1000000, tcp.usPerEvent % 1000000);
+  printFamily(out, "async_tcp_pool_exhausted_total", "counter", "Event packets taken from the heap, the pool was empty");
+  out.printf("async_tcp_pool_exhausted_total %u\n", tcp.poolExhausted);
+#endif
+
+  printFamily(out, "heap_free_bytes", "gauge", "Free heap");
+  out.printf("heap_free_bytes %u\n", ESP.getFreeHeap());
+#ifdef ESP32
+  printFamily(out, "heap_free_min_bytes", "gauge", "Lowest free heap since boot");
+  out.printf("heap_free_min_bytes %u\n", ESP.getMinFreeHeap());
+  printFamily(out, "heap_largest_block_bytes", "gauge", "Largest block that can be allocated");
+  out.printf("heap_largest_block_bytes %u\n", ESP.getMaxAllocHeap());
+#endif
+}
+
 void AsyncWebServer::_handleDisconnect(AsyncWebServerRequest *request){
   delete request;
 }
 
 void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *request){
-  for(const auto& r: _rewrites){
-    if (r->match(request)){
-      request->_url = r->toUrl();
-      request->_addGetParams(r->params());
+  if(_routeGeneration != AsyncWebHandler::routeGeneration())
+    _buildRoutes();
+
+  //rewrites apply in order, each one sees the url left by the previous ones
+  AsyncWebRouteTable::Match matches[ROUTE_MAX_CANDIDATES];
+  size_t next = 0;
+  while(next < _rewriteList.size()){
+    int count = _rewriteRoutes.match(request->_url.c_str(), request->_url.length(), request->method(), matches, ROUTE_MAX_CANDIDATES);
+    if(count < 0){
+      for(size_t i = next; i < _rewriteList.size(); i++){
+        AsyncWebRewrite* r = _rewriteList[i];
+        if (r->match(request)){
+          request->_url = r->toUrl();
+          request->_addGetParams(r->params());
+        }
+      }
+      return;
     }
+
+    bool rewritten = false;
+    for(int i = 0; i < count && !rewritten; i++){
+      if(matches[i].index < next)
+        continue;
+      AsyncWebRewrite* r = _rewriteList[matches[i].index];
+      if (r->match(request)){
+        request->_url = r->toUrl();
+        request->_addGetParams(r->params());
+        next = matches[i].index + 1;
+        rewritten = true;
+      }
+    }
+    if(!rewritten)
+      return;
   }
 }
 
 void AsyncWebServer::_attachHandler(AsyncWebServerRequest *request){
-  for(const auto& h: _handlers){
-    if (h->filter(request) && h->canHandle(request)){
-      request->setHandler(h);
-      return;
+  if(_routeGeneration != AsyncWebHandler::routeGeneration())
+    _buildRoutes();
+
+  AsyncWebRouteTable::Match matches[ROUTE_MAX_CANDIDATES];
+  const String& url = request->url();
+  int count = _handlerRoutes.match(url.c_str(), url.length(), request->method(), matches, ROUTE_MAX_CANDIDATES);
+
+  if(count < 0){
+    //too many candidates or a url the table does not understand
+    for(const auto& h: _handlers){
+      if (h->filter(request) && h->canHandle(request)){
+        request->setHandler(h);
+        return;
+      }
+    }
+  } else {
+    for(int i = 0; i < count; i++){
+      const AsyncWebRouteTable::Match& m = matches[i];
+      AsyncWebHandler* h = _handlerList[m.index];
+      if (!h->filter(request))
+        continue;
+      for(uint8_t p = 0; p < m.params; p++)
+        request->_addPathParam(url.c_str() + m.paramStart[p], m.paramLength[p]);
+      if (m.kind == ROUTE_OPAQUE ? h->canHandle(request) : h->canHandleRoute(request)){
+        request->setHandler(h);
+        return;
+      }
+      if(m.params)
+        request->_pathParams.free();
     }
   }
-  
+
   request->addInterestingHeader("ANY");
   request->setHandler(_catchAllHandler);
 }
@@ -183,6 +386,7 @@ void AsyncWebServer::onRequestBody(ArBodyHandlerFunction fn){
 void AsyncWebServer::reset(){
   _rewrites.free();
   _handlers.free();
+  AsyncWebHandler::invalidateRoutes();
   
   if (_catchAllHandler != NULL){
     _catchAllHandler->onRequest(NULL);
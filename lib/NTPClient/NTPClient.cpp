@@ -117,6 +117,89 @@ bool NTPClient::forceUpdate() {
   return true;  // return true after successful update
 }
 
+bool NTPClient::sendRequest() {
+  if (!this->_udpSetup) this->begin(this->_port);
+
+  // flush any existing packets
+  while(this->_udp->parsePacket() != 0)
+    this->_udp->flush();
+
+  this->_requestPending = false;
+  if (!this->sendNTPPacket()) return false;
+
+  this->_requestSentMicros = micros();
+  this->_requestPending = true;
+  return true;
+}
+
+int NTPClient::checkResponse(unsigned long timeout) {
+  if (!this->_requestPending) return NTP_RESPONSE_FAILED;
+
+  while (this->_udp->parsePacket() >= NTP_PACKET_SIZE) {
+    unsigned long receivedMicros = micros();
+    this->_udp->read(this->_packetBuffer, NTP_PACKET_SIZE);
+    if (this->parseResponse(receivedMicros)) {
+      this->_requestPending = false;
+      // Keep the address the name resolved to, looking it up blocks
+      if (this->_poolServerName && !this->_resolved) {
+        this->_resolvedIP = this->_udp->remoteIP();
+        this->_resolved = true;
+        this->_resolvedAt = millis();
+      }
+      return NTP_RESPONSE_OK;
+    }
+  }
+
+  if (micros() - this->_requestSentMicros >= timeout * 1000UL) {
+    this->_requestPending = false;
+    // The pool may have dropped that server, the next request looks the name up again
+    this->_resolved = false;
+    return NTP_RESPONSE_FAILED;
+  }
+  return NTP_RESPONSE_PENDING;
+}
+
+bool NTPClient::isRequestPending() const {
+  return this->_requestPending;
+}
+
+unsigned long long NTPClient::getServerMicros() const {
+  return this->_serverMicros;
+}
+
+unsigned long NTPClient::getRoundTripMicros() const {
+  return this->_roundTripMicros;
+}
+
+// Convert a 64 bit NTP timestamp (seconds since 1900 + 32 bit fraction) to microseconds since 1970
+static unsigned long long ntpToMicros(const byte* p) {
+  unsigned long seconds = (unsigned long)p[0] << 24 | (unsigned long)p[1] << 16 | (unsigned long)p[2] << 8 | p[3];
+  unsigned long fraction = (unsigned long)p[4] << 24 | (unsigned long)p[5] << 16 | (unsigned long)p[6] << 8 | p[7];
+
+  unsigned long long unixSeconds = seconds - SEVENZYYEARS;
+  if (seconds < SEVENZYYEARS) unixSeconds += 0x100000000ULL; // NTP era 1 starts in 2036
+
+  return unixSeconds * 1000000ULL + (((unsigned long long)fraction * 1000000ULL) >> 32);
+}
+
+bool NTPClient::parseResponse(unsigned long receivedMicros) {
+  // Only accept server mode replies to our own request, stratum 0 is a kiss-o'-death
+  if ((this->_packetBuffer[0] & 0x07) != 4 || this->_packetBuffer[1] == 0) return false;
+  if (memcmp(this->_packetBuffer + 24, this->_requestStamp, sizeof(this->_requestStamp)) != 0) return false;
+
+  unsigned long long serverReceive = ntpToMicros(this->_packetBuffer + 32);
+  unsigned long long serverTransmit = ntpToMicros(this->_packetBuffer + 40);
+
+  unsigned long elapsed = receivedMicros - this->_requestSentMicros;
+  unsigned long processing = serverTransmit > serverReceive ? (unsigned long)(serverTransmit - serverReceive) : 0;
+  this->_roundTripMicros = elapsed > processing ? elapsed - processing : 0;
+  this->_serverMicros = serverTransmit + this->_roundTripMicros / 2;
+
+  this->_currentEpoc = this->_serverMicros / 1000000ULL;
+  this->_lastUpdate = millis() - (unsigned long)(this->_serverMicros % 1000000ULL) / 1000;
+  return true;
+}
+
 bool NTPClient::update() {
   if ((millis() - this->_lastUpdate >= this->_updateInterval)     // Update after _updateInterval
     || this->_lastUpdate == 0) {                                // Update if there was no update yet.
@@ -179,9 +262,14 @@ void NTPClient::setUpdateInterval(unsigned long updateInterval) {
 
 void NTPClient::setPoolServerName(const char* poolServerName) {
     this->_poolServerName = poolServerName;
+    this->_resolved = false;
+}
+
+void NTPClient::setServerPort(unsigned int serverPort) {
+    this->_serverPort = serverPort;
 }
 
-void NTPClient::sendNTPPacket() {
+bool NTPClient::sendNTPPacket() {
   // set all bytes in the buffer to 0
   memset(this->_packetBuffer, 0, NTP_PACKET_SIZE);
   // Initialize values needed to form NTP request
@@ -195,15 +283,31 @@ void NTPClient::sendNTPPacket() {
   this->_packetBuffer[14]  = 49;
   this->_packetBuffer[15]  = 52;
 
+  // Transmit timestamp, only used to match the reply (it is copied into the originate field)
+  unsigned long stampHigh = millis();
+  unsigned long stampLow = micros();
+  for (int i = 0; i < 4; i++) {
+    this->_requestStamp[i] = stampHigh >> (24 - 8 * i);
+    this->_requestStamp[4 + i] = stampLow >> (24 - 8 * i);
+  }
+  memcpy(this->_packetBuffer + 40, this->_requestStamp, sizeof(this->_requestStamp));
+
   // all NTP fields have been given values, now
   // you can send a packet requesting a timestamp:
-  if  (this->_poolServerName) {
-    this->_udp->beginPacket(this->_poolServerName, 123);
+  int ok;
+  if (this->_resolved && millis() - this->_resolvedAt >= NTP_DEFAULT_RESOLVE_INTERVAL) {
+    this->_resolved = false;
+  }
+  if  (this->_poolServerName && this->_resolved) {
+    ok = this->_udp->beginPacket(this->_resolvedIP, this->_serverPort);
+  } else if (this->_poolServerName) {
+    ok = this->_udp->beginPacket(this->_poolServerName, this->_serverPort);
   } else {
-    this->_udp->beginPacket(this->_poolServerIP, 123);
+    ok = this->_udp->beginPacket(this->_poolServerIP, this->_serverPort);
   }
+  if (!ok) return false;
   this->_udp->write(this->_packetBuffer, NTP_PACKET_SIZE);
-  this->_udp->endPacket();
+  return this->_udp->endPacket() != 0;
 }
 
 void NTPClient::setRandomPort(unsigned int minValue, unsigned int maxValue) {
@@ -7,6 +7,12 @@
 #define SEVENZYYEARS 2208988800UL
 #define NTP_PACKET_SIZE 48
 #define NTP_DEFAULT_LOCAL_PORT 1337
+#define NTP_DEFAULT_SERVER_PORT 123
+#define NTP_DEFAULT_RESOLVE_INTERVAL 3600000UL // In ms, a pool address is used this long before the name is looked up again
+
+#define NTP_RESPONSE_FAILED  -1
+#define NTP_RESPONSE_PENDING  0
+#define NTP_RESPONSE_OK       1
 
 class NTPClient {
   private:
@@ -15,7 +21,11 @@ class NTPClient {
 
     const char*   _poolServerName = "pool.ntp.org"; // Default time server
     IPAddress     _poolServerIP;
+    IPAddress     _resolvedIP;              // Address of _poolServerName that answered last
+    bool          _resolved       = false;
+    unsigned long _resolvedAt     = 0;      // In ms
     unsigned int  _port           = NTP_DEFAULT_LOCAL_PORT;
+    unsigned int  _serverPort     = NTP_DEFAULT_SERVER_PORT;
     long          _timeOffset     = 0;
 
     unsigned long _updateInterval = 60000;  // In ms
@@ -25,7 +35,15 @@ class NTPClient {
 
     byte          _packetBuffer[NTP_PACKET_SIZE];
 
-    void          sendNTPPacket();
+    bool          _requestPending = false;
+    unsigned long _requestSentMicros = 0;
+    byte          _requestStamp[8];         // Transmit timestamp echoed back by the server
+
+    unsigned long long _serverMicros = 0;   // Server time (us since 1970) when the last reply arrived
+    unsigned long _roundTripMicros = 0;
+
+    bool          sendNTPPacket();
+    bool          parseResponse(unsigned long receivedMicros);
 
   public:
     NTPClient(UDP& udp);
@@ -44,6 +62,13 @@ class NTPClient {
      */
     void setPoolServerName(const char* poolServerName);
 
+    /**
+     * Set the UDP port of the time server, e.g. for a local test server
+     *
+     * @param serverPort
+     */
+    void setServerPort(unsigned int serverPort);
+
      /**
      * Set random local port
      */
@@ -74,6 +99,41 @@ class NTPClient {
      */
     bool forceUpdate();
 
+    /**
+     * Send a single request without waiting for the answer. Poll checkResponse()
+     * from the main loop to collect it. The server name is only looked up for the
+     * first request, after a request went unanswered and every NTP_DEFAULT_RESOLVE_INTERVAL,
+     * the address that answered is used in between.
+     *
+     * @return true if the request was sent
+     */
+    bool sendRequest();
+
+    /**
+     * Non-blocking counterpart of forceUpdate(). Reads the reply to the last
+     * sendRequest() if it has arrived. Replies that do not echo our request are ignored.
+     *
+     * @return NTP_RESPONSE_OK, NTP_RESPONSE_PENDING or NTP_RESPONSE_FAILED on timeout
+     */
+    int checkResponse(unsigned long timeout = 1000);
+
+    /**
+     * @return true while a request sent with sendRequest() is waiting for its reply
+     */
+    bool isRequestPending() const;
+
+    /**
+     * @return server time in microseconds since Jan. 1, 1970 at the moment the last
+     * reply was read, corrected by half the network delay
+     */
+    unsigned long long getServerMicros() const;
+
+    /**
+     * @return round trip time of the last reply in microseconds, without the time
+     * the server spent processing the request
+     */
+    unsigned long getRoundTripMicros() const;
+
     /**
      * This allows to check if the NTPClient successfully received a NTP packet and set the time.
      *
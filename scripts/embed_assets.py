@@ -0,0 +1,250 @@
+# PlatformIO pre-build script: embeds the web files from data/ into the firmware.
+#
+# Every file is minified (html, css, js), gzipped and written as a byte array to
+# include/web_assets_data.h. Files other than html pages get the first 8 hex digits
+# of their content hash in the name (style.css -> style.1a2b3c4d.css) and the
+# pages are rewritten to reference those names, so they can be cached forever.
+#
+# Also runs standalone: python scripts/embed_assets.py [project dir]
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+WEB_TYPES = {
+    ".html": "text/html",
+    ".htm": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".gif": "image/gif",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+    ".svg": "image/svg+xml",
+}
+
+HEADER = "web_assets_data.h"
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{}:;,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+# A "/" after one of these (or at the start) begins a regular expression, otherwise it divides
+REGEX_AFTER = set("(,=:[!&|?{};+-*%<>~^")
+REGEX_KEYWORDS = {"return", "typeof", "case", "do", "else", "in", "of", "new", "delete", "void",
+                  "throw", "instanceof", "yield", "await"}
+
+
+def skip_string(text, i):
+    # text[i] is the opening quote, returns the index after the closing one
+    quote = text[i]
+    i += 1
+    while i < len(text) and text[i] != quote and text[i] != "\n":
+        i += 2 if text[i] == "\\" else 1
+    return i + 1
+
+
+def skip_regex(text, i):
+    # text[i] is the opening slash; a slash inside a [class] does not end it
+    i += 1
+    in_class = False
+    while i < len(text) and text[i] != "\n":
+        c = text[i]
+        if c == "\\":
+            i += 2
+            continue
+        if c == "[":
+            in_class = True
+        elif c == "]":
+            in_class = False
+        elif c == "/" and not in_class:
+            return i + 1
+        i += 1
+    return i
+
+
+def skip_template(text, i):
+    # text[i] is the opening backtick; ${...} may hold strings and further templates
+    i += 1
+    while i < len(text) and text[i] != "`":
+        if text[i] == "\\":
+            i += 2
+        elif text.startswith("${", i):
+            i += 2
+            depth = 1
+            while i < len(text) and depth:
+                c = text[i]
+                if c in "'\"":
+                    i = skip_string(text, i)
+                elif c == "`":
+                    i = skip_template(text, i)
+                else:
+                    depth += {"{": 1, "}": -1}.get(c, 0)
+                    i += 1
+        else:
+            i += 1
+    return i + 1
+
+
+def minify_js(text):
+    # Drops comments and indentation. Strings, template literals and regular
+    # expressions are copied unchanged, line breaks stay for automatic semicolon insertion
+    out = []
+    word = ""
+    i = 0
+    while i < len(text):
+        c = text[i]
+        if c.isspace() or text.startswith("//", i) or text.startswith("/*", i):
+            newline = False
+            while i < len(text):
+                if text[i].isspace():
+                    newline = newline or text[i] == "\n"
+                    i += 1
+                elif text.startswith("//", i):
+                    end = text.find("\n", i)
+                    i = len(text) if end < 0 else end
+                elif text.startswith("/*", i):
+                    end = text.find("*/", i + 2)
+                    end = len(text) if end < 0 else end + 2
+                    newline = newline or "\n" in text[i:end]
+                    i = end
+                else:
+                    break
+            if out and i < len(text):
+                out.append("\n" if newline else " ")
+            continue
+
+        start = i
+        last = "".join(out).rstrip()[-1:] if c == "/" else ""
+        if c in "'\"":
+            i = skip_string(text, i)
+        elif c == "`":
+            i = skip_template(text, i)
+        elif c == "/" and (not last or last in REGEX_AFTER or word in REGEX_KEYWORDS):
+            i = skip_regex(text, i)
+        else:
+            i += 1
+        out.append(text[start:i])
+        if c.isalnum() or c in "_$":
+            word = word + c if start > 0 and (text[start - 1].isalnum() or text[start - 1] in "_$") else c
+        else:
+            word = ""
+    return "".join(out)
+
+
+def minify_html(text):
+    # Only whitespace: text and inline scripts may hold anything
+    text = re.sub(r"<!--(?!\[).*?-->", "", text, flags=re.S)
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip())
+
+
+MINIFIERS = {".css": minify_css, ".js": minify_js, ".html": minify_html, ".htm": minify_html}
+
+
+def fingerprinted(name, digest):
+    base, ext = os.path.splitext(name)
+    return "%s.%s%s" % (base, digest, ext)
+
+
+def rewrite_references(text, renames):
+    for name, new_name in renames.items():
+        text = re.sub(r"(?<=[\"'(/=])%s(?=[\"')?#\s>])" % re.escape(name), new_name, text)
+    return text
+
+
+def load_assets(data_dir):
+    files = sorted(f for f in os.listdir(data_dir) if os.path.splitext(f)[1].lower() in WEB_TYPES)
+    # Referenced files first so pages (and stylesheets) can point to their new names
+    order = {".html": 2, ".htm": 2, ".css": 1}
+    files.sort(key=lambda f: order.get(os.path.splitext(f)[1].lower(), 0))
+
+    renames = {}
+    assets = []
+    for name in files:
+        ext = os.path.splitext(name)[1].lower()
+        with open(os.path.join(data_dir, name), "rb") as f:
+            content = f.read()
+        if ext in MINIFIERS:
+            text = content.decode("utf-8")
+            text = rewrite_references(text, renames)
+            content = MINIFIERS[ext](text).encode("utf-8")
+
+        digest = hashlib.sha256(content).hexdigest()[:8]
+        page = ext in (".html", ".htm")
+        path = name if page else fingerprinted(name, digest)
+        if not page:
+            renames[name] = path
+
+        packed = gzip.compress(content, 9, mtime=0)
+        compressed = len(packed) < len(content)
+        assets.append({
+            "source": "/" + name,
+            "path": "/" + path,
+            "type": WEB_TYPES[ext],
+            "data": packed if compressed else content,
+            "gzip": compressed,
+            "immutable": not page,
+            "etag": digest,
+        })
+    return assets
+
+
+def render(assets):
+    out = [
+        "// Generated by scripts/embed_assets.py from data/, do not edit",
+        "#ifndef __WEB_ASSETS_DATA_H",
+        "#define __WEB_ASSETS_DATA_H",
+        "",
+        "#include \"web_assets.h\"",
+        "",
+    ]
+    for i, asset in enumerate(assets):
+        data = asset["data"]
+        out.append("// %s (%d bytes)" % (asset["path"], len(data)))
+        out.append("static const uint8_t webAssetData%d[] PROGMEM = {" % i)
+        for pos in range(0, len(data), 16):
+            out.append("  " + ", ".join("0x%02x" % b for b in data[pos:pos + 16]) + ",")
+        out.append("};")
+        out.append("")
+    out.append("static const WebAsset webAssets[] = {")
+    for i, asset in enumerate(assets):
+        out.append("  {\"%s\", \"%s\", \"%s\", webAssetData%d, %d, %s, %s, \"\\\"%s\\\"\"}," % (
+            asset["path"], asset["source"], asset["type"], i, len(asset["data"]),
+            "true" if asset["gzip"] else "false", "true" if asset["immutable"] else "false", asset["etag"]))
+    out.append("};")
+    out.append("")
+    out.append("#define WEB_ASSET_COUNT %d" % len(assets))
+    out.append("")
+    out.append("#endif")
+    out.append("")
+    return "\n".join(out)
+
+
+def generate(project_dir):
+    data_dir = os.path.join(project_dir, "data")
+    header = os.path.join(project_dir, "include", HEADER)
+    text = render(load_assets(data_dir))
+
+    # Only touch the header when an asset changed, otherwise everything rebuilds
+    if os.path.exists(header):
+        with open(header) as f:
+            if f.read() == text:
+                return
+    with open(header, "w") as f:
+        f.write(text)
+    print("embed_assets: wrote %s" % header)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(sys.argv[1] if len(sys.argv) > 1 else os.getcwd())
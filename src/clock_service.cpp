@@ -0,0 +1,186 @@
+#include "clock_service.h"
+#include "esp_timer.h"
+
+// Wall clock anchor: epoch (in microseconds) at a given monotonic timestamp.
+// From the anchor the clock runs at the monotonic rate plus ratePpb, while
+// slewTotalUs is worked off at CLOCK_SLEW_MAX_PPM.
+static int64_t baseEpochUs = 0;
+static int64_t baseMonoUs = 0;
+static int32_t ratePpb = 0;
+static int64_t slewTotalUs = 0;
+static bool synced = false;
+static long localOffsetSec = 0;
+
+// Date prefix "YYYY-MM-DD " is only recomputed when the local day changes
+static long cachedDay = -1;
+static char cachedDate[12];
+
+// Readers may run on the web server task, updates come from the loop task
+static portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Part of the slew applied after elapsedUs
+static int64_t slewApplied(int64_t elapsedUs)
+{
+  if (elapsedUs <= 0)
+  {
+    return 0;
+  }
+  int64_t limit = elapsedUs * CLOCK_SLEW_MAX_PPM / 1000000LL;
+  if (slewTotalUs >= 0)
+  {
+    return slewTotalUs < limit ? slewTotalUs : limit;
+  }
+  return slewTotalUs > -limit ? slewTotalUs : -limit;
+}
+
+static int64_t epochAtMono(int64_t monoUs)
+{
+  int64_t elapsedUs = monoUs - baseMonoUs;
+  return baseEpochUs + elapsedUs + elapsedUs * ratePpb / 1000000000LL + slewApplied(elapsedUs);
+}
+
+// Move the anchor to now so a new rate or slew only affects the future
+static void reanchor()
+{
+  int64_t nowUs = esp_timer_get_time();
+  baseEpochUs = epochAtMono(nowUs);
+  slewTotalUs -= slewApplied(nowUs - baseMonoUs);
+  baseMonoUs = nowUs;
+}
+
+void clockBegin(long utcOffsetSec)
+{
+  portENTER_CRITICAL(&clockMux);
+  localOffsetSec = utcOffsetSec;
+  cachedDay = -1;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void clockStep(int64_t offsetUs)
+{
+  portENTER_CRITICAL(&clockMux);
+  reanchor();
+  baseEpochUs += offsetUs;
+  slewTotalUs = 0;
+  synced = true;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void clockSlew(int64_t offsetUs)
+{
+  portENTER_CRITICAL(&clockMux);
+  reanchor();
+  slewTotalUs = offsetUs;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+int64_t clockPendingSlewUs()
+{
+  portENTER_CRITICAL(&clockMux);
+  int64_t pendingUs = slewTotalUs - slewApplied(esp_timer_get_time() - baseMonoUs);
+  portEXIT_CRITICAL(&clockMux);
+  return pendingUs;
+}
+
+void clockSetRate(int32_t newRatePpb)
+{
+  if (newRatePpb > CLOCK_RATE_MAX_PPB)
+  {
+    newRatePpb = CLOCK_RATE_MAX_PPB;
+  }
+  else if (newRatePpb < -CLOCK_RATE_MAX_PPB)
+  {
+    newRatePpb = -CLOCK_RATE_MAX_PPB;
+  }
+
+  portENTER_CRITICAL(&clockMux);
+  reanchor();
+  ratePpb = newRatePpb;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+int32_t clockRate()
+{
+  return ratePpb;
+}
+
+bool clockIsSynced()
+{
+  return synced;
+}
+
+int64_t clockMonotonicUs()
+{
+  return esp_timer_get_time();
+}
+
+int64_t clockNowUs()
+{
+  portENTER_CRITICAL(&clockMux);
+  int64_t nowUs = epochAtMono(esp_timer_get_time());
+  portEXIT_CRITICAL(&clockMux);
+  return nowUs;
+}
+
+time_t clockNow()
+{
+  return (time_t)(clockNowUs() / 1000000LL);
+}
+
+time_t clockEpochAt(int64_t monoUs)
+{
+  portENTER_CRITICAL(&clockMux);
+  int64_t epochUs = epochAtMono(monoUs);
+  portEXIT_CRITICAL(&clockMux);
+  return (time_t)(epochUs / 1000000LL);
+}
+
+// Write a two digit number without going through printf
+static inline void putTwoDigits(char *p, uint8_t value)
+{
+  p[0] = '0' + value / 10;
+  p[1] = '0' + value % 10;
+}
+
+char *clockFormat(time_t epoch, char *buf)
+{
+  portENTER_CRITICAL(&clockMux);
+  int64_t local = (int64_t)epoch + localOffsetSec;
+  bool cached = false;
+  long day = (long)(local / 86400);
+  long secOfDay = (long)(local % 86400);
+  if (secOfDay < 0)
+  {
+    secOfDay += 86400;
+    day--;
+  }
+  if (day == cachedDay)
+  {
+    memcpy(buf, cachedDate, 11);
+    cached = true;
+  }
+  portEXIT_CRITICAL(&clockMux);
+
+  if (!cached)
+  {
+    time_t dayStart = (time_t)day * 86400;
+    struct tm timeinfo;
+    char date[12];
+    gmtime_r(&dayStart, &timeinfo);
+    strftime(date, sizeof(date), "%Y-%m-%d ", &timeinfo);
+    memcpy(buf, date, 11);
+
+    portENTER_CRITICAL(&clockMux);
+    memcpy(cachedDate, date, sizeof(date));
+    cachedDay = day;
+    portEXIT_CRITICAL(&clockMux);
+  }
+
+  putTwoDigits(buf + 11, secOfDay / 3600);
+  buf[13] = ':';
+  putTwoDigits(buf + 14, (secOfDay / 60) % 60);
+  buf[16] = ':';
+  putTwoDigits(buf + 17, secOfDay % 60);
+  buf[19] = 0;
+  return buf;
+}
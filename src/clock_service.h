@@ -0,0 +1,45 @@
+#ifndef __CLOCK_SERVICE_H
+#define __CLOCK_SERVICE_H
+
+#include "Arduino.h"
+#include <time.h>
+
+// Length of "YYYY-MM-DD HH:MM:SS" including the terminating zero
+#define CLOCK_TIMESTAMP_LEN 20
+
+// Maximum rate at which an offset is slewed out (microseconds per second)
+#define CLOCK_SLEW_MAX_PPM 500
+
+// Maximum frequency correction (parts per billion)
+#define CLOCK_RATE_MAX_PPB 500000
+
+// Set the fixed offset from UTC used when formatting local time
+void clockBegin(long utcOffsetSec);
+
+// Jump the clock by offsetUs at once; the first step marks the clock as synced
+void clockStep(int64_t offsetUs);
+
+// Correct offsetUs gradually so the clock never jumps or runs backwards
+void clockSlew(int64_t offsetUs);
+int64_t clockPendingSlewUs();
+
+// Frequency correction for the crystal drift, in parts per billion
+void clockSetRate(int32_t ratePpb);
+int32_t clockRate();
+
+bool clockIsSynced();
+
+// Monotonic time since boot, valid before the clock is synced
+int64_t clockMonotonicUs();
+
+// Current UTC time in microseconds / seconds since 1970
+int64_t clockNowUs();
+time_t clockNow();
+
+// Wall time of an earlier monotonic timestamp, e.g. one taken before the first sync
+time_t clockEpochAt(int64_t monoUs);
+
+// Format an epoch as local "YYYY-MM-DD HH:MM:SS" into buf (CLOCK_TIMESTAMP_LEN bytes)
+char *clockFormat(time_t epoch, char *buf);
+
+#endif
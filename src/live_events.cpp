@@ -0,0 +1,129 @@
+#include "live_events.h"
+#include "clock_service.h"
+
+struct LiveEvent
+{
+  uint32_t id;
+  const char *event;
+  float temperature;
+  char date[CLOCK_TIMESTAMP_LEN];
+};
+
+// Owned by the server once added
+static AsyncEventSource *events = NULL;
+
+// Event n sits at n % LIVE_REPLAY_SIZE; written by loop(), read on the async_tcp task
+static LiveEvent replayRing[LIVE_REPLAY_SIZE];
+static uint32_t newestId = 0;
+static portMUX_TYPE replayLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Last event sent to all subscribers, only used on the async_tcp task
+static uint32_t broadcastId = 0;
+
+// Copy event id out of the ring, false when it was not published yet or already overwritten
+static bool readEvent(uint32_t id, LiveEvent &entry)
+{
+  portENTER_CRITICAL(&replayLock);
+  entry = replayRing[id % LIVE_REPLAY_SIZE];
+  portEXIT_CRITICAL(&replayLock);
+  return id != 0 && entry.id == id;
+}
+
+static uint32_t readNewestId()
+{
+  portENTER_CRITICAL(&replayLock);
+  uint32_t id = newestId;
+  portEXIT_CRITICAL(&replayLock);
+  return id;
+}
+
+// Same fields as an entry of /getData
+static void formatEvent(const LiveEvent &entry, char *buf, size_t len)
+{
+  snprintf(buf, len, "{\"temperature\":%.2f,\"date\":\"%s\"}", entry.temperature, entry.date);
+}
+
+// Posted by liveEventsPublish, sends every event published since the last run.
+// A post that did not fit the queue is caught up by the next one
+static void broadcastPending(void *arg)
+{
+  (void)arg;
+  uint32_t newest = readNewestId();
+  if (newest - broadcastId > LIVE_REPLAY_SIZE)
+  {
+    broadcastId = newest - LIVE_REPLAY_SIZE;
+  }
+
+  LiveEvent entry;
+  char data[64];
+  while (broadcastId != newest)
+  {
+    broadcastId++;
+    if (readEvent(broadcastId, entry))
+    {
+      formatEvent(entry, data, sizeof(data));
+      events->send(data, entry.event, entry.id);
+    }
+  }
+}
+
+// Send a reconnecting client what it missed, from the ring instead of the SD card
+static void replayEvents(AsyncEventSourceClient *client)
+{
+  // Also tells the browser how soon to reconnect
+  client->send("connected", NULL, 0, LIVE_RETRY_MS);
+
+  uint32_t from = client->lastId();
+  if (from == 0)
+  {
+    return;
+  }
+  // An id from before a restart, or older than the ring, gets everything that is kept
+  if (from > broadcastId || broadcastId - from > LIVE_REPLAY_SIZE)
+  {
+    from = broadcastId > LIVE_REPLAY_SIZE ? broadcastId - LIVE_REPLAY_SIZE : 0;
+  }
+
+  // Later events reach this client with the next broadcast
+  LiveEvent entry;
+  char data[64];
+  for (uint32_t id = from + 1; id <= broadcastId; id++)
+  {
+    if (readEvent(id, entry))
+    {
+      formatEvent(entry, data, sizeof(data));
+      client->send(data, entry.event, entry.id);
+    }
+  }
+}
+
+void liveEventsBegin(AsyncWebServer &server)
+{
+  if (events != NULL)
+  {
+    return;
+  }
+  events = new AsyncEventSource(LIVE_EVENTS_URL);
+  events->onConnect(replayEvents);
+  server.addHandler(events);
+}
+
+void liveEventsPublish(const char *event, float temperature, const char *date)
+{
+  if (events == NULL)
+  {
+    return;
+  }
+
+  LiveEvent entry;
+  entry.event = event;
+  entry.temperature = temperature;
+  strlcpy(entry.date, date, sizeof(entry.date));
+
+  portENTER_CRITICAL(&replayLock);
+  entry.id = ++newestId;
+  replayRing[entry.id % LIVE_REPLAY_SIZE] = entry;
+  portEXIT_CRITICAL(&replayLock);
+
+  asyncTcpCall(broadcastPending, NULL);
+}
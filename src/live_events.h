@@ -0,0 +1,27 @@
+#ifndef __LIVE_EVENTS_H
+#define __LIVE_EVENTS_H
+
+#include "Arduino.h"
+#include <ESPAsyncWebServer.h>
+
+// URL the dashboard subscribes to with an EventSource
+#define LIVE_EVENTS_URL "/events"
+
+// Recent events kept in RAM for clients that reconnect with a Last-Event-ID, about
+// 100 seconds of samples. Stays below SSE_MAX_QUEUED_MESSAGES so a replay is never cut short
+#define LIVE_REPLAY_SIZE 24
+
+// How long a browser waits before it reconnects (milliseconds)
+#define LIVE_RETRY_MS 5000
+
+// Event name of every reading. Averages go to the chart over the sample socket, see sample_socket.h
+#define LIVE_EVENT_SAMPLE "sample"
+
+// Register the event source with the server, call before server.begin()
+void liveEventsBegin(AsyncWebServer &server);
+
+// Push a temperature to every subscriber, once. date is "" while the clock is not synced.
+// Callable from loop(), the sending itself runs on the async_tcp task
+void liveEventsPublish(const char *event, float temperature, const char *date);
+
+#endif
@@ -11,8 +11,15 @@
 #include "SD_MMC.h"
 #include "time.h"
 #include <ArduinoJson.h>
+#include "clock_service.h"
+#include "time_service.h"
+#include "web_assets.h"
+#include "storage_worker.h"
+#include "live_events.h"
+#include "sample_socket.h"
 
 const char *ntpServer = "pool.ntp.org";
+const uint16_t ntpPort = 123; // Point ntpServer/ntpPort to a local UDP server for testing
 const long gmtOffset_sec = 3600;
 const int daylightOffset_sec = 3600;
 
@@ -29,8 +36,25 @@ const unsigned long averageInterval = 30000; // 30 seconds in milliseconds
 float averageTemp = 0.0;
 int iterations = 1;
 
+// Averages taken before the clock is synced, written to SD once the wall time is known
+#define PENDING_LOG_SIZE 120 // One hour of 30 second averages
+struct PendingSample
+{
+  float temperature;
+  int64_t monoUs;
+};
+PendingSample pendingLog[PENDING_LOG_SIZE];
+int pendingLogHead = 0;
+int pendingLogCount = 0;
+
+// Log lines the storage queue had no room for, queued again from loop() so only the storage task writes the log
+#define UNQUEUED_LOG_MAX 4096
+String unqueuedLog;
+
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
+// Serves the SPIFFS files that are not embedded, told about every file written there
+AsyncStaticWebHandler *spiffsFiles = NULL;
 
 // Search for parameter in HTTP POST request
 const char *PARAM_INPUT_1 = "ssid";
@@ -59,6 +83,11 @@ IPAddress localGateway;
 IPAddress subnet(255, 255, 0, 0);
 IPAddress dns(8, 8, 8, 8);
 
+// Restart asked for by a web handler, done from loop() once the answer had time to go out
+#define RESTART_DELAY_MS 3000
+volatile bool restartPending = false;
+volatile unsigned long restartRequestedAt = 0;
+
 // Timer variables
 unsigned long previousMillis = 0;
 const long interval = 10000; // interval to wait for Wi-Fi connection (milliseconds)
@@ -78,11 +107,17 @@ void initSPIFFS();
 void initSDCard();
 String readFileFS(fs::FS &fs, const char *path);
 void writeFileFS(fs::FS &fs, const char *path, const char *message);
-String getLocalTime();
 void writeFileSD(String data);
+void logToSD(const String &data);
+void retryLogToSD();
 void readTemp();
+void bufferPendingSample(float temperature);
+void flushPendingLog();
+bool isEpochField(const String &field);
 String getSensorData();
+String resetDataLog();
 void deleteNetworkSettings();
+void scheduleRestart();
 
 // Debugging prototypes
 void readFileSDDEBUG();
@@ -98,6 +133,9 @@ void setup()
 
   initSPIFFS();
 
+  // SD card work from the web handlers and the data logging runs on its own task
+  storageBegin();
+
   // Load values saved in SPIFFS
   ssid = readFileFS(SPIFFS, ssidPath);
   pass = readFileFS(SPIFFS, passPath);
@@ -118,21 +156,16 @@ void setup()
 
   if (initWiFi())
   {
-    // Route for root / web page
+    // Route for root / web page, the page and its assets are embedded in the firmware
+    webAssetsBegin(server);
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/index.html", "text/html", false); });
-    server.serveStatic("/", SPIFFS, "/");
+              { webAssetSend(request, webAssetFind("/index.html")); });
+    // Only for files that are not embedded, the cache would hold copies of the embedded ones
+    spiffsFiles = &server.serveStatic("/", SPIFFS, "/").setDefaultFile("index.html").setCacheSize(0);
 
-    // Sends JSON data to client
+    // Sends JSON data to client, the log is read on the storage task
     server.on("/getData", HTTP_GET, [](AsyncWebServerRequest *request)
-              {
-  String jsonData = getSensorData();
-  if (jsonData.isEmpty()) {
-    request->send(500, "text/plain", "Error reading sensor data");
-    return;
-  }
-
-  request->send(200, "application/json", jsonData); });
+              { storageRespond(request, "application/json", getSensorData, "Error reading sensor data"); });
 
     // Delete network settings
     server.on("/deleteNetwork", HTTP_GET, [](AsyncWebServerRequest *request)
@@ -142,35 +175,30 @@ void setup()
       writeFileFS(SPIFFS, ipPath, "");
       writeFileFS(SPIFFS, gatewayPath, "");
       request->send(200, "text/plain", "Network settings deleted. ESP will restart.");
-      delay(3000);
-      ESP.restart(); });
+      scheduleRestart(); });
+
+    // Download the data log, a Range request resumes it or reads only its tail. Read on the storage task,
+    // a chunk at a time, so logging and deleting the log wait for a chunk instead of an open file
+    server.on("/datalog.csv", HTTP_GET, [](AsyncWebServerRequest *request)
+              { storageSendFile(request, SD_MMC, "/data/datalog.csv", "text/csv"); });
 
     // Delete data log
     server.on("/deleteDataLog", HTTP_GET, [](AsyncWebServerRequest *request)
+              { storageRespond(request, "text/plain", resetDataLog, "Error deleting data log."); });
+
+    // Request counts, latency and heap in Prometheus text format
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
               {
-      deleteFile(SD_MMC, "/data/datalog.csv");      
-      
-      if (SD_MMC.exists("/data/datalog.csv"))
-      {
-        Serial.println("datalog.csv exists.");
-      }
-      else
-      {
-        File dataFile = SD_MMC.open("/data/datalog.csv", FILE_WRITE);
-        if (dataFile)
-        {
-          Serial.println("datalog.csv created.");
-        }
-        else
-        {
-          Serial.println("Error creating CSV file.");
-        }
-          dataFile.close();
-      }
-      
-      
+      AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+      server.printMetrics(*response);
+      sampleSocketPrintMetrics(*response);
+      request->send(response); });
+
+    // Pushes every reading to the dashboard, see currentTemp.js
+    liveEventsBegin(server);
 
-        request->send(200, "text/plain", "Data log deleted."); });
+    // The logged averages for the chart, packed binary over a WebSocket
+    sampleSocketBegin(server, SD_MMC, "/data/datalog.csv");
 
     server.begin();
   }
@@ -186,10 +214,11 @@ void setup()
     Serial.println(IP);
 
     // Web Server Root URL
+    webAssetsBegin(server);
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-              { request->send(SPIFFS, "/wifimanager.html", "text/html"); });
+              { webAssetSend(request, webAssetFind("/wifimanager.html")); });
 
-    server.serveStatic("/", SPIFFS, "/");
+    spiffsFiles = &server.serveStatic("/", SPIFFS, "/").setCacheSize(0);
 
     server.on("/", HTTP_POST, [](AsyncWebServerRequest *request)
               {
@@ -235,15 +264,13 @@ void setup()
         }
       }
       request->send(200, "text/plain", "Done. ESP will restart, connect to your router and go to IP address: " + ip);
-      delay(3000);
-      ESP.restart(); });
+      scheduleRestart(); });
     server.begin();
   }
 
-  // Init and get the time
-  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  Serial.println("Waiting for time");
-  Serial.println(getLocalTime());
+  // Start time synchronization, it runs in the background from loop()
+  clockBegin(gmtOffset_sec + daylightOffset_sec);
+  timeServiceBegin(ntpServer, ntpPort);
 
   initSDCard();
 
@@ -255,7 +282,14 @@ void setup()
 
 void loop()
 {
+  timeServiceLoop();
   readTemp();
+  retryLogToSD();
+
+  if (restartPending && millis() - restartRequestedAt >= RESTART_DELAY_MS)
+  {
+    ESP.restart();
+  }
 }
 
 // Initialize SPIFFS
@@ -380,6 +414,11 @@ void writeFileFS(fs::FS &fs, const char *path, const char *message)
     Serial.println("- failed to open file for writing");
     return;
   }
+  // SPIFFS keeps no modification times, a remembered ETag would survive a rewrite of the same size
+  if (spiffsFiles != NULL)
+  {
+    spiffsFiles->invalidate(path);
+  }
   if (file.print(message))
   {
     Serial.println("- file written");
@@ -390,21 +429,6 @@ void writeFileFS(fs::FS &fs, const char *path, const char *message)
   }
 }
 
-// Get local time
-String getLocalTime()
-{
-  struct tm timeinfo;
-  while (!getLocalTime(&timeinfo))
-  {
-    vTaskDelay(500);
-    Serial.print(".");
-  }
-
-  char timeStringBuff[50];
-  strftime(timeStringBuff, sizeof(timeStringBuff), "%Y-%m-%d %H:%M:%S", &timeinfo);
-  return String(timeStringBuff); // Convert C-style string to String object
-}
-
 // Write data to SD card
 void writeFileSD(String data)
 {
@@ -425,11 +449,45 @@ void writeFileSD(String data)
   file.close();
 }
 
+// Append to the data log on the storage task, lines it has no room for wait in unqueuedLog
+void logToSD(const String &data)
+{
+  if (unqueuedLog.length() + data.length() > UNQUEUED_LOG_MAX)
+  {
+    Serial.println("Log line dropped, storage busy");
+    return;
+  }
+  // Behind the waiting lines, so the log stays in order
+  unqueuedLog += data;
+  retryLogToSD();
+}
+
+void retryLogToSD()
+{
+  if (unqueuedLog.isEmpty())
+  {
+    return;
+  }
+  String lines = unqueuedLog;
+  if (storageSubmit([lines]()
+                    {
+    writeFileSD(lines);
+    return String(); }))
+  {
+    unqueuedLog = String();
+  }
+}
+
 // Read Temperatur and write average to SD card
 void readTemp()
 {
   unsigned long currentTime = millis();
 
+  if (pendingLogCount > 0 && clockIsSynced())
+  {
+    flushPendingLog();
+  }
+
   // Check for temperature reading interval
   if (currentTime - lastReadingTime >= readingInterval)
   {
@@ -443,7 +501,19 @@ void readTemp()
 
     Serial.print("Current Temp: ");
     Serial.print(currentTemp);
-    Serial.println(" C - " + getLocalTime() + "\n");
+    Serial.print(" C - ");
+    char timestamp[CLOCK_TIMESTAMP_LEN] = "";
+    if (clockIsSynced())
+    {
+      Serial.println(clockFormat(clockNow(), timestamp));
+    }
+    else
+    {
+      // Provisional timestamp until the first sync
+      Serial.printf("uptime %llu s\n", (unsigned long long)(clockMonotonicUs() / 1000000));
+    }
+    Serial.println();
+    liveEventsPublish(LIVE_EVENT_SAMPLE, currentTemp, timestamp);
   }
 
   // Check for average temperature update interval
@@ -453,14 +523,74 @@ void readTemp()
 
     Serial.print("Average Temp: ");
     // Serial.print(averageTemp);
-    // Serial.println(" C - " + getLocalTime() + " Past 30 seconds");
-    String stringToSD = String(averageTemp) + "," + getLocalTime() + "\n";
+    if (!clockIsSynced())
+    {
+      Serial.println(String(averageTemp) + " (kept until the clock is synced)");
+      bufferPendingSample(averageTemp);
+      return;
+    }
+    // Store the epoch as an integer, it is formatted when the log is read back
+    String stringToSD = String(averageTemp) + "," + String((unsigned long)clockNow()) + "\n";
     Serial.println(String(averageTemp));
     Serial.println(stringToSD);
-    writeFileSD(stringToSD);
+    logToSD(stringToSD);
+
+    // Only the chart shows averages, see sample_socket.h
+    sampleSocketPublish(averageTemp, (uint32_t)clockNow());
   }
 }
 
+// Keep an average with its monotonic timestamp, the oldest is dropped when full
+void bufferPendingSample(float temperature)
+{
+  int index = (pendingLogHead + pendingLogCount) % PENDING_LOG_SIZE;
+  pendingLog[index].temperature = temperature;
+  pendingLog[index].monoUs = clockMonotonicUs();
+
+  if (pendingLogCount < PENDING_LOG_SIZE)
+  {
+    pendingLogCount++;
+  }
+  else
+  {
+    pendingLogHead = (pendingLogHead + 1) % PENDING_LOG_SIZE;
+  }
+}
+
+// Write buffered averages to SD with their timestamps fixed up to wall time
+void flushPendingLog()
+{
+  String stringToSD;
+  for (int i = 0; i < pendingLogCount; i++)
+  {
+    PendingSample &sample = pendingLog[(pendingLogHead + i) % PENDING_LOG_SIZE];
+    stringToSD += String(sample.temperature) + "," + String((unsigned long)clockEpochAt(sample.monoUs)) + "\n";
+  }
+  pendingLogHead = 0;
+  pendingLogCount = 0;
+
+  Serial.println(stringToSD);
+  logToSD(stringToSD);
+}
+
+// Check if a log field holds an epoch integer instead of a formatted date
+bool isEpochField(const String &field)
+{
+  if (field.isEmpty())
+  {
+    return false;
+  }
+  for (unsigned int i = 0; i < field.length(); i++)
+  {
+    if (!isDigit(field[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Read data log from SD card and return it as JSON
 String getSensorData()
 {
   File file = SD_MMC.open("/data/datalog.csv");
@@ -486,7 +616,16 @@ String getSensorData()
     JsonObject dataObj = dataArray.add<JsonObject>();
 
     dataObj["temperature"] = tempStr.toFloat();
-    dataObj["date"] = dateStr;
+    if (isEpochField(dateStr))
+    {
+      char timestamp[CLOCK_TIMESTAMP_LEN];
+      dataObj["date"] = clockFormat((time_t)strtoul(dateStr.c_str(), NULL, 10), timestamp);
+    }
+    else
+    {
+      // Older logs stored the formatted local time as text
+      dataObj["date"] = dateStr;
+    }
   }
 
   file.close();
@@ -496,6 +635,35 @@ String getSensorData()
   return jsonString;
 }
 
+// Empty the data log, runs on the storage task
+String resetDataLog()
+{
+  deleteFile(SD_MMC, "/data/datalog.csv");
+
+  if (SD_MMC.exists("/data/datalog.csv"))
+  {
+    Serial.println("datalog.csv exists.");
+    return "";
+  }
+
+  File dataFile = SD_MMC.open("/data/datalog.csv", FILE_WRITE);
+  if (!dataFile)
+  {
+    Serial.println("Error creating CSV file.");
+    return "";
+  }
+  Serial.println("datalog.csv created.");
+  dataFile.close();
+  return "Data log deleted.";
+}
+
+// Restart in RESTART_DELAY_MS without holding up the web server task
+void scheduleRestart()
+{
+  restartRequestedAt = millis();
+  restartPending = true;
+}
+
 // Delete network settings
 void deleteNetworkSettings()
 {
@@ -0,0 +1,454 @@
+#include "sample_socket.h"
+#include "storage_worker.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+struct SampleBlock
+{
+  uint8_t *data;
+  size_t size;
+  size_t length;
+  uint16_t count;
+  uint32_t last;
+};
+
+// A history frame handed from the storage task to the async_tcp task
+enum FrameResult
+{
+  FRAME_SENT,
+  FRAME_BUSY,
+  FRAME_GONE
+};
+
+struct HistoryFrame
+{
+  uint32_t clientId;
+  uint8_t *data;
+  size_t length;
+  TaskHandle_t task;
+  volatile FrameResult result;
+};
+
+// One client's way through the log, advanced a frame per storage job
+struct HistoryStream
+{
+  uint32_t clientId;
+  size_t offset;        // where the next frame starts in the log
+  size_t end;           // log size when the stream started, later lines come as live blocks
+  bool started;
+  bool pending;         // data holds a frame the client did not take yet
+  bool last;            // the pending frame is the end of the history
+  uint16_t attempts;    // times the pending frame was refused
+  size_t length;
+  esp_timer_handle_t retry;
+  uint8_t data[SAMPLE_FRAME_SIZE];
+};
+
+struct LiveSample
+{
+  float temperature;
+  uint32_t epoch;
+};
+
+// Owned by the server once added
+static AsyncWebSocket *samples = NULL;
+static fs::FS *logFs = NULL;
+static const char *logPath = NULL;
+
+static void putU16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+static void putU32(uint8_t *p, uint32_t value)
+{
+  putU16(p, value & 0xFFFF);
+  putU16(p + 2, value >> 16);
+}
+
+// Start a block at data, records are measured from base
+static void blockBegin(SampleBlock &block, uint8_t *data, size_t size, uint8_t type, uint32_t base)
+{
+  block.data = data;
+  block.size = size;
+  block.length = SAMPLE_BLOCK_HEADER;
+  block.count = 0;
+  block.last = base;
+  data[0] = type;
+  putU16(data + 1, 0);
+  putU32(data + 3, base);
+}
+
+// Add a record, false when the block is full
+static bool blockAdd(SampleBlock &block, uint32_t epoch, float temperature)
+{
+  if (block.length + SAMPLE_RECORD_MAX > block.size || block.count == UINT16_MAX)
+  {
+    return false;
+  }
+
+  // Zigzag, so a clock that was set back costs a byte more instead of breaking the stream
+  int32_t delta = (int32_t)(epoch - block.last);
+  uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+  while (zigzag >= 0x80)
+  {
+    block.data[block.length++] = (zigzag & 0x7F) | 0x80;
+    zigzag >>= 7;
+  }
+  block.data[block.length++] = zigzag;
+
+  float centi = roundf(temperature * 100);
+  centi = constrain(centi, INT16_MIN, INT16_MAX);
+  putU16(block.data + block.length, (uint16_t)(int16_t)centi);
+  block.length += 2;
+
+  block.last = epoch;
+  block.count++;
+  putU16(block.data + 1, block.count);
+  return true;
+}
+
+// On the async_tcp task: queue the frame unless the client is gone or still has enough to send
+static void sendHistoryFrame(void *arg)
+{
+  HistoryFrame *frame = (HistoryFrame *)arg;
+  AsyncWebSocketClient *client = samples->client(frame->clientId);
+  if (client == NULL)
+  {
+    frame->result = FRAME_GONE;
+  }
+  else if (client->queueLength() >= SAMPLE_HISTORY_QUEUE)
+  {
+    frame->result = FRAME_BUSY;
+  }
+  else
+  {
+    // Copied, the storage task reuses its buffer
+    client->binary(frame->data, frame->length);
+    frame->result = FRAME_SENT;
+  }
+  xTaskNotifyGive(frame->task);
+}
+
+// Streams sending, and clients waiting for one; changed on the async_tcp and the storage task
+static portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t historyActive = 0;
+static uint32_t historyWaiting[SAMPLE_HISTORY_WAITING];
+static uint8_t historyWaitingFirst = 0;
+static uint8_t historyWaitingCount = 0;
+
+static void historyContinue(HistoryStream *stream, uint32_t delayMs);
+
+// On the storage task: offer the pending frame to the client once, the answer comes back right away
+static FrameResult postHistoryFrame(HistoryStream *stream)
+{
+  HistoryFrame frame = {stream->clientId, stream->data, stream->length, xTaskGetCurrentTaskHandle(), FRAME_BUSY};
+  if (!asyncTcpCall(sendHistoryFrame, &frame, SAMPLE_HISTORY_WAIT_MS))
+  {
+    return FRAME_BUSY;
+  }
+  // Every posted call notifies, the frame on this stack is not used after that
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  return frame.result;
+}
+
+// Parse an epoch log field, false for the formatted dates of older logs
+static bool parseEpoch(const String &field, uint32_t &epoch)
+{
+  const char *start = field.c_str();
+  char *end;
+  epoch = strtoul(start, &end, 10);
+  return end != start && *end == '\0';
+}
+
+// On the storage task: fill the frame with the records from the stream's offset on
+static void readHistoryFrame(HistoryStream *stream)
+{
+  SampleBlock block;
+  blockBegin(block, stream->data, sizeof(stream->data), SAMPLE_HISTORY, 0);
+  stream->last = true;
+
+  File file = logFs->open(logPath);
+  if (file && !file.isDirectory())
+  {
+    if (!stream->started)
+    {
+      stream->end = file.size();
+      stream->started = true;
+    }
+    // Fails when the log was deleted meanwhile, the history ends there
+    if (stream->offset < stream->end && file.seek(stream->offset))
+    {
+      String line;
+      size_t lineStart = stream->offset;
+      while (lineStart < stream->end && (line = file.readStringUntil('\n')) != "")
+      {
+        int commaIndex = line.indexOf(',');
+        uint32_t epoch;
+        // Lines from before the log stored epochs have no usable time, /getData still returns them
+        if (commaIndex >= 0 && parseEpoch(line.substring(commaIndex + 1), epoch))
+        {
+          float temperature = line.substring(0, commaIndex).toFloat();
+          if (block.count == 0)
+          {
+            blockBegin(block, stream->data, sizeof(stream->data), SAMPLE_HISTORY, epoch);
+          }
+          if (!blockAdd(block, epoch, temperature))
+          {
+            // Read again for the next frame
+            stream->last = false;
+            break;
+          }
+        }
+        lineStart = file.position();
+      }
+      stream->offset = lineStart;
+    }
+    file.close();
+  }
+
+  // Sent even when empty, the dashboard draws the chart once it has the whole history
+  if (stream->last)
+  {
+    stream->data[0] = SAMPLE_HISTORY_END;
+  }
+  stream->length = block.length;
+  stream->pending = true;
+  stream->attempts = 0;
+}
+
+static bool historyBegin(uint32_t clientId);
+
+// On the storage task: free the stream and give its place to the next waiting client
+static void historyEnd(HistoryStream *stream)
+{
+  esp_timer_delete(stream->retry);
+  free(stream);
+
+  while (true)
+  {
+    uint32_t next = 0;
+    bool waiting = false;
+    portENTER_CRITICAL(&historyLock);
+    if (historyWaitingCount > 0)
+    {
+      next = historyWaiting[historyWaitingFirst];
+      historyWaitingFirst = (historyWaitingFirst + 1) % SAMPLE_HISTORY_WAITING;
+      historyWaitingCount--;
+      waiting = true;
+    }
+    else
+    {
+      historyActive--;
+    }
+    portEXIT_CRITICAL(&historyLock);
+
+    if (!waiting || historyBegin(next))
+    {
+      return;
+    }
+    Serial.println("Sample history not sent, out of memory");
+  }
+}
+
+// Runs on the storage task, sends one frame and queues the rest of the stream behind other SD work
+static String historyStep(HistoryStream *stream)
+{
+  if (!stream->pending)
+  {
+    readHistoryFrame(stream);
+  }
+
+  switch (postHistoryFrame(stream))
+  {
+  case FRAME_SENT:
+    stream->pending = false;
+    if (stream->last)
+    {
+      historyEnd(stream);
+    }
+    else
+    {
+      historyContinue(stream, 0);
+    }
+    break;
+  case FRAME_GONE:
+    historyEnd(stream);
+    break;
+  case FRAME_BUSY:
+    if (++stream->attempts >= SAMPLE_HISTORY_RETRIES)
+    {
+      Serial.println("Sample history not sent, client too slow");
+      historyEnd(stream);
+    }
+    else
+    {
+      historyContinue(stream, SAMPLE_HISTORY_WAIT_MS);
+    }
+    break;
+  }
+  return String();
+}
+
+static bool historySubmit(HistoryStream *stream)
+{
+  return storageSubmit([stream]()
+                       { return historyStep(stream); });
+}
+
+// On the esp_timer task: queue the next step, or try again when the storage queue is full
+static void historyRetry(void *arg)
+{
+  HistoryStream *stream = (HistoryStream *)arg;
+  if (!historySubmit(stream))
+  {
+    esp_timer_start_once(stream->retry, SAMPLE_HISTORY_WAIT_MS * 1000);
+  }
+}
+
+static void historyContinue(HistoryStream *stream, uint32_t delayMs)
+{
+  if (delayMs > 0 || !historySubmit(stream))
+  {
+    esp_timer_start_once(stream->retry, (delayMs > 0 ? delayMs : SAMPLE_HISTORY_WAIT_MS) * 1000);
+  }
+}
+
+// Start streaming the log to a client that holds one of the streams
+static bool historyBegin(uint32_t clientId)
+{
+  HistoryStream *stream = (HistoryStream *)calloc(1, sizeof(HistoryStream));
+  if (stream == NULL)
+  {
+    return false;
+  }
+  stream->clientId = clientId;
+  esp_timer_create_args_t args = {};
+  args.callback = historyRetry;
+  args.arg = stream;
+  args.name = "history";
+  if (esp_timer_create(&args, &stream->retry) != ESP_OK)
+  {
+    free(stream);
+    return false;
+  }
+  historyContinue(stream, 0);
+  return true;
+}
+
+static void onSampleSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+  if (type != WS_EVT_CONNECT)
+  {
+    return;
+  }
+  uint32_t id = client->id();
+  bool start = false;
+  bool queued = false;
+  portENTER_CRITICAL(&historyLock);
+  if (historyActive < SAMPLE_HISTORY_STREAMS)
+  {
+    historyActive++;
+    start = true;
+  }
+  else if (historyWaitingCount < SAMPLE_HISTORY_WAITING)
+  {
+    historyWaiting[(historyWaitingFirst + historyWaitingCount) % SAMPLE_HISTORY_WAITING] = id;
+    historyWaitingCount++;
+    queued = true;
+  }
+  portEXIT_CRITICAL(&historyLock);
+
+  if (queued)
+  {
+    return;
+  }
+  if (start && historyBegin(id))
+  {
+    return;
+  }
+  if (start)
+  {
+    portENTER_CRITICAL(&historyLock);
+    historyActive--;
+    portEXIT_CRITICAL(&historyLock);
+  }
+  // 1013: try again later
+  client->close(1013);
+}
+
+// On the async_tcp task, a single record block shared by all clients
+static void publishLive(void *arg)
+{
+  LiveSample *sample = (LiveSample *)arg;
+  uint8_t data[SAMPLE_BLOCK_HEADER + SAMPLE_RECORD_MAX];
+  SampleBlock block;
+  blockBegin(block, data, sizeof(data), SAMPLE_LIVE, sample->epoch);
+  blockAdd(block, sample->epoch, sample->temperature);
+  free(sample);
+
+  samples->publish("average", data, block.length, WS_BINARY);
+  samples->cleanupClients();
+}
+
+void sampleSocketBegin(AsyncWebServer &server, fs::FS &fs, const char *path)
+{
+  if (samples != NULL)
+  {
+    return;
+  }
+  logFs = &fs;
+  logPath = path;
+  samples = new AsyncWebSocket(SAMPLE_SOCKET_URL);
+  // A client that falls behind gets the averages it missed in one frame
+  samples->setQueuePolicy(WS_QUEUE_BATCH);
+  // History frames are compressed, live blocks are too small to be worth it
+  samples->setDeflate(true);
+  // A sleeping laptop or a closed phone tab never says goodbye, its slot is freed by the timeout
+  samples->setKeepAlivePeriod(SAMPLE_KEEPALIVE_S);
+  samples->setIdleTimeout(SAMPLE_IDLE_TIMEOUT_S);
+  samples->onEvent(onSampleSocketEvent);
+  server.addHandler(samples);
+}
+
+void sampleSocketPublish(float temperature, uint32_t epoch)
+{
+  if (samples == NULL)
+  {
+    return;
+  }
+  LiveSample *sample = (LiveSample *)malloc(sizeof(LiveSample));
+  if (sample == NULL)
+  {
+    return;
+  }
+  sample->temperature = temperature;
+  sample->epoch = epoch;
+  // Dropped when the async_tcp queue is full, the dashboard gets it from the log on reload
+  if (!asyncTcpCall(publishLive, sample))
+  {
+    free(sample);
+  }
+}
+
+void sampleSocketPrintMetrics(Print &out)
+{
+  if (samples == NULL)
+  {
+    return;
+  }
+  // Only changed on the async_tcp task, where /metrics is answered as well
+  const AsyncWebSocketDeflateStats &stats = samples->deflateStats();
+  out.print("# HELP ws_deflate_messages_total Messages sent compressed on " SAMPLE_SOCKET_URL "\n# TYPE ws_deflate_messages_total counter\n");
+  out.printf("ws_deflate_messages_total %u\n", stats.messages);
+  out.print("# HELP ws_deflate_skipped_total Messages that did not get smaller\n# TYPE ws_deflate_skipped_total counter\n");
+  out.printf("ws_deflate_skipped_total %u\n", stats.skipped);
+  out.print("# HELP ws_deflate_input_bytes_total Bytes of the compressed messages before compression\n# TYPE ws_deflate_input_bytes_total counter\n");
+  out.printf("ws_deflate_input_bytes_total %llu\n", (unsigned long long)stats.bytesIn);
+  out.print("# HELP ws_deflate_output_bytes_total Bytes of the compressed messages after compression\n# TYPE ws_deflate_output_bytes_total counter\n");
+  out.printf("ws_deflate_output_bytes_total %llu\n", (unsigned long long)stats.bytesOut);
+  out.print("# HELP ws_deflate_seconds_total Time spent compressing\n# TYPE ws_deflate_seconds_total counter\n");
+  out.printf("ws_deflate_seconds_total %lu.%06lu\n", (unsigned long)(stats.micros / 1000000), (unsigned long)(stats.micros % 1000000));
+}
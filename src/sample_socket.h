@@ -0,0 +1,50 @@
+#ifndef __SAMPLE_SOCKET_H
+#define __SAMPLE_SOCKET_H
+
+#include "Arduino.h"
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+
+// WebSocket the dashboard chart reads the logged averages from, see data/temperatur.js
+#define SAMPLE_SOCKET_URL "/samples"
+
+// Binary frames hold one or more blocks, all numbers little-endian:
+//   uint8 type, uint16 record count, uint32 base epoch
+//   per record: zigzag varint seconds since the previous record (the first since the base),
+//               int16 temperature in hundredths of a degree
+// A 30 second step takes 1 byte, so a record is 3 bytes instead of ~55 as JSON
+#define SAMPLE_HISTORY 1     // from the log, in order
+#define SAMPLE_HISTORY_END 2 // the last history block, may be empty
+#define SAMPLE_LIVE 3        // a new average, live blocks of a slow client are joined into one frame
+
+#define SAMPLE_BLOCK_HEADER 7
+#define SAMPLE_RECORD_MAX 7 // 5 byte varint and the temperature
+
+// History frame size, about 340 averages
+#define SAMPLE_FRAME_SIZE 1024
+
+// History frames queued per client before its stream waits, leaves room for live frames
+#define SAMPLE_HISTORY_QUEUE 4
+#define SAMPLE_HISTORY_WAIT_MS 50
+#define SAMPLE_HISTORY_RETRIES 200 // 10 seconds for a client that stopped reading
+
+// The log is sent one frame per storage job, other SD work runs in between.
+// Clients beyond SAMPLE_HISTORY_STREAMS wait for a free stream, beyond the waiting ones they are refused
+#define SAMPLE_HISTORY_STREAMS 2
+#define SAMPLE_HISTORY_WAITING 8
+
+// Clients are pinged after this many quiet seconds, and dropped when nothing came back for the timeout.
+// Live averages every 30 seconds keep the connection busy, the pings find dashboards that went away
+#define SAMPLE_KEEPALIVE_S 15
+#define SAMPLE_IDLE_TIMEOUT_S 40
+
+// Register the socket; each client that connects gets the log at path, then every new average
+void sampleSocketBegin(AsyncWebServer &server, fs::FS &fs, const char *path);
+
+// Send a logged average to every client, callable from loop()
+void sampleSocketPublish(float temperature, uint32_t epoch);
+
+// Compression counters of the socket in the Prometheus text format, for /metrics
+void sampleSocketPrintMetrics(Print &out);
+
+#endif
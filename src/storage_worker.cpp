@@ -0,0 +1,280 @@
+#include "storage_worker.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "WebResponseImpl.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+
+struct StorageJob
+{
+  StorageWork work;
+  StorageDone done;
+};
+
+static QueueHandle_t storageQueue = NULL;
+
+// Runs the jobs one after the other, so SD card access never interleaves
+static void storageTask(void *arg)
+{
+  (void)arg;
+  StorageJob *job;
+  while (true)
+  {
+    if (xQueueReceive(storageQueue, &job, portMAX_DELAY) != pdTRUE)
+    {
+      continue;
+    }
+    String result = job->work();
+    if (job->done)
+    {
+      job->done(result);
+    }
+    delete job;
+  }
+}
+
+void storageBegin()
+{
+  if (storageQueue != NULL)
+  {
+    return;
+  }
+  storageQueue = xQueueCreate(STORAGE_QUEUE_LENGTH, sizeof(StorageJob *));
+  if (storageQueue == NULL)
+  {
+    Serial.println("Failed to create storage queue");
+    return;
+  }
+  if (xTaskCreate(storageTask, "storage", STORAGE_TASK_STACK, NULL, STORAGE_TASK_PRIORITY, NULL) != pdPASS)
+  {
+    Serial.println("Failed to start storage task");
+    vQueueDelete(storageQueue);
+    storageQueue = NULL;
+  }
+}
+
+bool storageSubmit(StorageWork work, StorageDone done)
+{
+  if (storageQueue == NULL)
+  {
+    return false;
+  }
+  StorageJob *job = new StorageJob{work, done};
+  if (xQueueSend(storageQueue, &job, 0) != pdTRUE)
+  {
+    delete job;
+    return false;
+  }
+  return true;
+}
+
+void storageRespond(AsyncWebServerRequest *request, const char *contentType, StorageWork work, const char *errorBody)
+{
+  AsyncWebDeferred *deferred = request->defer();
+  if (deferred == NULL)
+  {
+    request->send(503, "text/plain", "Server busy");
+    return;
+  }
+
+  // Skip the work when the client left while the job was queued
+  bool queued = storageSubmit([deferred, work]()
+                              { return deferred->abandoned() ? String() : work(); },
+                              [deferred, contentType, errorBody](const String &result)
+                              {
+    if (result.isEmpty())
+    {
+      deferred->send(500, "text/plain", errorBody);
+    }
+    else
+    {
+      deferred->send(200, contentType, result);
+    } });
+  if (!queued)
+  {
+    deferred->send(503, "text/plain", "Storage busy");
+  }
+}
+
+// A file on its way to a client: the storage task reads chunks into the ring, the connection takes them out
+struct FileStream
+{
+  portMUX_TYPE lock;
+  fs::FS *fs;
+  String path;
+  size_t offset; // next byte of the file to read
+  size_t end;    // past the last byte to send
+  size_t head;   // first byte in the ring
+  size_t length; // bytes in the ring
+  bool reading;  // a read job is queued
+  bool failed;
+  uint8_t ring[2 * STORAGE_FILE_CHUNK];
+};
+
+// On the storage task, false when the file is gone or shorter than it was
+static bool fileStreamRead(FileStream *stream)
+{
+  portENTER_CRITICAL(&stream->lock);
+  size_t room = sizeof(stream->ring) - stream->length;
+  size_t tail = (stream->head + stream->length) % sizeof(stream->ring);
+  portEXIT_CRITICAL(&stream->lock);
+  size_t want = std::min(std::min(room, (size_t)STORAGE_FILE_CHUNK), stream->end - stream->offset);
+  // the tail part of the ring first, the connection only takes from the head
+  want = std::min(want, sizeof(stream->ring) - tail);
+
+  File file = stream->fs->open(stream->path, FILE_READ);
+  size_t got = 0;
+  if (file && file.seek(stream->offset))
+  {
+    got = file.read(stream->ring + tail, want);
+  }
+  file.close();
+
+  portENTER_CRITICAL(&stream->lock);
+  stream->offset += got;
+  stream->length += got;
+  stream->reading = false;
+  stream->failed = got == 0 && want > 0;
+  portEXIT_CRITICAL(&stream->lock);
+  return !stream->failed;
+}
+
+static bool fileStreamSubmit(std::shared_ptr<FileStream> stream)
+{
+  return storageSubmit([stream]()
+                       {
+    // the response holds the other reference, without it the client is gone
+    if (stream.use_count() > 1)
+    {
+      fileStreamRead(stream.get());
+    }
+    return String(); });
+}
+
+// On the async_tcp task, the filler of the response
+static size_t fileStreamTake(const std::shared_ptr<FileStream> &stream, uint8_t *buffer, size_t maxLen)
+{
+  FileStream *s = stream.get();
+  portENTER_CRITICAL(&s->lock);
+  size_t n = std::min(std::min(maxLen, s->length), sizeof(s->ring) - s->head);
+  memcpy(buffer, s->ring + s->head, n);
+  s->head = (s->head + n) % sizeof(s->ring);
+  s->length -= n;
+  bool failed = s->failed;
+  bool more = !s->reading && !failed && s->offset < s->end && sizeof(s->ring) - s->length >= STORAGE_FILE_CHUNK;
+  if (more)
+  {
+    s->reading = true;
+  }
+  portEXIT_CRITICAL(&s->lock);
+
+  // a full storage queue is tried again on the next call
+  if (more && !fileStreamSubmit(stream))
+  {
+    portENTER_CRITICAL(&s->lock);
+    s->reading = false;
+    portEXIT_CRITICAL(&s->lock);
+  }
+  if (n > 0)
+  {
+    return n;
+  }
+  // ends the response early, the client sees less than Content-Length
+  return failed ? 0 : RESPONSE_TRY_AGAIN;
+}
+
+// On the storage task: finds the size and range, reads the first chunk and answers
+static void fileStreamBegin(AsyncWebDeferred *deferred, std::shared_ptr<FileStream> stream, const String &range, const char *contentType)
+{
+  File file = stream->fs->open(stream->path, FILE_READ);
+  if (!file || file.isDirectory())
+  {
+    file.close();
+    deferred->send(404);
+    return;
+  }
+  size_t size = file.size();
+  file.close();
+
+  int code = 200;
+  stream->end = size;
+  char contentRange[64] = "";
+  if (range.length())
+  {
+    AsyncByteRanges ranges;
+    int count = ranges.parse(range, size);
+    if (count == 0)
+    {
+      AsyncWebServerResponse *response = new AsyncBasicResponse(416);
+      snprintf(contentRange, sizeof(contentRange), "bytes */%u", (unsigned)size);
+      response->addHeader("Content-Range", contentRange);
+      deferred->send(response);
+      return;
+    }
+    // several ranges are answered with the whole file
+    if (count == 1)
+    {
+      code = 206;
+      stream->offset = ranges.start(0);
+      stream->end = ranges.end(0) + 1;
+      snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", (unsigned)ranges.start(0), (unsigned)ranges.end(0), (unsigned)size);
+    }
+  }
+  size_t length = stream->end - stream->offset;
+  if (length > 0 && !fileStreamRead(stream.get()))
+  {
+    deferred->send(500, "text/plain", "Error reading file");
+    return;
+  }
+
+  AsyncWebServerResponse *response = new AsyncCallbackResponse(contentType, length, [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                { return fileStreamTake(stream, buffer, maxLen); });
+  if (response == NULL)
+  {
+    deferred->send(503, "text/plain", "Server busy");
+    return;
+  }
+  response->setCode(code);
+  response->addHeader("Accept-Ranges", "bytes");
+  if (code == 206)
+  {
+    response->addHeader("Content-Range", contentRange);
+  }
+  String name = stream->path.substring(stream->path.lastIndexOf('/') + 1);
+  response->addHeader("Content-Disposition", "attachment; filename=\"" + name + "\"");
+  deferred->send(response);
+}
+
+void storageSendFile(AsyncWebServerRequest *request, fs::FS &fs, const char *path, const char *contentType)
+{
+  // If-Range needs a validator this response does not have, the whole file is sent
+  String range = request->hasHeader("Range") && !request->hasHeader("If-Range") ? request->header("Range") : String();
+  std::shared_ptr<FileStream> stream(new (std::nothrow) FileStream());
+  AsyncWebDeferred *deferred = stream ? request->defer() : NULL;
+  if (deferred == NULL)
+  {
+    request->send(503, "text/plain", "Server busy");
+    return;
+  }
+  stream->lock = portMUX_INITIALIZER_UNLOCKED;
+  stream->fs = &fs;
+  stream->path = path;
+
+  bool queued = storageSubmit([deferred, stream, range, contentType]()
+                              {
+    if (deferred->abandoned())
+    {
+      deferred->send(503);
+    }
+    else
+    {
+      fileStreamBegin(deferred, stream, range, contentType);
+    }
+    return String(); });
+  if (!queued)
+  {
+    deferred->send(503, "text/plain", "Storage busy");
+  }
+}
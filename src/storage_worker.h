@@ -0,0 +1,37 @@
+#ifndef __STORAGE_WORKER_H
+#define __STORAGE_WORKER_H
+
+#include "Arduino.h"
+#include <functional>
+#include <ESPAsyncWebServer.h>
+
+// Jobs that can wait for the storage task before new ones are refused
+#define STORAGE_QUEUE_LENGTH 8
+
+// Below the async_tcp task, so a slow SD card never holds up a connection
+#define STORAGE_TASK_PRIORITY 1
+#define STORAGE_TASK_STACK 8192
+
+// A file sent with storageSendFile() is read a chunk per job, up to two chunks ahead of the connection
+#define STORAGE_FILE_CHUNK 2048
+
+// Work run on the storage task; its result is passed to the completion callback
+typedef std::function<String()> StorageWork;
+typedef std::function<void(const String &result)> StorageDone;
+
+// Start the storage task, call before anything is submitted
+void storageBegin();
+
+// Queue work for the storage task, done (if any) is called on that task once the work ran.
+// Returns false when the queue is full or the task is not running
+bool storageSubmit(StorageWork work, StorageDone done = nullptr);
+
+// Answer a request with the result of work once the storage task ran it.
+// Other connections are served meanwhile; an empty result is answered with 500 and errorBody
+void storageRespond(AsyncWebServerRequest *request, const char *contentType, StorageWork work, const char *errorBody);
+
+// Send a file as a download, read on the storage task. The file is opened and closed again for every chunk,
+// so other storage work on it, appending or deleting, runs between chunks. A single Range is answered with 206
+void storageSendFile(AsyncWebServerRequest *request, fs::FS &fs, const char *path, const char *contentType);
+
+#endif
@@ -0,0 +1,132 @@
+#include "time_service.h"
+#include "clock_service.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <NTPClient.h>
+
+static WiFiUDP ntpUDP;
+static NTPClient timeClient(ntpUDP);
+
+// Burst state
+static uint8_t burstSent = 0;
+static bool burstHasSample = false;
+static unsigned long bestRoundTripUs = 0;
+static int64_t bestOffsetUs = 0;
+
+static unsigned long lastActionMs = 0;
+static unsigned long waitMs = 0;
+
+// Monotonic time of the last applied sample, used for the drift estimate
+static int64_t lastSyncMonoUs = 0;
+static unsigned long lastRoundTripUs = 0;
+
+// Prototypes
+static void finishBurst();
+static void applySample(int64_t offsetUs, unsigned long roundTripUs);
+
+void timeServiceBegin(const char *server, uint16_t port)
+{
+  timeClient.setPoolServerName(server);
+  timeClient.setServerPort(port);
+  timeClient.begin();
+}
+
+void timeServiceLoop()
+{
+  // Collect the reply of the outstanding request
+  if (timeClient.isRequestPending())
+  {
+    int result = timeClient.checkResponse(TIME_RESPONSE_TIMEOUT_MS);
+    if (result == NTP_RESPONSE_PENDING)
+    {
+      return;
+    }
+    if (result == NTP_RESPONSE_OK)
+    {
+      int64_t offsetUs = (int64_t)timeClient.getServerMicros() - clockNowUs();
+      unsigned long roundTripUs = timeClient.getRoundTripMicros();
+      if (!burstHasSample || roundTripUs < bestRoundTripUs)
+      {
+        bestRoundTripUs = roundTripUs;
+        bestOffsetUs = offsetUs;
+        burstHasSample = true;
+      }
+    }
+    lastActionMs = millis();
+    waitMs = TIME_BURST_SPACING_MS;
+    return;
+  }
+
+  if (millis() - lastActionMs < waitMs)
+  {
+    return;
+  }
+
+  if (burstSent < TIME_BURST_SIZE && WiFi.status() == WL_CONNECTED)
+  {
+    if (timeClient.sendRequest())
+    {
+      burstSent++;
+    }
+    else
+    {
+      // Name lookup or socket failed, give up on this burst
+      burstSent = TIME_BURST_SIZE;
+    }
+    lastActionMs = millis();
+    waitMs = 0;
+    return;
+  }
+
+  finishBurst();
+}
+
+unsigned long timeServiceLastRoundTrip()
+{
+  return lastRoundTripUs;
+}
+
+// Apply the best sample of the burst and schedule the next one
+static void finishBurst()
+{
+  if (burstHasSample)
+  {
+    applySample(bestOffsetUs, bestRoundTripUs);
+    waitMs = TIME_SYNC_INTERVAL_MS;
+  }
+  else
+  {
+    waitMs = TIME_RETRY_INTERVAL_MS;
+  }
+
+  burstSent = 0;
+  burstHasSample = false;
+  lastActionMs = millis();
+}
+
+static void applySample(int64_t offsetUs, unsigned long roundTripUs)
+{
+  int64_t nowMonoUs = clockMonotonicUs();
+  int64_t intervalUs = nowMonoUs - lastSyncMonoUs;
+  lastRoundTripUs = roundTripUs;
+
+  if (!clockIsSynced() || llabs(offsetUs) > TIME_STEP_THRESHOLD_US)
+  {
+    clockStep(offsetUs);
+    lastSyncMonoUs = nowMonoUs;
+    Serial.printf("Clock stepped by %lld us (rtt %lu us)\n", offsetUs, roundTripUs);
+    return;
+  }
+
+  if (intervalUs >= TIME_DRIFT_MIN_INTERVAL_US)
+  {
+    // What remains after the pending correction is the drift since the last sync
+    int64_t residualUs = offsetUs - clockPendingSlewUs();
+    int64_t correctionPpb = residualUs * 1000000000LL / intervalUs;
+    clockSetRate(clockRate() + (int32_t)(correctionPpb / 2));
+  }
+  lastSyncMonoUs = nowMonoUs;
+
+  clockSlew(offsetUs);
+  Serial.printf("Clock slewing %lld us, rate %ld ppb (rtt %lu us)\n", offsetUs, (long)clockRate(), roundTripUs);
+}
@@ -0,0 +1,30 @@
+#ifndef __TIME_SERVICE_H
+#define __TIME_SERVICE_H
+
+#include "Arduino.h"
+
+// Requests per synchronization burst, the reply with the lowest round trip is used
+#define TIME_BURST_SIZE 4
+#define TIME_BURST_SPACING_MS 250
+#define TIME_RESPONSE_TIMEOUT_MS 1000
+
+// Time between bursts once synced, and after a burst without any reply
+#define TIME_SYNC_INTERVAL_MS 3600000UL
+#define TIME_RETRY_INTERVAL_MS 15000UL
+
+// Offsets above this are stepped, smaller ones are slewed out
+#define TIME_STEP_THRESHOLD_US 500000LL
+
+// Minimum time between two syncs before the crystal drift estimate is updated
+#define TIME_DRIFT_MIN_INTERVAL_US 600000000LL
+
+// Set the NTP server; the port can point to a local stand-in server for testing
+void timeServiceBegin(const char *server, uint16_t port);
+
+// Drive the synchronization from loop(), never blocks
+void timeServiceLoop();
+
+// Round trip of the sample used for the last sync, in microseconds
+unsigned long timeServiceLastRoundTrip();
+
+#endif
@@ -0,0 +1,54 @@
+#include "web_assets.h"
+#include "web_assets_data.h"
+
+void webAssetsBegin(AsyncWebServer &server)
+{
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    const WebAsset *asset = &webAssets[i];
+    server.on(asset->path, HTTP_GET, [asset](AsyncWebServerRequest *request)
+              { webAssetSend(request, asset); });
+  }
+  Serial.printf("Embedded %u web assets\n", (unsigned)WEB_ASSET_COUNT);
+}
+
+const WebAsset *webAssetFind(const char *source)
+{
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    if (strcmp(webAssets[i].source, source) == 0)
+    {
+      return &webAssets[i];
+    }
+  }
+  return NULL;
+}
+
+void webAssetSend(AsyncWebServerRequest *request, const WebAsset *asset)
+{
+  if (asset == NULL)
+  {
+    request->send(404);
+    return;
+  }
+  const char *cacheControl = asset->immutable ? WEB_ASSET_IMMUTABLE : "no-cache";
+
+  // Pages are revalidated on every load, the ETag makes that a header exchange
+  if (request->header("If-None-Match") == asset->etag)
+  {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("Cache-Control", cacheControl);
+    response->addHeader("ETag", asset->etag);
+    request->send(response);
+    return;
+  }
+
+  AsyncWebServerResponse *response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+  if (asset->gzip)
+  {
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("Cache-Control", cacheControl);
+  response->addHeader("ETag", asset->etag);
+  request->send(response);
+}
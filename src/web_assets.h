@@ -0,0 +1,32 @@
+#ifndef __WEB_ASSETS_H
+#define __WEB_ASSETS_H
+
+#include "Arduino.h"
+#include <ESPAsyncWebServer.h>
+
+// Cache-Control of fingerprinted files, their name changes with their content
+#define WEB_ASSET_IMMUTABLE "public, max-age=31536000, immutable"
+
+// A file from data/ embedded by scripts/embed_assets.py
+struct WebAsset
+{
+  const char *path;        // URL, fingerprinted except for html pages
+  const char *source;      // Original name in data/
+  const char *contentType;
+  const uint8_t *data;
+  size_t length;
+  bool gzip;
+  bool immutable;
+  const char *etag;
+};
+
+// Register a GET route for every embedded file; call before serveStatic so these win
+void webAssetsBegin(AsyncWebServer &server);
+
+// Embedded file by its original name in data/, NULL if it was not embedded
+const WebAsset *webAssetFind(const char *source);
+
+// Send an embedded file, or 304 when the client already has this version
+void webAssetSend(AsyncWebServerRequest *request, const WebAsset *asset);
+
+#endif
@@ -0,0 +1,66 @@
+// Heap allocations and time per AsyncTCP event, in bursts the pool covers and in a storm larger than the pool.
+// CXXFLAGS=-DCONFIG_ASYNC_TCP_EVENT_POOL_SIZE=0 gives the heap allocation every event had before the pool.
+#include <cstdlib>
+#include <chrono>
+
+// Every heap call of the event path goes through here
+static long allocations;
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *malloc(size_t size) { allocations++; return __libc_malloc(size); }
+
+#include "AsyncTCP.cpp"
+#include "queue_standin.h"
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+static void noop(void *) {}
+
+// What the async_tcp task does with the queue, without the task
+static void drain()
+{
+  lwip_event_packet_t *e;
+  while (uxQueueMessagesWaiting(_async_queue))
+  {
+    _get_async_event(&e);
+    _handle_async_event(e);
+  }
+}
+
+int main()
+{
+  _init_async_event_queue();
+
+  // a poll round over many connections: polls, acks and calls from other tasks, handled before the next round
+  const int rounds = 200000, burst = 16;
+  long before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+  {
+    for (int i = 0; i < burst; i++)
+    {
+      if (i % 3 == 0)
+        _tcp_poll(NULL, NULL);
+      else if (i % 3 == 1)
+        _tcp_sent(NULL, NULL, 100);
+      else
+        asyncTcpCall(noop, NULL);
+    }
+    drain();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("pool of %d, bursts of %d: %.3f allocations, %.0f ns per event (host)\n", CONFIG_ASYNC_TCP_EVENT_POOL_SIZE, burst,
+         (double)(allocations - before) / (rounds * burst), ns / (rounds * burst));
+
+  // more packets in use at once than the pool has, as when a full queue holds up the callbacks that wait for room
+  lwip_event_packet_t *held[100];
+  before = allocations;
+  uint32_t exhausted = asyncTcpPoolExhausted();
+  for (int i = 0; i < 100; i++)
+    held[i] = _alloc_event();
+  long stormed = allocations - before;
+  for (int i = 0; i < 100; i++)
+    _free_event(held[i]);
+  printf("pool of %d, 100 packets in use: %ld allocations, %u times the pool ran out\n", CONFIG_ASYNC_TCP_EVENT_POOL_SIZE,
+         stormed, asyncTcpPoolExhausted() - exhausted);
+}
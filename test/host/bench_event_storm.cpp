@@ -0,0 +1,61 @@
+// Events per second through the async_tcp task in an event storm, with the watchdog cost of the ESP32 simulated.
+// CXXFLAGS=-DCONFIG_ASYNC_TCP_MAX_BATCH=1 adds and removes the task from the watchdog around every event, as before
+// batching. An argument sets the simulated watchdog cost in microseconds (default 33, the header's lower bound).
+#include "AsyncTCP.cpp"
+#include "queue_standin.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static auto boot = std::chrono::steady_clock::now();
+unsigned long micros() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count(); }
+unsigned long millis() { return micros() / 1000; }
+
+static void spin(unsigned us)
+{
+  unsigned long end = micros() + us;
+  while (micros() < end)
+    ;
+}
+
+// Adding the task to the watchdog and removing it again costs wdtUs in all
+static unsigned wdtUs = 33;
+static std::atomic<long> wdtCalls{0};
+esp_err_t esp_task_wdt_add(TaskHandle_t) { wdtCalls++; spin(wdtUs / 2); return ESP_OK; }
+esp_err_t esp_task_wdt_delete(TaskHandle_t) { wdtCalls++; spin(wdtUs - wdtUs / 2); return ESP_OK; }
+esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+// A handler that does a little work, like a short callback of the web server
+static std::atomic<long> handled{0};
+static void work(void *)
+{
+  spin(5);
+  handled++;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+    wdtUs = atoi(argv[1]);
+  _init_async_event_queue();
+  std::thread(_async_service_task, (void *)NULL).detach();
+
+  const long events = 100000;
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < events; i++)
+    while (!asyncTcpCall(work, NULL, 1000))
+      ;
+  // the task counts a batch after its last event
+  while (handled < events || asyncTcpStats().events < events)
+    std::this_thread::yield();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  AsyncTcpStats stats = asyncTcpStats();
+  printf("batches of up to %d, watchdog %u us: %.0f events/s, %.2f watchdog calls per event (host)\n", CONFIG_ASYNC_TCP_MAX_BATCH,
+         wdtUs, events / seconds, (double)wdtCalls / events);
+  printf("  stats: %u events in %u batches (%.1f per batch), %u events/s, %u us per event, %u queued\n", stats.events,
+         stats.batches, (double)stats.events / stats.batches, stats.eventsPerSecond, stats.usPerEvent, stats.queued);
+  // the task never returns
+  fflush(stdout);
+  _Exit(0);
+}
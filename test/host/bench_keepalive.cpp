@@ -0,0 +1,105 @@
+// Requests per second and p99 latency of small responses, with persistent connections on and off.
+// An argument adds a simulated connection setup in microseconds to every new connection (default 0: server work only).
+#define private public
+#define protected public
+#include "WebRequest.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+static auto boot = std::chrono::steady_clock::now();
+unsigned long micros() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count(); }
+unsigned long millis() { return micros() / 1000; }
+
+// The client connection writes into a string, closing it deletes the request like AsyncTCP does
+static std::string wire;
+static AsyncWebServerRequest *connection;
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+void AsyncClient::setRxTimeout(uint32_t) {}
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 5744; }
+size_t AsyncClient::write(const char *data) { return write(data, strlen(data)); }
+size_t AsyncClient::write(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+void AsyncClient::close(bool)
+{
+  AsyncWebServerRequest *r = connection;
+  connection = NULL;
+  if (r != NULL)
+    r->_onDisconnect();
+}
+void AsyncWebServer::_handleDisconnect(AsyncWebServerRequest *r) { delete r; }
+
+// A small JSON reading, like the dashboard polls
+struct Reading : public AsyncWebHandler
+{
+  bool canHandle(AsyncWebServerRequest *) override { return true; }
+  bool isRequestHandlerTrivial() override { return false; }
+  void handleRequest(AsyncWebServerRequest *r) override { r->send(200, "application/json", "{\"temperature\":21.5}"); }
+};
+
+static Reading reading;
+void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *) {}
+void AsyncWebServer::_attachHandler(AsyncWebServerRequest *r) { r->setHandler(&reading); }
+
+static void spin(unsigned us)
+{
+  unsigned long end = micros() + us;
+  while (micros() < end)
+    ;
+}
+
+// A browser that sends the next request once the response before is acknowledged
+static void run(bool keepAlive, unsigned setupUs, bool report = true)
+{
+  static AsyncWebServer *server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+  static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+  server->setKeepAlive(keepAlive);
+  std::string request = "GET /temperature HTTP/1.1\r\nHost: esp32.local\r\nAccept: application/json\r\n"
+                        "Accept-Encoding: gzip, deflate\r\nConnection: keep-alive\r\n\r\n";
+  const int count = 200000;
+  std::vector<double> latency(count);
+  long connections = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < count; n++)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    if (connection == NULL)
+    {
+      spin(setupUs);
+      connection = new AsyncWebServerRequest(server, client);
+      connections++;
+    }
+    std::string copy = request;
+    connection->_onData(&copy[0], copy.size());
+    std::string sent;
+    sent.swap(wire);
+    connection->_onAck(sent.size(), 0);
+    latency[n] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  delete connection;
+  connection = NULL;
+  if (!report)
+    return;
+  std::sort(latency.begin(), latency.end());
+  printf("keep-alive %-3s setup %4u us: %6ld connections, %8.0f requests/s, p50 %6.2f us, p99 %6.2f us (host)\n",
+         keepAlive ? "on" : "off", setupUs, connections, count / seconds, latency[count / 2], latency[count * 99 / 100]);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned setupUs = argc > 1 ? atoi(argv[1]) : 0;
+  // the first run warms up the caches and the allocator
+  run(true, setupUs, false);
+  run(true, setupUs);
+  run(false, setupUs);
+}
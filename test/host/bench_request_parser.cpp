@@ -0,0 +1,92 @@
+// Heap allocations and time per parsed request head, for a browser request with few and with many headers.
+#define private public
+#define protected public
+#include "WebRequest.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include <chrono>
+#include <string>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+// Every heap call of the parser goes through here
+static long allocations;
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *malloc(size_t size) { allocations++; return __libc_malloc(size); }
+extern "C" void *realloc(void *p, size_t size) { allocations++; return __libc_realloc(p, size); }
+extern "C" void *calloc(size_t n, size_t size) { allocations++; return __libc_calloc(n, size); }
+
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+
+// Looks at what a file handler would, then leaves the request without a response
+struct Reader : public AsyncWebHandler
+{
+  size_t seen = 0;
+  bool canHandle(AsyncWebServerRequest *) override { return true; }
+  bool isRequestHandlerTrivial() override { return false; }
+  void handleRequest(AsyncWebServerRequest *r) override
+  {
+    seen += r->url().length() + r->header("Accept-Encoding").length() + r->header("If-None-Match").length();
+  }
+};
+
+static Reader reader;
+void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *) {}
+void AsyncWebServer::_attachHandler(AsyncWebServerRequest *r) { r->setHandler(&reader); }
+
+// A new connection per request, or one persistent connection that parses them all
+static void run(const char *name, const std::string &request, size_t packet, int count, bool persistent = false)
+{
+  static AsyncWebServer *server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+  static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+  std::string copy = request;
+  long before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  AsyncWebServerRequest *r = NULL;
+  for (int n = 0; n < count; n++)
+  {
+    if (r == NULL)
+      r = new AsyncWebServerRequest(server, client);
+    for (size_t i = 0; i < copy.size(); i += packet)
+      r->_onData(&copy[i], std::min(packet, copy.size() - i));
+    if (persistent)
+      r->_reset();
+    else
+    {
+      delete r;
+      r = NULL;
+    }
+  }
+  delete r;
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+  printf("%-28s %-10s %4zu bytes, %4zu byte packets: %5.1f allocations, %6.0f ns per request (host)\n", name,
+         persistent ? "persistent" : "new", request.size(), packet, (double)(allocations - before) / count, ns);
+}
+
+int main()
+{
+  std::string few = "GET /index.html HTTP/1.1\r\nHost: esp32.local\r\nAccept-Encoding: gzip, deflate\r\n"
+                    "If-None-Match: \"5f3a-1c2b\"\r\nConnection: keep-alive\r\n\r\n";
+  std::string many = "GET /api/history?from=1700000000&to=1700086400&step=60 HTTP/1.1\r\nHost: esp32.local\r\n"
+                     "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+                     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+                     "Accept-Language: da,en-US;q=0.7,en;q=0.3\r\nAccept-Encoding: gzip, deflate\r\n"
+                     "Referer: http://esp32.local/\r\nConnection: keep-alive\r\nUpgrade-Insecure-Requests: 1\r\n"
+                     "If-None-Match: \"5f3a-1c2b\"\r\nCache-Control: max-age=0\r\nDNT: 1\r\nSec-GPC: 1\r\n"
+                     "Priority: u=0, i\r\nPragma: no-cache\r\n\r\n";
+  const int count = 200000;
+  run("5 headers", few, few.size(), count);
+  run("5 headers", few, 64, count);
+  run("14 headers, 3 parameters", many, many.size(), count);
+  run("14 headers, 3 parameters", many, 64, count);
+  run("14 headers, 3 parameters", many, 64, count, true);
+  return reader.seen == 0;
+}
@@ -0,0 +1,209 @@
+// Template responses on a large page with many placeholders, against the std::vector cache they replaced.
+#define private public
+#define protected public
+#include "WebResponses.cpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+// The content a page is read from, in the chunks the output asks for
+struct Page
+{
+  std::string text;
+  size_t read(uint8_t *buffer, size_t len, size_t index)
+  {
+    size_t n = std::min(len, text.size() - index);
+    memcpy(buffer, text.data() + index, n);
+    return n;
+  }
+};
+
+// The previous implementation, kept as the baseline: placeholders that cross a chunk are carried in a
+// std::vector that is inserted into and erased from at the front
+struct VectorCacheTemplates
+{
+  std::vector<uint8_t> _cache;
+  AwsTemplateProcessor _callback;
+  Page *_page;
+  size_t _index = 0;
+  size_t _fillBuffer(uint8_t *data, size_t len)
+  {
+    size_t n = _page->read(data, len, _index);
+    _index += n;
+    return n;
+  }
+  size_t _readDataFromCacheOrContent(uint8_t *data, const size_t len);
+  size_t _fillBufferAndProcessTemplates(uint8_t *data, size_t len);
+};
+
+// Copied as it was, its std::min calls mix size_t and unsigned int, which only compiles where they are the same type
+#define min(a, b) min<size_t>(a, b)
+
+size_t VectorCacheTemplates::_readDataFromCacheOrContent(uint8_t* data, const size_t len)
+{
+    // If we have something in cache, copy it to buffer
+    const size_t readFromCache = std::min(len, _cache.size());
+    if(readFromCache) {
+      memcpy(data, _cache.data(), readFromCache);
+      _cache.erase(_cache.begin(), _cache.begin() + readFromCache);
+    }
+    // If we need to read more...
+    const size_t needFromFile = len - readFromCache;
+    const size_t readFromContent = _fillBuffer(data + readFromCache, needFromFile);
+    return readFromCache + readFromContent;
+}
+
+size_t VectorCacheTemplates::_fillBufferAndProcessTemplates(uint8_t* data, size_t len)
+{
+  if(!_callback)
+    return _fillBuffer(data, len);
+
+  const size_t originalLen = len;
+  len = _readDataFromCacheOrContent(data, len);
+  // Now we've read 'len' bytes, either from cache or from file
+  // Search for template placeholders
+  uint8_t* pTemplateStart = data;
+  while((pTemplateStart < &data[len]) && (pTemplateStart = (uint8_t*)memchr(pTemplateStart, TEMPLATE_PLACEHOLDER, &data[len - 1] - pTemplateStart + 1))) { // data[0] ... data[len - 1]
+    uint8_t* pTemplateEnd = (pTemplateStart < &data[len - 1]) ? (uint8_t*)memchr(pTemplateStart + 1, TEMPLATE_PLACEHOLDER, &data[len - 1] - pTemplateStart) : nullptr;
+    // temporary buffer to hold parameter name
+    uint8_t buf[TEMPLATE_PARAM_NAME_LENGTH + 1];
+    String paramName;
+    // If closing placeholder is found:
+    if(pTemplateEnd) {
+      // prepare argument to callback
+      const size_t paramNameLength = std::min(sizeof(buf) - 1, (unsigned int)(pTemplateEnd - pTemplateStart - 1));
+      if(paramNameLength) {
+        memcpy(buf, pTemplateStart + 1, paramNameLength);
+        buf[paramNameLength] = 0;
+        paramName = String(reinterpret_cast<char*>(buf));
+      } else { // double percent sign encountered, this is single percent sign escaped.
+        // remove the 2nd percent sign
+        memmove(pTemplateEnd, pTemplateEnd + 1, &data[len] - pTemplateEnd - 1);
+        len += _readDataFromCacheOrContent(&data[len - 1], 1) - 1;
+        ++pTemplateStart;
+      }
+    } else if(&data[len - 1] - pTemplateStart + 1 < TEMPLATE_PARAM_NAME_LENGTH + 2) { // closing placeholder not found, check if it's in the remaining file data
+      memcpy(buf, pTemplateStart + 1, &data[len - 1] - pTemplateStart);
+      const size_t readFromCacheOrContent = _readDataFromCacheOrContent(buf + (&data[len - 1] - pTemplateStart), TEMPLATE_PARAM_NAME_LENGTH + 2 - (&data[len - 1] - pTemplateStart + 1));
+      if(readFromCacheOrContent) {
+        pTemplateEnd = (uint8_t*)memchr(buf + (&data[len - 1] - pTemplateStart), TEMPLATE_PLACEHOLDER, readFromCacheOrContent);
+        if(pTemplateEnd) {
+          // prepare argument to callback
+          *pTemplateEnd = 0;
+          paramName = String(reinterpret_cast<char*>(buf));
+          // Copy remaining read-ahead data into cache
+          _cache.insert(_cache.begin(), pTemplateEnd + 1, buf + (&data[len - 1] - pTemplateStart) + readFromCacheOrContent);
+          pTemplateEnd = &data[len - 1];
+        }
+        else // closing placeholder not found in file data, store found percent symbol as is and advance to the next position
+        {
+          // but first, store read file data in cache
+          _cache.insert(_cache.begin(), buf + (&data[len - 1] - pTemplateStart), buf + (&data[len - 1] - pTemplateStart) + readFromCacheOrContent);
+          ++pTemplateStart;
+        }
+      }
+      else // closing placeholder not found in content data, store found percent symbol as is and advance to the next position
+        ++pTemplateStart;
+    }
+    else // closing placeholder not found in content data, store found percent symbol as is and advance to the next position
+      ++pTemplateStart;
+    if(paramName.length()) {
+      // call callback and replace with result.
+      // Everything in range [pTemplateStart, pTemplateEnd] can be safely replaced with parameter value.
+      // Data after pTemplateEnd may need to be moved.
+      // The first byte of data after placeholder is located at pTemplateEnd + 1.
+      // It should be located at pTemplateStart + numBytesCopied (to begin right after inserted parameter value).
+      const String paramValue(_callback(paramName));
+      const char* pvstr = paramValue.c_str();
+      const unsigned int pvlen = paramValue.length();
+      const size_t numBytesCopied = std::min(pvlen, static_cast<unsigned int>(&data[originalLen - 1] - pTemplateStart + 1));
+      // make room for param value
+      // 1. move extra data to cache if parameter value is longer than placeholder AND if there is no room to store
+      if((pTemplateEnd + 1 < pTemplateStart + numBytesCopied) && (originalLen - (pTemplateStart + numBytesCopied - pTemplateEnd - 1) < len)) {
+        _cache.insert(_cache.begin(), &data[originalLen - (pTemplateStart + numBytesCopied - pTemplateEnd - 1)], &data[len]);
+        //2. parameter value is longer than placeholder text, push the data after placeholder which not saved into cache further to the end
+        memmove(pTemplateStart + numBytesCopied, pTemplateEnd + 1, &data[originalLen] - pTemplateStart - numBytesCopied);
+        len = originalLen; // fix issue with truncated data, not sure if it has any side effects
+      } else if(pTemplateEnd + 1 != pTemplateStart + numBytesCopied)
+        //2. Either parameter value is shorter than placeholder text OR there is enough free space in buffer to fit.
+        //   Move the entire data after the placeholder
+        memmove(pTemplateStart + numBytesCopied, pTemplateEnd + 1, &data[len] - pTemplateEnd - 1);
+      // 3. replace placeholder with actual value
+      memcpy(pTemplateStart, pvstr, numBytesCopied);
+      // If result is longer than buffer, copy the remainder into cache (this could happen only if placeholder text itself did not fit entirely in buffer)
+      if(numBytesCopied < pvlen) {
+        _cache.insert(_cache.begin(), pvstr + numBytesCopied, pvstr + pvlen);
+      } else if(pTemplateStart + numBytesCopied < pTemplateEnd + 1) { // result is copied fully; if result is shorter than placeholder text...
+        // there is some free room, fill it from cache
+        const size_t roomFreed = pTemplateEnd + 1 - pTemplateStart - numBytesCopied;
+        const size_t totalFreeRoom = originalLen - len + roomFreed;
+        len += _readDataFromCacheOrContent(&data[len - roomFreed], totalFreeRoom) - roomFreed;
+      } else { // result is copied fully; it is longer than placeholder text
+        const size_t roomTaken = pTemplateStart + numBytesCopied - pTemplateEnd - 1;
+        len = std::min(len + roomTaken, originalLen);
+      }
+    }
+  } // while(pTemplateStart)
+  return len;
+}
+
+
+#undef min
+
+template <class Fill>
+static double timeMs(Fill fill, size_t chunk, std::string &out)
+{
+  std::vector<uint8_t> buffer(chunk);
+  out.clear();
+  auto start = std::chrono::steady_clock::now();
+  size_t n;
+  while ((n = fill(buffer.data(), chunk)) != 0)
+    out.append((char *)buffer.data(), n);
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const char *name, const std::string &text, const AwsTemplateProcessor &processor, int placeholders)
+{
+  Page page = {text};
+  // A TCP segment, the default MSS and a full send buffer
+  const int rounds = 5;
+  for (size_t chunk : {536, 1436, 5744})
+  {
+    double scanner = 0, vector = 0;
+    std::string a, b;
+    for (int i = 0; i < rounds; i++)
+    {
+      AsyncCallbackResponse response("text/html", 0, [&](uint8_t *buffer, size_t len, size_t index) { return page.read(buffer, len, index); },
+                                     processor);
+      scanner += timeMs([&](uint8_t *data, size_t len) { return response._fillBufferAndProcessTemplates(data, len); }, chunk, a);
+      VectorCacheTemplates baseline;
+      baseline._callback = processor;
+      baseline._page = &page;
+      vector += timeMs([&](uint8_t *data, size_t len) { return baseline._fillBufferAndProcessTemplates(data, len); }, chunk, b);
+    }
+    printf("%s: %zu byte page, %d placeholders, %4zu byte chunks: scanner %6.2f ms, vector cache %6.2f ms, same output %s (host)\n",
+           name, text.size(), placeholders, chunk, scanner / rounds, vector / rounds, a == b ? "yes" : "NO");
+  }
+}
+
+int main()
+{
+  std::string text;
+  int placeholders = 0;
+  while (text.size() < 262144)
+    text += "<td class=\"v\">%VAR" + std::to_string(placeholders++ % 50) + "%</td>\n";
+  run("short values", text, [](const String &name) -> String { return String("<") + name + ">"; }, placeholders);
+
+  // Each placeholder becomes a table row, the output runs ahead of the content read so far
+  text.clear();
+  placeholders = 0;
+  while (text.size() < 65536)
+    text += "<tr>%ROW" + std::to_string(placeholders++ % 50) + "%</tr>\n";
+  std::string row;
+  for (int i = 0; i < 8; i++)
+    row += "<td class=\"v\">21.50</td>";
+  run("row values", text, [&](const String &) -> String { return String(row.c_str()); }, placeholders);
+}
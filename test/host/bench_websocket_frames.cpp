@@ -0,0 +1,96 @@
+// WebSocket unmasking and frame sending throughput at different payload sizes, against the code they replaced.
+#define private public
+#define protected public
+#include "AsyncWebSocket.cpp"
+#include "WebMetrics.cpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+static std::string wire;
+static size_t window;
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return window; }
+size_t AsyncClient::add(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+bool AsyncClient::send() { return true; }
+
+// The byte loop _onData used before
+static void maskBytes(uint8_t *data, size_t len, const uint8_t *mask, size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+    data[i] ^= mask[(offset + i) % 4];
+}
+
+// The previous webSocketSendFrame: header in a malloc'd buffer, header and payload in two add() calls
+static size_t mallocHeaderSendFrame(AsyncClient *client, bool final, uint8_t opcode, bool mask, uint8_t *data, size_t len)
+{
+  size_t space = client->space();
+  uint8_t mbuf[4] = {1, 2, 3, 4};
+  uint8_t headLen = 2;
+  if (len && mask)
+    headLen += 4;
+  if (len > 125)
+    headLen += 2;
+  space -= headLen;
+  if (len > space)
+    len = space;
+  uint8_t *buf = (uint8_t *)malloc(headLen);
+  buf[0] = opcode | (final ? 0x80 : 0);
+  if (len < 126)
+    buf[1] = len;
+  else
+  {
+    buf[1] = 126;
+    buf[2] = len >> 8;
+    buf[3] = len;
+  }
+  if (len && mask)
+  {
+    buf[1] |= 0x80;
+    memcpy(buf + (headLen - 4), mbuf, 4);
+  }
+  client->add((const char *)buf, headLen);
+  free(buf);
+  if (len && mask)
+    maskBytes(data, len, mbuf, 0);
+  client->add((const char *)data, len);
+  client->send();
+  return len;
+}
+
+// MB/s over 64 MiB of payload
+template <class F>
+static double throughput(size_t len, F f)
+{
+  int count = (int)(64 * 1024 * 1024 / len);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; i++)
+    f();
+  return (double)len * count / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+}
+
+int main()
+{
+  AsyncClient *client = (AsyncClient *)calloc(1, 512);
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  printf("%8s %16s %16s %16s %16s\n", "bytes", "unmask bytes", "unmask words", "send 2 x add", "send headroom");
+  for (size_t len : {16, 125, 1024, 16384})
+  {
+    // the payload of a received frame starts after its header, so it is rarely aligned
+    std::vector<uint8_t> buffer(len + 16);
+    uint8_t *payload = &buffer[9];
+    double bytes = throughput(len, [&] { maskBytes(payload, len, mask, 1); asm volatile("" : : "r"(payload) : "memory"); });
+    double words = throughput(len, [&] { webSocketMask(payload, len, mask, 1); asm volatile("" : : "r"(payload) : "memory"); });
+
+    // one frame of up to a segment, from a buffer with WS_FRAME_HEADROOM in front
+    size_t frame = std::min<size_t>(len, 1400);
+    window = frame + 16;
+    wire.reserve(2 * window);
+    double twoAdds = throughput(frame, [&] { wire.clear(); mallocHeaderSendFrame(client, true, WS_BINARY, false, &buffer[8], frame); });
+    double headroom = throughput(frame, [&] { wire.clear(); webSocketSendFrame(client, true, WS_BINARY, false, &buffer[8], frame); });
+    printf("%8zu %11.0f MB/s %11.0f MB/s %11.0f MB/s %11.0f MB/s\n", len, bytes, words, twoAdds, headroom);
+  }
+}
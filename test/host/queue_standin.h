@@ -0,0 +1,87 @@
+// FreeRTOS queues and semaphores for tests that run the AsyncTCP event queue on host threads.
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// A ring of length items of itemSize bytes, allocated once; a wait of portMAX_DELAY ticks waits forever,
+// a tick is a millisecond
+struct HostQueue
+{
+  std::mutex lock;
+  std::condition_variable changed;
+  std::vector<char> ring;
+  size_t length, itemSize, first = 0, count = 0;
+
+  HostQueue(size_t length, size_t itemSize) : ring(length * itemSize), length(length), itemSize(itemSize) {}
+
+  template <class P>
+  bool wait(std::unique_lock<std::mutex> &l, TickType_t ticks, P ready)
+  {
+    if (ticks == portMAX_DELAY)
+    {
+      changed.wait(l, ready);
+      return true;
+    }
+    return changed.wait_for(l, std::chrono::milliseconds(ticks), ready);
+  }
+
+  BaseType_t send(const void *item, TickType_t ticks, bool front)
+  {
+    std::unique_lock<std::mutex> l(lock);
+    if (!wait(l, ticks, [&] { return count < length; }))
+      return pdFALSE;
+    size_t slot = front ? (first = (first + length - 1) % length) : (first + count) % length;
+    if (itemSize)
+      memcpy(&ring[slot * itemSize], item, itemSize);
+    count++;
+    changed.notify_all();
+    return pdPASS;
+  }
+
+  BaseType_t receive(void *item, TickType_t ticks, bool remove)
+  {
+    std::unique_lock<std::mutex> l(lock);
+    if (!wait(l, ticks, [&] { return count > 0; }))
+      return pdFALSE;
+    if (itemSize)
+      memcpy(item, &ring[first * itemSize], itemSize);
+    if (remove)
+    {
+      first = (first + 1) % length;
+      count--;
+      changed.notify_all();
+    }
+    return pdPASS;
+  }
+};
+
+QueueHandle_t xQueueCreate(unsigned length, unsigned itemSize)
+{
+  return new HostQueue(length, itemSize);
+}
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks) { return ((HostQueue *)q)->send(item, ticks, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks) { return ((HostQueue *)q)->send(item, ticks, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks) { return ((HostQueue *)q)->send(item, ticks, true); }
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks) { return ((HostQueue *)q)->receive(item, ticks, true); }
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks) { return ((HostQueue *)q)->receive(item, ticks, false); }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+  std::lock_guard<std::mutex> l(((HostQueue *)q)->lock);
+  return ((HostQueue *)q)->count;
+}
+
+// Semaphores are queues of one empty item; a mutex starts given
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  SemaphoreHandle_t s = xSemaphoreCreateBinary();
+  xQueueSend(s, "", 0);
+  return s;
+}
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) { return xQueueReceive(s, NULL, ticks); }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) { return xQueueSend(s, "", 0); }
+void vSemaphoreDelete(SemaphoreHandle_t s) { delete (HostQueue *)s; }
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Build and run the host tests and benchmarks against the stand-ins in stubs/.
+#   test/host/run.sh                  every test_*.cpp, with AddressSanitizer and UBSan
+#   test/host/run.sh bench_pool ...   the named tests or benchmarks, benchmarks are built with -O2
+# Extra link flags of a file are read from its "// host-flags:" line, $CXXFLAGS is added to every build.
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/../.." && pwd)
+out=${OUT:-${TMPDIR:-/tmp}/host-tests}
+CXX=${CXX:-g++}
+mkdir -p "$out"
+
+# The sources are included as they are, symbols a test never reaches stay unresolved
+common="-std=gnu++17 -g -fno-rtti -fpermissive -w -DESP32 -no-pie -fno-pie -pthread $CXXFLAGS
+  -I$here/stubs -I$root/lib/AsyncTCP/src -I$root/lib/ESPAsyncWebServer/src -I$root/lib/NTPClient -I$root/src"
+
+names=$*
+[ -n "$names" ] || names=$(cd "$here" && ls test_*.cpp | sed 's/\.cpp$//')
+
+for name in $names; do
+  name=${name%.cpp}
+  case $name in
+    bench_*) flags="-O2 -DNDEBUG" ;;
+    *) flags="-O1 -fsanitize=address,undefined" ;;
+  esac
+  extra=$(sed -n 's|^// host-flags: ||p' "$here/$name.cpp")
+  echo "== $name"
+  $CXX $common $flags "$here/$name.cpp" -o "$out/$name" -Wl,--unresolved-symbols=ignore-all $extra
+  ASAN_OPTIONS=detect_leaks=0 "$out/$name"
+done
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#define vsnprintf_P vsnprintf
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log_stub.h"
+typedef uint8_t byte; typedef bool boolean;
+#define ESP32 1
+#define ARDUINO 10800
+unsigned long millis(); unsigned long micros(); void delay(uint32_t); void yield();
+inline long random(long a, long b){ return a; } inline long random(long b){ return b / 3; } inline void randomSeed(unsigned long){} inline int analogRead(int){ return 0; }
+inline uint16_t word(uint8_t h, uint8_t l){ return h<<8|l; }
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define isDigit(c) isdigit(c)
+template<class A,class B> inline auto min(A a,B b)->decltype(a<b?a:b){return a<b?a:b;}
+template<class A,class B> inline auto max(A a,B b)->decltype(a>b?a:b){return a>b?a:b;}
+#define constrain(v,a,b) ((v)<(a)?(a):((v)>(b)?(b):(v)))
+#define IRAM_ATTR
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "esp_heap.h"
+inline size_t strlcpy(char* d, const char* s, size_t n){ size_t l=strlen(s); if(n){ size_t c=l<n-1?l:n-1; memcpy(d,s,c); d[c]=0;} return l; }
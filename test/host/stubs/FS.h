@@ -0,0 +1,17 @@
+#pragma once
+#include "Arduino.h"
+#include <memory>
+namespace fs {
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+class File : public Stream { public:
+ File(){} size_t write(uint8_t){return 1;} size_t write(const uint8_t*, size_t n){return n;} int available(){return 0;} int read(){return -1;} int peek(){return -1;}
+ size_t read(uint8_t*, size_t){return 0;} bool seek(uint32_t, SeekMode m=SeekSet){return true;} size_t position() const {return 0;} size_t size() const {return 0;} void close(){}
+ operator bool() const {return false;} const char* name() const {return "";} const char* path() const {return "";} bool isDirectory(){return false;} File openNextFile(const char* m="r"){return File();} time_t getLastWrite(){return 0;} void rewindDirectory(){}
+};
+class FS { public: File open(const char*, const char* m="r", bool c=false){return File();} File open(const String& p, const char* m="r", bool c=false){return File();}
+ bool exists(const char*){return false;} bool exists(const String&){return false;} bool remove(const char*){return true;} bool remove(const String&){return true;} bool rename(const String&, const String&){return true;} bool mkdir(const String&){return true;} bool rmdir(const String&){return true;} };
+}
+using fs::FS; using fs::File;
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in, the address is kept in network byte order like on the ESP32
+class IPAddress { public: uint32_t a=0; IPAddress(){} IPAddress(uint32_t x):a(x){} IPAddress(uint8_t b0,uint8_t b1,uint8_t b2,uint8_t b3):a(b0|b1<<8|b2<<16|(uint32_t)b3<<24){}
+ operator uint32_t() const { return a; } bool operator==(const IPAddress& o) const { return a==o.a; } bool operator!=(const IPAddress& o) const { return a!=o.a; }
+ uint8_t operator[](int i) const { return a >> (8 * i); }
+ String toString() const { char b[16]; snprintf(b, sizeof(b), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]); return String(b); } bool fromString(const char*){ return true; } };
@@ -0,0 +1,12 @@
+#pragma once
+class Print; class Printable { public: virtual ~Printable(){} virtual size_t printTo(Print&) const = 0; };
+class Print { public:
+ virtual ~Print(){}
+ virtual size_t write(uint8_t)=0; virtual size_t write(const uint8_t* b, size_t n){ size_t r=0; while(n--) r+=write(*b++); return r; }
+ size_t write(const char* s){ return write((const uint8_t*)s, strlen(s)); }
+ size_t print(const String& s){ return write((const uint8_t*)s.c_str(), s.length()); } size_t print(const char* s){ return write(s); }
+ size_t print(int v){ return print(String(v)); } size_t print(char c){ return write((uint8_t)c); } size_t print(unsigned long v){ return print(String(v)); } size_t print(float v){ return print(String(v)); }
+ size_t print(const __FlashStringHelper* s){ return write((const char*)s); }
+ size_t println(const String& s=String()){ return print(s)+write("\r\n"); } size_t println(const char* s){ return print(s)+write("\r\n"); }
+ size_t printf(const char*, ...){ return 0; }
+};
@@ -0,0 +1,5 @@
+#pragma once
+#include "FS.h"
+#define SDMMC_FREQ_DEFAULT 20000
+struct SDMMCFS : fs::FS { bool begin(const char* m="/sdcard", bool mode1bit=false, bool f=false, int freq=SDMMC_FREQ_DEFAULT, uint8_t maxfiles=5){return true;} bool setPins(int,int,int){return true;} uint64_t cardSize(){return 0;} uint64_t totalBytes(){return 0;} uint64_t usedBytes(){return 0;} };
+extern SDMMCFS SD_MMC;
@@ -0,0 +1,9 @@
+#pragma once
+class Stream : public Print { public:
+ virtual int available()=0; virtual int read()=0; virtual int peek()=0; virtual void flush(){}
+ size_t readBytes(char* b, size_t n){ size_t i=0; while(i<n){ int c=read(); if(c<0) break; b[i++]=c;} return i; }
+ size_t readBytes(uint8_t* b, size_t n){ return readBytes((char*)b,n); }
+ String readStringUntil(char){ return String(); }
+};
+struct HardwareSerial : Stream { size_t write(uint8_t){return 1;} int available(){return 0;} int read(){return -1;} int peek(){return -1;} void begin(unsigned long){} };
+extern HardwareSerial Serial;
@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <strings.h>
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+#define FPSTR(s) ((const __FlashStringHelper*)(s))
+#define PSTR(s) (s)
+typedef const char* PGM_P;
+class String {
+ public:
+  std::string s; bool invalid=false;
+  String(){} String(const char* c){ if(c) s=c; else invalid=true; } String(const std::string& x):s(x){}
+  String(const __FlashStringHelper* c):s((const char*)c){}
+  String(char c):s(1,c){} explicit String(int v,unsigned char base=10){char b[34]; if(base==16) snprintf(b,34,"%x",v); else snprintf(b,34,"%d",v); s=b;}
+  explicit String(unsigned int v,unsigned char base=10){char b[34]; if(base==16) snprintf(b,34,"%x",v); else snprintf(b,34,"%u",v); s=b;}
+  explicit String(long v,unsigned char base=10):s(std::to_string(v)){} explicit String(unsigned long v,unsigned char base=10){char b[34]; if(base==16) snprintf(b,34,"%lx",v); else snprintf(b,34,"%lu",v); s=b;}
+  explicit String(long long v):s(std::to_string(v)){} explicit String(unsigned long long v):s(std::to_string(v)){}
+  explicit String(float v,unsigned int d=2){char b[40];snprintf(b,40,"%.*f",d,v);s=b;} explicit String(double v,unsigned int d=2){char b[40];snprintf(b,40,"%.*f",d,v);s=b;}
+  size_t length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  bool reserve(unsigned int n){ s.reserve(n); return true; }
+  bool isEmpty() const { return s.empty(); }
+  explicit operator bool() const { return !invalid; }
+  char operator[](unsigned int i) const { return i<s.size()?s[i]:0; }
+  char& operator[](unsigned int i){ return s[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  void setCharAt(unsigned int i, char c){ if(i<s.size()) s[i]=c; }
+  String& operator+=(const String& o){ s+=o.s; return *this; }
+  String& operator+=(const char* o){ s+=o; return *this; }
+  String& operator+=(char c){ s+=c; return *this; }
+  String& operator+=(int v){ s+=std::to_string(v); return *this; }
+  String& operator+=(unsigned int v){ s+=std::to_string(v); return *this; }
+  String& operator+=(long v){ s+=std::to_string(v); return *this; }
+  String& operator+=(unsigned long v){ s+=std::to_string(v); return *this; }
+  bool concat(const String& o){ s+=o.s; return true; } bool concat(const char* o){ s+=o; return true; } bool concat(char c){ s+=c; return true; }
+  bool concat(const char* o, unsigned int n){ s.append(o,n); return true; }
+  bool concat(int v){ s+=std::to_string(v); return true; } bool concat(unsigned int v){ s+=std::to_string(v); return true; }
+  bool concat(unsigned long v){ s+=std::to_string(v); return true; } bool concat(long v){ s+=std::to_string(v); return true; }
+  bool equals(const String& o) const { return s==o.s; } bool equals(const char* o) const { return s==o; }
+  bool equalsIgnoreCase(const String& o) const { return strcasecmp(s.c_str(),o.s.c_str())==0; }
+  bool operator==(const String& o) const { return s==o.s; } bool operator==(const char* o) const { return s==o; }
+  bool operator!=(const String& o) const { return s!=o.s; } bool operator!=(const char* o) const { return s!=o; }
+  bool operator<(const String& o) const { return s<o.s; }
+  bool startsWith(const String& p) const { return s.compare(0,p.s.size(),p.s)==0; }
+  bool startsWith(const String& p, unsigned int off) const { return s.compare(off,p.s.size(),p.s)==0; }
+  bool endsWith(const String& p) const { return s.size()>=p.s.size() && s.compare(s.size()-p.s.size(),p.s.size(),p.s)==0; }
+  int indexOf(char c, unsigned int from=0) const { auto r=s.find(c,from); return r==std::string::npos?-1:(int)r; }
+  int indexOf(const String& c, unsigned int from=0) const { auto r=s.find(c.s,from); return r==std::string::npos?-1:(int)r; }
+  int indexOf(const char* c, unsigned int from=0) const { auto r=s.find(c,from); return r==std::string::npos?-1:(int)r; }
+  int lastIndexOf(char c) const { auto r=s.rfind(c); return r==std::string::npos?-1:(int)r; }
+  int lastIndexOf(const String& c) const { auto r=s.rfind(c.s); return r==std::string::npos?-1:(int)r; }
+  int lastIndexOf(const char* c) const { auto r=s.rfind(c); return r==std::string::npos?-1:(int)r; }
+  String substring(unsigned int a) const { return a<s.size()?String(s.substr(a)):String(""); }
+  String substring(unsigned int a, unsigned int b) const { if(b>s.size())b=s.size(); return a<b?String(s.substr(a,b-a)):String(""); }
+  void trim(){ size_t a=s.find_first_not_of(" \t\r\n"); size_t b=s.find_last_not_of(" \t\r\n"); s = a==std::string::npos?"":s.substr(a,b-a+1); }
+  void toLowerCase(){ for(auto&c:s) c=tolower(c);} void toUpperCase(){ for(auto&c:s) c=toupper(c);}
+  void replace(const String& a, const String& b){ size_t p=0; while((p=s.find(a.s,p))!=std::string::npos){ s.replace(p,a.s.size(),b.s); p+=b.s.size(); } }
+  void replace(char a, char b){ for(auto&c:s) if(c==a) c=b; }
+  void remove(unsigned int i){ if(i<s.size()) s.erase(i); } void remove(unsigned int i, unsigned int n){ if(i<s.size()) s.erase(i,n); }
+  long toInt() const { return atol(s.c_str()); } float toFloat() const { return atof(s.c_str()); }
+  void getBytes(unsigned char* b, unsigned int n, unsigned int idx=0) const { strncpy((char*)b, s.c_str()+idx, n); }
+  void toCharArray(char* b, unsigned int n) const { strncpy(b, s.c_str(), n); }
+  const char* begin() const { return s.c_str(); } const char* end() const { return s.c_str()+s.size(); }
+  void clear(){ s.clear(); }
+};
+inline String operator+(const String& a, const String& b){ return String(a.s+b.s); }
+inline String operator+(const String& a, const char* b){ return String(a.s+b); }
+inline String operator+(const char* a, const String& b){ return String(a+b.s); }
+inline String operator+(const String& a, char b){ return String(a.s+b); }
+inline String operator+(const String& a, int b){ return String(a.s+std::to_string(b)); }
+inline String operator+(const String& a, unsigned int b){ return String(a.s+std::to_string(b)); }
+inline String operator+(const String& a, long b){ return String(a.s+std::to_string(b)); }
+inline String operator+(const String& a, unsigned long b){ return String(a.s+std::to_string(b)); }
@@ -0,0 +1,8 @@
+#pragma once
+#include "Arduino.h"
+#define WL_CONNECTED 3
+struct WiFiClass { IPAddress localIP(){return IPAddress();} int status(){return WL_CONNECTED;} bool mode(int){return true;} bool config(IPAddress,IPAddress,IPAddress,IPAddress){return true;} void begin(const char*,const char*){} bool softAP(const char*, const char*){return true;} IPAddress softAPIP(){return IPAddress();} };
+extern WiFiClass WiFi;
+#define WIFI_STA 1
+inline void configTime(long, int, const char*, const char* a=0, const char* b=0){}
+inline bool getLocalTime(struct tm*, uint32_t ms=5000){ return true; }
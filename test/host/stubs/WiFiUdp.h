@@ -0,0 +1,33 @@
+#pragma once
+// Host stand-in over a POSIX datagram socket, so NTPClient can talk to a local UDP server
+#include "Udp.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+// Name lookups done by beginPacket(host, port), tests check they are not repeated
+extern int wifiUdpLookups;
+
+class WiFiUDP : public UDP {
+  int _fd = -1;
+  sockaddr_in _to = {}, _from = {};
+  std::vector<uint8_t> _out, _in;
+  size_t _pos = 0;
+ public:
+  uint8_t begin(uint16_t port){ stop(); _fd = socket(AF_INET, SOCK_DGRAM, 0); sockaddr_in a = {}; a.sin_family = AF_INET; a.sin_port = htons(port);
+    if(_fd < 0 || bind(_fd, (sockaddr*)&a, sizeof(a)) != 0) return 0; fcntl(_fd, F_SETFL, O_NONBLOCK); return 1; }
+  void stop(){ if(_fd >= 0) close(_fd); _fd = -1; }
+  int beginPacket(IPAddress ip, uint16_t port){ _to = {}; _to.sin_family = AF_INET; _to.sin_port = htons(port); _to.sin_addr.s_addr = (uint32_t)ip; _out.clear(); return 1; }
+  int beginPacket(const char* host, uint16_t port){ wifiUdpLookups++; addrinfo hints = {}, *res; hints.ai_family = AF_INET; hints.ai_socktype = SOCK_DGRAM;
+    if(getaddrinfo(host, NULL, &hints, &res) != 0) return 0; uint32_t ip = ((sockaddr_in*)res->ai_addr)->sin_addr.s_addr; freeaddrinfo(res); return beginPacket(IPAddress(ip), port); }
+  int endPacket(){ return sendto(_fd, _out.data(), _out.size(), 0, (sockaddr*)&_to, sizeof(_to)) == (ssize_t)_out.size(); }
+  size_t write(uint8_t b){ _out.push_back(b); return 1; } size_t write(const uint8_t* b, size_t n){ _out.insert(_out.end(), b, b + n); return n; }
+  int parsePacket(){ uint8_t buf[1500]; socklen_t l = sizeof(_from); ssize_t n = _fd < 0 ? -1 : recvfrom(_fd, buf, sizeof(buf), 0, (sockaddr*)&_from, &l);
+    _in.assign(buf, buf + (n > 0 ? n : 0)); _pos = 0; return n > 0 ? n : 0; }
+  int read(unsigned char* b, size_t n){ size_t c = std::min(n, _in.size() - _pos); memcpy(b, _in.data() + _pos, c); _pos += c; return c; }
+  int read(){ return _pos < _in.size() ? _in[_pos++] : -1; } int available(){ return _in.size() - _pos; } int peek(){ return _pos < _in.size() ? _in[_pos] : -1; }
+  IPAddress remoteIP(){ return IPAddress((uint32_t)_from.sin_addr.s_addr); } uint16_t remotePort(){ return ntohs(_from.sin_port); }
+};
@@ -0,0 +1,18 @@
+// host stand-in for the ROM tinfl, backed by zlib (raw inflate), same calling contract
+#pragma once
+#include <zlib.h>
+#include <string.h>
+typedef enum { TINFL_STATUS_FAILED = -1, TINFL_STATUS_DONE = 0, TINFL_STATUS_NEEDS_MORE_INPUT = 1, TINFL_STATUS_HAS_MORE_OUTPUT = 2 } tinfl_status;
+enum { TINFL_FLAG_PARSE_ZLIB_HEADER = 1, TINFL_FLAG_HAS_MORE_INPUT = 2, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4 };
+typedef struct { int m_state; z_stream z; char pad[11000]; } tinfl_decompressor;
+#define tinfl_init(r) do { (r)->m_state = 0; } while(0)
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const unsigned char *in, size_t *inSize, unsigned char *start, unsigned char *next, size_t *outSize, unsigned flags){
+  if(!r->m_state){ memset(&r->z, 0, sizeof(r->z)); inflateInit2(&r->z, -15); r->m_state = 1; }
+  r->z.next_in = (unsigned char*)in; r->z.avail_in = *inSize; r->z.next_out = next; r->z.avail_out = *outSize;
+  int ret = inflate(&r->z, Z_SYNC_FLUSH);
+  *inSize -= r->z.avail_in; *outSize -= r->z.avail_out;
+  if(ret == Z_STREAM_END) { inflateEnd(&r->z); return TINFL_STATUS_DONE; }
+  if(ret != Z_OK && ret != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+  if(r->z.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+  return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdlib.h>
+#define MALLOC_CAP_SPIRAM 1
+#define MALLOC_CAP_8BIT 2
+#define MALLOC_CAP_INTERNAL 4
+#define MALLOC_CAP_DEFAULT 8
+inline void* heap_caps_malloc(size_t n, uint32_t){ return malloc(n); }
+inline size_t heap_caps_get_free_size(uint32_t){ return 0; }
+inline size_t heap_caps_get_largest_free_block(uint32_t){ return 0; }
+struct EspClass { uint32_t getFreeHeap(){return 0;} uint32_t getMinFreeHeap(){return 0;} uint32_t getMaxAllocHeap(){return 0;} uint32_t getFreePsram(){return 0;} uint32_t getPsramSize(){return 0;} void restart(){} uint32_t getCycleCount(){return 0;} };
+extern EspClass ESP;
+inline void* ps_malloc(size_t n){ return malloc(n); }
+inline bool psramFound(){ return false; }
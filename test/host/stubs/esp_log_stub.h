@@ -0,0 +1,7 @@
+#pragma once
+#define log_e(...) do{}while(0)
+#define log_w(...) do{}while(0)
+#define log_i(...) do{}while(0)
+#define log_d(...) do{}while(0)
+#define log_v(...) do{}while(0)
+#define ets_printf(...) do{}while(0)
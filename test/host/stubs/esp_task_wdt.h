@@ -0,0 +1,6 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+esp_err_t esp_task_wdt_add(TaskHandle_t); esp_err_t esp_task_wdt_delete(TaskHandle_t); esp_err_t esp_task_wdt_reset(); esp_err_t esp_task_wdt_status(TaskHandle_t);
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C"
+#endif
+int64_t esp_timer_get_time();
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+typedef struct { esp_timer_cb_t callback; void* arg; esp_timer_dispatch_t dispatch_method; const char* name; bool skip_unhandled_events; } esp_timer_create_args_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+int esp_timer_create(const esp_timer_create_args_t*, esp_timer_handle_t*);
+int esp_timer_start_once(esp_timer_handle_t, uint64_t);
+int esp_timer_delete(esp_timer_handle_t);
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+typedef void* QueueHandle_t; typedef void* SemaphoreHandle_t; typedef void* TaskHandle_t; typedef uint32_t TickType_t; typedef int BaseType_t; typedef unsigned UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(x) do{}while(0)
+#define portEXIT_CRITICAL(x) do{}while(0)
+#define portENTER_CRITICAL_ISR(x) do{}while(0)
+#define portEXIT_CRITICAL_ISR(x) do{}while(0)
+#define tskNO_AFFINITY 0x7fffffff
+#define configMAX_PRIORITIES 25
+#define xPortGetCoreID() 0
+#ifdef __cplusplus
+extern "C" {
+#endif
+QueueHandle_t xQueueCreate(unsigned, unsigned); BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t); BaseType_t xQueueSendToBack(QueueHandle_t, const void*, TickType_t); BaseType_t xQueueSendToFront(QueueHandle_t, const void*, TickType_t);
+BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t); UBaseType_t uxQueueMessagesWaiting(QueueHandle_t); UBaseType_t uxQueueSpacesAvailable(QueueHandle_t);
+SemaphoreHandle_t xSemaphoreCreateMutex(); SemaphoreHandle_t xSemaphoreCreateBinary(); SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(); BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t); BaseType_t xSemaphoreGive(SemaphoreHandle_t); void vSemaphoreDelete(SemaphoreHandle_t);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t); BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t);
+TaskHandle_t xTaskGetCurrentTaskHandle(); void vTaskDelay(TickType_t); TickType_t xTaskGetTickCount(); void vTaskDelete(TaskHandle_t);
+BaseType_t xTaskCreatePinnedToCore(void(*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t);
+BaseType_t xTaskCreate(void(*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*);
+void vQueueDelete(QueueHandle_t); BaseType_t xQueueReset(QueueHandle_t);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t); BaseType_t xTaskNotifyGive(TaskHandle_t);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+#ifdef __cplusplus
+}
+#endif
+typedef QueueHandle_t xQueueHandle;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+#define CONFIG_LWIP_MAX_ACTIVE_TCP 16
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+#ifdef __cplusplus
+extern "C" {
+#endif
+BaseType_t xQueuePeek(QueueHandle_t, void*, TickType_t);
+BaseType_t xTaskCreateUniversal(void(*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,3 @@
+#pragma once
+typedef struct { int x; } base64_encodestate;
+extern "C" { void base64_init_encodestate(base64_encodestate*); int base64_encode_block(const char*, int, char*, base64_encodestate*); int base64_encode_chars(const char*, int, char*); int base64_encode_blockend(char*, base64_encodestate*); int base64_encode_expected_len(int); }
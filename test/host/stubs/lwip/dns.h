@@ -0,0 +1,4 @@
+#pragma once
+#include "ip_addr.h"
+typedef void (*dns_found_callback)(const char*, const ip_addr_t*, void*);
+err_t dns_gethostbyname(const char*, ip_addr_t*, dns_found_callback, void*);
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include "err.h"
+typedef struct { uint32_t addr; } ip4_addr_t;
+typedef struct ip_addr { union { ip4_addr_t ip4; } u_addr; uint8_t type; } ip_addr_t;
+#define IPADDR_TYPE_V4 0
+#define IPADDR_ANY 0
+#define ip_addr_copy(a,b) ((a)=(b))
+#define IP_ADDR4(a,b,c,d,e)
+typedef ip4_addr_t ip4_addr;
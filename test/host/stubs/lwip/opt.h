@@ -0,0 +1,5 @@
+#pragma once
+#define LWIP_IPV6 0
+#define TCP_MSS 1436
+#define TCP_SND_BUF 5744
+#define TCP_WND 5744
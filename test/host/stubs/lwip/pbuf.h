@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+struct pbuf { struct pbuf* next; void* payload; uint16_t tot_len; uint16_t len; uint8_t flags; uint16_t ref; };
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint8_t pbuf_free(struct pbuf*); void pbuf_ref(struct pbuf*);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,5 @@
+#pragma once
+#include "../err.h"
+struct tcpip_api_call_data { err_t err; };
+typedef err_t (*tcpip_api_call_fn)(struct tcpip_api_call_data*);
+extern "C" err_t tcpip_api_call(tcpip_api_call_fn, struct tcpip_api_call_data*);
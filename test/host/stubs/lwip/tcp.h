@@ -0,0 +1,31 @@
+#pragma once
+#include "pbuf.h"
+#include "err.h"
+#include "ip_addr.h"
+#include "opt.h"
+enum tcp_state { CLOSED, LISTEN, SYN_SENT, SYN_RCVD, ESTABLISHED, FIN_WAIT_1, FIN_WAIT_2, CLOSE_WAIT, CLOSING, LAST_ACK, TIME_WAIT };
+struct tcp_pcb { ip_addr_t local_ip, remote_ip; uint16_t local_port, remote_port; enum tcp_state state; uint8_t so_options; uint8_t flags; uint16_t mss; uint16_t snd_buf; uint32_t keep_idle, keep_intvl, keep_cnt; uint8_t prio; };
+typedef err_t (*tcp_recv_fn)(void*, struct tcp_pcb*, struct pbuf*, err_t);
+typedef err_t (*tcp_sent_fn)(void*, struct tcp_pcb*, uint16_t);
+typedef err_t (*tcp_poll_fn)(void*, struct tcp_pcb*);
+typedef void (*tcp_err_fn)(void*, err_t);
+typedef err_t (*tcp_accept_fn)(void*, struct tcp_pcb*, err_t);
+typedef err_t (*tcp_connected_fn)(void*, struct tcp_pcb*, err_t);
+#define TCP_NODELAY 0x40
+#define SOF_KEEPALIVE 0x08
+#define TCP_WRITE_FLAG_COPY 1
+#define TCP_WRITE_FLAG_MORE 2
+#define tcp_nagle_disable(p)
+#define tcp_nagle_enable(p)
+#define tcp_nagle_disabled(p) 0
+#define tcp_sndbuf(p) ((p)->snd_buf)
+#define tcp_mss(p) ((p)->mss)
+#define ip_set_option(p,o)
+#define ip_reset_option(p,o)
+#define TCP_PRIO_MIN 1
+extern "C" {
+void tcp_arg(struct tcp_pcb*, void*); void tcp_recv(struct tcp_pcb*, tcp_recv_fn); void tcp_sent(struct tcp_pcb*, tcp_sent_fn); void tcp_poll(struct tcp_pcb*, tcp_poll_fn, uint8_t); void tcp_err(struct tcp_pcb*, tcp_err_fn);
+void tcp_accept(struct tcp_pcb*, tcp_accept_fn); void tcp_recved(struct tcp_pcb*, uint16_t); err_t tcp_output(struct tcp_pcb*); err_t tcp_write(struct tcp_pcb*, const void*, uint16_t, uint8_t);
+err_t tcp_close(struct tcp_pcb*); void tcp_abort(struct tcp_pcb*); err_t tcp_connect(struct tcp_pcb*, const ip_addr_t*, uint16_t, tcp_connected_fn);
+struct tcp_pcb* tcp_new_ip_type(uint8_t); err_t tcp_bind(struct tcp_pcb*, const ip_addr_t*, uint16_t); struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb*, uint8_t);
+}
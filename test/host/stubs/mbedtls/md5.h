@@ -0,0 +1,4 @@
+#pragma once
+typedef struct { int x; } mbedtls_md5_context;
+void mbedtls_md5_init(mbedtls_md5_context*); int mbedtls_md5_starts_ret(mbedtls_md5_context*); int mbedtls_md5_update_ret(mbedtls_md5_context*, const unsigned char*, size_t); int mbedtls_md5_finish_ret(mbedtls_md5_context*, unsigned char[16]);
+void mbedtls_md5_starts(mbedtls_md5_context*); void mbedtls_md5_update(mbedtls_md5_context*, const unsigned char*, size_t); void mbedtls_md5_finish(mbedtls_md5_context*, unsigned char[16]); void mbedtls_md5_free(mbedtls_md5_context*);
@@ -0,0 +1,4 @@
+#pragma once
+typedef struct { int x; } mbedtls_sha1_context;
+void mbedtls_sha1_init(mbedtls_sha1_context*); int mbedtls_sha1_starts_ret(mbedtls_sha1_context*); int mbedtls_sha1_update_ret(mbedtls_sha1_context*, const unsigned char*, size_t); int mbedtls_sha1_finish_ret(mbedtls_sha1_context*, unsigned char[20]);
+void mbedtls_sha1_starts(mbedtls_sha1_context*); void mbedtls_sha1_update(mbedtls_sha1_context*, const unsigned char*, size_t); void mbedtls_sha1_finish(mbedtls_sha1_context*, unsigned char[20]); void mbedtls_sha1_free(mbedtls_sha1_context*);
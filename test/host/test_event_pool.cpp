@@ -0,0 +1,93 @@
+// The AsyncTCP event packet pool under concurrent producers and one consumer, then every packet back on the free list.
+#include "AsyncTCP.cpp"
+#include "queue_standin.h"
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+static std::atomic<long> handled{0};
+static void count(void *) { handled++; }
+
+// The packets reachable from the head of the free list, each once
+static int freePackets()
+{
+  std::vector<bool> seen(CONFIG_ASYNC_TCP_EVENT_POOL_SIZE);
+  int n = 0;
+  for (uint32_t h = _event_pool_head & 0xFFFF; h; h = _event_pool_next[h - 1])
+  {
+    assert(h <= CONFIG_ASYNC_TCP_EVENT_POOL_SIZE && !seen[h - 1]);
+    seen[h - 1] = true;
+    n++;
+  }
+  return n;
+}
+
+int main()
+{
+  _init_async_event_queue();
+  assert(freePackets() == CONFIG_ASYNC_TCP_EVENT_POOL_SIZE);
+
+  // Three tasks call into the async_tcp task, which handles everything until they are done
+  const long calls = 100000;
+  std::atomic<bool> stop{false};
+  std::thread consumer([&] {
+    lwip_event_packet_t *e;
+    while (!stop || uxQueueMessagesWaiting(_async_queue))
+      if (xQueueReceive(_async_queue, &e, 1) == pdPASS)
+        _handle_async_event(e);
+  });
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 3; p++)
+    producers.emplace_back([&] {
+      for (long i = 0; i < calls; i++)
+        while (!asyncTcpCall(count, NULL, i % 2 ? 1 : 0))
+          std::this_thread::yield();
+    });
+  for (std::thread &p : producers)
+    p.join();
+  stop = true;
+  consumer.join();
+  assert(handled == 3 * calls);
+  assert(freePackets() == CONFIG_ASYNC_TCP_EVENT_POOL_SIZE);
+
+  // Threads taking and returning packets as fast as they can: no packet is handed to two of them at once
+  std::vector<std::thread> takers;
+  for (int t = 0; t < 4; t++)
+    takers.emplace_back([t] {
+      lwip_event_packet_t *mine[8];
+      for (int round = 0; round < 200000; round++)
+      {
+        int n = 1 + (round + t) % 8;
+        for (int i = 0; i < n; i++)
+        {
+          mine[i] = _alloc_event();
+          mine[i]->slot = t * 8 + i;
+        }
+        std::this_thread::yield();
+        for (int i = 0; i < n; i++)
+        {
+          assert(mine[i]->slot == t * 8 + i);
+          _free_event(mine[i]);
+        }
+      }
+    });
+  for (std::thread &t : takers)
+    t.join();
+  assert(freePackets() == CONFIG_ASYNC_TCP_EVENT_POOL_SIZE);
+
+  // Past the pool the heap takes over, and its packets are freed to the heap
+  std::vector<lwip_event_packet_t *> held;
+  uint32_t exhausted = asyncTcpPoolExhausted();
+  for (int i = 0; i < CONFIG_ASYNC_TCP_EVENT_POOL_SIZE + 5; i++)
+    held.push_back(_alloc_event());
+  assert(freePackets() == 0 && asyncTcpPoolExhausted() - exhausted == 5);
+  for (lwip_event_packet_t *e : held)
+    _free_event(e);
+  assert(freePackets() == CONFIG_ASYNC_TCP_EVENT_POOL_SIZE);
+  printf("%ld calls from 3 threads, the pool ran out %u times in all\n", handled.load(), asyncTcpPoolExhausted());
+  puts("ok");
+}
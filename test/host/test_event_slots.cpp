@@ -0,0 +1,110 @@
+// Events queued for a closed AsyncTCP client are dropped by their slot generation, a client reusing the slot gets its own.
+#define private public
+#define protected public
+#include "AsyncTCP.cpp"
+#include "queue_standin.h"
+#include <cassert>
+#include <map>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+// lwIP is called on the calling thread and does nothing
+extern "C" void tcp_arg(struct tcp_pcb *, void *) {}
+extern "C" void tcp_recv(struct tcp_pcb *, tcp_recv_fn) {}
+extern "C" void tcp_sent(struct tcp_pcb *, tcp_sent_fn) {}
+extern "C" void tcp_poll(struct tcp_pcb *, tcp_poll_fn, uint8_t) {}
+extern "C" void tcp_err(struct tcp_pcb *, tcp_err_fn) {}
+extern "C" void tcp_recved(struct tcp_pcb *, uint16_t) {}
+extern "C" err_t tcp_close(struct tcp_pcb *) { return ERR_OK; }
+extern "C" err_t tcpip_api_call(tcpip_api_call_fn fn, struct tcpip_api_call_data *call) { return fn(call); }
+
+static int freedBuffers;
+extern "C" uint8_t pbuf_free(struct pbuf *p)
+{
+  freedBuffers++;
+  delete (char *)p->payload;
+  delete p;
+  return 1;
+}
+
+static struct pbuf *buffer()
+{
+  return new pbuf{NULL, new char('x'), 1, 1, 0, 1};
+}
+
+// What each client was handed by the async_tcp task, by the index of its pcb; a deleted client's address can come back
+static tcp_pcb pcbs[_number_of_event_slots + 2];
+static std::map<int, int> dispatched;
+
+static AsyncClient *connect(int id)
+{
+  AsyncClient *c = new AsyncClient(&pcbs[id]);
+  void *arg = (void *)(intptr_t)id;
+  c->onData([](void *id, AsyncClient *, void *, size_t) { dispatched[(intptr_t)id]++; }, arg);
+  c->onAck([](void *id, AsyncClient *, size_t, uint32_t) { dispatched[(intptr_t)id]++; }, arg);
+  c->onPoll([](void *id, AsyncClient *) { dispatched[(intptr_t)id]++; }, arg);
+  return c;
+}
+
+// A received packet, an ack and a poll from the lwIP task
+static void queueEvents(AsyncClient *c)
+{
+  _tcp_recv(c, c->_pcb, buffer(), ERR_OK);
+  _tcp_sent(c, c->_pcb, 10);
+  _tcp_poll(c, c->_pcb);
+}
+
+// What the async_tcp task does with the queue, without the task
+static void drain()
+{
+  lwip_event_packet_t *e;
+  while (xQueueReceive(_async_queue, &e, 0) == pdPASS)
+    _handle_async_event(e);
+}
+
+int main()
+{
+  _init_async_event_queue();
+
+  // Closed and deleted with its events still queued: they are dropped when they come up, the buffer freed
+  AsyncClient *closed = connect(0);
+  int16_t slot = closed->_event_slot;
+  assert(slot >= 0);
+  queueEvents(closed);
+  closed->close(true);
+  delete closed;
+
+  // The next client takes the same slot with the next generation, its events are handled
+  AsyncClient *reused = connect(1);
+  assert(reused->_event_slot == slot && reused->_event_generation == _event_generations[slot]);
+  queueEvents(reused);
+  drain();
+  assert(dispatched.count(0) == 0 && dispatched[1] == 3 && freedBuffers == 2);
+
+  // Slots are reused until none is left, a client without one is purged from the queue by a clear event
+  std::vector<AsyncClient *> clients{reused};
+  for (int i = 1; _free_event_slot_count; i++)
+    clients.push_back(connect(1 + i));
+  assert((int)clients.size() == _number_of_event_slots);
+  AsyncClient *unslotted = connect(_number_of_event_slots + 1);
+  assert(unslotted->_event_slot == -1 && !unslotted->_event_slot_held);
+  dispatched.clear();
+  queueEvents(unslotted);
+  queueEvents(clients.back());
+  unslotted->close(true);
+  delete unslotted;
+  drain();
+  assert(dispatched.count(_number_of_event_slots + 1) == 0 && dispatched[_number_of_event_slots] == 3 && freedBuffers == 4);
+  assert(uxQueueMessagesWaiting(_async_queue) == 0);
+
+  // Closing every client frees every slot
+  for (AsyncClient *c : clients)
+  {
+    c->close(true);
+    delete c;
+  }
+  assert(_free_event_slot_count == _number_of_event_slots);
+  puts("ok");
+}
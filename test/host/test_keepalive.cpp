@@ -0,0 +1,192 @@
+// Persistent connections: pipelined requests answered in order, each started by the ack that ends the response before.
+#define private public
+#define protected public
+#include "WebRequest.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+static unsigned long now;
+unsigned long millis() { return now; }
+unsigned long micros() { return 0; }
+
+// The client connection writes into a string, closing it deletes the request like AsyncTCP does
+static std::string wire;
+static AsyncWebServerRequest *connection;
+static std::map<AsyncClient *, AsyncWebServerRequest *> others;
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+void AsyncClient::setRxTimeout(uint32_t) {}
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 5744; }
+size_t AsyncClient::write(const char *data) { return write(data, strlen(data)); }
+size_t AsyncClient::write(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+void AsyncClient::close(bool)
+{
+  AsyncWebServerRequest *r = connection;
+  if (others.count(this))
+  {
+    r = others[this];
+    others.erase(this);
+  }
+  else
+    connection = NULL;
+  if (r != NULL)
+    r->_onDisconnect();
+}
+void AsyncWebServer::_handleDisconnect(AsyncWebServerRequest *r) { delete r; }
+
+// Closes the connection from inside its first ack, as a failed stream does
+struct ClosingResponse : AsyncWebServerResponse
+{
+  bool _sourceValid() const override { return true; }
+  void _respond(AsyncWebServerRequest *r) override
+  {
+    _state = RESPONSE_CONTENT;
+    r->client()->write("HTTP/1.1 200 OK\r\n");
+  }
+  size_t _ack(AsyncWebServerRequest *r, size_t, uint32_t) override
+  {
+    r->client()->close();
+    return 0;
+  }
+};
+
+// Answers each request with its url
+struct Echo : public AsyncWebHandler
+{
+  bool canHandle(AsyncWebServerRequest *) override { return true; }
+  bool isRequestHandlerTrivial() override { return false; }
+  void handleRequest(AsyncWebServerRequest *r) override
+  {
+    if (r->url() == "/closing")
+      r->send(new ClosingResponse());
+    else
+      r->send(200, "text/plain", r->url());
+  }
+};
+
+static Echo echo;
+void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *) {}
+void AsyncWebServer::_attachHandler(AsyncWebServerRequest *r) { r->setHandler(&echo); }
+
+static AsyncWebServer *server;
+static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+
+static void open()
+{
+  if (server == NULL)
+  {
+    server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+    server->_keepAlive = true;
+  }
+  connection = new AsyncWebServerRequest(server, client);
+  wire.clear();
+}
+
+static void receive(const std::string &data)
+{
+  std::string copy = data;
+  connection->_onData(&copy[0], copy.size());
+}
+
+// The ack for everything written so far, returns what was sent in reply to it
+static std::string ack()
+{
+  std::string sent = wire;
+  wire.clear();
+  connection->_onAck(sent.size(), 0);
+  return sent;
+}
+
+static bool has(const std::string &s, const char *part) { return s.find(part) != std::string::npos; }
+
+int main()
+{
+  // Three pipelined requests in one packet: one response per ack, in order, no poll in between
+  open();
+  receive("GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\nGET /c HTTP/1.1\r\nConnection: close\r\n\r\n");
+  std::string a = ack();
+  assert(has(a, "HTTP/1.1 200 OK") && has(a, "Connection: keep-alive") && has(a, "\r\n\r\n/a"));
+  std::string b = ack();
+  assert(has(b, "Connection: keep-alive") && has(b, "\r\n\r\n/b"));
+  std::string c = ack();
+  assert(has(c, "Connection: close") && has(c, "\r\n\r\n/c"));
+  // the server closes once the last response is acknowledged
+  assert(connection == NULL);
+  printf("pipelined: %s | %s | %s\n", a.substr(a.rfind('\n') + 1).c_str(), b.substr(b.rfind('\n') + 1).c_str(),
+         c.substr(c.rfind('\n') + 1).c_str());
+
+  // A request that arrives in pieces while the one before is still being sent
+  open();
+  receive("GET /d HTTP/1.1\r\n\r\nGET /e HT");
+  receive("TP/1.1\r\nHost: x\r\n\r\n");
+  assert(has(ack(), "/d") && has(ack(), "/e"));
+
+  // A chunked body cannot be told from the next request: the connection closes and the body is not parsed
+  receive("POST /f HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nGET\r\n0\r\n\r\n");
+  std::string f = ack();
+  assert(has(f, "Connection: close") && has(f, "/f") && connection == NULL);
+
+  // HTTP/1.0 closes unless it asks for keep-alive
+  open();
+  receive("GET /g HTTP/1.0\r\n\r\n");
+  assert(has(ack(), "Connection: close") && connection == NULL);
+  open();
+  receive("GET /h HTTP/1.0\r\nConnection: keep-alive\r\n\r\nGET /i HTTP/1.0\r\n\r\n");
+  assert(has(ack(), "Connection: keep-alive") && has(ack(), "/i"));
+  delete connection;
+
+  // More pipelined data than WEBSERVER_MAX_PIPELINE_SIZE: the connection closes after this response, the client repeats the rest
+  open();
+  std::string burst = "GET /j HTTP/1.1\r\n\r\n";
+  while (burst.size() <= WEBSERVER_MAX_PIPELINE_SIZE + 20)
+    burst += "GET /k HTTP/1.1\r\n\r\n";
+  receive(burst);
+  assert(has(ack(), "\r\n\r\n/j") && connection == NULL);
+
+  // A response that closes the connection in its ack deletes the request, which must not be touched after
+  open();
+  receive("GET /closing HTTP/1.1\r\n\r\nGET /l HTTP/1.1\r\n\r\n");
+  connection->_onAck(1, 0);
+  assert(connection == NULL);
+
+  // A full pool closes the connection idle longest for a new one, and refuses only when none is idle
+  std::vector<AsyncClient *> clients;
+  for (int i = 0; i < WEBSERVER_MAX_REQUESTS; i++)
+  {
+    AsyncClient *c = (AsyncClient *)calloc(1, 512);
+    AsyncWebServerRequest *r = new AsyncWebServerRequest(server, c);
+    assert(r != NULL);
+    now = i == 5 ? 50 : 100 + i;
+    std::string get = "GET /m HTTP/1.1\r\n\r\n";
+    r->_onData(&get[0], get.size());
+    r->_onAck(wire.size(), 0);
+    wire.clear();
+    others[c] = r;
+    clients.push_back(c);
+  }
+  assert(new AsyncWebServerRequest(server, client) == NULL);
+  assert(AsyncWebServerRequest::_closeIdle() && others.size() == WEBSERVER_MAX_REQUESTS - 1 && !others.count(clients[5]));
+  connection = new AsyncWebServerRequest(server, client);
+  assert(connection != NULL);
+  // connections receiving a request body, or their first request, are not idle
+  for (auto &o : others)
+  {
+    std::string post = "POST /n HTTP/1.1\r\nContent-Length: 10\r\n\r\n12345";
+    o.second->_onData(&post[0], post.size());
+  }
+  assert(!AsyncWebServerRequest::_closeIdle() && others.size() == WEBSERVER_MAX_REQUESTS - 1);
+  delete connection;
+  for (auto &o : others)
+    delete o.second;
+  puts("ok");
+}
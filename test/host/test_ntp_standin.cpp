@@ -0,0 +1,140 @@
+// NTPClient and the time service against a local UDP stand-in server.
+// The stand-in answers like an NTP server whose clock runs OFFSET_US ahead of this host.
+#include "NTPClient.cpp"
+#include "clock_service.cpp"
+#include "time_service.cpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+#define OFFSET_US 1234567890LL
+
+int wifiUdpLookups = 0;
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+static int64_t hostUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+static int64_t monoUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+unsigned long millis() { return monoUs() / 1000; }
+unsigned long micros() { return monoUs(); }
+int64_t esp_timer_get_time() { return monoUs(); }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+static std::atomic<bool> answering(true), running(true);
+static std::atomic<int> requests(0);
+
+static void putNtp(uint8_t *p, int64_t unixUs)
+{
+  uint32_t seconds = unixUs / 1000000 + SEVENZYYEARS;
+  uint32_t fraction = (uint32_t)(((unixUs % 1000000) << 32) / 1000000);
+  for (int i = 0; i < 4; i++)
+  {
+    p[i] = seconds >> (24 - 8 * i);
+    p[4 + i] = fraction >> (24 - 8 * i);
+  }
+}
+
+static void standIn(int fd)
+{
+  while (running)
+  {
+    uint8_t packet[NTP_PACKET_SIZE];
+    sockaddr_in from;
+    socklen_t len = sizeof(from);
+    if (recvfrom(fd, packet, sizeof(packet), 0, (sockaddr *)&from, &len) != NTP_PACKET_SIZE)
+      continue;
+    requests++;
+    if (!answering)
+      continue;
+    int64_t received = hostUs() + OFFSET_US;
+    uint8_t reply[NTP_PACKET_SIZE] = {0x24, 2}; // server mode, stratum 2
+    memcpy(reply + 24, packet + 40, 8);         // originate = the client's transmit stamp
+    putNtp(reply + 32, received);
+    putNtp(reply + 40, hostUs() + OFFSET_US);
+    sendto(fd, reply, sizeof(reply), 0, (sockaddr *)&from, len);
+  }
+}
+
+static int poll(NTPClient &client, unsigned long timeoutMs)
+{
+  int result;
+  while ((result = client.checkResponse(timeoutMs)) == NTP_RESPONSE_PENDING)
+    delay(1);
+  return result;
+}
+
+int main()
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  timeval tv = {0, 20000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  assert(bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0 && getsockname(fd, (sockaddr *)&addr, &len) == 0);
+  uint16_t port = ntohs(addr.sin_port);
+  std::thread server(standIn, fd);
+
+  // A reply is matched to the request and corrected by half the round trip
+  WiFiUDP udp;
+  NTPClient client(udp, "localhost");
+  client.setServerPort(port);
+  client.begin(0);
+  assert(client.sendRequest());
+  assert(poll(client, 1000) == NTP_RESPONSE_OK);
+  int64_t error = (int64_t)client.getServerMicros() - (hostUs() + OFFSET_US);
+  printf("first reply: error %lld us, round trip %lu us\n", (long long)error, client.getRoundTripMicros());
+  assert(llabs(error) < 20000 && client.getRoundTripMicros() < 20000);
+  assert(wifiUdpLookups == 1);
+
+  // The address that answered is used for the next requests, no more lookups
+  for (int i = 0; i < 5; i++)
+  {
+    assert(client.sendRequest());
+    assert(poll(client, 1000) == NTP_RESPONSE_OK);
+  }
+  assert(wifiUdpLookups == 1);
+
+  // A request without an answer makes the next one look the name up again
+  answering = false;
+  assert(client.sendRequest());
+  assert(poll(client, 100) == NTP_RESPONSE_FAILED);
+  answering = true;
+  assert(client.sendRequest());
+  assert(poll(client, 1000) == NTP_RESPONSE_OK);
+  assert(wifiUdpLookups == 2);
+  printf("client: %d requests, %d name lookups\n", requests.load(), wifiUdpLookups);
+
+  // The time service steps the clock from the best reply of a burst, loop() never waits
+  int lookups = wifiUdpLookups;
+  timeServiceBegin("localhost", port);
+  int64_t start = monoUs();
+  long passes = 0;
+  while (!clockIsSynced() && monoUs() - start < 5000000)
+  {
+    int64_t before = monoUs();
+    timeServiceLoop();
+    assert(monoUs() - before < 5000);
+    passes++;
+  }
+  assert(clockIsSynced());
+  error = clockNowUs() - (hostUs() + OFFSET_US);
+  printf("time service: synced after %lld ms in %ld loop passes, error %lld us, %d name lookups\n",
+         (long long)(monoUs() - start) / 1000, passes, (long long)error, wifiUdpLookups - lookups);
+  assert(llabs(error) < 20000);
+  assert(wifiUdpLookups - lookups == 1);
+
+  running = false;
+  server.join();
+  close(fd);
+  puts("ok");
+}
@@ -0,0 +1,143 @@
+// The request head parser fed in packets of every size, and random input under AddressSanitizer.
+#define private public
+#define protected public
+#include "WebRequest.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include <cassert>
+#include <random>
+#include <string>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+// The client connection writes into a string
+static std::string wire;
+static bool closed;
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+void AsyncClient::setRxTimeout(uint32_t) {}
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 5744; }
+size_t AsyncClient::add(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+bool AsyncClient::send() { return true; }
+size_t AsyncClient::write(const char *data) { return write(data, strlen(data)); }
+size_t AsyncClient::write(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+void AsyncClient::close(bool) { closed = true; }
+
+// What the handler saw of a request, in one string so packet splits can be compared
+struct Recorder : public AsyncWebHandler
+{
+  std::string body, seen;
+  bool canHandle(AsyncWebServerRequest *) override { return true; }
+  bool isRequestHandlerTrivial() override { return false; }
+  void handleBody(AsyncWebServerRequest *, uint8_t *data, size_t len, size_t, size_t) override
+  {
+    body.append((char *)data, len);
+  }
+  void handleRequest(AsyncWebServerRequest *r) override
+  {
+    seen += std::string(r->methodToString()) + " " + r->url().c_str() + " v" + std::to_string(r->version()) +
+            " host=" + r->host().c_str() + " type=" + r->contentType().c_str() + " length=" + std::to_string(r->contentLength()) +
+            " ws=" + std::to_string(r->_reqconntype == RCT_WS) + "\n";
+    for (size_t i = 0; i < r->params(); i++)
+      seen += std::string("param ") + r->argName(i).c_str() + "=" + r->arg(i).c_str() + "\n";
+    for (size_t i = 0; i < r->headers(); i++)
+      seen += std::string("header ") + r->headerName(i).c_str() + ": " + r->header(i).c_str() + "\n";
+    seen += "body " + body + "\n";
+  }
+};
+
+static Recorder *handler;
+void AsyncWebServer::_rewriteRequest(AsyncWebServerRequest *) {}
+void AsyncWebServer::_attachHandler(AsyncWebServerRequest *r) { r->setHandler(handler); }
+
+static AsyncWebServer *server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+
+// Feeds input in packets of the given sizes, returns what the handler saw and the parse state
+static std::string parse(const std::string &input, std::mt19937 *rng, size_t packet, int *state = NULL)
+{
+  Recorder recorder;
+  handler = &recorder;
+  wire.clear();
+  closed = false;
+  AsyncWebServerRequest *r = (AsyncWebServerRequest *)calloc(1, sizeof(AsyncWebServerRequest));
+  ::new (r) AsyncWebServerRequest(server, client);
+  std::string copy = input;
+  for (size_t i = 0; i < copy.size() && r->_parseState < PARSE_REQ_END;)
+  {
+    size_t n = rng ? 1 + (*rng)() % packet : packet;
+    n = std::min(n, copy.size() - i);
+    r->_onData(&copy[i], n);
+    i += n;
+  }
+  if (state)
+    *state = r->_parseState;
+  // the ack of an error response ends it
+  if (!wire.empty())
+    r->_onAck(wire.size(), 0);
+  r->~AsyncWebServerRequest();
+  free(r);
+  return recorder.seen;
+}
+
+int main()
+{
+  // One request split at every packet size gives the same result
+  std::string request = "\r\nPOST /api/x%20y?a=1&b=hello+w&c HTTP/1.1\r\nHost: esp.local\r\n"
+                        "Content-Type: text/json; charset=utf-8\r\nX-Keep:   yes  \r\nbogus line\r\n"
+                        "Content-Length: 5\r\n\r\nhello";
+  std::string expected = parse(request, NULL, request.size());
+  printf("%s", expected.c_str());
+  assert(expected.find("POST /api/x y v1 host=esp.local type=text/json length=5 ws=0\n") != std::string::npos);
+  assert(expected.find("param a=1\nparam b=hello w\nparam c=\n") != std::string::npos);
+  assert(expected.find("header X-Keep: yes\n") != std::string::npos);
+  assert(expected.find("bogus") == std::string::npos);
+  assert(expected.find("body hello\n") != std::string::npos);
+  for (size_t packet = 1; packet < request.size(); packet++)
+    assert(parse(request, NULL, packet) == expected);
+
+  // Bare line feeds, HTTP/1.0 and a WebSocket upgrade
+  std::string upgrade = parse("GET /ws HTTP/1.0\nUpgrade: websocket\nConnection: Upgrade\nX-Empty:\n\n", NULL, 1);
+  assert(upgrade.find("GET /ws v0 host= type= length=0 ws=1\n") == 0);
+  assert(upgrade.find("header X-Empty: \n") != std::string::npos);
+
+  // A head larger than WEBSERVER_MAX_HEAD_SIZE, or with too many headers, is refused with 431 and the connection
+  // closes, even when it could be kept
+  int state;
+  server->_keepAlive = true;
+  parse("GET / HTTP/1.1\r\nCookie: " + std::string(WEBSERVER_MAX_HEAD_SIZE, 'a') + "\r\n\r\n", NULL, 100, &state);
+  assert(state == PARSE_REQ_FAIL && wire.compare(0, 12, "HTTP/1.1 431") == 0);
+  assert(wire.find("Connection: close") != std::string::npos && closed);
+  std::string many = "GET / HTTP/1.1\r\n";
+  for (int i = 0; i <= WEBSERVER_MAX_HEADERS; i++)
+    many += "X-" + std::to_string(i) + ": 1\r\n";
+  parse(many + "\r\n", NULL, 7, &state);
+  assert(state == PARSE_REQ_FAIL && wire.compare(0, 12, "HTTP/1.1 431") == 0);
+  assert(wire.find("Connection: close") != std::string::npos && closed);
+  server->_keepAlive = false;
+
+  // Random input in random packets: no memory errors, and valid heads parse the same at any split
+  std::mt19937 rng(1);
+  const char *alphabet = "GET /?&=%+: \r\n\tabcXYZ-HTTP/1.0Content-Length 3";
+  for (int round = 0; round < 20000; round++)
+  {
+    std::string input;
+    int n = rng() % 300;
+    for (int i = 0; i < n; i++)
+      input += rng() % 8 == 0 ? (char)(rng() % 256) : alphabet[rng() % strlen(alphabet)];
+    if (round % 2)
+      input = "GET /r" + std::to_string(round) + "?" + input.substr(0, input.size() / 4) + " HTTP/1.1\r\nH: " +
+              input.substr(input.size() / 4) + "\r\n\r\n";
+    std::string whole = parse(input, NULL, input.size() + 1);
+    std::string split = parse(input, &rng, 20);
+    assert(whole == split);
+  }
+  puts("ok");
+}
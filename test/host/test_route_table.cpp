@@ -0,0 +1,151 @@
+// Route table dispatch against the canHandle() walk it replaced, for exact, path, prefix, extension and rewrite routes.
+#define private public
+#define protected public
+#include "WebServer.cpp"
+#include "WebRequest.cpp"
+#include "WebHandlers.cpp"
+#include "WebRouteTable.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include "WebAssetCache.cpp"
+#include "AsyncEventSource.cpp"
+#include <cassert>
+#include <random>
+#include <string>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+AsyncServer::AsyncServer(uint16_t) {}
+AsyncServer::~AsyncServer() {}
+void AsyncServer::onClient(AcConnectHandler, void *) {}
+void AsyncServer::end() {}
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+
+static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+static fs::FS files;
+
+// Where a request ends up: the url after rewrites, the handler and its path arguments
+struct Dispatch
+{
+  std::string url;
+  AsyncWebHandler *handler;
+  std::string args;
+  bool operator==(const Dispatch &o) const { return url == o.url && handler == o.handler && args == o.args; }
+};
+
+static AsyncWebServerRequest *request(const std::string &url, WebRequestMethodComposite method)
+{
+  AsyncWebServerRequest *r = new AsyncWebServerRequest(NULL, client);
+  r->_url = url.c_str();
+  r->_method = method;
+  return r;
+}
+
+static Dispatch result(AsyncWebServerRequest *r)
+{
+  Dispatch d{r->url().c_str(), r->_handler, ""};
+  for (size_t i = 0; i < r->_pathParams.length(); i++)
+    d.args += std::string(r->pathArg(i).c_str()) + "/";
+  delete r;
+  return d;
+}
+
+static Dispatch routed(AsyncWebServer &server, const std::string &url, WebRequestMethodComposite method)
+{
+  AsyncWebServerRequest *r = request(url, method);
+  r->_server = &server;
+  server._rewriteRequest(r);
+  server._attachHandler(r);
+  return result(r);
+}
+
+// What the server did before the route table: every rewrite in order, then the first handler that accepts
+static Dispatch walked(AsyncWebServer &server, const std::string &url, WebRequestMethodComposite method)
+{
+  AsyncWebServerRequest *r = request(url, method);
+  r->_server = &server;
+  for (const auto &rewrite : server._rewrites)
+    if (rewrite->match(r))
+    {
+      r->_url = rewrite->toUrl();
+      r->_addGetParams(rewrite->params());
+    }
+  r->_handler = server._catchAllHandler;
+  for (const auto &h : server._handlers)
+    if (h->filter(r) && h->canHandle(r))
+    {
+      r->_handler = h;
+      break;
+    }
+  return result(r);
+}
+
+static bool same(AsyncWebServer &server, const std::string &url, WebRequestMethodComposite method)
+{
+  Dispatch a = routed(server, url, method), b = walked(server, url, method);
+  if (!(a == b))
+    printf("%s: table %s %p [%s], walk %s %p [%s]\n", url.c_str(), a.url.c_str(), (void *)a.handler, a.args.c_str(),
+           b.url.c_str(), (void *)b.handler, b.args.c_str());
+  return a == b;
+}
+
+int main()
+{
+  AsyncWebServer server(80);
+  ArRequestHandlerFunction ok = [](AsyncWebServerRequest *) {};
+  AsyncWebHandler *root = &server.on("/", HTTP_GET, ok);
+  AsyncWebHandler *getTemp = &server.on("/api/temp", HTTP_GET, ok);
+  AsyncWebHandler *postTemp = &server.on("/api/temp", HTTP_POST, ok);
+  server.on("/api/*", HTTP_ANY, ok);
+  server.on("/api", HTTP_GET, ok);
+  server.on("/*.js", HTTP_GET, ok);
+  AsyncWebHandler *sensor = &server.on("/sensor/{id}/value", HTTP_GET, ok);
+  server.on("/log*", HTTP_GET, ok);
+  server.addHandler(new AsyncEventSource("/events"));
+  server.serveStatic("/static/", files, "/");
+  server.on("/sensor/{id}/{field}", HTTP_DELETE, ok);
+  server.rewrite("/", "/index.htm");
+  server.rewrite("/index.htm", "/api/temp");
+  server.addRewrite(new AsyncWebRewrite("/old", "/api/temp?x=1"));
+
+  // The routes one by one
+  assert(routed(server, "/", HTTP_GET).handler == getTemp && routed(server, "/", HTTP_GET).url == "/api/temp");
+  assert(routed(server, "/api/temp", HTTP_POST).handler == postTemp);
+  assert(routed(server, "/sensor/7/value", HTTP_GET).handler == sensor && routed(server, "/sensor/7/value", HTTP_GET).args == "7/");
+  assert(routed(server, "/nothing", HTTP_GET).handler == server._catchAllHandler);
+  const char *urls[] = {"/", "/api", "/api/", "/api/temp", "/api/temp/", "/api/tempx", "/apix", "/app.js", "/a/b/c.js",
+                        "/x.json", "/sensor/1/value", "/sensor/1/value/2", "/sensor//value", "/sensor/1/2", "/log",
+                        "/logs/today", "/lo", "/events", "/events/", "/static/", "/static/a.css", "/old", "/index.htm"};
+  for (const char *url : urls)
+    for (WebRequestMethodComposite method : {HTTP_GET, HTTP_POST, HTTP_DELETE, HTTP_HEAD})
+      assert(same(server, url, method));
+
+  // Random urls from the segments the routes use
+  const char *segments[] = {"", "api", "temp", "sensor", "3", "value", "log", "logs", "events", "static", "x.js", "index.htm", "old", "a.b"};
+  std::mt19937 rng(1);
+  for (int round = 0; round < 20000; round++)
+  {
+    std::string url;
+    int depth = rng() % 5;
+    for (int i = 0; i < depth || url.empty(); i++)
+      url += std::string("/") + segments[rng() % (sizeof(segments) / sizeof(*segments))];
+    WebRequestMethodComposite method = 1 << (rng() % 7);
+    assert(same(server, url, method));
+  }
+
+  // A removed handler or rewrite is gone from the table, not only from the list
+  assert(server.removeHandler(sensor) && server.removeRewrite(server._rewrites.front()));
+  assert(routed(server, "/sensor/7/value", HTTP_GET).handler == server._catchAllHandler);
+  assert(routed(server, "/", HTTP_GET).handler == root);
+  for (const char *url : urls)
+    assert(same(server, url, HTTP_GET));
+  puts("ok");
+}
@@ -0,0 +1,113 @@
+// Template responses against a reference replacement, with random source chunks and output sizes.
+#define private public
+#define protected public
+#include "WebResponses.cpp"
+#include <cassert>
+#include <random>
+#include <string>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+
+static std::mt19937 rng(1);
+
+// What a template response must send: %NAME% of up to TEMPLATE_PARAM_NAME_LENGTH bytes is replaced,
+// %% is a single %, any other % is sent as it is
+static std::string reference(const std::string &in, const AwsTemplateProcessor &processor)
+{
+  std::string out;
+  size_t i = 0;
+  while (i < in.size())
+  {
+    if (in[i] != TEMPLATE_PLACEHOLDER)
+    {
+      out += in[i++];
+      continue;
+    }
+    size_t j = i + 1;
+    while (j < in.size() && in[j] != TEMPLATE_PLACEHOLDER && j - i - 1 < TEMPLATE_PARAM_NAME_LENGTH)
+      j++;
+    if (j < in.size() && in[j] == TEMPLATE_PLACEHOLDER)
+    {
+      if (j == i + 1)
+        out += TEMPLATE_PLACEHOLDER;
+      else
+        out += processor(String(in.substr(i + 1, j - i - 1).c_str())).c_str();
+      i = j + 1;
+    }
+    else
+      out += in[i++];
+  }
+  return out;
+}
+
+// Sends in through a callback response whose source gives at most sourceChunk bytes a call (0: as many as asked)
+// and sometimes nothing yet, and reads it out in random pieces of up to outChunk bytes
+static std::string render(const std::string &in, const AwsTemplateProcessor &processor, size_t sourceChunk, size_t outChunk)
+{
+  AsyncCallbackResponse response("text/html", 0, [&](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    if (sourceChunk && rng() % 8 == 0)
+      return RESPONSE_TRY_AGAIN;
+    size_t n = std::min(maxLen, in.size() - index);
+    if (sourceChunk)
+      n = std::min(n, 1 + rng() % sourceChunk);
+    memcpy(buffer, in.data() + index, n);
+    return n;
+  }, processor);
+  std::string out;
+  std::vector<uint8_t> buffer(outChunk);
+  for (;;)
+  {
+    size_t n = response._fillBufferAndProcessTemplates(buffer.data(), 1 + rng() % outChunk);
+    if (n == RESPONSE_TRY_AGAIN)
+      continue;
+    if (n == 0)
+      break;
+    out.append((char *)buffer.data(), n);
+  }
+  return out;
+}
+
+static bool matches(const std::string &in, const AwsTemplateProcessor &processor, size_t sourceChunk, size_t outChunk)
+{
+  std::string got = render(in, processor, sourceChunk, outChunk), expected = reference(in, processor);
+  if (got != expected)
+    printf("in       [%s]\ngot      [%s]\nexpected [%s]\n", in.c_str(), got.c_str(), expected.c_str());
+  return got == expected;
+}
+
+int main()
+{
+  AwsTemplateProcessor processor = [](const String &name) -> String {
+    if (name == "LONG")
+      return String(std::string(300, 'x').c_str());
+    if (name == "E")
+      return String();
+    return String("<") + name + ">";
+  };
+  std::string longest(TEMPLATE_PARAM_NAME_LENGTH, 'n');
+
+  // Placeholders at the edges, escapes, names at and past the length limit, values larger than the output
+  const char *cases[] = {"%A%", "a%A%b", "%%", "100%% sure", "50% off", "%", "%open", "%A%%B%", "%LONG%", "x%E%y"};
+  for (const char *c : cases)
+    for (size_t out = 1; out < 12; out++)
+      assert(matches(c, processor, 1, out) && matches(c, processor, 0, out));
+  assert(matches("%" + longest + "%", processor, 3, 5));
+  assert(matches("%" + longest + "n%", processor, 3, 5));
+  assert(reference("%" + longest + "n%", processor) == "%" + longest + "n%");
+
+  // Random text in random source chunks and output sizes
+  const char alphabet[] = "ab %%%LONGE_xyz\n";
+  for (int round = 0; round < 20000; round++)
+  {
+    std::string in;
+    size_t length = rng() % 300;
+    for (size_t i = 0; i < length; i++)
+      in += alphabet[rng() % (sizeof(alphabet) - 1)];
+    if (rng() % 4 == 0)
+      in += "%" + std::string(rng() % 40, 'n') + "%";
+    assert(matches(in, processor, rng() % 2 ? 1 + rng() % 64 : 0, 1 + rng() % 100));
+  }
+  puts("ok");
+}
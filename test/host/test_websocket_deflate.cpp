@@ -0,0 +1,159 @@
+// permessage-deflate of the WebSocket server, checked against zlib.
+// host-flags: -lz
+#define private public
+#define protected public
+#include "AsyncWebSocket.cpp"
+#include "AsyncWebSocketDeflate.cpp"
+#include "WebMetrics.cpp"
+#include <cassert>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+// The client connection writes into a string
+static std::string wire;
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 5744; }
+size_t AsyncClient::add(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+bool AsyncClient::send() { return true; }
+void AsyncClient::close(bool) {}
+
+static std::string inflateAll(z_stream &z, const std::string &in)
+{
+  std::string s = in + std::string("\x00\x00\xff\xff", 4), out(100000, 0);
+  z.next_in = (Bytef *)&s[0];
+  z.avail_in = s.size();
+  z.next_out = (Bytef *)&out[0];
+  z.avail_out = out.size();
+  assert(inflate(&z, Z_SYNC_FLUSH) == Z_OK && z.avail_in == 0);
+  out.resize(out.size() - z.avail_out);
+  return out;
+}
+
+static std::string json(int i)
+{
+  char b[64];
+  snprintf(b, sizeof(b), "{\"temperature\":%.2f,\"date\":\"2026-10-%02d %02d:%02d:00\"}", 21.5 + (i % 7) * 0.25, 1 + i / 2880, (i / 120) % 24, (i / 2) % 60);
+  return b;
+}
+
+// A connected client of a server with deflate on, messages of minSize bytes and more are compressed
+static AsyncWebSocketClient *makeClient(size_t minSize)
+{
+  AsyncWebSocket *server = (AsyncWebSocket *)calloc(1, sizeof(AsyncWebSocket));
+  new (&server->_eventHandler) AwsEventHandler();
+  server->setDeflate(true, 11, true, minSize);
+  AsyncWebSocketClient *c = (AsyncWebSocketClient *)calloc(1, sizeof(AsyncWebSocketClient));
+  new (&c->_messageQueue) LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m) { delete m; });
+  new (&c->_controlQueue) LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *m) { delete m; });
+  c->_client = (AsyncClient *)calloc(1, 512);
+  c->_server = server;
+  c->_status = WS_CONNECTED;
+  c->_deflater = new AsyncWebSocketDeflater(11, true);
+  return c;
+}
+
+int main()
+{
+  srand(1);
+
+  // Every window size, with and without context takeover, inflates back with zlib
+  for (int bits = 8; bits <= 15; bits++)
+    for (int takeover = 0; takeover < 2; takeover++)
+    {
+      AsyncWebSocketDeflater d(bits, takeover);
+      z_stream z = {};
+      assert(inflateInit2(&z, -bits) == Z_OK);
+      for (int m = 0; m < 40; m++)
+      {
+        std::string msg;
+        if (m % 4 == 0)
+          for (int i = 0; i < m * 37; i++)
+            msg += char(rand());
+        else if (m % 4 == 1)
+          for (int i = 0; i < 20; i++)
+            msg += json(m * 20 + i) + ",";
+        else if (m % 4 == 2)
+          msg = std::string(m * 100 + 3, 'a');
+        else
+          for (int i = 0; i < 3000; i++)
+            msg += char('a' + rand() % 4);
+        std::vector<uint8_t> out(msg.size() * 2 + 64);
+        size_t n = d.deflate((uint8_t *)msg.data(), msg.size(), out.data(), out.size());
+        assert(n);
+        d.sent((uint8_t *)msg.data(), msg.size());
+        if (!takeover)
+        {
+          inflateEnd(&z);
+          z = {};
+          inflateInit2(&z, -bits);
+        }
+        assert(inflateAll(z, std::string((char *)out.data(), n)) == msg);
+      }
+      inflateEnd(&z);
+    }
+
+  // Output that would not be smaller is refused
+  {
+    AsyncWebSocketDeflater d(11, false);
+    std::string r;
+    for (int i = 0; i < 500; i++)
+      r += char(rand());
+    std::vector<uint8_t> out(499);
+    assert(d.deflate((uint8_t *)r.data(), r.size(), out.data(), out.size()) == 0);
+  }
+
+  // Queued messages go out compressed and masked off the context of the ones before
+  {
+    AsyncWebSocketClient *c = makeClient(64);
+    z_stream z = {};
+    inflateInit2(&z, -11);
+    for (int k = 0; k < 3; k++)
+    {
+      std::string m;
+      for (int i = 0; i < 30; i++)
+        m += json(k * 30 + i);
+      AsyncWebSocketMessageBuffer *b = new AsyncWebSocketMessageBuffer((uint8_t *)m.data(), m.size());
+      AsyncWebSocketMultiMessage *message = new AsyncWebSocketMultiMessage(b);
+      wire.clear();
+      c->_queueMessage(message);
+      if (wire.empty())
+        c->_runQueue();
+      assert((uint8_t)wire[0] == (0x80 | 0x40 | WS_TEXT));
+      size_t len = (uint8_t)wire[1] & 0x7f, head = 2;
+      if (len == 126)
+      {
+        len = ((uint8_t)wire[2] << 8) | (uint8_t)wire[3];
+        head = 4;
+      }
+      assert(wire.size() == head + len);
+      assert(inflateAll(z, wire.substr(head)) == m);
+      message->ack(wire.size(), 0);
+      c->_runQueue();
+    }
+    inflateEnd(&z);
+
+    // Below the minimum size a message is sent as it is
+    wire.clear();
+    c->_queueMessage(new AsyncWebSocketBasicMessage("hi", 2));
+    c->_runQueue();
+    assert(wire == std::string("\x81\x02hi", 4));
+  }
+
+  // With no minimum size, empty and one byte messages are left as they are
+  {
+    AsyncWebSocketClient *c = makeClient(0);
+    for (size_t len = 0; len < 2; len++)
+    {
+      AsyncWebSocketBasicMessage message("x", len);
+      c->_deflateMessage(&message);
+      assert(message.deflated() && !message._compressed);
+      assert(message.payloadLength() == len && memcmp(message.payload(), "x", len) == 0);
+    }
+  }
+
+  puts("ok");
+}
@@ -0,0 +1,175 @@
+// WebSocket masking and framing: word-wise unmasking against a byte loop, frames sent from the payload headroom.
+#define private public
+#define protected public
+#include "AsyncWebSocket.cpp"
+#include "AsyncWebSocketDeflate.cpp"
+#include "WebMetrics.cpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+// The client connection writes into a string, through a send window of the given size
+static std::string wire;
+static size_t window = 1436;
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return window; }
+size_t AsyncClient::add(const char *data, size_t size, uint8_t) { wire.append(data, size); return size; }
+bool AsyncClient::send() { return true; }
+void AsyncClient::close(bool) {}
+
+static AsyncClient *client = (AsyncClient *)calloc(1, 512);
+
+static void maskBytes(uint8_t *data, size_t len, const uint8_t *mask, size_t offset)
+{
+  for (size_t i = 0; i < len; i++)
+    data[i] ^= mask[(offset + i) % 4];
+}
+
+// Joins the unmasked payloads of the frames on the wire, checks each header uses the shortest length form
+static std::string unframe(const std::string &w, int *frames)
+{
+  std::string out;
+  size_t p = 0;
+  *frames = 0;
+  while (p < w.size())
+  {
+    size_t len = (uint8_t)w[p + 1] & 0x7f, head = 2;
+    if (len == 126)
+    {
+      len = ((uint8_t)w[p + 2] << 8) | (uint8_t)w[p + 3];
+      head = 4;
+      assert(len >= 126);
+    }
+    uint8_t mask[4] = {0};
+    if ((uint8_t)w[p + 1] & 0x80)
+    {
+      memcpy(mask, &w[p + head], 4);
+      head += 4;
+    }
+    std::string payload = w.substr(p + head, len);
+    maskBytes((uint8_t *)&payload[0], len, mask, 0);
+    out += payload;
+    p += head + len;
+    (*frames)++;
+  }
+  return out;
+}
+
+static std::string text(size_t len)
+{
+  std::string s(len, 0);
+  for (size_t i = 0; i < len; i++)
+    s[i] = 'a' + i % 26;
+  return s;
+}
+
+int main()
+{
+  // Every alignment, mask offset and length gives what the byte loop gives
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  std::vector<uint8_t> a(200), b(200);
+  for (size_t align = 0; align < 8; align++)
+    for (size_t offset = 0; offset < 4; offset++)
+      for (size_t len = 0; len < 150; len++)
+      {
+        for (size_t i = 0; i < a.size(); i++)
+          a[i] = b[i] = i * 7 + 3;
+        webSocketMask(&a[align], len, mask, offset);
+        maskBytes(&b[align], len, mask, offset);
+        assert(a == b);
+      }
+
+  // Messages split over small send windows, masked and not: shortest headers, payload intact afterwards
+  for (int masked = 0; masked < 2; masked++)
+    for (size_t len : {0, 5, 125, 126, 300, 3000})
+      for (size_t w : {40, 200, 1436})
+      {
+        std::string s = text(len);
+        AsyncWebSocketBasicMessage message(s.data(), len, WS_TEXT, masked);
+        wire.clear();
+        window = w;
+        while (!message.finished())
+        {
+          size_t sent = message._sent;
+          message.send(client);
+          message.ack(message._ack - message._acked, 0);
+          if (len == 0)
+            break;
+          assert(message._sent > sent || message.finished());
+        }
+        int frames;
+        assert(unframe(wire, &frames) == s);
+        assert(std::string((char *)message._data, len) == s && message._data[len] == 0);
+      }
+
+  // Control frames
+  window = 1436;
+  wire.clear();
+  {
+    uint8_t payload[3] = {9, 8, 7};
+    AsyncWebSocketControl ping(WS_PING, payload, 3, true);
+    ping.send(client);
+    int frames;
+    assert(wire[0] == (char)0x89 && unframe(wire, &frames) == std::string("\x09\x08\x07"));
+  }
+
+  // A masked shared buffer is unmasked again for the next client
+  {
+    AsyncWebSocketMessageBuffer buffer((uint8_t *)"hello world", 11);
+    AsyncWebSocketMultiMessage first(&buffer, WS_TEXT, true), second(&buffer, WS_TEXT, true);
+    wire.clear();
+    first.send(client);
+    std::string firstWire = wire;
+    wire.clear();
+    second.send(client);
+    int frames;
+    assert(unframe(firstWire, &frames) == "hello world" && unframe(wire, &frames) == "hello world");
+    buffer._count = 0;
+  }
+
+  // Masked frames received in packets of every size are unmasked at the right mask offset
+  AsyncWebSocket *server = (AsyncWebSocket *)calloc(1, sizeof(AsyncWebSocket));
+  new (&server->_eventHandler) AwsEventHandler();
+  std::string received;
+  server->onEvent([&](AsyncWebSocket *, AsyncWebSocketClient *, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if (type == WS_EVT_DATA)
+    {
+      assert(((AwsFrameInfo *)arg)->index == received.size());
+      received.append((char *)data, len);
+    }
+  });
+  AsyncWebSocketClient *c = (AsyncWebSocketClient *)calloc(1, sizeof(AsyncWebSocketClient));
+  new (&c->_messageQueue) LinkedList<AsyncWebSocketMessage *>([](AsyncWebSocketMessage *m) { delete m; });
+  new (&c->_controlQueue) LinkedList<AsyncWebSocketControl *>([](AsyncWebSocketControl *m) { delete m; });
+  c->_client = client;
+  c->_server = server;
+  c->_status = WS_CONNECTED;
+  for (size_t len : {1, 5, 125, 126, 1000})
+    for (size_t packet = 1; packet <= len; packet += packet < 16 ? 1 : 37)
+    {
+      std::string s = text(len), frame = "\x81";
+      if (len < 126)
+        frame += char(0x80 | len);
+      else
+        frame += std::string("\xfe", 1) + char(len >> 8) + char(len & 0xff);
+      frame += std::string((const char *)mask, 4);
+      std::string payload = s;
+      maskBytes((uint8_t *)&payload[0], len, mask, 0);
+      frame += payload;
+      // the header comes in one piece, the payload in packets; a pbuf always has a byte to spare
+      size_t head = frame.size() - len;
+      received.clear();
+      for (size_t i = 0; i < frame.size();)
+      {
+        size_t n = i == 0 ? head + std::min(packet, len) : std::min(packet, frame.size() - i);
+        std::string piece = frame.substr(i, n) + '\0';
+        c->_onData(&piece[0], n);
+        i += n;
+      }
+      assert(received == s);
+    }
+  puts("ok");
+}
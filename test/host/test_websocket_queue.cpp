@@ -0,0 +1,196 @@
+// WebSocket queue policies on a stalled client: what is dropped, replaced and batched, and what still arrives.
+#define private public
+#define protected public
+#include "AsyncWebSocket.cpp"
+#include "AsyncWebSocketDeflate.cpp"
+#include "WebRequest.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include "queue_standin.h"
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+unsigned long millis() { return 0; }
+unsigned long micros() { return 0; }
+void *pxCurrentTCB;
+
+// Each connection keeps what was written and not acknowledged yet; nothing is acknowledged until delivered
+struct Connection
+{
+  std::string wire;
+  size_t unacked;
+};
+static std::map<AsyncClient *, Connection> connections;
+AsyncClient::~AsyncClient() {}
+void AsyncClient::onDisconnect(AcConnectHandler, void *) {}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+void AsyncClient::setRxTimeout(uint32_t) {}
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 1436; }
+bool AsyncClient::send() { return true; }
+void AsyncClient::close(bool) {}
+size_t AsyncClient::add(const char *data, size_t size, uint8_t)
+{
+  connections[this].wire.append(data, size);
+  connections[this].unacked += size;
+  return size;
+}
+
+static AsyncWebServer *server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+
+static AsyncWebSocketClient *connect(AsyncWebSocket &ws, AwsQueuePolicy policy)
+{
+  AsyncClient *client = (AsyncClient *)::operator new(sizeof(AsyncClient));
+  memset((void *)client, 0, sizeof(AsyncClient));
+  connections[client] = Connection();
+  AsyncWebSocketClient *c = new AsyncWebSocketClient(new AsyncWebServerRequest(server, client), &ws);
+  c->setQueuePolicy(policy);
+  return c;
+}
+
+// Acknowledges everything sent until the queue is empty, returns the messages that arrived since the last call
+static std::vector<std::string> deliver(AsyncWebSocketClient *c)
+{
+  Connection &conn = connections[c->client()];
+  while (conn.unacked)
+  {
+    size_t n = conn.unacked;
+    conn.unacked = 0;
+    c->_onAck(n, 0);
+  }
+  assert(c->_messageQueue.isEmpty());
+  std::vector<std::string> messages;
+  std::string message;
+  const std::string &w = conn.wire;
+  for (size_t p = 0; p < w.size();)
+  {
+    bool fin = (uint8_t)w[p] & 0x80;
+    size_t len = (uint8_t)w[p + 1] & 0x7f, head = 2;
+    if (len == 126)
+    {
+      len = ((uint8_t)w[p + 2] << 8) | (uint8_t)w[p + 3];
+      head = 4;
+    }
+    message += w.substr(p + head, len);
+    p += head + len;
+    if (fin)
+    {
+      messages.push_back(message);
+      message.clear();
+    }
+  }
+  conn.wire.clear();
+  return messages;
+}
+
+static std::string text(char c, size_t len) { return std::string(len, c); }
+
+// A large message is half sent when the client stalls: its first frame is out, the rest waits for an ack
+static AsyncWebSocketClient *stalled(AsyncWebSocket &ws, AwsQueuePolicy policy, const std::string &head)
+{
+  AsyncWebSocketClient *c = connect(ws, policy);
+  c->text(head.c_str(), head.size());
+  assert(!c->_messageQueue.front()->pending() && connections[c->client()].unacked > 0);
+  return c;
+}
+
+int main()
+{
+  AsyncWebSocket ws("/ws");
+  const std::string head = text('h', 3000);
+
+  // WS_QUEUE_DROP_OLDEST: the oldest waiting messages go, never the one partly sent
+  {
+    AsyncWebSocketClient *c = stalled(ws, WS_QUEUE_DROP_OLDEST, head);
+    uint32_t before = ws.dropped();
+    for (int i = 0; i < 80; i++)
+      c->text(String(i));
+    assert(c->_messageQueue.length() == WS_MAX_QUEUED_MESSAGES);
+    assert(c->dropped() == 80 - (WS_MAX_QUEUED_MESSAGES - 1) && ws.dropped() - before == c->dropped());
+    std::vector<std::string> got = deliver(c);
+    assert(got.size() == WS_MAX_QUEUED_MESSAGES && got[0] == head);
+    for (size_t i = 1; i < got.size(); i++)
+      assert(got[i] == std::to_string(80 - WS_MAX_QUEUED_MESSAGES + i));
+  }
+
+  // The byte cap drops waiting messages too, the partly sent one counts but stays
+  {
+    AsyncWebSocketClient *c = stalled(ws, WS_QUEUE_DROP_OLDEST, head);
+    for (int i = 0; i < 30; i++)
+    {
+      std::string m = text('a' + i % 26, 1000);
+      c->text(m.c_str(), m.size());
+      assert(c->queuedBytes() <= WS_MAX_QUEUED_BYTES && c->_messageQueue.front()->payloadLength() == head.size());
+    }
+    size_t kept = (WS_MAX_QUEUED_BYTES - head.size()) / 1000;
+    assert(c->_messageQueue.length() == 1 + kept && c->dropped() == 30 - kept);
+    std::vector<std::string> got = deliver(c);
+    assert(got.size() == 1 + kept && got[0] == head && got.back() == text('a' + 29 % 26, 1000));
+  }
+
+  // WS_QUEUE_DROP_NEWEST: a full queue refuses new messages
+  {
+    AsyncWebSocketClient *c = stalled(ws, WS_QUEUE_DROP_NEWEST, head);
+    for (int i = 0; i < 80; i++)
+      c->text(String(i));
+    assert(c->dropped() == 80 - (WS_MAX_QUEUED_MESSAGES - 1));
+    std::vector<std::string> got = deliver(c);
+    assert(got.size() == WS_MAX_QUEUED_MESSAGES && got[0] == head && got[1] == "0" && got.back() == std::to_string(WS_MAX_QUEUED_MESSAGES - 2));
+  }
+
+  // WS_QUEUE_LATEST: each topic keeps its newest value, in publishing order; a live client gets every value
+  {
+    AsyncWebSocketClient *c = stalled(ws, WS_QUEUE_LATEST, head);
+    AsyncWebSocketClient *live = connect(ws, WS_QUEUE_LATEST);
+    deliver(live);
+    for (int i = 0; i < 40; i++)
+    {
+      ws.publish("temp", String("t") + i);
+      ws.publish("hum", String("h") + i);
+      assert(deliver(live) == std::vector<std::string>({"t" + std::to_string(i), "h" + std::to_string(i)}));
+    }
+    ws.publish(NULL, String("untagged"));
+    assert(c->_messageQueue.length() == 4 && c->dropped() == 78);
+    std::vector<std::string> got = deliver(c);
+    assert(got == std::vector<std::string>({head, "t39", "h39", "untagged"}));
+    deliver(live);
+  }
+
+  // WS_QUEUE_BATCH: waiting messages of a topic are joined by newlines; the shared buffers of a publish are copied,
+  // not changed, so the live client still gets each one alone
+  {
+    ws.setQueuePolicy(WS_QUEUE_BATCH);
+    AsyncWebSocketClient *c = stalled(ws, WS_QUEUE_BATCH, head);
+    AsyncWebSocketClient *live = connect(ws, WS_QUEUE_BATCH);
+    deliver(live);
+    std::string temps, hums;
+    for (int i = 0; i < 40; i++)
+    {
+      ws.publish("temp", String("t") + i);
+      ws.publish("hum", String("h") + i);
+      temps += (i ? "\n" : "") + ("t" + std::to_string(i));
+      hums += (i ? "\n" : "") + ("h" + std::to_string(i));
+      assert(deliver(live) == std::vector<std::string>({"t" + std::to_string(i), "h" + std::to_string(i)}));
+    }
+    assert(c->_messageQueue.length() == 3 && c->dropped() == 0);
+    std::vector<std::string> got = deliver(c);
+    assert(got == std::vector<std::string>({head, temps, hums}));
+
+    // a batch stops growing at WS_BATCH_MAX_SIZE, the rest starts the next one
+    c->text(head.c_str(), head.size());
+    std::string part = text('p', 400);
+    for (int i = 0; i < 5; i++)
+      ws.publish("big", part.c_str());
+    got = deliver(c);
+    assert(got.size() == 4 && got[1] == part + "\n" + part && got[2] == got[1] && got[3] == part);
+    deliver(live);
+  }
+  puts("ok");
+}
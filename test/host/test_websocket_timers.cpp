@@ -0,0 +1,219 @@
+// The WebSocket timer wheel: when pings, idle timeouts and close timeouts fire, clients closed while a slot runs, stalls.
+#define private public
+#define protected public
+#include "AsyncWebSocket.cpp"
+#include "AsyncWebSocketDeflate.cpp"
+#include "WebRequest.cpp"
+#include "WebResponses.cpp"
+#include "WebFieldTable.cpp"
+#include "WebMetrics.cpp"
+#include "queue_standin.h"
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+static uint32_t now;
+unsigned long millis() { return now; }
+unsigned long micros() { return 0; }
+void *pxCurrentTCB;
+
+// Each connection counts the pings it sent and may close another one when it writes; closing it deletes the
+// WebSocket client and the connection like AsyncTCP does
+struct Connection
+{
+  AcConnectHandler onDisconnect;
+  void *arg;
+  int pings;
+  AsyncClient *closeOnWrite;
+};
+static std::map<AsyncClient *, Connection> connections;
+AsyncClient::~AsyncClient() {}
+void AsyncClient::onDisconnect(AcConnectHandler cb, void *arg)
+{
+  connections[this].onDisconnect = cb;
+  connections[this].arg = arg;
+}
+void AsyncClient::onAck(AcAckHandler, void *) {}
+void AsyncClient::onError(AcErrorHandler, void *) {}
+void AsyncClient::onData(AcDataHandler, void *) {}
+void AsyncClient::onTimeout(AcTimeoutHandler, void *) {}
+void AsyncClient::onPoll(AcConnectHandler, void *) {}
+void AsyncClient::setRxTimeout(uint32_t) {}
+bool AsyncClient::canSend() { return true; }
+size_t AsyncClient::space() { return 5744; }
+bool AsyncClient::send() { return true; }
+size_t AsyncClient::add(const char *data, size_t size, uint8_t)
+{
+  Connection &c = connections[this];
+  if ((uint8_t)data[0] == 0x89)
+    c.pings++;
+  if (c.closeOnWrite != NULL)
+    c.closeOnWrite->close(true);
+  return size;
+}
+void AsyncClient::close(bool)
+{
+  auto it = connections.find(this);
+  if (it == connections.end())
+    return;
+  Connection c = it->second;
+  connections.erase(it);
+  c.onDisconnect(c.arg, this);
+}
+
+static AsyncWebServer *server = (AsyncWebServer *)calloc(1, sizeof(AsyncWebServer));
+
+static AsyncWebSocketClient *connect(AsyncWebSocket &ws)
+{
+  AsyncClient *client = (AsyncClient *)::operator new(sizeof(AsyncClient));
+  memset((void *)client, 0, sizeof(AsyncClient));
+  connections[client] = Connection();
+  AsyncWebSocketClient *c = new AsyncWebSocketClient(new AsyncWebServerRequest(server, client), &ws);
+  return c;
+}
+
+static bool open(AsyncClient *client) { return connections.count(client) != 0; }
+
+// Polls every 10 ms until the given time; sent control frames are acknowledged right away unless told otherwise
+static void runUntil(AsyncWebSocket &ws, uint32_t until, bool ack = true)
+{
+  while ((int32_t)(until - now) > 0)
+  {
+    now += 10;
+    ws._runTimers();
+    if (ack)
+      for (AsyncWebSocketClient *c : ws._clients)
+        while (!c->_controlQueue.isEmpty() && c->_controlQueue.front()->finished())
+          c->_onAck(c->_controlQueue.front()->len(), 0);
+    assert(ws._timerWheel[WS_TIMER_SLOTS] == NULL);
+  }
+}
+
+// The first time a ping goes out on the client's connection
+static uint32_t firstPing(AsyncWebSocket &ws, AsyncClient *client, uint32_t until)
+{
+  while (connections[client].pings == 0 && (int32_t)(until - now) > 0)
+    runUntil(ws, now + 10);
+  return now;
+}
+
+// Every case starts at the given time
+static void check(uint32_t start)
+{
+  const uint32_t tick = WS_TIMER_TICK_MS;
+
+  // A ping once the keep-alive period passes without traffic, within a tick, then every period after the ack
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    ws.setKeepAlivePeriod(10);
+    AsyncWebSocketClient *c = connect(ws);
+    AsyncClient *client = c->client();
+    assert(firstPing(ws, client, start + 20000) - start >= 10000 && now - start <= 10000 + tick);
+    runUntil(ws, start + 39990);
+    assert(connections[client].pings == 3);
+    // traffic moves the next ping on, the timer finds that when it comes up
+    c->_lastMessageTime = now;
+    runUntil(ws, now + 9900);
+    assert(connections[client].pings == 3);
+    runUntil(ws, now + 100 + tick);
+    assert(connections[client].pings == 4);
+    c->_client->close(true);
+  }
+
+  // A deadline past one turn of the wheel waits for the later turn
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    ws.setKeepAlivePeriod(60);
+    assert(60000 > WS_TIMER_SLOTS * WS_TIMER_TICK_MS);
+    AsyncClient *client = connect(ws)->client();
+    assert(firstPing(ws, client, start + 70000) - start >= 60000 && now - start <= 60000 + tick);
+    client->close(true);
+  }
+
+  // Idle clients are closed, unless data came in since
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    ws.setIdleTimeout(5);
+    AsyncClient *idle = connect(ws)->client();
+    AsyncWebSocketClient *talking = connect(ws);
+    AsyncClient *talkingClient = talking->client();
+    runUntil(ws, start + 3000);
+    talking->_lastReceiveTime = now;
+    runUntil(ws, start + 4990);
+    assert(open(idle) && open(talkingClient));
+    runUntil(ws, start + 5000 + tick);
+    assert(!open(idle) && open(talkingClient));
+    runUntil(ws, start + 7990);
+    assert(open(talkingClient));
+    runUntil(ws, start + 8000 + tick);
+    assert(!open(talkingClient) && ws.count() == 0);
+  }
+
+  // A close handshake without an answer ends after WS_CLOSE_TIMEOUT_MS
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    AsyncWebSocketClient *c = connect(ws);
+    AsyncClient *client = c->client();
+    runUntil(ws, start + 1000);
+    c->close();
+    runUntil(ws, start + 1000 + WS_CLOSE_TIMEOUT_MS - 10, false);
+    assert(open(client));
+    runUntil(ws, start + 1000 + WS_CLOSE_TIMEOUT_MS + tick, false);
+    assert(!open(client));
+  }
+
+  // A client closing others from its own timer: they are taken out of the slot being run, the rest still get theirs
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    ws.setKeepAlivePeriod(10);
+    std::vector<AsyncClient *> clients;
+    for (int i = 0; i < 6; i++)
+      clients.push_back(connect(ws)->client());
+    // the slot runs its clients newest first: 5 closes one still to run, 3 and 1 close ones already rescheduled
+    connections[clients[5]].closeOnWrite = clients[2];
+    connections[clients[3]].closeOnWrite = clients[4];
+    connections[clients[1]].closeOnWrite = clients[5];
+    runUntil(ws, start + 10000 + tick);
+    assert(!open(clients[2]) && !open(clients[4]) && !open(clients[5]));
+    assert(connections[clients[0]].pings == 1 && connections[clients[1]].pings == 1 && connections[clients[3]].pings == 1);
+    connections[clients[1]].closeOnWrite = NULL;
+    connections[clients[3]].closeOnWrite = NULL;
+    runUntil(ws, start + 20000 + 2 * tick);
+    assert(connections[clients[0]].pings == 2 && ws.count() == 3);
+    for (int i : {0, 1, 3})
+      clients[i]->close(true);
+  }
+
+  // After a stall longer than the wheel every client due is run once, and the wheel catches up in one turn
+  {
+    now = start;
+    AsyncWebSocket ws("/ws");
+    ws.setKeepAlivePeriod(10);
+    AsyncClient *early = connect(ws)->client();
+    runUntil(ws, start + 5000);
+    AsyncClient *late = connect(ws)->client();
+    uint8_t pos = ws._timerPos;
+    now += 600000;
+    ws._runTimers();
+    assert(connections[early].pings == 1 && connections[late].pings == 1);
+    // one turn back at the same slot, not the 2400 ticks of the stall
+    assert(ws._timerPos == pos && now - ws._timerTime < tick && ws._timerWheel[WS_TIMER_SLOTS] == NULL);
+    early->close(true);
+    late->close(true);
+  }
+  assert(connections.empty());
+}
+
+int main()
+{
+  check(1000);
+  // millis() wraps during every case
+  check(0xFFFFFFFF - 7000);
+  puts("ok");
+}